@@ -0,0 +1,243 @@
+#ifndef JSON_HPP
+#define JSON_HPP
+
+#include <charconv>
+#include <cstddef>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <variant>
+#include <vector>
+
+// minimal json reader/writer helpers, just enough for qoibench reports
+// \uXXXX escapes are not decoded, they are read as '?'
+namespace json
+{
+    struct Value;
+
+    using Null   = std::nullptr_t;
+    using Array  = std::vector<Value>;
+    using Object = std::vector<std::pair<std::string, Value>>;    // keeps insertion order
+
+    struct Value
+    {
+        std::variant<Null, bool, double, std::string, Array, Object> m_value = nullptr;
+
+        template <typename T>
+        const T* get() const
+        {
+            return std::get_if<T>(&m_value);
+        }
+
+        // object member lookup, nullptr if not an object or the key is missing
+        const Value* find(std::string_view key) const
+        {
+            if (auto* object = get<Object>(); object != nullptr) {
+                for (const auto& [name, value] : *object) {
+                    if (name == key) {
+                        return &value;
+                    }
+                }
+            }
+            return nullptr;
+        }
+
+        std::optional<double> number(std::string_view key) const
+        {
+            if (auto* value = find(key); value != nullptr) {
+                if (auto* number = value->get<double>(); number != nullptr) {
+                    return *number;
+                }
+            }
+            return std::nullopt;
+        }
+    };
+
+    class Parser
+    {
+    public:
+        explicit Parser(std::string_view text)
+            : m_text{ text }
+        {
+        }
+
+        Value parse() noexcept(false)
+        {
+            auto value = parseValue();
+            skipSpace();
+            if (m_pos != m_text.size()) {
+                fail("trailing characters");
+            }
+            return value;
+        }
+
+    private:
+        [[noreturn]] void fail(std::string_view what) const noexcept(false)
+        {
+            auto message = "json: " + std::string{ what } + " at offset " + std::to_string(m_pos);
+            throw std::runtime_error{ message };
+        }
+
+        void skipSpace() noexcept
+        {
+            while (m_pos < m_text.size()
+                   && (m_text[m_pos] == ' ' || m_text[m_pos] == '\n' || m_text[m_pos] == '\r'
+                       || m_text[m_pos] == '\t')) {
+                ++m_pos;
+            }
+        }
+
+        bool consume(char c) noexcept
+        {
+            skipSpace();
+            if (m_pos < m_text.size() && m_text[m_pos] == c) {
+                ++m_pos;
+                return true;
+            }
+            return false;
+        }
+
+        void expect(char c) noexcept(false)
+        {
+            if (!consume(c)) {
+                fail(std::string{ "expected '" } + c + "'");
+            }
+        }
+
+        bool literal(std::string_view word) noexcept
+        {
+            if (m_text.substr(m_pos, word.size()) == word) {
+                m_pos += word.size();
+                return true;
+            }
+            return false;
+        }
+
+        Value parseValue() noexcept(false)
+        {
+            skipSpace();
+            if (m_pos >= m_text.size()) {
+                fail("unexpected end of input");
+            }
+
+            switch (m_text[m_pos]) {
+            case '{': return { parseObject() };
+            case '[': return { parseArray() };
+            case '"': return { parseString() };
+            case 't': return literal("true") ? Value{ true } : (fail("invalid literal"), Value{});
+            case 'f': return literal("false") ? Value{ false } : (fail("invalid literal"), Value{});
+            case 'n': return literal("null") ? Value{ nullptr } : (fail("invalid literal"), Value{});
+            default: return { parseNumber() };
+            }
+        }
+
+        Object parseObject() noexcept(false)
+        {
+            expect('{');
+            Object object;
+            if (consume('}')) {
+                return object;
+            }
+            do {
+                skipSpace();
+                auto key = parseString();
+                expect(':');
+                object.emplace_back(std::move(key), parseValue());
+            } while (consume(','));
+            expect('}');
+            return object;
+        }
+
+        Array parseArray() noexcept(false)
+        {
+            expect('[');
+            Array array;
+            if (consume(']')) {
+                return array;
+            }
+            do {
+                array.push_back(parseValue());
+            } while (consume(','));
+            expect(']');
+            return array;
+        }
+
+        std::string parseString() noexcept(false)
+        {
+            if (m_pos >= m_text.size() || m_text[m_pos] != '"') {
+                fail("expected string");
+            }
+            ++m_pos;
+
+            std::string result;
+            while (m_pos < m_text.size() && m_text[m_pos] != '"') {
+                auto c = m_text[m_pos++];
+                if (c != '\\') {
+                    result.push_back(c);
+                    continue;
+                }
+                if (m_pos >= m_text.size()) {
+                    break;
+                }
+                switch (auto e = m_text[m_pos++]) {
+                case 'n': result.push_back('\n'); break;
+                case 't': result.push_back('\t'); break;
+                case 'r': result.push_back('\r'); break;
+                case 'b': result.push_back('\b'); break;
+                case 'f': result.push_back('\f'); break;
+                case 'u':
+                    m_pos += 4;
+                    result.push_back('?');
+                    break;
+                default: result.push_back(e);
+                }
+            }
+
+            if (m_pos >= m_text.size()) {
+                fail("unterminated string");
+            }
+            ++m_pos;
+            return result;
+        }
+
+        double parseNumber() noexcept(false)
+        {
+            double value = 0.0;
+            auto [ptr, ec] = std::from_chars(m_text.data() + m_pos, m_text.data() + m_text.size(), value);
+            if (ec != std::errc{}) {
+                fail("invalid number");
+            }
+            m_pos = static_cast<std::size_t>(ptr - m_text.data());
+            return value;
+        }
+
+        std::string_view m_text;
+        std::size_t      m_pos = 0;
+    };
+
+    inline Value parse(std::string_view text) noexcept(false)
+    {
+        return Parser{ text }.parse();
+    }
+
+    // quote and escape a string for output
+    inline std::string quote(std::string_view str)
+    {
+        std::string result = "\"";
+        for (auto c : str) {
+            switch (c) {
+            case '"': result += "\\\""; break;
+            case '\\': result += "\\\\"; break;
+            case '\n': result += "\\n"; break;
+            case '\t': result += "\\t"; break;
+            case '\r': result += "\\r"; break;
+            default: result.push_back(c);
+            }
+        }
+        return result + "\"";
+    }
+}
+
+#endif /* ifndef JSON_HPP */
@@ -11,16 +11,33 @@
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #include <stb_image_write.h>
 
+#include "json.hpp"
+
 #include <CLI/CLI.hpp>
 #include <fmt/core.h>
 #include <fmt/std.h>
 #include <fmt/color.h>
 
+#include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <cmath>
+#include <cstdio>
 #include <exception>
 #include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <span>
+#include <sstream>
 #include <string>
+#include <thread>
 #include <utility>
+#include <vector>
+
+#if defined(__linux__)
+#    include <pthread.h>
+#    include <sched.h>
+#endif
 
 namespace fs = std::filesystem;
 
@@ -28,6 +45,12 @@ using Clock     = std::chrono::high_resolution_clock;
 using TimePoint = Clock::time_point;
 using Duration  = Clock::duration;    // nano seconds
 
+// serializes output from concurrent benchmark workers
+std::mutex g_printMutex;
+
+// progress and diagnostics, moved to stderr when stdout carries a machine readable report
+std::FILE* g_log = stdout;
+
 namespace lib
 {
     enum class Lib
@@ -35,7 +58,9 @@ namespace lib
         none,
         qoi,
         qoixx,
-        qoipp
+        qoipp,
+        qoippFast,    // qoipp at the other effort levels
+        qoippBest,
     };
 
     std::map<Lib, std::string_view> names = {
@@ -43,9 +68,65 @@ namespace lib
         { Lib::qoi, "qoi" },
         { Lib::qoixx, "qoixx" },
         { Lib::qoipp, "qoipp" },
+        { Lib::qoippFast, "qoipp-f" },
+        { Lib::qoippBest, "qoipp-b" },
     };
 };
 
+enum class Format
+{
+    table,
+    json,
+    csv,
+};
+
+// summary of per-run timings, all in milliseconds
+struct Stats
+{
+    double m_min    = 0.0;
+    double m_median = 0.0;
+    double m_p95    = 0.0;
+    double m_stddev = 0.0;
+    double m_mean   = 0.0;
+
+    static Stats of(std::vector<Duration> samples)
+    {
+        if (samples.empty()) {
+            return {};
+        }
+
+        using Millis = std::chrono::duration<double, std::milli>;
+
+        std::ranges::sort(samples);
+        const auto count = samples.size();
+        const auto at    = [&](std::size_t i) {
+            return std::chrono::duration_cast<Millis>(samples[i]).count();
+        };
+
+        auto sum = 0.0;
+        for (std::size_t i = 0; i < count; ++i) {
+            sum += at(i);
+        }
+        const auto mean = sum / (double)count;
+
+        auto squares = 0.0;
+        for (std::size_t i = 0; i < count; ++i) {
+            squares += (at(i) - mean) * (at(i) - mean);
+        }
+
+        // nearest-rank percentile
+        const auto p95 = static_cast<std::size_t>(std::ceil(0.95 * (double)count)) - 1;
+
+        return {
+            .m_min    = at(0),
+            .m_median = count % 2 == 1 ? at(count / 2) : (at(count / 2 - 1) + at(count / 2)) / 2.0,
+            .m_p95    = at(p95),
+            .m_stddev = count > 1 ? std::sqrt(squares / (double)(count - 1)) : 0.0,
+            .m_mean   = mean,
+        };
+    }
+};
+
 struct RawImage
 {
     qoipp::ByteVec   m_data;
@@ -88,10 +169,16 @@ struct Options
     bool         m_reference  = true;
     bool         m_encode     = true;
     bool         m_decode     = true;
+    bool         m_effort     = true;
     bool         m_recurse    = true;
     bool         m_onlyTotals = false;
     bool         m_color      = true;
+    bool         m_singleCore = false;
     unsigned int m_runs       = 1;
+    unsigned int m_jobs       = 1;
+    Format       m_format     = Format::table;
+    fs::path     m_baseline   = {};
+    double       m_threshold  = 5.0;
 
     void configure(CLI::App& app)
     {
@@ -102,23 +189,50 @@ struct Options
         app.add_flag("!--no-reference", m_reference, "Don't run reference implementation");
         app.add_flag("!--no-encode", m_encode, "Don't run encoders");
         app.add_flag("!--no-decode", m_decode, "Don't run decoders");
+        app.add_flag("!--no-effort", m_effort, "Don't run qoipp at the fast and best effort levels");
         app.add_flag("!--no-recurse", m_recurse, "Don't descend into directories");
         app.add_flag("!--no-color", m_color, "Don't print with color");
         app.add_flag("--only-totals", m_onlyTotals, "Don't print individual image results");
+
+        auto jobs   = app.add_option("-j,--jobs", m_jobs, "Number of images benchmarked concurrently")
+                        ->default_val(m_jobs)
+                        ->check(CLI::PositiveNumber);
+        auto single = app.add_flag("--single-core", m_singleCore, "Pin the benchmark to a single core");
+        single->excludes(jobs);
+
+        const auto formats = std::map<std::string, Format>{
+            { "table", Format::table },
+            { "json", Format::json },
+            { "csv", Format::csv },
+        };
+        app.add_option("--format", m_format, "Output format, json and csv are written to stdout")
+            ->transform(CLI::CheckedTransformer(formats, CLI::ignore_case));
+        app.add_option("--baseline", m_baseline, "Compare qoipp against a previous '--format json' report")
+            ->check(CLI::ExistingFile);
+        app.add_option("--threshold", m_threshold, "Median slowdown (%) reported as a regression")
+            ->default_val(m_threshold)
+            ->check(CLI::NonNegativeNumber);
     }
 
     void print()
     {
-        fmt::println("Options:");
-        fmt::println("\t- runs      : {}", m_runs);
-        fmt::println("\t- warmup    : {}", m_warmup);
-        fmt::println("\t- verify    : {}", m_verify);
-        fmt::println("\t- reference : {}", m_reference);
-        fmt::println("\t- encode    : {}", m_encode);
-        fmt::println("\t- decode    : {}", m_decode);
-        fmt::println("\t- recurse   : {}", m_recurse);
-        fmt::println("\t- color     : {}", m_color);
-        fmt::println("\t- onlytotals: {}", m_onlyTotals);
+        fmt::println(g_log, "Options:");
+        fmt::println(g_log, "\t- runs      : {}", m_runs);
+        fmt::println(g_log, "\t- warmup    : {}", m_warmup);
+        fmt::println(g_log, "\t- verify    : {}", m_verify);
+        fmt::println(g_log, "\t- reference : {}", m_reference);
+        fmt::println(g_log, "\t- encode    : {}", m_encode);
+        fmt::println(g_log, "\t- decode    : {}", m_decode);
+        fmt::println(g_log, "\t- effort    : {}", m_effort);
+        fmt::println(g_log, "\t- recurse   : {}", m_recurse);
+        fmt::println(g_log, "\t- color     : {}", m_color);
+        fmt::println(g_log, "\t- onlytotals: {}", m_onlyTotals);
+        fmt::println(g_log, "\t- jobs      : {}", m_jobs);
+        fmt::println(g_log, "\t- singlecore: {}", m_singleCore);
+        fmt::println(g_log, "\t- format    : {}", fmt::underlying(m_format));
+        fmt::println(g_log, "\t- baseline  : {}", m_baseline);
+        fmt::println(g_log, "\t- threshold : {}%", m_threshold);
+        fmt::println(g_log, "\t- kernel    : {}", qoipp::kernelName(qoipp::activeKernel()));
     }
 };
 
@@ -126,17 +240,189 @@ struct BenchmarkResult
 {
     struct LibInfo
     {
-        Duration    m_encodeTime  = {};
+        Duration    m_encodeTime  = {};    // mean of the runs
         Duration    m_decodeTime  = {};
         std::size_t m_encodedSize = 0;
+
+        std::vector<Duration> m_encodeSamples = {};    // one per run
+        std::vector<Duration> m_decodeSamples = {};
     };
 
     qoipp::ImageDesc m_desc    = {};
-    fs::path         m_file    = {};
+    fs::path         m_file    = {};    // empty for merged totals
     std::size_t      m_rawSize = 0;
+    std::size_t      m_pixels  = 0;
+    std::size_t      m_images  = 0;
 
     std::map<lib::Lib, LibInfo> m_libsInfo = {};
 
+    qoipp::Stats m_qoippStats = {};    // of a single encode and decode, only with QOIPP_ENABLE_STATS
+
+    // accumulate another result into this one, results without any lib info (failed verification) are skipped
+    void merge(const BenchmarkResult& other)
+    {
+        if (other.m_libsInfo.empty()) {
+            return;
+        }
+
+        m_rawSize += other.m_rawSize;
+        m_pixels  += other.m_pixels;
+        m_images  += other.m_images;
+
+        // run i of the total is the sum of run i of every image
+        const auto accumulate = [](std::vector<Duration>& total, const std::vector<Duration>& samples) {
+            total.resize(std::max(total.size(), samples.size()));
+            for (std::size_t i = 0; i < samples.size(); ++i) {
+                total[i] += samples[i];
+            }
+        };
+
+        const auto addOps = [](qoipp::OpStats& total, const qoipp::OpStats& ops) {
+            total.m_rgb       += ops.m_rgb;
+            total.m_rgba      += ops.m_rgba;
+            total.m_index     += ops.m_index;
+            total.m_diff      += ops.m_diff;
+            total.m_luma      += ops.m_luma;
+            total.m_run       += ops.m_run;
+            total.m_runPixels += ops.m_runPixels;
+            total.m_bytes     += ops.m_bytes;
+        };
+
+        const auto addPerf = [](qoipp::PerfStats& total, const qoipp::PerfStats& perf) {
+            total.m_nanoseconds  += perf.m_nanoseconds;
+            total.m_cycles       += perf.m_cycles;
+            total.m_instructions += perf.m_instructions;
+            total.m_branchMisses += perf.m_branchMisses;
+            total.m_cacheMisses  += perf.m_cacheMisses;
+            total.m_hardware      = total.m_hardware || perf.m_hardware;
+        };
+
+        addOps(m_qoippStats.m_encodeOps, other.m_qoippStats.m_encodeOps);
+        addOps(m_qoippStats.m_decodeOps, other.m_qoippStats.m_decodeOps);
+        addPerf(m_qoippStats.m_encodePerf, other.m_qoippStats.m_encodePerf);
+        addPerf(m_qoippStats.m_decodePerf, other.m_qoippStats.m_decodePerf);
+
+        for (const auto& [lib, info] : other.m_libsInfo) {
+            auto& total          = m_libsInfo[lib];
+            total.m_encodeTime  += info.m_encodeTime;
+            total.m_decodeTime  += info.m_decodeTime;
+            total.m_encodedSize += info.m_encodedSize;
+
+            accumulate(total.m_encodeSamples, info.m_encodeSamples);
+            accumulate(total.m_decodeSamples, info.m_decodeSamples);
+        }
+    }
+
+    std::string name() const { return m_file.empty() ? std::string{ "total" } : m_file.string(); }
+
+    // throughput for a time in milliseconds
+    double megabytesPerSec(double millis) const
+    {
+        return millis > 0.0 ? (double)m_rawSize / millis / 1e3 : 0.0;
+    }
+
+    double pixelsPerMicro(double millis) const
+    {
+        return millis > 0.0 ? (double)m_pixels / millis / 1e3 : 0.0;
+    }
+
+    std::string json() const
+    {
+        const auto op = [&](const std::vector<Duration>& samples) {
+            auto stats = Stats::of(samples);
+            return fmt::format(
+                R"({{ "min_ms": {}, "median_ms": {}, "p95_ms": {}, "stddev_ms": {}, "mean_ms": {}, )"
+                R"("mb_per_s": {}, "px_per_us": {} }})",
+                stats.m_min,
+                stats.m_median,
+                stats.m_p95,
+                stats.m_stddev,
+                stats.m_mean,
+                megabytesPerSec(stats.m_median),
+                pixelsPerMicro(stats.m_median)
+            );
+        };
+
+        std::string libs;
+        for (const auto& [lib, info] : m_libsInfo) {
+            libs += fmt::format(
+                R"({}"{}": {{ "encode": {}, "decode": {}, "size": {} }})",
+                libs.empty() ? "" : ",\n        ",
+                lib::names[lib],
+                op(info.m_encodeSamples),
+                op(info.m_decodeSamples),
+                info.m_encodedSize
+            );
+        }
+
+        return fmt::format(
+            "{{\n      \"file\": {}, \"images\": {}, \"width\": {}, \"height\": {}, \"channels\": {}, "
+            "\"raw_size\": {}, \"pixels\": {},\n      \"libs\": {{\n        {}\n      }}\n    }}",
+            json::quote(name()),
+            m_images,
+            m_desc.m_width,
+            m_desc.m_height,
+            fmt::underlying(m_desc.m_channels),
+            m_rawSize,
+            m_pixels,
+            libs
+        );
+    }
+
+    static void csvHeader(std::FILE* file)
+    {
+        const auto columns = {
+            "min_ms", "median_ms", "p95_ms", "stddev_ms", "mean_ms", "mb_per_s", "px_per_us",
+        };
+
+        fmt::print(file, "file,lib,width,height,channels,raw_size,pixels,encoded_size");
+        for (auto op : { "enc", "dec" }) {
+            for (auto column : columns) {
+                fmt::print(file, ",{}_{}", op, column);
+            }
+        }
+        fmt::println(file, "");
+    }
+
+    void csv(std::FILE* file) const
+    {
+        std::string quoted = "\"";
+        for (auto c : name()) {
+            quoted += c == '"' ? std::string{ "\"\"" } : std::string{ c };
+        }
+        quoted += '"';
+
+        for (const auto& [lib, info] : m_libsInfo) {
+            fmt::print(
+                file,
+                "{},{},{},{},{},{},{},{}",
+                quoted,
+                lib::names[lib],
+                m_desc.m_width,
+                m_desc.m_height,
+                fmt::underlying(m_desc.m_channels),
+                m_rawSize,
+                m_pixels,
+                info.m_encodedSize
+            );
+            for (const auto* samples : { &info.m_encodeSamples, &info.m_decodeSamples }) {
+                auto stats = Stats::of(*samples);
+                fmt::print(
+                    file,
+                    ",{},{},{},{},{},{},{}",
+                    stats.m_min,
+                    stats.m_median,
+                    stats.m_p95,
+                    stats.m_stddev,
+                    stats.m_mean,
+                    megabytesPerSec(stats.m_median),
+                    pixelsPerMicro(stats.m_median)
+                );
+            }
+            fmt::println(file, "");
+        }
+    }
+
     void print(bool color) const
     {
         using Lib     = lib::Lib;
@@ -155,7 +441,7 @@ struct BenchmarkResult
             float       m_encodeSizeRatio;
         };
 
-        auto pixelCount = m_desc.m_width * m_desc.m_height;
+        auto pixelCount = m_pixels;
 
         std::map<Lib, Printed> printed;
         for (const auto& [lib, info] : m_libsInfo) {
@@ -172,14 +458,18 @@ struct BenchmarkResult
             );
         }
 
-        const auto [width, height, channels, _] = m_desc;
-        fmt::println(
-            "File: '{}' [{} x {} ({})]",
-            m_file,
-            width,
-            height,
-            channels == qoipp::Channels::RGB ? "RGB" : "RGBA"
-        );
+        if (m_file.empty()) {
+            fmt::println("Total: {} images [{} pixels]", m_images, m_pixels);
+        } else {
+            const auto [width, height, channels, _] = m_desc;
+            fmt::println(
+                "File: '{}' [{} x {} ({})]",
+                m_file,
+                width,
+                height,
+                channels == qoipp::Channels::RGB ? "RGB" : "RGBA"
+            );
+        }
 
         if (m_libsInfo.empty()) {
             fmt::println("\tNo results");
@@ -262,9 +552,82 @@ struct BenchmarkResult
         }
 
         fmt::println("{:->110}", "");
+
+        if constexpr (qoipp::statsEnabled) {
+            printStats();
+        }
+    }
+
+    void printStats() const
+    {
+        const auto printOps = [](std::string_view name, const qoipp::OpStats& ops) {
+            const auto total = ops.m_rgb + ops.m_rgba + ops.m_index + ops.m_diff + ops.m_luma + ops.m_run;
+            if (total == 0) {
+                return;
+            }
+            fmt::println(
+                "| {:<8} | rgb {:>9} | rgba {:>9} | index {:>9} | diff {:>9} | luma {:>9} | "
+                "run {:>9} ({} px) | {:.2f} B/op",
+                name,
+                ops.m_rgb,
+                ops.m_rgba,
+                ops.m_index,
+                ops.m_diff,
+                ops.m_luma,
+                ops.m_run,
+                ops.m_runPixels,
+                (double)ops.m_bytes / (double)total
+            );
+        };
+
+        const auto printPerf = [](std::string_view name, const qoipp::PerfStats& perf) {
+            if (!perf.m_hardware) {
+                fmt::println("| {:<8} | {} ns (hardware counters unavailable)", name, perf.m_nanoseconds);
+                return;
+            }
+            fmt::println(
+                "| {:<8} | {} ns | {} cycles | {:.2f} IPC | {} branch misses | {} cache misses",
+                name,
+                perf.m_nanoseconds,
+                perf.m_cycles,
+                perf.m_cycles > 0 ? (double)perf.m_instructions / (double)perf.m_cycles : 0.0,
+                perf.m_branchMisses,
+                perf.m_cacheMisses
+            );
+        };
+
+        printOps("enc ops", m_qoippStats.m_encodeOps);
+        printOps("dec ops", m_qoippStats.m_decodeOps);
+        printPerf("enc perf", m_qoippStats.m_encodePerf);
+        printPerf("dec perf", m_qoippStats.m_decodePerf);
+        fmt::println("{:->110}", "");
     }
 };
 
+// pin the calling thread to the given core, returns false if the platform doesn't support it or it failed
+bool pinToCore(unsigned int core)
+{
+#if defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(core, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    (void)core;
+    return false;
+#endif
+}
+
+unsigned int currentCore()
+{
+#if defined(__linux__)
+    auto core = sched_getcpu();
+    return core < 0 ? 0u : static_cast<unsigned int>(core);
+#else
+    return 0;
+#endif
+}
+
 RawImage loadImage(const fs::path& file)
 {
     int   width, height, channels;
@@ -399,10 +762,10 @@ EncodeResult qoixxDecode(const QoiImage& image)
     };
 }
 
-EncodeResult qoippEncode(const RawImage& image)
+EncodeResult qoippEncodeAt(const RawImage& image, qoipp::Effort effort)
 {
     auto timepoint = Clock::now();
-    auto encoded   = qoipp::encode(image.m_data, image.m_desc);
+    auto encoded   = qoipp::encode(image.m_data, image.m_desc, { .m_effort = effort });
     auto duration  = Clock::now() - timepoint;
 
     return {
@@ -411,6 +774,11 @@ EncodeResult qoippEncode(const RawImage& image)
     };
 }
 
+EncodeResult qoippEncode(const RawImage& image)
+{
+    return qoippEncodeAt(image, qoipp::Effort::Default);
+}
+
 DecodeResult qoippDecode(const QoiImage& image)
 {
     auto timepoint       = Clock::now();
@@ -425,7 +793,10 @@ DecodeResult qoippDecode(const QoiImage& image)
 
 BenchmarkResult benchmark(const fs::path& file, const Options& opt)
 {
-    fmt::println("\t>> Benchmarking '{}'", file);
+    {
+        auto lock = std::scoped_lock{ g_printMutex };
+        fmt::println(g_log, "\t>> Benchmarking '{}'", file);
+    }
 
     auto rawImage = loadImage(file);
     auto qoiImage = qoiEncode(rawImage).m_image;
@@ -435,7 +806,8 @@ BenchmarkResult benchmark(const fs::path& file, const Options& opt)
             requires(std::same_as<T, RawImage> or std::same_as<T, QoiImage>)
         {
             if (leftImage.m_data != rightImage.m_data || leftImage.m_desc != rightImage.m_desc) {
-                fmt::println("\t\tVerification failed for {} [skipped]", file);
+                auto lock = std::scoped_lock{ g_printMutex };
+                fmt::println(g_log, "\t\tVerification failed for {} [skipped]", file);
                 return false;
             }
             return true;
@@ -472,6 +844,17 @@ BenchmarkResult benchmark(const fs::path& file, const Options& opt)
                 return { .m_file = file };
             }
         }
+
+        // qoipp encode at the other effort levels -> qoi decode -> compare with rawImage
+        const auto efforts = opt.m_effort ? std::vector{ qoipp::Effort::Fast, qoipp::Effort::Best }
+                                          : std::vector<qoipp::Effort>{};
+        for (auto effort : efforts) {
+            auto [qoippEncoded, _] = qoippEncodeAt(rawImage, effort);
+            auto [qoiDecoded, __]  = qoiDecode(qoippEncoded);
+            if (!verify(qoiDecoded, rawImage)) {
+                return { .m_file = file };
+            }
+        }
     }
 
     auto benchmarkImpl = [&](auto func, const auto& image) {
@@ -480,15 +863,18 @@ BenchmarkResult benchmark(const fs::path& file, const Options& opt)
             func(image);    // should i do this more than once?
         }
 
-        Duration    total = Duration::zero();
-        std::size_t size  = 0;
+        Duration              total = Duration::zero();
+        std::size_t           size  = 0;
+        std::vector<Duration> samples;
+        samples.reserve(opt.m_runs);
         for (auto run = opt.m_runs; run-- > 0;) {
             auto [coded, time]  = func(image);
             total              += time;
             size                = coded.m_data.size();
+            samples.push_back(time);
         }
 
-        return std::make_pair(total / opt.m_runs, size);
+        return std::make_tuple(total / opt.m_runs, size, std::move(samples));
     };
 
     // the benchmark starts here
@@ -497,68 +883,268 @@ BenchmarkResult benchmark(const fs::path& file, const Options& opt)
         .m_desc    = qoiImage.m_desc,
         .m_file    = file,
         .m_rawSize = rawImage.m_data.size(),
+        .m_pixels  = std::size_t{ qoiImage.m_desc.m_width } * qoiImage.m_desc.m_height,
+        .m_images  = 1,
     };
 
     if (opt.m_encode) {
-        auto [qoiTime, qoiSize]     = benchmarkImpl(qoiEncode, rawImage);
-        auto [qoixxTime, qoixxSize] = benchmarkImpl(qoixxEncode, rawImage);
-        auto [qoippTime, qoippSize] = benchmarkImpl(qoippEncode, rawImage);
+        auto [qoiTime, qoiSize, qoiSamples]       = benchmarkImpl(qoiEncode, rawImage);
+        auto [qoixxTime, qoixxSize, qoixxSamples] = benchmarkImpl(qoixxEncode, rawImage);
+        auto [qoippTime, qoippSize, qoippSamples] = benchmarkImpl(qoippEncode, rawImage);
 
-        result.m_libsInfo[lib::Lib::qoi].m_encodeTime  = qoiTime;
-        result.m_libsInfo[lib::Lib::qoi].m_encodedSize = qoiSize;
+        result.m_libsInfo[lib::Lib::qoi].m_encodeTime    = qoiTime;
+        result.m_libsInfo[lib::Lib::qoi].m_encodedSize   = qoiSize;
+        result.m_libsInfo[lib::Lib::qoi].m_encodeSamples = std::move(qoiSamples);
 
-        result.m_libsInfo[lib::Lib::qoixx].m_encodeTime  = qoixxTime;
-        result.m_libsInfo[lib::Lib::qoixx].m_encodedSize = qoixxSize;
+        result.m_libsInfo[lib::Lib::qoixx].m_encodeTime    = qoixxTime;
+        result.m_libsInfo[lib::Lib::qoixx].m_encodedSize   = qoixxSize;
+        result.m_libsInfo[lib::Lib::qoixx].m_encodeSamples = std::move(qoixxSamples);
 
-        result.m_libsInfo[lib::Lib::qoipp].m_encodeTime  = qoippTime;
-        result.m_libsInfo[lib::Lib::qoipp].m_encodedSize = qoippSize;
+        result.m_libsInfo[lib::Lib::qoipp].m_encodeTime    = qoippTime;
+        result.m_libsInfo[lib::Lib::qoipp].m_encodedSize   = qoippSize;
+        result.m_libsInfo[lib::Lib::qoipp].m_encodeSamples = std::move(qoippSamples);
     }
 
     if (opt.m_decode) {
-        auto [qoiTime, _]     = benchmarkImpl(qoiDecode, qoiImage);
-        auto [qoixxTime, __]  = benchmarkImpl(qoixxDecode, qoiImage);
-        auto [qoippTime, ___] = benchmarkImpl(qoippDecode, qoiImage);
+        auto [qoiTime, _, qoiSamples]      = benchmarkImpl(qoiDecode, qoiImage);
+        auto [qoixxTime, __, qoixxSamples] = benchmarkImpl(qoixxDecode, qoiImage);
+        auto [qoippTime, ___, qoippSamples] = benchmarkImpl(qoippDecode, qoiImage);
+
+        result.m_libsInfo[lib::Lib::qoi].m_decodeTime      = qoiTime;
+        result.m_libsInfo[lib::Lib::qoi].m_decodeSamples   = std::move(qoiSamples);
+        result.m_libsInfo[lib::Lib::qoixx].m_decodeTime    = qoixxTime;
+        result.m_libsInfo[lib::Lib::qoixx].m_decodeSamples = std::move(qoixxSamples);
+        result.m_libsInfo[lib::Lib::qoipp].m_decodeTime    = qoippTime;
+        result.m_libsInfo[lib::Lib::qoipp].m_decodeSamples = std::move(qoippSamples);
+    }
+
+    // the size and speed of the other levels, the decode is of their own output
+    const auto efforts = {
+        std::pair{ lib::Lib::qoippFast, qoipp::Effort::Fast },
+        std::pair{ lib::Lib::qoippBest, qoipp::Effort::Best },
+    };
+
+    for (auto [lib, effort] : efforts) {
+        if (!opt.m_effort || (!opt.m_encode && !opt.m_decode)) {
+            break;
+        }
 
-        result.m_libsInfo[lib::Lib::qoi].m_decodeTime   = qoiTime;
-        result.m_libsInfo[lib::Lib::qoixx].m_decodeTime = qoixxTime;
-        result.m_libsInfo[lib::Lib::qoipp].m_decodeTime = qoippTime;
+        auto  encode = [effort](const RawImage& image) { return qoippEncodeAt(image, effort); };
+        auto& info   = result.m_libsInfo[lib];
+
+        if (opt.m_encode) {
+            auto [time, size, samples] = benchmarkImpl(encode, rawImage);
+
+            info.m_encodeTime    = time;
+            info.m_encodedSize   = size;
+            info.m_encodeSamples = std::move(samples);
+        }
+
+        if (opt.m_decode) {
+            auto [time, _, samples] = benchmarkImpl(qoippDecode, encode(rawImage).m_image);
+
+            info.m_decodeTime    = time;
+            info.m_decodeSamples = std::move(samples);
+        }
+    }
+
+    // outside the timed runs: the instrumentation itself costs time
+    if constexpr (qoipp::statsEnabled) {
+        qoipp::resetStats();
+        if (opt.m_encode) {
+            qoippEncode(rawImage);
+        }
+        if (opt.m_decode) {
+            qoippDecode(qoiImage);
+        }
+        result.m_qoippStats = qoipp::stats();
     }
 
     return result;
 }
 
-std::vector<BenchmarkResult> benchmarkDirectory(const fs::path& path, const Options& opt)
+std::vector<fs::path> findImages(const fs::path& path, bool recurse)
 {
+    std::vector<fs::path> files;
 
-    std::vector<BenchmarkResult> results;
+    const auto collect = [&](auto&& iterator) {
+        for (const auto& entry : iterator) {
+            if (fs::is_regular_file(entry) && entry.path().extension() == ".png") {
+                files.push_back(entry.path());
+            }
+        }
+    };
+
+    if (recurse) {
+        collect(fs::recursive_directory_iterator{ path });
+    } else {
+        collect(fs::directory_iterator{ path });
+    }
+
+    // directory iteration order is unspecified, sort so results are comparable between runs
+    std::ranges::sort(files);
+    return files;
+}
 
+std::vector<BenchmarkResult> benchmarkDirectory(const fs::path& path, const Options& opt)
+{
     if (opt.m_recurse) {
-        fmt::println(">> Benchmarking {} (recurse)...", path / "**/*.png");
+        fmt::println(g_log, ">> Benchmarking {} (recurse)...", path / "**/*.png");
+    } else {
+        fmt::println(g_log, ">> Benchmarking {}...", path / "*.png");
+    }
 
-        for (const auto& path : fs::recursive_directory_iterator{ path }) {
-            if (fs::is_regular_file(path) && path.path().extension() == ".png") {
-                // results.push_back(benchmark(path, opt));
-                auto result = benchmark(path, opt);
-                result.print(opt.m_color);
+    const auto files = findImages(path, opt.m_recurse);
+    auto       jobs  = std::min<std::size_t>(opt.m_jobs, files.size());
+
+    std::vector<BenchmarkResult> results(files.size());
+    std::atomic<std::size_t>     next  = 0;
+    std::exception_ptr           error = nullptr;
+    std::mutex                   errorMutex;
+
+    // each worker claims the next unprocessed file, results stay in file order regardless of completion order
+    auto work = [&] {
+        for (auto index = next++; index < files.size(); index = next++) {
+            try {
+                results[index] = benchmark(files[index], opt);
+            } catch (...) {
+                auto lock = std::scoped_lock{ errorMutex };
+                if (!error) {
+                    error = std::current_exception();
+                }
+                next = files.size();
+                return;
             }
-        }
-    } else {
-        fmt::println(">> Benchmarking {}...", path / "*.png");
 
-        for (const auto& path : fs::directory_iterator{ path }) {
-            if (fs::is_regular_file(path) && path.path().extension() == ".png") {
-                // results.push_back(benchmark(path, opt));
-                auto result = benchmark(path, opt);
-                result.print(opt.m_color);
+            if (!opt.m_onlyTotals && opt.m_format == Format::table) {
+                auto lock = std::scoped_lock{ g_printMutex };
+                results[index].print(opt.m_color);
             }
         }
+    };
+
+    if (jobs <= 1) {
+        work();
+    } else {
+        const auto cores = std::max(std::thread::hardware_concurrency(), 1u);
+
+        std::vector<std::jthread> workers;
+        workers.reserve(jobs);
+        for (auto i = 0u; i < jobs; ++i) {
+            workers.emplace_back([&, i] {
+                if (!pinToCore(i % cores)) {
+                    auto lock = std::scoped_lock{ g_printMutex };
+                    fmt::println(g_log, "\t>> Unable to pin worker {} to core {}", i, i % cores);
+                }
+                work();
+            });
+        }
+    }    // jthreads join here
+
+    if (error) {
+        std::rethrow_exception(error);
     }
 
-    fmt::println("\t>> Benchmarking '{}' done!", path);
+    fmt::println(g_log, "\t>> Benchmarking '{}' done!", path);
 
     return results;
 }
 
+// compare qoipp medians and sizes against a json report, returns the number of regressions found
+std::size_t compareBaseline(
+    const fs::path&                  baselineFile,
+    std::span<const BenchmarkResult> results,
+    const BenchmarkResult&           total,
+    double                           threshold
+) noexcept(false)
+{
+    auto stream = std::ifstream{ baselineFile };
+    auto buffer = std::stringstream{};
+    buffer << stream.rdbuf();
+
+    const auto baseline = json::parse(buffer.str());
+    const auto* images  = baseline.find("images");
+    if (images == nullptr || images->get<json::Array>() == nullptr) {
+        throw std::runtime_error{ fmt::format("'{}' is not a qoibench json report", baselineFile) };
+    }
+
+    const auto findImage = [&](const std::string& name) -> const json::Value* {
+        if (name == "total") {
+            return baseline.find("total");
+        }
+        for (const auto& image : *images->get<json::Array>()) {
+            auto* file = image.find("file");
+            if (file != nullptr && file->get<std::string>() != nullptr && *file->get<std::string>() == name) {
+                return &image;
+            }
+        }
+        return nullptr;
+    };
+
+    std::size_t regressions = 0;
+
+    const auto compare = [&](const BenchmarkResult& result) {
+        auto qoipp = result.m_libsInfo.find(lib::Lib::qoipp);
+        if (qoipp == result.m_libsInfo.end()) {
+            return;
+        }
+
+        const auto* image = findImage(result.name());
+        const auto* libs  = image ? image->find("libs") : nullptr;
+        const auto* base  = libs ? libs->find(lib::names[lib::Lib::qoipp]) : nullptr;
+        if (base == nullptr) {
+            fmt::println(g_log, "\t>> '{}' not in baseline", result.name());
+            return;
+        }
+
+        const auto& info = qoipp->second;
+        const auto ops = {
+            std::pair{ "encode", &info.m_encodeSamples },
+            std::pair{ "decode", &info.m_decodeSamples },
+        };
+        for (auto [op, samples] : ops) {
+            const auto* baseOp    = base->find(op);
+            const auto  oldMedian = baseOp ? baseOp->number("median_ms") : std::nullopt;
+            const auto  newMedian = Stats::of(*samples).m_median;
+            if (!oldMedian || *oldMedian <= 0.0 || samples->empty()) {
+                continue;
+            }
+
+            const auto change = (newMedian - *oldMedian) / *oldMedian * 100.0;
+            if (change > threshold) {
+                ++regressions;
+                fmt::println(
+                    g_log,
+                    "REGRESSION: {} {} median {:.3f} ms -> {:.3f} ms ({:+.1f}%)",
+                    result.name(),
+                    op,
+                    *oldMedian,
+                    newMedian,
+                    change
+                );
+            }
+        }
+
+        if (auto oldSize = base->number("size"); oldSize && (double)info.m_encodedSize > *oldSize) {
+            ++regressions;
+            fmt::println(
+                g_log,
+                "REGRESSION: {} size {} -> {} bytes",
+                result.name(),
+                (std::size_t)*oldSize,
+                info.m_encodedSize
+            );
+        }
+    };
+
+    for (const auto& result : results) {
+        compare(result);
+    }
+    compare(total);
+
+    return regressions;
+}
+
 int main(int argc, char* argv[])
 try {
     CLI::App app{ "Qoibench - Benchmarking tool for QOI" };
@@ -575,24 +1161,83 @@ try {
 
     CLI11_PARSE(app, argc, argv);
 
+    if (opt.m_format != Format::table) {
+        g_log = stderr;
+    }
+
     opt.print();
 
+    if (opt.m_singleCore) {
+        auto core = currentCore();
+        if (!pinToCore(core)) {
+            fmt::println(g_log, "Unable to pin the benchmark to a single core");
+            return 1;
+        }
+        fmt::println(g_log, ">> Pinned to core {}", core);
+    } else if (opt.m_jobs > 1) {
+        // concurrent workers share caches and memory bandwidth, timings are only comparable at equal --jobs
+        fmt::println(
+            g_log,
+            ">> Running {} jobs concurrently, timings are not comparable to serial runs",
+            opt.m_jobs
+        );
+        if (opt.m_jobs > std::thread::hardware_concurrency()) {
+            fmt::println(g_log, ">> Warning: more jobs than cores ({})", std::thread::hardware_concurrency());
+        }
+    }
+
     if (!fs::exists(dirpath)) {
-        fmt::println("'{}' directory does not exist", dirpath);
+        fmt::println(g_log, "'{}' directory does not exist", dirpath);
         return 1;
     } else if (!fs::is_directory(dirpath)) {
-        fmt::println("'{}' is not a directory", dirpath);
+        fmt::println(g_log, "'{}' is not a directory", dirpath);
         return 1;
     }
 
     auto results = benchmarkDirectory(dirpath, opt);
 
+    BenchmarkResult total;
     for (const auto& result : results) {
-        result.print(opt.m_color);
+        total.merge(result);
+    }
+
+    switch (opt.m_format) {
+    case Format::table:
         fmt::println("");
+        total.print(opt.m_color);
+        break;
+    case Format::json: {
+        fmt::println("{{\n  \"runs\": {},\n  \"images\": [", opt.m_runs);
+        if (!opt.m_onlyTotals) {
+            auto first = true;
+            for (const auto& result : results) {
+                if (!result.m_libsInfo.empty()) {
+                    fmt::print("{}    {}", std::exchange(first, false) ? "" : ",\n", result.json());
+                }
+            }
+        }
+        fmt::println("\n  ],\n  \"total\": {}\n}}", total.json());
+    } break;
+    case Format::csv:
+        BenchmarkResult::csvHeader(stdout);
+        if (!opt.m_onlyTotals) {
+            for (const auto& result : results) {
+                result.csv(stdout);
+            }
+        }
+        total.csv(stdout);
+        break;
+    }
+
+    if (!opt.m_baseline.empty()) {
+        auto regressions = compareBaseline(opt.m_baseline, results, total, opt.m_threshold);
+        fmt::println(g_log, ">> Baseline '{}': {} regression(s)", opt.m_baseline, regressions);
+        if (regressions > 0) {
+            return 2;
+        }
     }
 
 } catch (std::exception& e) {
-    fmt::println("Exception occurred: {}", e.what());
+    fmt::println(g_log, "Exception occurred: {}", e.what());
     return 1;
 }
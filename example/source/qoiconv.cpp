@@ -10,6 +10,7 @@
 #include <fmt/core.h>
 #include <CLI/CLI.hpp>
 
+#include <algorithm>
 #include <stdexcept>
 #include <utility>
 #include <cstddef>
@@ -18,6 +19,7 @@
 #include <fstream>
 #include <memory>
 #include <tuple>
+#include <vector>
 #include <variant>
 #include <format>
 
@@ -210,6 +212,119 @@ std::pair<FileType, FileType> validate(const fs::path& input, const fs::path& ou
     };
 }
 
+// png <-> qoi from memory, for the batch mode where the files are read and written by the library
+ByteVec pngToQoi(ByteSpan png)
+{
+    int   width, height, channels;
+    auto* data = stbi_load_from_memory(
+        reinterpret_cast<const unsigned char*>(png.data()),
+        static_cast<int>(png.size()),
+        &width,
+        &height,
+        &channels,
+        0
+    );
+    if (data == nullptr) {
+        throw std::runtime_error{ std::format("Failed to load PNG image: {}", stbi_failure_reason()) };
+    }
+
+    const auto image = StbImage{
+        .m_data = StbImage::UniqueData{ data },
+        .m_desc = {
+            .m_width      = static_cast<unsigned int>(width),
+            .m_height     = static_cast<unsigned int>(height),
+            .m_channels   = channels == 4 ? qoipp::Channels::RGBA : qoipp::Channels::RGB,
+            .m_colorspace = qoipp::Colorspace::sRGB,
+        },
+    };
+    if (channels != 3 && channels != 4) {
+        throw std::runtime_error{ std::format("Unsupported PNG channel count: {}", channels) };
+    }
+
+    const auto size = image.m_desc.m_width * image.m_desc.m_height * static_cast<std::size_t>(channels);
+    return qoipp::encode({ reinterpret_cast<const std::byte*>(data), size }, image.m_desc);
+}
+
+ByteVec qoiToPng(ByteSpan qoi, bool rgbOnly)
+{
+    const auto decoded                = qoipp::decode(qoi, rgbOnly);
+    auto [width, height, channels, _] = decoded.m_desc;
+
+    ByteVec png;
+    auto    append = [](void* context, void* data, int size) {
+        auto* out   = static_cast<ByteVec*>(context);
+        auto* bytes = static_cast<const std::byte*>(data);
+        out->insert(out->end(), bytes, bytes + size);
+    };
+
+    const auto status = stbi_write_png_to_func(
+        append,
+        &png,
+        (int)width,
+        (int)height,
+        (int)channels,
+        reinterpret_cast<const StbImage::Data*>(decoded.m_data.data()),
+        0
+    );
+    if (status == 0) {
+        throw std::runtime_error{ "Failed to encode PNG image" };
+    }
+
+    return png;
+}
+
+// convert every .png and .qoi file under `inputDir` into the other format under `outputDir`
+int convertDirectory(
+    const fs::path&           inputDir,
+    const fs::path&           outputDir,
+    bool                      rgbOnly,
+    qoipp::FilePipelineOptions options
+) noexcept(false)
+{
+    if (!fs::is_directory(inputDir)) {
+        throw std::runtime_error{ std::format("Input directory does not exist '{}'", inputDir.c_str()) };
+    }
+
+    std::vector<qoipp::FileJob> jobs;
+    for (const auto& entry : fs::recursive_directory_iterator{ inputDir }) {
+        const auto& path = entry.path();
+        if (!entry.is_regular_file() || (path.extension() != ".png" && path.extension() != ".qoi")) {
+            continue;
+        }
+
+        auto output = outputDir / fs::relative(path, inputDir);
+        output.replace_extension(path.extension() == ".png" ? ".qoi" : ".png");
+        fs::create_directories(output.parent_path());
+
+        jobs.push_back({ .m_input = path, .m_output = std::move(output) });
+    }
+
+    const auto transform = [&](const qoipp::FileJob& job, ByteSpan input) {
+        return job.m_input.extension() == ".png" ? pngToQoi(input) : qoiToPng(input, rgbOnly);
+    };
+
+    auto errors = DO_TIME_MS ("Convert files (qoipp)")
+    {
+        return qoipp::convertFiles(jobs, transform, options);
+    };
+
+    std::size_t failed = 0;
+    for (std::size_t i = 0; i < jobs.size(); ++i) {
+        if (errors[i] == nullptr) {
+            continue;
+        }
+        ++failed;
+        try {
+            std::rethrow_exception(errors[i]);
+        } catch (std::exception& e) {
+            fmt::println("Failed '{}': {}", jobs[i].m_input.c_str(), e.what());
+        }
+    }
+
+    fmt::println("Converted {} of {} files", jobs.size() - failed, jobs.size());
+    return failed == 0 ? 0 : 1;
+}
+
 int main(int argc, char** argv)
 try {
     CLI::App app{ "QOI to PNG and PNG to QOI converter" };
@@ -217,10 +332,17 @@ try {
     fs::path inputPath;
     fs::path outputPath;
     bool     rgbOnly = false;
+    bool     batch   = false;
+
+    qoipp::FilePipelineOptions options;
+    std::size_t                maxMemoryMiB = options.m_maxInFlight >> 20;
 
     app.add_option("infile", inputPath, "Input filepath")->required();
     app.add_option("outfile", outputPath, "Output filepath")->required();
     app.add_flag("--rgb-only", rgbOnly, "Extract rgb only (for QOI image)");
+    app.add_flag("--batch", batch, "Convert every png and qoi file under the infile directory into outfile");
+    app.add_option("--jobs", options.m_threads, "Conversion threads for --batch (0 for all cores)");
+    app.add_option("--max-memory", maxMemoryMiB, "Memory held by the files in flight for --batch (MiB)");
 
     if (argc <= 1) {
         fmt::print("{}", app.help());
@@ -229,6 +351,11 @@ try {
 
     CLI11_PARSE(app, argc, argv);
 
+    if (batch) {
+        options.m_maxInFlight = std::max<std::size_t>(maxMemoryMiB, 1) << 20;
+        return convertDirectory(inputPath, outputPath, rgbOnly, options);
+    }
+
     auto [input, output] = validate(inputPath, outputPath);
     if (input == FileType::PNG && output == FileType::QOI) {
         auto image = readPng(inputPath);
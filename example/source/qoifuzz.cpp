@@ -1,17 +1,429 @@
-#include <qoipp.hpp>
+// the library source is compiled in instead of linked for the op structs in `qoipp::data`
+#include <qoipp.cpp>
+#define QOI_IMPLEMENTATION
+#include <qoi.h>
+
+#include <CLI/CLI.hpp>
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <initializer_list>
+#include <random>
+#include <span>
+#include <stdexcept>
+#include <string_view>
+#include <vector>
+
+namespace fs = std::filesystem;
+namespace op = qoipp::data::op;
 
 using qoipp::ByteSpan;
+using qoipp::ByteVec;
+using qoipp::Channels;
+using qoipp::ImageDesc;
+using qoipp::Kernel;
+using qoipp::i8;
+using qoipp::u32;
+using qoipp::u8;
+using qoipp::usize;
 
-extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
+using Clock = std::chrono::steady_clock;
+
+// ------------------------------------------
+// checks, a failure aborts for the fuzzer
+// ------------------------------------------
+
+void expect(bool ok, std::string_view what, Kernel kernel = qoipp::activeKernel())
+{
+    if (!ok) {
+        fmt::println(stderr, "qoifuzz: {} ({} kernel)", what, qoipp::kernelName(kernel));
+        std::abort();
+    }
+}
+
+template <typename Fn>
+void forEachKernel(Fn&& fn)
+{
+    const auto active = qoipp::activeKernel();
+    for (auto kernel : { Kernel::Baseline, Kernel::SSE42, Kernel::AVX2, Kernel::AVX512 }) {
+        if (qoipp::isKernelSupported(kernel)) {
+            qoipp::setKernel(kernel);
+            fn(kernel);
+        }
+    }
+    qoipp::setKernel(active);
+}
+
+// empty if the reference decoder rejects the data, `channels` 0 decodes to the channels of the image
+ByteVec referenceDecode(ByteSpan data, int channels)
+{
+    qoi_desc desc;
+
+    auto* decoded = qoi_decode(data.data(), static_cast<int>(data.size()), &desc, channels);
+    if (decoded == nullptr) {
+        return {};
+    }
+
+    auto* bytePtr = static_cast<std::byte*>(decoded);
+    auto  pixel   = static_cast<usize>(channels != 0 ? channels : desc.channels);
+    auto  size    = usize{ desc.width } * desc.height * pixel;
+    auto  result  = ByteVec(bytePtr, bytePtr + size);
+
+    QOI_FREE(decoded);
+    return result;
+}
+
+ByteVec referenceEncode(ByteSpan data, ImageDesc desc)
+{
+    qoi_desc qdesc{
+        .width      = desc.m_width,
+        .height     = desc.m_height,
+        .channels   = static_cast<unsigned char>(desc.m_channels),
+        .colorspace = static_cast<unsigned char>(desc.m_colorspace),
+    };
+
+    int   len     = 0;
+    auto* encoded = qoi_encode(data.data(), &qdesc, &len);
+    if (encoded == nullptr) {
+        return {};
+    }
+
+    auto* bytePtr = static_cast<std::byte*>(encoded);
+    auto  result  = ByteVec(bytePtr, bytePtr + len);
+
+    QOI_FREE(encoded);
+    return result;
+}
+
+// every decode path of qoipp against the reference decoder, with every kernel
+void checkDecode(ByteSpan data)
 {
-    auto bytes = reinterpret_cast<std::byte*>(const_cast<uint8_t*>(data));
-    auto span  = ByteSpan{ bytes, size };
+    const auto native = referenceDecode(data, 0);
+    const auto rgb    = referenceDecode(data, 3);
+    auto       rgba   = referenceDecode(data, 4);
+    expect(!native.empty(), "reference decoder rejects the image");
 
+    // the reference keeps the alpha of OP_RGBA in a 3-channel image, qoipp fills it with 255 as documented
+    if (qoipp::readHeader(data)->m_channels == Channels::RGB) {
+        for (usize i = 3; i < rgba.size(); i += 4) {
+            rgba[i] = std::byte{ 0xFF };
+        }
+    }
+
+    auto codec = qoipp::Codec{};
+
+    forEachKernel([&](Kernel kernel) {
+        expect(qoipp::decode(data).m_data == native, "decode does not match the reference", kernel);
+        expect(qoipp::decodeUnchecked(data).m_data == native, "unchecked decode does not match", kernel);
+        expect(qoipp::tryDecode(data).m_value.m_data == native, "tryDecode does not match", kernel);
+        expect(qoipp::decode(data, Channels::RGB).m_data == rgb, "decode to RGB does not match", kernel);
+        expect(qoipp::decode(data, Channels::RGBA).m_data == rgba, "decode to RGBA does not match", kernel);
+        expect(std::ranges::equal(codec.decode(data).m_data, native), "Codec decode does not match", kernel);
+    });
+}
+
+// byte identity with the reference encoder at the default effort, round trips at the others
+void checkEncode(ByteSpan data, ImageDesc desc)
+{
+    const auto reference = referenceEncode(data, desc);
+    expect(!reference.empty(), "reference encoder rejects the image");
+
+    forEachKernel([&](Kernel kernel) {
+        expect(qoipp::encode(data, desc) == reference, "encode does not match the reference", kernel);
+
+        for (auto effort : { qoipp::Effort::Fast, qoipp::Effort::Best }) {
+            const auto encoded = qoipp::encode(data, desc, { .m_effort = effort });
+            expect(std::ranges::equal(qoipp::decode(encoded).m_data, data), "round trip failed", kernel);
+            if (effort == qoipp::Effort::Best) {
+                expect(encoded.size() <= reference.size(), "best effort is bigger than default", kernel);
+            }
+        }
+    });
+}
+
+// arbitrary data: the throwing and the error code decode must agree, whatever decodes must round trip
+void checkUntrusted(ByteSpan data)
+{
+    auto decoded = qoipp::Image{};
+    auto threw   = false;
     try {
-        auto [decoded, error] = qoipp::decode(span);
-    } catch (const std::exception& e) {
-        /* ignore exception */
+        decoded = qoipp::decode(data);
+    } catch (const std::invalid_argument&) {
+        threw = true;
+    }
+
+    const auto tried = qoipp::tryDecode(data);
+    expect(threw == !tried, "decode and tryDecode disagree on the data");
+
+    // the reference decoder also rejects colorspaces other than 0 and 1
+    if (tried && static_cast<int>(decoded.m_desc.m_colorspace) <= 1) {
+        expect(tried.m_value.m_data == decoded.m_data, "decode and tryDecode decode differently");
+        checkDecode(data);
+        checkEncode(decoded.m_data, decoded.m_desc);
     }
+}
+
+// ------------------------------------------
+// structure-aware input: a recipe of ops
+// ------------------------------------------
+
+// reads the fuzzer input byte by byte, zeros once it runs out
+class Recipe
+{
+public:
+    explicit Recipe(ByteSpan bytes)
+        : m_bytes{ bytes }
+    {
+    }
+
+    u8 next() noexcept { return m_index < m_bytes.size() ? std::to_integer<u8>(m_bytes[m_index++]) : 0; }
+
+    i8 next(i8 min, i8 max) noexcept { return static_cast<i8>(min + next() % (max - min + 1)); }
+
+private:
+    ByteSpan m_bytes;
+    usize    m_index = 0;
+};
+
+struct Generated
+{
+    ByteVec   m_stream;
+    ImageDesc m_desc;
+};
+
+// a valid op stream: every op sequence is valid as long as the ops cover exactly the pixels of the header,
+// an exhausted recipe ends the image with the longest runs
+Generated generate(Recipe& recipe)
+{
+    const auto desc = ImageDesc{
+        .m_width      = 1u + recipe.next() % 64u,
+        .m_height     = 1u + recipe.next() % 64u,
+        .m_channels   = recipe.next() & 1 ? Channels::RGBA : Channels::RGB,
+        .m_colorspace = recipe.next() & 1 ? qoipp::Colorspace::Linear : qoipp::Colorspace::sRGB,
+    };
+
+    // OP_RGBA is the largest op, it may be used for 3-channel images too
+    const auto pixels = usize{ desc.m_width } * desc.m_height;
+    auto       stream = ByteVec(pixels * 5 + qoipp::constants::headerSize + 8);
 
+    const auto header = qoipp::data::QoiHeader{
+        .m_width      = desc.m_width,
+        .m_height     = desc.m_height,
+        .m_channels   = static_cast<u8>(desc.m_channels),
+        .m_colorspace = static_cast<u8>(desc.m_colorspace),
+    };
+
+    usize index = 0;
+    header.write(stream, index);
+
+    auto* cursor = stream.data() + index;
+    for (usize done = 0; done < pixels;) {
+        switch (recipe.next() % 8) {
+        case 0: {
+            const auto value  = recipe.next();
+            const auto length = std::min<usize>(pixels - done, value == 0 ? 62u : value % 62u + 1u);
+            op::Run{ .m_run = static_cast<i8>(length) }.write(cursor);
+            done += length;
+            continue;
+        }
+        case 1: op::Index{ .m_index = recipe.next() % 64u }.write(cursor); break;
+        case 2:
+        case 3: op::Diff{ recipe.next(-2, 1), recipe.next(-2, 1), recipe.next(-2, 1) }.write(cursor); break;
+        case 4:
+        case 5: op::Luma{ recipe.next(-32, 31), recipe.next(-8, 7), recipe.next(-8, 7) }.write(cursor); break;
+        case 6: op::Rgb{ recipe.next(), recipe.next(), recipe.next() }.write(cursor); break;
+        default: op::Rgba{ recipe.next(), recipe.next(), recipe.next(), recipe.next() }.write(cursor); break;
+        }
+        ++done;
+    }
+    qoipp::data::EndMarker::write(cursor);
+
+    stream.resize(static_cast<usize>(cursor - stream.data()));
+    return { .m_stream = std::move(stream), .m_desc = desc };
+}
+
+// the whole harness for one input: the ops it generates, a damaged copy of them, and the input as it is
+void fuzzOne(ByteSpan input)
+{
+    auto       recipe         = Recipe{ input };
+    const auto damage         = recipe.next();
+    auto       [stream, desc] = generate(recipe);
+    const auto decoded        = qoipp::decode(stream);
+
+    expect(decoded.m_desc == desc, "decoded description does not match the header");
+    checkDecode(stream);
+    checkEncode(decoded.m_data, desc);
+
+    // flip a few bytes and cut the stream short, which must either decode or be rejected cleanly
+    for (auto i = 0; i < (damage & 7); ++i) {
+        const auto at = (usize{ recipe.next() } << 8 | recipe.next()) % stream.size();
+        stream[at] ^= std::byte{ static_cast<u8>(recipe.next() | 1) };
+    }
+    if (damage & 8) {
+        stream.resize(stream.size() - (usize{ recipe.next() } << 4) % stream.size());
+    }
+    checkUntrusted(stream);
+    checkUntrusted(input);
+}
+
+#if defined(QOIPP_LIBFUZZER)
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
+{
+    fuzzOne(ByteSpan{ reinterpret_cast<const std::byte*>(data), size });
     return 0;
 }
+#else
+
+// ------------------------------------------
+// standalone driver and corpus check
+// ------------------------------------------
+
+ByteVec readFile(const fs::path& path)
+{
+    auto file = std::ifstream{ path, std::ios::binary };
+    auto data = ByteVec(fs::file_size(path));
+    file.read(reinterpret_cast<char*>(data.data()), static_cast<std::streamsize>(data.size()));
+    return data;
+}
+
+std::vector<fs::path> listFiles(const fs::path& path, std::string_view extension = {})
+{
+    if (!fs::is_directory(path)) {
+        return { path };
+    }
+
+    auto files = std::vector<fs::path>{};
+    for (const auto& entry : fs::recursive_directory_iterator{ path }) {
+        if (entry.is_regular_file() && (extension.empty() || entry.path().extension() == extension)) {
+            files.push_back(entry.path());
+        }
+    }
+    std::ranges::sort(files);
+    return files;
+}
+
+// best of `runs` passes over the corpus, in MB/s of decoded pixels
+template <typename Decode>
+double decodeThroughput(const std::vector<ByteVec>& corpus, usize runs, Decode&& decode)
+{
+    auto bytes = usize{ 0 };
+    for (const auto& image : corpus) {
+        bytes += decode(image);
+    }
+
+    auto best = Clock::duration::max();
+    for (usize run = 0; run < runs; ++run) {
+        const auto start = Clock::now();
+        for (const auto& image : corpus) {
+            decode(image);
+        }
+        best = std::min(best, Clock::now() - start);
+    }
+
+    return static_cast<double>(bytes) / std::chrono::duration<double, std::micro>(best).count();
+}
+
+struct Options
+{
+    std::vector<fs::path> m_inputs     = {};
+    usize                 m_iterations = 10000;
+    u32                   m_seed       = 0x716f6966;
+    usize                 m_maxSize    = 4096;
+    fs::path              m_corpus     = {};
+    usize                 m_runs       = 10;
+    double                m_minMbps    = 0.0;
+
+    void configure(CLI::App& app)
+    {
+        app.add_option("inputs", m_inputs, "Files or directories run through the checks, e.g. crashes")
+            ->check(CLI::ExistingPath);
+        app.add_option("-n,--iterations", m_iterations, "Number of random inputs")->default_val(m_iterations);
+        app.add_option("--seed", m_seed, "Seed of the random inputs")->default_val(m_seed);
+        app.add_option("--max-size", m_maxSize, "Maximum size of a random input")->default_val(m_maxSize);
+        app.add_option("--corpus", m_corpus, "QOI images checked against the reference and timed")
+            ->check(CLI::ExistingDirectory);
+        app.add_option("--runs", m_runs, "Timed passes over the corpus")
+            ->default_val(m_runs)
+            ->check(CLI::PositiveNumber);
+        app.add_option("--min-mbps", m_minMbps, "Decode throughput floor on the corpus (MB/s)")
+            ->default_val(m_minMbps)
+            ->check(CLI::NonNegativeNumber);
+    }
+};
+
+int main(int argc, char* argv[])
+try {
+    CLI::App app{ "Qoifuzz - Fuzzing and throughput checks for qoipp" };
+    Options  opt;
+    opt.configure(app);
+
+    CLI11_PARSE(app, argc, argv);
+
+    for (const auto& input : opt.m_inputs) {
+        for (const auto& file : listFiles(input)) {
+            fuzzOne(readFile(file));
+        }
+    }
+
+    auto random = std::mt19937{ opt.m_seed };
+    auto input  = ByteVec{};
+    for (usize i = 0; i < opt.m_iterations; ++i) {
+        input.resize(std::uniform_int_distribution<usize>{ 0, opt.m_maxSize }(random));
+        std::ranges::generate(input, [&] { return static_cast<std::byte>(random()); });
+        fuzzOne(input);
+    }
+    fmt::println(">> Fuzz: the inputs and {} random ones passed", opt.m_iterations);
+
+    if (opt.m_corpus.empty()) {
+        return 0;
+    }
+
+    auto corpus = std::vector<ByteVec>{};
+    for (const auto& file : listFiles(opt.m_corpus, ".qoi")) {
+        corpus.push_back(readFile(file));
+        checkDecode(corpus.back());
+
+        const auto decoded = qoipp::decode(corpus.back());
+        checkEncode(decoded.m_data, decoded.m_desc);
+    }
+    if (corpus.empty()) {
+        fmt::println(">> Corpus '{}' has no QOI images", opt.m_corpus.string());
+        return 1;
+    }
+
+    auto codec     = qoipp::Codec{};
+    auto buffer    = ByteVec{};
+    auto checked   = decodeThroughput(corpus, opt.m_runs, [&](const ByteVec& image) {
+        return codec.decode(image).m_data.size();
+    });
+    auto unchecked = decodeThroughput(corpus, opt.m_runs, [&](const ByteVec& image) {
+        buffer.resize(std::max(buffer.size(), qoipp::decodedSize(*qoipp::readHeader(image))));
+        return qoipp::decodedSize(qoipp::decodeUnchecked(image, buffer));
+    });
+
+    fmt::println(
+        ">> Corpus '{}': {} images match the reference, decode {:.1f} MB/s ({:.1f} unchecked, {})",
+        opt.m_corpus.string(),
+        corpus.size(),
+        checked,
+        unchecked,
+        qoipp::kernelName(qoipp::activeKernel())
+    );
+
+    if (checked < opt.m_minMbps) {
+        fmt::println(">> Decode throughput is below the floor of {:.1f} MB/s", opt.m_minMbps);
+        return 2;
+    }
+
+} catch (std::exception& e) {
+    fmt::println(stderr, "Exception occurred: {}", e.what());
+    return 1;
+}
+#endif
@@ -2,9 +2,17 @@
 #define QOIPP_HPP_O4A387W5ER6OW7E
 
 #include <cstddef>
+#include <cstdint>
+#include <exception>
 #include <filesystem>
+#include <functional>
+#include <memory>
 #include <optional>
 #include <span>
+#include <stdexcept>
+#include <string_view>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
 namespace qoipp
@@ -38,10 +46,67 @@ namespace qoipp
         constexpr auto operator<=>(const ImageDesc&) const = default;
     };
 
-    struct Image
+    template <typename Alloc = std::allocator<std::byte>>
+    struct BasicImage
     {
-        ByteVec   m_data;
-        ImageDesc m_desc;
+        std::vector<std::byte, Alloc> m_data;
+        ImageDesc                     m_desc;
+    };
+
+    using Image = BasicImage<>;
+
+    template <typename A>
+    concept ByteAllocator = requires(A alloc, std::size_t size) {
+        { alloc.allocate(size) } -> std::same_as<std::byte*>;
+        alloc.deallocate(alloc.allocate(size), size);
+    };
+
+    /**
+     * @brief An allocator that leaves the bytes uninitialized when a vector is sized (`resize`, `vector(n)`)
+     *
+     * Use it with the allocator overloads of `encode` and `decode` to skip zeroing buffers that are
+     * overwritten right after. Any other allocator can be wrapped, e.g. `std::pmr::polymorphic_allocator`.
+     */
+    template <typename Base = std::allocator<std::byte>>
+    struct UninitAllocator : Base
+    {
+        template <typename U>
+        struct rebind
+        {
+            using other = UninitAllocator<typename std::allocator_traits<Base>::template rebind_alloc<U>>;
+        };
+
+        using Base::Base;
+
+        UninitAllocator() = default;
+
+        UninitAllocator(const Base& base) noexcept
+            : Base{ base }
+        {
+        }
+
+        template <typename U>
+        UninitAllocator(const UninitAllocator<U>& other) noexcept
+            : Base{ static_cast<const U&>(other) }
+        {
+        }
+
+        UninitAllocator select_on_container_copy_construction() const
+        {
+            return { std::allocator_traits<Base>::select_on_container_copy_construction(*this) };
+        }
+
+        template <typename U>
+        void construct(U* ptr) noexcept(std::is_nothrow_default_constructible_v<U>)
+        {
+            ::new (static_cast<void*>(ptr)) U;
+        }
+
+        template <typename U, typename... Args>
+        void construct(U* ptr, Args&&... args)
+        {
+            std::allocator_traits<Base>::construct(*this, ptr, std::forward<Args>(args)...);
+        }
     };
 
     /**
@@ -52,30 +117,121 @@ namespace qoipp
      */
     std::optional<ImageDesc> readHeader(ByteSpan data) noexcept;
 
+    /**
+     * @brief Get the worst-case size of the encoded QOI image for the given description
+     *
+     * @param desc The description of the image
+     * @return std::size_t The number of bytes an output buffer needs to always fit the encoded image
+     */
+    constexpr std::size_t maxEncodedSize(ImageDesc desc) noexcept
+    {
+        // every pixel stored as a full OP_RGB/OP_RGBA op + 14 bytes of header + 8 bytes of end marker
+        const auto pixels = std::size_t{ desc.m_width } * desc.m_height;
+        return pixels * (static_cast<std::size_t>(desc.m_channels) + 1) + 14 + 8;
+    }
+
+    /**
+     * @brief Get the size of the raw data of an image with the given description
+     *
+     * @param desc The description of the image
+     * @return std::size_t The number of bytes of the raw image data (width * height * channels)
+     */
+    constexpr std::size_t decodedSize(ImageDesc desc) noexcept
+    {
+        return std::size_t{ desc.m_width } * desc.m_height * static_cast<std::size_t>(desc.m_channels);
+    }
+
+    /**
+     * @brief Check that a description can be encoded: non-zero dimensions and 3 or 4 channels
+     *
+     * @param desc The description of the image
+     * @return bool True if the description is valid
+     */
+    constexpr bool isValidDesc(ImageDesc desc) noexcept
+    {
+        return desc.m_width > 0 && desc.m_height > 0
+            && (desc.m_channels == Channels::RGB || desc.m_channels == Channels::RGBA);
+    }
+
+    // how much work the encoder puts into choosing ops, every level produces standard QOI
+    //
+    // The state of the decoder does not depend on the ops chosen, so the greedy choices of the reference
+    // encoder are already the smallest except for one case: it does not index the pixel of a run, which only
+    // matters when the image starts with a run of the start pixel. `Best` handles that case.
+    enum class Effort : int
+    {
+        Fast    = 0,    // no OP_INDEX: no hashing and no lookups, bigger when colors repeat
+        Default = 1,    // the same choices as the reference encoder
+        Best    = 2,    // never bigger than `Default`, the same speed
+    };
+
+    struct EncodeOptions
+    {
+        Effort m_effort = Effort::Default;
+    };
+
     /**
      * @brief Encode the given data into a QOI image
      *
      * @param data The data to encode
      * @param desc The description of the image
+     * @param options How the image is encoded
      * @return ByteVec The encoded image
      * @throw std::invalid_argument If there is a mismatch between the data and the description
      */
-    ByteVec encode(ByteSpan data, ImageDesc desc) noexcept(false);
+    ByteVec encode(ByteSpan data, ImageDesc desc, EncodeOptions options = {}) noexcept(false);
+
+    template <CharLike Char>
+    inline ByteVec encode(
+        std::span<const Char> data,
+        ImageDesc             desc,
+        EncodeOptions         options = {}
+    ) noexcept(false)
+    {
+        auto byteData = ByteSpan{ reinterpret_cast<const std::byte*>(data.data()), data.size() };
+        return encode(byteData, desc, options);
+    }
+
+    /**
+     * @brief Encode the given data into a QOI image written to a caller-provided buffer
+     *
+     * @param data The data to encode
+     * @param desc The description of the image
+     * @param out The buffer to write the encoded image to (at least `maxEncodedSize(desc)` bytes)
+     * @param options How the image is encoded
+     * @return std::size_t The number of bytes written to `out`
+     * @throw std::invalid_argument If there is a mismatch between the data and the description or if `out`
+     * is too small
+     */
+    std::size_t encode(
+        ByteSpan             data,
+        ImageDesc            desc,
+        std::span<std::byte> out,
+        EncodeOptions        options = {}
+    ) noexcept(false);
 
     template <CharLike Char>
-    inline ByteVec encode(std::span<const Char> data, ImageDesc desc) noexcept(false)
+    inline std::size_t encode(
+        std::span<const Char> data,
+        ImageDesc             desc,
+        std::span<std::byte>  out,
+        EncodeOptions         options = {}
+    ) noexcept(false)
     {
         auto byteData = ByteSpan{ reinterpret_cast<const std::byte*>(data.data()), data.size() };
-        return encode(byteData, desc);
+        return encode(byteData, desc, out, options);
     }
 
     /**
      * @brief Decode the given QOI image
      *
+     * The header is validated up front and the op stream is never read past the end marker, so this is
+     * safe to use on untrusted data.
+     *
      * @param data The QOI image to decode
      * @param rgbOnly If true, only the RGB channels will be extracted
      * @return Image The decoded image
-     * @throw std::invalid_argument If the data is not a valid QOI image
+     * @throw std::invalid_argument If the data is not a valid QOI image or if it is truncated
      */
     Image decode(ByteSpan data, bool rgbOnly = false) noexcept(false);
 
@@ -87,36 +243,1820 @@ namespace qoipp
     }
 
     /**
-     * @brief Read the header of a QOI image from a file
-     * @param path The path to the file
-     * @return std::optional<ImageDesc> The description of the image (std::nullopt if it's invalid)
+     * @brief Decode the given QOI image into the given number of channels
+     *
+     * Decoding an RGB image into RGBA fills the alpha channel with 255, decoding an RGBA image into RGB
+     * drops the alpha channel.
+     *
+     * @param data The QOI image to decode
+     * @param target The number of channels of the decoded image
+     * @return Image The decoded image
+     * @throw std::invalid_argument If the data is not a valid QOI image, if it is truncated or if the target
+     * is invalid
      */
-    std::optional<ImageDesc> readHeaderFromFile(const std::filesystem::path& path) noexcept;
+    Image decode(ByteSpan data, Channels target) noexcept(false);
+
+    template <CharLike Char>
+    inline Image decode(std::span<const Char> data, Channels target) noexcept(false)
+    {
+        auto byteData = ByteSpan{ reinterpret_cast<const std::byte*>(data.data()), data.size() };
+        return decode(byteData, target);
+    }
 
     /**
-     * @brief Encode the given data into a QOI image and write it to a file
-     * @param path The path to the file
+     * @brief Decode the given QOI image into a caller-provided buffer
+     *
+     * @param data The QOI image to decode
+     * @param out The buffer to write the decoded image to (at least `decodedSize()` of the returned desc)
+     * @param rgbOnly If true, only the RGB channels will be extracted
+     * @return ImageDesc The description of the decoded image written to `out`
+     * @throw std::invalid_argument If the data is not a valid QOI image, if it is truncated or if `out` is
+     * too small
+     */
+    ImageDesc decode(ByteSpan data, std::span<std::byte> out, bool rgbOnly = false) noexcept(false);
+
+    template <CharLike Char>
+    inline ImageDesc decode(
+        std::span<const Char> data,
+        std::span<std::byte>  out,
+        bool                  rgbOnly = false
+    ) noexcept(false)
+    {
+        auto byteData = ByteSpan{ reinterpret_cast<const std::byte*>(data.data()), data.size() };
+        return decode(byteData, out, rgbOnly);
+    }
+
+    /**
+     * @brief Decode the given QOI image into a caller-provided buffer with the given number of channels
+     *
+     * @param data The QOI image to decode
+     * @param out The buffer to write the decoded image to (at least `decodedSize()` of the returned desc)
+     * @param target The number of channels of the decoded image
+     * @return ImageDesc The description of the decoded image written to `out`
+     * @throw std::invalid_argument If the data is not a valid QOI image, if it is truncated, if `out` is too
+     * small or if the target is invalid
+     */
+    ImageDesc decode(ByteSpan data, std::span<std::byte> out, Channels target) noexcept(false);
+
+    template <CharLike Char>
+    inline ImageDesc decode(
+        std::span<const Char> data,
+        std::span<std::byte>  out,
+        Channels              target
+    ) noexcept(false)
+    {
+        auto byteData = ByteSpan{ reinterpret_cast<const std::byte*>(data.data()), data.size() };
+        return decode(byteData, out, target);
+    }
+
+    // The order of the channels of 4 byte pixels in memory, e.g. of a framebuffer. The `X` formats have a
+    // padding byte instead of alpha, ignored on encode and set to 255 on decode. The premultiplied formats
+    // hold the color multiplied by alpha, QOI images always hold it straight.
+    enum class PixelFormat : int
+    {
+        RGBA,
+        BGRA,
+        ARGB,
+        ABGR,
+        RGBX,
+        BGRX,
+        RGBAPremultiplied,
+        BGRAPremultiplied,
+    };
+
+    /**
+     * @brief Encode the given pixels of the given format into a QOI image
+     *
+     * The pixels are converted as they are encoded, without a separate pass over the data.
+     *
+     * @param data The data to encode, 4 bytes per pixel whatever the channels in `desc` are
+     * @param desc The description of the image, an RGB image drops the alpha of the pixels
+     * @param format The format of the pixels in `data`
+     * @param options How the image is encoded
+     * @return ByteVec The encoded image
+     * @throw std::invalid_argument If there is a mismatch between the data and the description
+     */
+    ByteVec encode(
+        ByteSpan      data,
+        ImageDesc     desc,
+        PixelFormat   format,
+        EncodeOptions options = {}
+    ) noexcept(false);
+
+    template <CharLike Char>
+    inline ByteVec encode(
+        std::span<const Char> data,
+        ImageDesc             desc,
+        PixelFormat           format,
+        EncodeOptions         options = {}
+    ) noexcept(false)
+    {
+        auto byteData = ByteSpan{ reinterpret_cast<const std::byte*>(data.data()), data.size() };
+        return encode(byteData, desc, format, options);
+    }
+
+    // Pixels that are read in place row by row: a crop of a bigger image (`m_data` starting at the first
+    // pixel of the crop, with the stride of the bigger image) or a buffer with a row pitch (a GPU readback).
+    struct ImageView
+    {
+        ByteSpan                   m_data;                    // from the first row up to the last pixel
+        ImageDesc                  m_desc;                    // of the pixels in the view
+        std::size_t                m_stride = 0;              // bytes from a row to the next, 0 if packed
+        std::optional<PixelFormat> m_format = std::nullopt;    // 4 byte pixels instead of `m_desc` channels
+    };
+
+    /**
+     * @brief Encode the pixels of the given view into a QOI image, without copying them into packed rows
+     *
+     * @param view The pixels to encode
+     * @param options How the image is encoded
+     * @return ByteVec The encoded image
+     * @throw std::invalid_argument If the description or the format is invalid, the stride is smaller than a
+     * row or the data is too small for the view
+     */
+    ByteVec encode(const ImageView& view, EncodeOptions options = {}) noexcept(false);
+
+    /**
+     * @brief Encode the pixels of the given view into a QOI image written to a caller-provided buffer
+     *
+     * @param view The pixels to encode
+     * @param out The buffer to write the encoded image to (at least `maxEncodedSize(view.m_desc)` bytes)
+     * @param options How the image is encoded
+     * @return std::size_t The number of bytes written to `out`
+     * @throw std::invalid_argument If the description or the format is invalid, the stride is smaller than a
+     * row, the data is too small for the view or `out` is too small
+     */
+    std::size_t encode(
+        const ImageView&     view,
+        std::span<std::byte> out,
+        EncodeOptions        options = {}
+    ) noexcept(false);
+
+    /**
+     * @brief Decode the given QOI image into pixels of the given format
+     *
+     * @param data The QOI image to decode
+     * @param format The format of the decoded pixels
+     * @return Image The decoded image, with 4 channels whatever the format is
+     * @throw std::invalid_argument If the data is not a valid QOI image or if it is truncated
+     */
+    Image decode(ByteSpan data, PixelFormat format) noexcept(false);
+
+    template <CharLike Char>
+    inline Image decode(std::span<const Char> data, PixelFormat format) noexcept(false)
+    {
+        auto byteData = ByteSpan{ reinterpret_cast<const std::byte*>(data.data()), data.size() };
+        return decode(byteData, format);
+    }
+
+    /**
+     * @brief Decode the given QOI image into a caller-provided buffer of pixels of the given format
+     *
+     * @param data The QOI image to decode
+     * @param out The buffer to write the decoded image to (at least `decodedSize()` of the returned desc)
+     * @param format The format of the decoded pixels
+     * @return ImageDesc The description of the decoded image written to `out`, with 4 channels
+     * @throw std::invalid_argument If the data is not a valid QOI image, if it is truncated or if `out` is
+     * too small
+     */
+    ImageDesc decode(ByteSpan data, std::span<std::byte> out, PixelFormat format) noexcept(false);
+
+    template <CharLike Char>
+    inline ImageDesc decode(
+        std::span<const Char> data,
+        std::span<std::byte>  out,
+        PixelFormat           format
+    ) noexcept(false)
+    {
+        auto byteData = ByteSpan{ reinterpret_cast<const std::byte*>(data.data()), data.size() };
+        return decode(byteData, out, format);
+    }
+
+    // a rectangle of an image in pixels
+    struct Region
+    {
+        unsigned int m_x      = 0;
+        unsigned int m_y      = 0;
+        unsigned int m_width  = 0;    // 0 for the rest of the width
+        unsigned int m_height = 0;    // 0 for the rest of the height
+
+        constexpr bool operator==(const Region&) const = default;
+    };
+
+    /**
+     * @brief Decode a region of the given QOI image, optionally downscaled
+     *
+     * The op stream still has to be decoded from the start, but only the pixels in the region are kept and
+     * decoding stops after the last row of the region, so only the output is allocated and the ops after
+     * that row are never read. With a `scale` above 1 each output pixel is the average of a `scale` x `scale`
+     * block of the region (of what is left of it at the right and bottom edges).
+     *
+     * @param data The QOI image to decode
+     * @param region The region to decode, within the image
+     * @param scale The downscale factor, 1 to keep every pixel
+     * @param rgbOnly If true, only the RGB channels will be extracted
+     * @return Image The decoded region, `ceil(width / scale)` x `ceil(height / scale)` pixels
+     * @throw std::invalid_argument If the data is not a valid QOI image, if it is truncated before the end of
+     * the region, if the region is not within the image or if the scale is 0
+     *
+     * The overload taking `target` decodes into the given number of channels like `decode`.
+     */
+    Image decodeRegion(
+        ByteSpan     data,
+        Region       region,
+        unsigned int scale   = 1,
+        bool         rgbOnly = false
+    ) noexcept(false);
+
+    Image decodeRegion(ByteSpan data, Region region, unsigned int scale, Channels target) noexcept(false);
+
+    /**
+     * @brief Decode the given QOI image without bounds checking the op stream
+     *
+     * Only the header is validated, the op stream is trusted to be well formed (e.g. produced by `encode`).
+     * Use `decode` for data from untrusted sources.
+     *
+     * @param data The QOI image to decode
+     * @param rgbOnly If true, only the RGB channels will be extracted
+     * @return Image The decoded image
+     * @throw std::invalid_argument If the header is invalid
+     *
+     * The overload taking `target` decodes into the given number of channels like `decode`.
+     */
+    Image decodeUnchecked(ByteSpan data, bool rgbOnly = false) noexcept(false);
+    Image decodeUnchecked(ByteSpan data, Channels target) noexcept(false);
+
+    /**
+     * @brief Decode the given QOI image into a caller-provided buffer without bounds checking the op stream
+     *
+     * @param data The QOI image to decode
+     * @param out The buffer to write the decoded image to (at least `decodedSize()` of the returned desc)
+     * @param rgbOnly If true, only the RGB channels will be extracted
+     * @return ImageDesc The description of the decoded image written to `out`
+     * @throw std::invalid_argument If the header is invalid or if `out` is too small
+     *
+     * The overload taking `target` decodes into the given number of channels like `decode`.
+     */
+    ImageDesc decodeUnchecked(ByteSpan data, std::span<std::byte> out, bool rgbOnly = false) noexcept(false);
+    ImageDesc decodeUnchecked(ByteSpan data, std::span<std::byte> out, Channels target) noexcept(false);
+
+    /**
+     * @brief Encode the given data with the number of channels and the colorspace known at compile time
+     *
+     * Same as `encode(data, desc)` without the dispatch on the channels. Every combination is instantiated
+     * in the library, with QOIPP_HEADER_ONLY they are compiled (and can be inlined) in the caller instead.
+     * There is no run-time choice left to make so the effort is always `Effort::Default`, like the
+     * fixed-size overload below; use `encode(data, desc, options)` for another effort.
+     *
+     * @tparam Chan The number of channels of `data`
+     * @tparam Space The colorspace written to the header
+     * @param data The data to encode
+     * @param width The width of the image
+     * @param height The height of the image
+     * @return ByteVec The encoded image
+     * @throw std::invalid_argument If there is a mismatch between the data and the dimensions
+     *
+     * The overload taking `out` writes to a caller-provided buffer like `encode(data, desc, out)`.
+     */
+    template <Channels Chan, Colorspace Space = Colorspace::sRGB>
+    ByteVec encode(ByteSpan data, unsigned int width, unsigned int height) noexcept(false);
+
+    template <Channels Chan, Colorspace Space = Colorspace::sRGB>
+    std::size_t encode(
+        ByteSpan             data,
+        std::span<std::byte> out,
+        unsigned int         width,
+        unsigned int         height
+    ) noexcept(false);
+
+    /**
+     * @brief Decode the given QOI image with the number of channels known at compile time
+     *
+     * Same as `decode(data, Dest)` without the dispatch on the channels. The image must have `Src` channels.
+     *
+     * @tparam Src The number of channels of the image
+     * @tparam Dest The number of channels to decode to
+     * @param data The QOI image to decode
+     * @return Image The decoded image
+     * @throw std::invalid_argument If the data is not a valid QOI image with `Src` channels or if it is
+     * truncated
+     *
+     * The overload taking `out` writes to a caller-provided buffer like `decode(data, out, Dest)`.
+     */
+    template <Channels Src, Channels Dest = Src>
+    Image decode(ByteSpan data) noexcept(false);
+
+    template <Channels Src, Channels Dest = Src>
+    ImageDesc decode(ByteSpan data, std::span<std::byte> out) noexcept(false);
+
+    /**
+     * @brief Encode an image whose description is known at compile time into a fixed-size buffer
+     *
+     * The sizes of `data` and `out` are part of their types, so a caller (e.g. encoding video frames of a
+     * fixed resolution) can keep both in `std::array`s sized with `decodedSize` and `maxEncodedSize`.
+     *
+     * @tparam Desc The description of the image
+     * @param data The data to encode
+     * @param out The buffer to write the encoded image to
+     * @return std::size_t The number of bytes written to `out`
+     */
+    template <ImageDesc Desc>
+        requires (isValidDesc(Desc))
+    std::size_t encode(
+        std::span<const std::byte, decodedSize(Desc)> data,
+        std::span<std::byte, maxEncodedSize(Desc)>    out
+    ) noexcept
+    {
+        // the sizes are checked by the types, nothing left to throw
+        return encode<Desc.m_channels, Desc.m_colorspace>(data, out, Desc.m_width, Desc.m_height);
+    }
+
+    /**
+     * @brief Decode an image whose description is known at compile time into a fixed-size buffer
+     *
+     * The colorspace of `Desc` is not checked, the actual one is in the returned desc.
+     *
+     * @tparam Desc The description of the image
+     * @tparam Dest The number of channels to decode to
+     * @param data The QOI image to decode
+     * @param out The buffer to write the decoded image to
+     * @return ImageDesc The description of the decoded image
+     * @throw std::invalid_argument If the data is not a valid QOI image matching `Desc` or if it is truncated
+     */
+    template <ImageDesc Desc, Channels Dest = Desc.m_channels>
+        requires (isValidDesc(Desc))
+    ImageDesc decode(
+        ByteSpan                                                                                    data,
+        std::span<std::byte, decodedSize({ Desc.m_width, Desc.m_height, Dest, Desc.m_colorspace })> out
+    ) noexcept(false)
+    {
+        if (auto header = readHeader(data); header.has_value()) {
+            if (header->m_width != Desc.m_width || header->m_height != Desc.m_height) {
+                throw std::invalid_argument{ "Image dimensions do not match the compile-time description" };
+            }
+        }
+        return decode<Desc.m_channels, Dest>(data, out);
+    }
+
+    /**
+     * @brief Encode the given data into a QOI image made of horizontal stripes encoded in parallel
+     *
+     * The stripes are encoded in parallel on a pool shared by the library. Each stripe starts from a state
+     * that doesn't depend on the stripes before it, so the result is a valid QOI image that any decoder
+     * reads as a single stream. A table of the stripe offsets is appended after the end marker for
+     * `decodeStriped` to decode the stripes in parallel. The output costs a full pixel op per stripe and the
+     * table, and differs from the output of `encode`. Use `encode` when a single stream without the
+     * trailing table is required.
+     *
      * @param data The data to encode
      * @param desc The description of the image
-     * @param overwrite If true, the file will be overwritten if it already exists
-     * @throw std::invalid_argument If the file already exists and overwrite is false or if there is a
-     * mismatch between the data and the description
+     * @param stripes The number of stripes (0 for the number of hardware threads), at most one per row
+     * @param options How the stripes are encoded
+     * @return ByteVec The encoded image
+     * @throw std::invalid_argument If there is a mismatch between the data and the description
      */
-    void encodeToFile(
-        const std::filesystem::path& path,
-        ByteSpan                     data,
-        ImageDesc                    desc,
-        bool                         overwrite = false
+    ByteVec encodeStriped(
+        ByteSpan      data,
+        ImageDesc     desc,
+        std::size_t   stripes = 0,
+        EncodeOptions options = {}
     ) noexcept(false);
 
+    template <CharLike Char>
+    inline ByteVec encodeStriped(
+        std::span<const Char> data,
+        ImageDesc             desc,
+        std::size_t           stripes = 0,
+        EncodeOptions         options = {}
+    ) noexcept(false)
+    {
+        auto byteData = ByteSpan{ reinterpret_cast<const std::byte*>(data.data()), data.size() };
+        return encodeStriped(byteData, desc, stripes, options);
+    }
+
     /**
-     * @brief Decode a QOI image from a file
+     * @brief Decode the given QOI image, in parallel over its stripes if it was encoded by `encodeStriped`
      *
-     * @param path The path to the file
+     * Images without a stripe table are decoded like `decode`.
+     *
+     * @param data The QOI image to decode
+     * @param rgbOnly If true, only the RGB channels will be extracted
      * @return Image The decoded image
-     * @throw std::invalid_argument If the file is not exist or not a valid QOI image
+     * @throw std::invalid_argument If the data is not a valid QOI image, if it is truncated or if the stripes
+     * don't match the stripe table
+     *
+     * The overload taking `target` decodes into the given number of channels like `decode`.
      */
-    Image decodeFromFile(const std::filesystem::path& path, bool rgbOnly = false) noexcept(false);
-}
+    Image decodeStriped(ByteSpan data, bool rgbOnly = false) noexcept(false);
+    Image decodeStriped(ByteSpan data, Channels target) noexcept(false);
+
+    template <CharLike Char>
+    inline Image decodeStriped(std::span<const Char> data, bool rgbOnly = false) noexcept(false)
+    {
+        auto byteData = ByteSpan{ reinterpret_cast<const std::byte*>(data.data()), data.size() };
+        return decodeStriped(byteData, rgbOnly);
+    }
+
+    /**
+     * @brief Build a row index of the given QOI image for `decodeRows`
+     *
+     * The state of the decoder at a pixel depends on every op before it, so decoding a row otherwise means
+     * decoding all the rows above it. The index saves that state every `interval` rows, 272 bytes each, and
+     * `decodeRows` starts from the one before the rows it is asked for. The index is either kept as a
+     * sidecar or appended after the end marker of the image, which decoders ignore. An image with a
+     * stripe table from `encodeStriped` is then decoded as a plain image by `decodeStriped` though.
+     *
+     * @param data The QOI image to index
+     * @param interval The number of rows between two saved states
+     * @return ByteVec The index
+     * @throw std::invalid_argument If the data is not a valid QOI image, if it is truncated or if the
+     * interval is 0
+     */
+    ByteVec indexRows(ByteSpan data, unsigned int interval = 64) noexcept(false);
+
+    /**
+     * @brief Decode the rows `[firstRow, firstRow + count)` of the given QOI image from its row index
+     *
+     * Only the ops from the saved state before `firstRow` to the last row asked for are decoded.
+     *
+     * @param data The QOI image to decode, the index may have been appended to it
+     * @param index The index from `indexRows` as a sidecar, or empty to use the one appended to the image
+     * @param firstRow The first row to decode
+     * @param count The number of rows to decode, 0 for the rest of the image
+     * @param rgbOnly If true, only the RGB channels will be extracted
+     * @return Image The decoded rows
+     * @throw std::invalid_argument If the data is not a valid QOI image, if it is truncated before the last
+     * row, if the rows are not within the image or if the given index does not match the image
+     *
+     * An image without an index appended to it is decoded from the start when `index` is empty. The overload
+     * taking `target` decodes into the given number of channels like `decode`.
+     */
+    Image decodeRows(
+        ByteSpan     data,
+        ByteSpan     index,
+        unsigned int firstRow,
+        unsigned int count,
+        bool         rgbOnly = false
+    ) noexcept(false);
+
+    Image decodeRows(
+        ByteSpan     data,
+        ByteSpan     index,
+        unsigned int firstRow,
+        unsigned int count,
+        Channels     target
+    ) noexcept(false);
+
+    // why a `try` function failed, the same checks as the throwing functions without the message
+    //
+    // Every function that decodes or encodes a whole image has a `try` variant for each of its overloads:
+    // `tryDecode`, `tryEncode`, `tryDecodeFromFile`, `tryEncodeToFile`, `tryDecodeRegion`, `tryDecodeRows`,
+    // `tryIndexRows`, `tryDecodeStriped`, `tryEncodeStriped`, `tryDecodeParallel`, `tryDecodeBatch`,
+    // `tryEncodeBatch`, `Decoder::tryPush`, `SequenceEncoder::tryEncode`, `SequenceDecoder::tryDecode`,
+    // `Codec::tryEncode` and `Codec::tryDecode`. What still throws is `decodeUnchecked`, which only checks
+    // the header (check untrusted data with one of the `try` functions first, or decode it with one of
+    // them), `Encoder`, whose pixels are pushed by the caller, and the constructors, which only reject an
+    // invalid description, target or sink.
+    enum class Error : int
+    {
+        None = 0,
+        BadMagic,         // the data does not start with the QOI magic
+        BadChannels,      // the channels of the description, the header or the target are not 3 or 4, or not
+                          // the ones of a compile-time overload
+        BadDimensions,    // the width or the height is 0, or not the ones of a compile-time description
+        SizeMismatch,     // the data does not match the description or the view, or the output buffer is too
+                          // small
+        Truncated,        // the data is shorter than a header or the op stream ends before the last pixel
+        PixelOverflow,    // the header has more pixels than the op stream can hold
+        File,             // the file does not exist, is not a regular file, can't be read or written
+        BadRegion,        // the region or the rows are not within the image, the scale or the interval is 0
+        BadTable,         // the row index or the stripe table does not match the image
+        BadEndMarker,     // the bytes after the last pixel of a stream are not the end marker
+        BadFormat,        // the pixel format is not one of `PixelFormat`
+        BadFrame,         // a delta frame does not follow a frame of the same description
+    };
+
+    template <typename T>
+    struct Result
+    {
+        T     m_value = {};    // value-initialized unless `m_error` is `None`, empty with an allocator
+        Error m_error = Error::None;
+
+        explicit operator bool() const noexcept { return m_error == Error::None; }
+    };
+
+    /**
+     * @brief Get a short description of an error for logs, like "truncated"
+     *
+     * @param error The error
+     * @return std::string_view The description of the error
+     */
+    std::string_view errorName(Error error) noexcept;
+
+    /**
+     * @brief Incremental QOI encoder that accepts the image a chunk of pixels at a time
+     *
+     * The header is emitted on construction, each `push()` emits the encoded bytes of the given pixels and
+     * `finish()` emits the end marker. The encoded bytes are handed to the sink as they are produced, the
+     * span is only valid for the duration of the sink call.
+     */
+    class Encoder
+    {
+    public:
+        using Sink = std::function<void(ByteSpan)>;
+
+        /**
+         * @brief Construct an encoder and emit the header of the image
+         *
+         * @param desc The description of the image
+         * @param sink The callable that receives the encoded bytes
+         * @param options How the pixels are encoded
+         * @throw std::invalid_argument If the description is invalid or the sink is empty
+         */
+        Encoder(ImageDesc desc, Sink sink, EncodeOptions options = {}) noexcept(false);
+        ~Encoder();
+
+        Encoder(Encoder&&) noexcept;
+        Encoder& operator=(Encoder&&) noexcept;
+
+        /**
+         * @brief Encode the next pixels of the image (e.g. a number of rows)
+         *
+         * @param data The data to encode, must be a whole number of pixels
+         * @throw std::invalid_argument If the data is not a whole number of pixels, exceeds the remaining
+         * pixels of the image, or the encoder is already finished
+         */
+        void push(ByteSpan data) noexcept(false);
+
+        template <CharLike Char>
+        inline void push(std::span<const Char> data) noexcept(false)
+        {
+            push(ByteSpan{ reinterpret_cast<const std::byte*>(data.data()), data.size() });
+        }
+
+        /**
+         * @brief Emit the end marker of the image
+         *
+         * @throw std::invalid_argument If not all pixels have been pushed or the encoder is already finished
+         */
+        void finish() noexcept(false);
+
+        /**
+         * @brief Get the number of pixels that still need to be pushed
+         */
+        std::size_t remaining() const noexcept;
+
+    private:
+        struct State;
+        std::unique_ptr<State> m_state;
+    };
+
+    /**
+     * @brief Incremental QOI decoder that accepts the encoded image a chunk of bytes at a time
+     *
+     * The chunks can be of any size, ops split across chunk boundaries are carried over to the next
+     * `push()`. Each row is handed to the sink as soon as it is complete, the span is only valid for the
+     * duration of the sink call. Any data after the end marker is ignored.
+     */
+    class Decoder
+    {
+    public:
+        using Sink = std::function<void(std::size_t row, ByteSpan data)>;
+
+        /**
+         * @brief Construct a decoder
+         *
+         * @param sink The callable that receives the decoded rows
+         * @param rgbOnly If true, only the RGB channels will be extracted
+         * @throw std::invalid_argument If the sink is empty
+         */
+        Decoder(Sink sink, bool rgbOnly = false) noexcept(false);
+
+        /**
+         * @brief Construct a decoder that decodes into the given number of channels
+         *
+         * @param sink The callable that receives the decoded rows
+         * @param target The number of channels of the decoded rows (see `decode`)
+         * @throw std::invalid_argument If the sink is empty or the target is invalid
+         */
+        Decoder(Sink sink, Channels target) noexcept(false);
+        ~Decoder();
+
+        Decoder(Decoder&&) noexcept;
+        Decoder& operator=(Decoder&&) noexcept;
+
+        /**
+         * @brief Decode the next chunk of the QOI image
+         *
+         * @param data The next bytes of the QOI image
+         * @throw std::invalid_argument If the header or the end marker is invalid
+         */
+        void push(ByteSpan data) noexcept(false);
+
+        template <CharLike Char>
+        inline void push(std::span<const Char> data) noexcept(false)
+        {
+            push(ByteSpan{ reinterpret_cast<const std::byte*>(data.data()), data.size() });
+        }
+
+        /**
+         * @brief `push` reporting failure with an error code
+         *
+         * A rejected header makes every later push fail the same way, a rejected end marker every later push
+         * until the rest of the marker is pushed.
+         *
+         * @param data The next bytes of the QOI image
+         * @return Error Why the data was rejected, `Error::None` if it was decoded
+         * @throw Only what the sink throws
+         */
+        Error tryPush(ByteSpan data) noexcept(false);
+
+        /**
+         * @brief Get the description of the decoded rows
+         *
+         * @return std::optional<ImageDesc> The description (std::nullopt if the header is not complete yet)
+         */
+        std::optional<ImageDesc> desc() const noexcept;
+
+        /**
+         * @brief Check whether all pixels and the end marker have been decoded
+         */
+        bool done() const noexcept;
+
+    private:
+        Decoder(Sink sink, std::optional<Channels> target) noexcept(false);
+
+        struct State;
+        std::unique_ptr<State> m_state;
+    };
+
+    /**
+     * @brief Encoder for a sequence of frames (e.g. a screen recording) that encodes each frame against the
+     * previous one
+     *
+     * A key frame is a plain QOI image. A delta frame is a QOI image of the residual of the frame against the
+     * previous one followed by a 4 byte marker after the end marker, pixels that did not change become runs.
+     * Delta frames can only be decoded with a `SequenceDecoder` that decoded the frame before.
+     */
+    class SequenceEncoder
+    {
+    public:
+        /**
+         * @brief Construct a sequence encoder
+         *
+         * @param options How the frames are encoded
+         */
+        explicit SequenceEncoder(EncodeOptions options = {});
+        ~SequenceEncoder();
+
+        SequenceEncoder(SequenceEncoder&&) noexcept;
+        SequenceEncoder& operator=(SequenceEncoder&&) noexcept;
+
+        /**
+         * @brief Encode the next frame of the sequence
+         *
+         * The first frame, a frame with a different description than the previous one and a frame whose
+         * delta would be larger than the last key frame are encoded as key frames.
+         *
+         * @param data The data of the frame
+         * @param desc The description of the frame
+         * @param key If true, the frame is encoded as a key frame
+         * @return ByteSpan The encoded frame, valid until the next call to `encode`
+         * @throw std::invalid_argument If there is a mismatch between the data and the description
+         */
+        ByteSpan encode(ByteSpan data, ImageDesc desc, bool key = false) noexcept(false);
+
+        template <CharLike Char>
+        inline ByteSpan encode(std::span<const Char> data, ImageDesc desc, bool key = false) noexcept(false)
+        {
+            auto byteData = ByteSpan{ reinterpret_cast<const std::byte*>(data.data()), data.size() };
+            return encode(byteData, desc, key);
+        }
+
+        /**
+         * @brief `encode` reporting failure with an error code, a rejected frame leaves the previous one
+         *
+         * @return Result<ByteSpan> The encoded frame or why the data was rejected
+         * @throw std::bad_alloc Only if a buffer has to grow and can't
+         */
+        Result<ByteSpan> tryEncode(ByteSpan data, ImageDesc desc, bool key = false) noexcept(false);
+
+        /**
+         * @brief Forget the previous frame, the next frame is encoded as a key frame
+         */
+        void reset() noexcept;
+
+    private:
+        struct State;
+        std::unique_ptr<State> m_state;
+    };
+
+    /**
+     * @brief Decoder for the frames of a `SequenceEncoder`, decodes every frame into the same buffer
+     */
+    class SequenceDecoder
+    {
+    public:
+        /**
+         * @brief Construct a sequence decoder
+         *
+         * @param rgbOnly If true, only the RGB channels will be extracted
+         */
+        explicit SequenceDecoder(bool rgbOnly = false);
+
+        /**
+         * @brief Construct a sequence decoder that decodes into the given number of channels
+         *
+         * @param target The number of channels of the decoded frames (see `decode`)
+         * @throw std::invalid_argument If the target is invalid
+         */
+        explicit SequenceDecoder(Channels target) noexcept(false);
+        ~SequenceDecoder();
+
+        SequenceDecoder(SequenceDecoder&&) noexcept;
+        SequenceDecoder& operator=(SequenceDecoder&&) noexcept;
+
+        /**
+         * @brief Decode the next frame of the sequence
+         *
+         * @param data The encoded frame
+         * @return const Image& The decoded frame, valid until the next call to `decode`
+         * @throw std::invalid_argument If the data is not a valid frame, or it is a delta frame that does not
+         * follow a frame of the same description
+         */
+        const Image& decode(ByteSpan data) noexcept(false);
+
+        template <CharLike Char>
+        inline const Image& decode(std::span<const Char> data) noexcept(false)
+        {
+            return decode(ByteSpan{ reinterpret_cast<const std::byte*>(data.data()), data.size() });
+        }
+
+        /**
+         * @brief `decode` reporting failure with an error code
+         *
+         * A frame rejected by the header checks leaves the previous frame to apply the next delta frame to,
+         * like `decode` does.
+         *
+         * @param data The encoded frame
+         * @return Result<ImageView> The pixels of the decoded frame, valid until the next call to `decode` or
+         * `tryDecode`, or why the frame was rejected
+         * @throw std::bad_alloc Only if the frame buffer has to grow and can't
+         */
+        Result<ImageView> tryDecode(ByteSpan data) noexcept(false);
+
+        /**
+         * @brief Check whether the encoded frame is a delta frame
+         */
+        static bool isDeltaFrame(ByteSpan data) noexcept;
+
+    private:
+        SequenceDecoder(std::optional<Channels> target) noexcept(false);
+
+        struct State;
+        std::unique_ptr<State> m_state;
+    };
+
+    /**
+     * @brief A pool of threads to run batches of jobs on
+     *
+     * The jobs of a batch are split evenly between the threads up front, a thread that runs out of jobs
+     * steals from the ones that still have some. The thread that starts a batch works on it too, and a batch
+     * started from within a job runs on the thread of that job.
+     */
+    class ThreadPool
+    {
+    public:
+        /**
+         * @brief Construct a pool and start its threads
+         *
+         * @param threads The number of threads working on a batch including the calling thread (0 for the
+         * number of hardware threads)
+         */
+        explicit ThreadPool(std::size_t threads = 0) noexcept(false);
+        ~ThreadPool();
+
+        ThreadPool(ThreadPool&&) noexcept;
+        ThreadPool& operator=(ThreadPool&&) noexcept;
+
+        /**
+         * @brief Get the number of threads working on a batch including the calling thread
+         */
+        std::size_t size() const noexcept;
+
+        /**
+         * @brief Call `fn` with every index in `[0, count)` and wait until all are done
+         *
+         * Batches started from several threads at once run one after another.
+         *
+         * @param count The number of jobs
+         * @param fn The job, called concurrently from several threads
+         * @throw Rethrows the first exception thrown by `fn` once all the jobs are done
+         */
+        void run(std::size_t count, const std::function<void(std::size_t)>& fn) noexcept(false);
+
+    private:
+        struct State;
+        std::unique_ptr<State> m_state;
+    };
+
+    struct EncodeJob
+    {
+        ByteSpan  m_data;
+        ImageDesc m_desc;
+    };
+
+    /**
+     * @brief Encode a batch of images in parallel
+     *
+     * Each thread encodes into a scratch buffer that is kept between jobs and batches, so only the encoded
+     * bytes of each image are allocated.
+     *
+     * @param jobs The images to encode
+     * @param pool The pool to run the batch on (a pool shared by the library if not given)
+     * @param options How the images are encoded
+     * @return std::vector<ByteVec> The encoded images, in the order of the jobs
+     * @throw std::invalid_argument If there is a mismatch between the data and the description of a job, the
+     * first one is rethrown after the whole batch is done
+     */
+    std::vector<ByteVec> encodeBatch(
+        std::span<const EncodeJob> jobs,
+        ThreadPool&                pool,
+        EncodeOptions              options = {}
+    ) noexcept(false);
+    std::vector<ByteVec> encodeBatch(
+        std::span<const EncodeJob> jobs,
+        EncodeOptions              options = {}
+    ) noexcept(false);
+
+    /**
+     * @brief Decode a batch of QOI images in parallel
+     *
+     * @param jobs The QOI images to decode
+     * @param pool The pool to run the batch on (a pool shared by the library if not given)
+     * @param rgbOnly If true, only the RGB channels will be extracted
+     * @return std::vector<Image> The decoded images, in the order of the jobs
+     * @throw std::invalid_argument If a job is not a valid QOI image or is truncated, the first one is
+     * rethrown after the whole batch is done
+     */
+    std::vector<Image> decodeBatch(
+        std::span<const ByteSpan> jobs,
+        ThreadPool&               pool,
+        bool                      rgbOnly = false
+    ) noexcept(false);
+    std::vector<Image> decodeBatch(std::span<const ByteSpan> jobs, bool rgbOnly = false) noexcept(false);
+
+    /**
+     * @brief Decode the given QOI image in parallel, without needing a stripe table
+     *
+     * The ops are split into one range per thread without decoding them: the size of an op and the number of
+     * pixels it decodes only depend on its tag, and the tags read from anywhere in the stream soon fall in
+     * step with the real ops. Each range is then decoded on its own from the start state, and the start of
+     * each range is decoded again in order with the state the range before it really ends with, up to the
+     * point where its pixels no longer depend on that state. Images too small to split are decoded like
+     * `decode`.
+     *
+     * @param data The QOI image to decode
+     * @param pool The pool to decode on (a pool shared by the library if not given)
+     * @param rgbOnly If true, only the RGB channels will be extracted
+     * @return Image The decoded image
+     * @throw std::invalid_argument If the data is not a valid QOI image or if it is truncated
+     */
+    Image decodeParallel(ByteSpan data, ThreadPool& pool, bool rgbOnly = false) noexcept(false);
+    Image decodeParallel(ByteSpan data, bool rgbOnly = false) noexcept(false);
+
+    /**
+     * @brief Read the header of a QOI image from a file
+     * @param path The path to the file
+     * @return std::optional<ImageDesc> The description of the image (std::nullopt if it's invalid)
+     */
+    std::optional<ImageDesc> readHeaderFromFile(const std::filesystem::path& path) noexcept;
+
+    enum class HeaderError
+    {
+        None = 0,
+        Open,         // the file does not exist or can't be opened
+        Read,         // the file can't be read, directories included
+        Truncated,    // the file is shorter than a header
+        Invalid,      // the file does not start with a QOI header
+    };
+
+    struct FileHeader
+    {
+        std::optional<ImageDesc> m_desc  = {};    // std::nullopt unless `m_error` is `None`
+        HeaderError              m_error = HeaderError::None;
+    };
+
+    /**
+     * @brief Read the headers of many QOI files in parallel
+     *
+     * Only the first 14 bytes of each file are read, with a single read into a buffer on the stack, so
+     * scanning a file costs an open, a read and a close. Errors are reported per file.
+     *
+     * @param paths The files to read
+     * @param pool The pool to run the batch on (a pool shared by the library if not given)
+     * @return std::vector<FileHeader> The header or the error of each file, in the order of the paths
+     * @throw std::bad_alloc Only if the result can't be allocated
+     */
+    std::vector<FileHeader> readHeaders(
+        std::span<const std::filesystem::path> paths,
+        ThreadPool&                            pool
+    ) noexcept(false);
+    std::vector<FileHeader> readHeaders(std::span<const std::filesystem::path> paths) noexcept(false);
+
+    /**
+     * @brief Encode the given data into a QOI image and write it to a file
+     *
+     * The image is written to a temporary file in the same directory, then renamed to `path` once it is
+     * complete, so a failed write never leaves a partial file behind or destroys the file it would replace.
+     *
+     * @param path The path to the file
+     * @param data The data to encode
+     * @param desc The description of the image
+     * @param overwrite If true, the file will be overwritten if it already exists
+     * @param options How the image is encoded
+     * @throw std::invalid_argument If the file already exists and overwrite is false or if there is a
+     * mismatch between the data and the description
+     */
+    void encodeToFile(
+        const std::filesystem::path& path,
+        ByteSpan                     data,
+        ImageDesc                    desc,
+        bool                         overwrite = false,
+        EncodeOptions                options   = {}
+    ) noexcept(false);
+
+    /**
+     * @brief Decode a QOI image from a file
+     *
+     * @param path The path to the file
+     * @return Image The decoded image
+     * @throw std::invalid_argument If the file is not exist or not a valid QOI image
+     */
+    Image decodeFromFile(const std::filesystem::path& path, bool rgbOnly = false) noexcept(false);
+
+    /**
+     * @brief Decode a QOI image from a file into the given number of channels
+     *
+     * @param path The path to the file
+     * @param target The number of channels of the decoded image (see `decode`)
+     * @return Image The decoded image
+     * @throw std::invalid_argument If the file is not exist, not a valid QOI image or the target is invalid
+     */
+    Image decodeFromFile(const std::filesystem::path& path, Channels target) noexcept(false);
+
+    /**
+     * @brief Encode the given data into a QOI image, reporting failure with an error code, see `encode`
+     *
+     * Nothing is allocated and no exception is thrown when the input is rejected, the vector is only
+     * allocated once the data matches the description.
+     *
+     * @param data The data to encode
+     * @param desc The description of the image
+     * @param options How the image is encoded
+     * @return Result<ByteVec> The encoded image or why the data was rejected
+     * @throw std::bad_alloc Only if the encoded image can't be allocated
+     */
+    Result<ByteVec> tryEncode(ByteSpan data, ImageDesc desc, EncodeOptions options = {}) noexcept(false);
+
+    /**
+     * @brief Encode the given data into a caller-provided buffer, reporting failure with an error code
+     *
+     * @param data The data to encode
+     * @param desc The description of the image
+     * @param out The buffer to write the encoded image to (at least `maxEncodedSize(desc)` bytes)
+     * @param options How the image is encoded
+     * @return Result<std::size_t> The number of bytes written to `out` or why the data was rejected
+     */
+    Result<std::size_t> tryEncode(
+        ByteSpan             data,
+        ImageDesc            desc,
+        std::span<std::byte> out,
+        EncodeOptions        options = {}
+    ) noexcept;
+
+    /**
+     * @brief Decode the given QOI image, reporting failure with an error code, see `decode`
+     *
+     * The header is validated before anything is allocated. A stream that passes the header checks but
+     * ends early is only detected while decoding, after the image is allocated; decode into a buffer of
+     * your own to never allocate.
+     *
+     * @param data The QOI image to decode
+     * @param rgbOnly If true, only the RGB channels will be extracted
+     * @return Result<Image> The decoded image or why the data was rejected
+     * @throw std::bad_alloc Only if the decoded image can't be allocated
+     *
+     * The overload taking `target` decodes into the given number of channels like `decode`.
+     */
+    Result<Image> tryDecode(ByteSpan data, bool rgbOnly = false) noexcept(false);
+    Result<Image> tryDecode(ByteSpan data, Channels target) noexcept(false);
+
+    /**
+     * @brief Decode the given QOI image into a caller-provided buffer, reporting failure with an error code
+     *
+     * @param data The QOI image to decode
+     * @param out The buffer to write the decoded image to (at least `decodedSize()` of the returned desc)
+     * @param rgbOnly If true, only the RGB channels will be extracted
+     * @return Result<ImageDesc> The description of the decoded image or why the data was rejected
+     *
+     * The overload taking `target` decodes into the given number of channels like `decode`.
+     */
+    Result<ImageDesc> tryDecode(ByteSpan data, std::span<std::byte> out, bool rgbOnly = false) noexcept;
+    Result<ImageDesc> tryDecode(ByteSpan data, std::span<std::byte> out, Channels target) noexcept;
+
+    /**
+     * @brief Decode a QOI image from a file, reporting failure with an error code, see `tryDecode`
+     *
+     * @param path The path to the file
+     * @param rgbOnly If true, only the RGB channels will be extracted
+     * @return Result<Image> The decoded image or why the file was rejected
+     * @throw std::bad_alloc Only if the decoded image can't be allocated
+     */
+    Result<Image> tryDecodeFromFile(const std::filesystem::path& path, bool rgbOnly = false) noexcept(false);
+    Result<Image> tryDecodeFromFile(const std::filesystem::path& path, Channels target) noexcept(false);
+
+    /**
+     * @brief Encode the given data and write it to a file, reporting failure with an error code
+     *
+     * The data is checked before the file is created, see `encodeToFile`.
+     *
+     * @param path The path to the file
+     * @param data The data to encode
+     * @param desc The description of the image
+     * @param overwrite If true, the file will be overwritten if it already exists
+     * @param options How the image is encoded
+     * @return Error Why the data or the file was rejected, `Error::File` if the file exists and overwrite is
+     * false or if it can't be written
+     * @throw std::bad_alloc Only if the file can't be set up for writing
+     */
+    Error tryEncodeToFile(
+        const std::filesystem::path& path,
+        ByteSpan                     data,
+        ImageDesc                    desc,
+        bool                         overwrite = false,
+        EncodeOptions                options   = {}
+    ) noexcept(false);
+
+    /**
+     * @brief Decode a region of the given QOI image, reporting failure with an error code, see `decodeRegion`
+     *
+     * @return Result<Image> The decoded region or why the data or the region was rejected
+     * @throw std::bad_alloc Only if the decoded region can't be allocated
+     */
+    Result<Image> tryDecodeRegion(
+        ByteSpan     data,
+        Region       region,
+        unsigned int scale   = 1,
+        bool         rgbOnly = false
+    ) noexcept(false);
+
+    Result<Image> tryDecodeRegion(
+        ByteSpan     data,
+        Region       region,
+        unsigned int scale,
+        Channels     target
+    ) noexcept(false);
+
+    /**
+     * @brief Decode rows of the given QOI image from its row index, reporting failure with an error code, see
+     * `decodeRows`
+     *
+     * @return Result<Image> The decoded rows or why the data, the rows or the index was rejected
+     * @throw std::bad_alloc Only if the decoded rows can't be allocated
+     */
+    Result<Image> tryDecodeRows(
+        ByteSpan     data,
+        ByteSpan     index,
+        unsigned int firstRow,
+        unsigned int count,
+        bool         rgbOnly = false
+    ) noexcept(false);
+
+    Result<Image> tryDecodeRows(
+        ByteSpan     data,
+        ByteSpan     index,
+        unsigned int firstRow,
+        unsigned int count,
+        Channels     target
+    ) noexcept(false);
+
+    /**
+     * @brief Decode the given QOI image over its stripes, reporting failure with an error code, see
+     * `decodeStriped`
+     *
+     * @return Result<Image> The decoded image or why the data was rejected
+     * @throw std::bad_alloc Only if the decoded image can't be allocated
+     */
+    Result<Image> tryDecodeStriped(ByteSpan data, bool rgbOnly = false) noexcept(false);
+    Result<Image> tryDecodeStriped(ByteSpan data, Channels target) noexcept(false);
+
+    /**
+     * @brief Decode many QOI images in parallel, reporting failure with an error code, see `decodeBatch`
+     *
+     * Unlike `decodeBatch` a rejected image does not fail the batch, each image has its own result.
+     *
+     * @return std::vector<Result<Image>> The decoded image or the error of each image, in the order of the
+     * jobs
+     * @throw std::bad_alloc Only if an image or the result can't be allocated
+     */
+    std::vector<Result<Image>> tryDecodeBatch(
+        std::span<const ByteSpan> jobs,
+        ThreadPool&               pool,
+        bool                      rgbOnly = false
+    ) noexcept(false);
+    std::vector<Result<Image>> tryDecodeBatch(
+        std::span<const ByteSpan> jobs,
+        bool                      rgbOnly = false
+    ) noexcept(false);
+
+    /**
+     * @brief Encode many images in parallel, reporting failure with an error code, see `encodeBatch`
+     *
+     * Unlike `encodeBatch` a rejected job does not fail the batch, each image has its own result.
+     *
+     * @return std::vector<Result<ByteVec>> The encoded image or the error of each job, in the order of the
+     * jobs
+     * @throw std::bad_alloc Only if an image or the result can't be allocated
+     */
+    std::vector<Result<ByteVec>> tryEncodeBatch(
+        std::span<const EncodeJob> jobs,
+        ThreadPool&                pool,
+        EncodeOptions              options = {}
+    ) noexcept(false);
+    std::vector<Result<ByteVec>> tryEncodeBatch(
+        std::span<const EncodeJob> jobs,
+        EncodeOptions              options = {}
+    ) noexcept(false);
+
+    /**
+     * @brief Decode the given QOI image in parallel, reporting failure with an error code, see
+     * `decodeParallel`
+     *
+     * @return Result<Image> The decoded image or why the data was rejected
+     * @throw std::bad_alloc Only if the decoded image can't be allocated
+     */
+    Result<Image> tryDecodeParallel(ByteSpan data, ThreadPool& pool, bool rgbOnly = false) noexcept(false);
+    Result<Image> tryDecodeParallel(ByteSpan data, bool rgbOnly = false) noexcept(false);
+
+    /**
+     * @brief Encode the given data into a striped QOI image, reporting failure with an error code, see
+     * `encodeStriped`
+     *
+     * @return Result<ByteVec> The encoded image or why the data was rejected
+     * @throw std::bad_alloc Only if the encoded image can't be allocated
+     */
+    Result<ByteVec> tryEncodeStriped(
+        ByteSpan      data,
+        ImageDesc     desc,
+        std::size_t   stripes = 0,
+        EncodeOptions options = {}
+    ) noexcept(false);
+
+    /**
+     * @brief Build a row index of the given QOI image, reporting failure with an error code, see `indexRows`
+     *
+     * @return Result<ByteVec> The index or why the data or the interval was rejected
+     * @throw std::bad_alloc Only if the index can't be allocated
+     */
+    Result<ByteVec> tryIndexRows(ByteSpan data, unsigned int interval = 64) noexcept(false);
+
+    /**
+     * @brief Encode the given pixels of the given format, reporting failure with an error code, see `encode`
+     *
+     * @return Result<ByteVec> The encoded image or why the data or the format was rejected
+     * @throw std::bad_alloc Only if the encoded image can't be allocated
+     */
+    Result<ByteVec> tryEncode(
+        ByteSpan      data,
+        ImageDesc     desc,
+        PixelFormat   format,
+        EncodeOptions options = {}
+    ) noexcept(false);
+
+    /**
+     * @brief Encode the pixels of the given view, reporting failure with an error code, see `encode`
+     *
+     * @return Result<ByteVec> The encoded image or why the view was rejected, `Error::SizeMismatch` if the
+     * stride is smaller than a row or the data is too small for the view
+     * @throw std::bad_alloc Only if the encoded image can't be allocated
+     *
+     * The overload taking `out` writes to a caller-provided buffer and never allocates.
+     */
+    Result<ByteVec> tryEncode(const ImageView& view, EncodeOptions options = {}) noexcept(false);
+
+    Result<std::size_t> tryEncode(
+        const ImageView&     view,
+        std::span<std::byte> out,
+        EncodeOptions        options = {}
+    ) noexcept;
+
+    /**
+     * @brief Decode the given QOI image into pixels of the given format, reporting failure with an error
+     * code, see `decode`
+     *
+     * @return Result<Image> The decoded image or why the data or the format was rejected
+     * @throw std::bad_alloc Only if the decoded image can't be allocated
+     *
+     * The overload taking `out` writes to a caller-provided buffer and never allocates.
+     */
+    Result<Image> tryDecode(ByteSpan data, PixelFormat format) noexcept(false);
+
+    Result<ImageDesc> tryDecode(ByteSpan data, std::span<std::byte> out, PixelFormat format) noexcept;
+
+    /**
+     * @brief `encode` with the number of channels and the colorspace known at compile time, reporting failure
+     * with an error code
+     *
+     * @return Result<ByteVec> The encoded image or why the data was rejected
+     * @throw std::bad_alloc Only if the encoded image can't be allocated
+     *
+     * The overload taking `out` writes to a caller-provided buffer and never allocates.
+     */
+    template <Channels Chan, Colorspace Space = Colorspace::sRGB>
+    Result<ByteVec> tryEncode(ByteSpan data, unsigned int width, unsigned int height) noexcept(false);
+
+    template <Channels Chan, Colorspace Space = Colorspace::sRGB>
+    Result<std::size_t> tryEncode(
+        ByteSpan             data,
+        std::span<std::byte> out,
+        unsigned int         width,
+        unsigned int         height
+    ) noexcept;
+
+    /**
+     * @brief `decode` with the number of channels known at compile time, reporting failure with an error code
+     *
+     * @return Result<Image> The decoded image or why the data was rejected, `Error::BadChannels` if the
+     * image does not have `Src` channels
+     * @throw std::bad_alloc Only if the decoded image can't be allocated
+     *
+     * The overload taking `out` writes to a caller-provided buffer and never allocates.
+     */
+    template <Channels Src, Channels Dest = Src>
+    Result<Image> tryDecode(ByteSpan data) noexcept(false);
+
+    template <Channels Src, Channels Dest = Src>
+    Result<ImageDesc> tryDecode(ByteSpan data, std::span<std::byte> out) noexcept;
+
+    /**
+     * @brief `decode` of an image whose description is known at compile time into a fixed-size buffer,
+     * reporting failure with an error code
+     *
+     * @return Result<ImageDesc> The description of the decoded image or why the data was rejected,
+     * `Error::BadDimensions` if the dimensions of the image are not the ones of `Desc`
+     */
+    template <ImageDesc Desc, Channels Dest = Desc.m_channels>
+        requires (isValidDesc(Desc))
+    Result<ImageDesc> tryDecode(
+        ByteSpan                                                                                    data,
+        std::span<std::byte, decodedSize({ Desc.m_width, Desc.m_height, Dest, Desc.m_colorspace })> out
+    ) noexcept
+    {
+        if (auto header = readHeader(data); header.has_value()) {
+            if (header->m_width != Desc.m_width || header->m_height != Desc.m_height) {
+                return { .m_error = Error::BadDimensions };
+            }
+        }
+        return tryDecode<Desc.m_channels, Dest>(data, out);
+    }
+
+    /**
+     * @brief A context that encodes and decodes into buffers of its own, for workers handling many images
+     *
+     * The buffers only grow and are never zeroed, so once they fit the largest image a worker sees, encoding
+     * and decoding don't allocate at all. The description checks of `encode` are skipped for the description
+     * of the last image. A context is not thread safe, give each thread its own.
+     */
+    class Codec
+    {
+    public:
+        /**
+         * @brief Construct a context with empty buffers
+         *
+         * @param options How the images are encoded
+         */
+        explicit Codec(EncodeOptions options = {});
+        ~Codec();
+
+        // the buffers move with the context, a moved-from context may only be destroyed or assigned to
+        Codec(Codec&&) noexcept;
+        Codec& operator=(Codec&&) noexcept;
+
+        /**
+         * @brief Grow the buffers to fit an image of the given description up front
+         *
+         * @param desc The description of the largest image expected
+         */
+        void reserve(ImageDesc desc) noexcept(false);
+
+        /**
+         * @brief Encode the given data into a QOI image, see `qoipp::encode`
+         *
+         * @param data The data to encode
+         * @param desc The description of the image
+         * @return ByteSpan The encoded image, valid until the next call to `encode` or `reserve`
+         * @throw std::invalid_argument If there is a mismatch between the data and the description
+         */
+        ByteSpan encode(ByteSpan data, ImageDesc desc) noexcept(false);
+
+        /**
+         * @brief Encode the pixels of a view into a QOI image, see `qoipp::encode`
+         *
+         * @param view The pixels to encode, e.g. a view returned by `decode`
+         * @return ByteSpan The encoded image, valid until the next call to `encode` or `reserve`
+         * @throw std::invalid_argument If the view is invalid or the data is too small for it
+         */
+        ByteSpan encode(const ImageView& view) noexcept(false);
+
+        template <CharLike Char>
+        inline ByteSpan encode(std::span<const Char> data, ImageDesc desc) noexcept(false)
+        {
+            return encode(ByteSpan{ reinterpret_cast<const std::byte*>(data.data()), data.size() }, desc);
+        }
+
+        /**
+         * @brief Decode the given QOI image, see `qoipp::decode`
+         *
+         * @param data The QOI image to decode
+         * @param rgbOnly If true, only the RGB channels will be extracted
+         * @return ImageView The decoded pixels, valid until the next call to `decode` or `reserve`
+         * @throw std::invalid_argument If the data is not a valid QOI image or if it is truncated
+         *
+         * The overload taking `target` decodes into the given number of channels like `qoipp::decode`.
+         */
+        ImageView decode(ByteSpan data, bool rgbOnly = false) noexcept(false);
+        ImageView decode(ByteSpan data, Channels target) noexcept(false);
+
+        /**
+         * @brief `encode` and `decode` reporting failure with an error code, see `qoipp::tryEncode`
+         *
+         * @throw std::bad_alloc Only if a buffer has to grow and can't
+         */
+        Result<ByteSpan>  tryEncode(ByteSpan data, ImageDesc desc) noexcept(false);
+        Result<ByteSpan>  tryEncode(const ImageView& view) noexcept(false);
+        Result<ImageView> tryDecode(ByteSpan data, bool rgbOnly = false) noexcept(false);
+        Result<ImageView> tryDecode(ByteSpan data, Channels target) noexcept(false);
+
+        /**
+         * @brief Get the description of the last image encoded or decoded
+         *
+         * @return std::optional<ImageDesc> The description, std::nullopt before the first image
+         */
+        std::optional<ImageDesc> desc() const noexcept;
+
+    private:
+        struct State;
+        std::unique_ptr<State> m_state;
+    };
+
+    /**
+     * @brief Get the output buffer of an encode or decode once its size is known
+     *
+     * Called at most once, after the input is validated, with the number of bytes needed. The returned buffer
+     * must be at least that large (e.g. from an arena or a pool of huge pages).
+     */
+    using Allocate = std::function<std::span<std::byte>(std::size_t size)>;
+
+    /**
+     * @brief Encode the given data into a QOI image written to a buffer obtained from `allocate`
+     *
+     * @param data The data to encode
+     * @param desc The description of the image
+     * @param allocate Called with `maxEncodedSize(desc)` to get the buffer to write to
+     * @param options How the image is encoded
+     * @return std::size_t The number of bytes written to the buffer
+     * @throw std::invalid_argument If there is a mismatch between the data and the description or if the
+     * buffer is too small
+     */
+    std::size_t encode(
+        ByteSpan        data,
+        ImageDesc       desc,
+        const Allocate& allocate,
+        EncodeOptions   options = {}
+    ) noexcept(false);
+
+    /**
+     * @brief Decode the given QOI image into a buffer obtained from `allocate`
+     *
+     * @param data The QOI image to decode
+     * @param allocate Called with `decodedSize()` of the returned desc to get the buffer to write to
+     * @param rgbOnly If true, only the RGB channels will be extracted
+     * @return ImageDesc The description of the decoded image
+     * @throw std::invalid_argument If the data is not a valid QOI image, if it is truncated or if the buffer
+     * is too small
+     *
+     * The overload taking `target` decodes into the given number of channels like `decode`.
+     */
+    ImageDesc decode(ByteSpan data, const Allocate& allocate, bool rgbOnly = false) noexcept(false);
+    ImageDesc decode(ByteSpan data, const Allocate& allocate, Channels target) noexcept(false);
+
+    /**
+     * @brief Decode a QOI image from a file into a buffer obtained from `allocate`, see `decode`
+     */
+    ImageDesc decodeFromFile(
+        const std::filesystem::path& path,
+        const Allocate&              allocate,
+        bool                         rgbOnly = false
+    ) noexcept(false);
+    ImageDesc decodeFromFile(
+        const std::filesystem::path& path,
+        const Allocate&              allocate,
+        Channels                     target
+    ) noexcept(false);
+
+    /**
+     * @brief `encode` and `decode` into a buffer obtained from `allocate`, reporting failure with an error
+     * code, see `tryEncode` and `tryDecode`
+     *
+     * `allocate` is only called once the input is checked, a buffer that is too small is
+     * `Error::SizeMismatch`.
+     *
+     * @throw Only what `allocate` throws
+     */
+    Result<std::size_t> tryEncode(
+        ByteSpan        data,
+        ImageDesc       desc,
+        const Allocate& allocate,
+        EncodeOptions   options = {}
+    ) noexcept(false);
+
+    Result<ImageDesc> tryDecode(
+        ByteSpan        data,
+        const Allocate& allocate,
+        bool            rgbOnly = false
+    ) noexcept(false);
+    Result<ImageDesc> tryDecode(ByteSpan data, const Allocate& allocate, Channels target) noexcept(false);
+
+    Result<ImageDesc> tryDecodeFromFile(
+        const std::filesystem::path& path,
+        const Allocate&              allocate,
+        bool                         rgbOnly = false
+    ) noexcept(false);
+    Result<ImageDesc> tryDecodeFromFile(
+        const std::filesystem::path& path,
+        const Allocate&              allocate,
+        Channels                     target
+    ) noexcept(false);
+
+    /**
+     * @brief Encode the given data into a QOI image stored in a vector using the given allocator
+     *
+     * E.g. `std::pmr::polymorphic_allocator<std::byte>{ &arena }` to allocate from a memory resource, or
+     * `UninitAllocator<>{}` to skip zeroing the buffer. It is sized for the worst case first, then shrunk
+     * without reallocating, see `maxEncodedSize`.
+     *
+     * @param data The data to encode
+     * @param desc The description of the image
+     * @param alloc The allocator of the returned vector
+     * @param options How the image is encoded
+     * @return std::vector<std::byte, Alloc> The encoded image
+     * @throw std::invalid_argument If there is a mismatch between the data and the description
+     */
+    template <ByteAllocator Alloc>
+    std::vector<std::byte, Alloc> encode(
+        ByteSpan      data,
+        ImageDesc     desc,
+        const Alloc&  alloc,
+        EncodeOptions options = {}
+    ) noexcept(false)
+    {
+        std::vector<std::byte, Alloc> encoded(alloc);
+
+        const auto size = encode(data, desc, [&](std::size_t required) {
+            encoded.resize(required);
+            return std::span{ encoded };
+        }, options);
+
+        encoded.resize(size);
+        return encoded;
+    }
+
+    /**
+     * @brief Decode the given QOI image into a vector using the given allocator, see the `encode` overload
+     *
+     * @param data The QOI image to decode
+     * @param alloc The allocator of the returned image data
+     * @param rgbOnly If true, only the RGB channels will be extracted
+     * @return BasicImage<Alloc> The decoded image
+     * @throw std::invalid_argument If the data is not a valid QOI image or if it is truncated
+     *
+     * The overload taking `target` decodes into the given number of channels like `decode`.
+     */
+    template <ByteAllocator Alloc>
+    BasicImage<Alloc> decode(ByteSpan data, const Alloc& alloc, bool rgbOnly = false) noexcept(false)
+    {
+        std::vector<std::byte, Alloc> decoded(alloc);
+
+        const auto desc = decode(data, [&](std::size_t size) {
+            decoded.resize(size);
+            return std::span{ decoded };
+        }, rgbOnly);
+
+        return { .m_data = std::move(decoded), .m_desc = desc };
+    }
+
+    template <ByteAllocator Alloc>
+    BasicImage<Alloc> decode(ByteSpan data, const Alloc& alloc, Channels target) noexcept(false)
+    {
+        std::vector<std::byte, Alloc> decoded(alloc);
+
+        const auto desc = decode(data, [&](std::size_t size) {
+            decoded.resize(size);
+            return std::span{ decoded };
+        }, target);
+
+        return { .m_data = std::move(decoded), .m_desc = desc };
+    }
+
+    /**
+     * @brief Decode a QOI image from a file into a vector using the given allocator, see `decode`
+     */
+    template <ByteAllocator Alloc>
+    BasicImage<Alloc> decodeFromFile(
+        const std::filesystem::path& path,
+        const Alloc&                 alloc,
+        bool                         rgbOnly = false
+    ) noexcept(false)
+    {
+        std::vector<std::byte, Alloc> decoded(alloc);
+
+        const auto desc = decodeFromFile(path, [&](std::size_t size) {
+            decoded.resize(size);
+            return std::span{ decoded };
+        }, rgbOnly);
+
+        return { .m_data = std::move(decoded), .m_desc = desc };
+    }
+
+    template <ByteAllocator Alloc>
+    BasicImage<Alloc> decodeFromFile(
+        const std::filesystem::path& path,
+        const Alloc&                 alloc,
+        Channels                     target
+    ) noexcept(false)
+    {
+        std::vector<std::byte, Alloc> decoded(alloc);
+
+        const auto desc = decodeFromFile(path, [&](std::size_t size) {
+            decoded.resize(size);
+            return std::span{ decoded };
+        }, target);
+
+        return { .m_data = std::move(decoded), .m_desc = desc };
+    }
+
+    /**
+     * @brief The allocator overloads of `encode`, `decode` and `decodeFromFile` reporting failure with an
+     * error code, see `tryEncode` and `tryDecode`
+     *
+     * The vector of a rejected input is empty and holds a copy of `alloc`.
+     *
+     * @throw Only what the allocator throws
+     */
+    template <ByteAllocator Alloc>
+    Result<std::vector<std::byte, Alloc>> tryEncode(
+        ByteSpan      data,
+        ImageDesc     desc,
+        const Alloc&  alloc,
+        EncodeOptions options = {}
+    ) noexcept(false)
+    {
+        std::vector<std::byte, Alloc> encoded(alloc);
+
+        const auto size = tryEncode(data, desc, [&](std::size_t required) {
+            encoded.resize(required);
+            return std::span{ encoded };
+        }, options);
+
+        encoded.resize(size.m_value);
+        return { .m_value = std::move(encoded), .m_error = size.m_error };
+    }
+
+    template <ByteAllocator Alloc>
+    Result<BasicImage<Alloc>> tryDecode(
+        ByteSpan     data,
+        const Alloc& alloc,
+        bool         rgbOnly = false
+    ) noexcept(false)
+    {
+        std::vector<std::byte, Alloc> decoded(alloc);
+
+        const auto desc = tryDecode(data, [&](std::size_t size) {
+            decoded.resize(size);
+            return std::span{ decoded };
+        }, rgbOnly);
+
+        if (!desc) {
+            decoded.clear();
+        }
+        return {
+            .m_value = { .m_data = std::move(decoded), .m_desc = desc.m_value },
+            .m_error = desc.m_error,
+        };
+    }
+
+    template <ByteAllocator Alloc>
+    Result<BasicImage<Alloc>> tryDecode(ByteSpan data, const Alloc& alloc, Channels target) noexcept(false)
+    {
+        std::vector<std::byte, Alloc> decoded(alloc);
+
+        const auto desc = tryDecode(data, [&](std::size_t size) {
+            decoded.resize(size);
+            return std::span{ decoded };
+        }, target);
+
+        if (!desc) {
+            decoded.clear();
+        }
+        return {
+            .m_value = { .m_data = std::move(decoded), .m_desc = desc.m_value },
+            .m_error = desc.m_error,
+        };
+    }
+
+    template <ByteAllocator Alloc>
+    Result<BasicImage<Alloc>> tryDecodeFromFile(
+        const std::filesystem::path& path,
+        const Alloc&                 alloc,
+        bool                         rgbOnly = false
+    ) noexcept(false)
+    {
+        std::vector<std::byte, Alloc> decoded(alloc);
+
+        const auto desc = tryDecodeFromFile(path, [&](std::size_t size) {
+            decoded.resize(size);
+            return std::span{ decoded };
+        }, rgbOnly);
+
+        if (!desc) {
+            decoded.clear();
+        }
+        return {
+            .m_value = { .m_data = std::move(decoded), .m_desc = desc.m_value },
+            .m_error = desc.m_error,
+        };
+    }
+
+    template <ByteAllocator Alloc>
+    Result<BasicImage<Alloc>> tryDecodeFromFile(
+        const std::filesystem::path& path,
+        const Alloc&                 alloc,
+        Channels                     target
+    ) noexcept(false)
+    {
+        std::vector<std::byte, Alloc> decoded(alloc);
+
+        const auto desc = tryDecodeFromFile(path, [&](std::size_t size) {
+            decoded.resize(size);
+            return std::span{ decoded };
+        }, target);
+
+        if (!desc) {
+            decoded.clear();
+        }
+        return {
+            .m_value = { .m_data = std::move(decoded), .m_desc = desc.m_value },
+            .m_error = desc.m_error,
+        };
+    }
+
+    struct FileJob
+    {
+        std::filesystem::path m_input;
+        std::filesystem::path m_output;    // created or overwritten
+    };
+
+    // turns the contents of the input file of a job into the contents of its output file
+    using FileTransform = std::function<ByteVec(const FileJob& job, ByteSpan input)>;
+
+    struct FilePipelineOptions
+    {
+        std::size_t m_threads     = 0;            // transform threads, 0 for the number of hardware threads
+        std::size_t m_queueDepth  = 64;           // reads and writes in flight at once
+        std::size_t m_maxInFlight = 256 << 20;    // bytes of inputs and outputs held at once (see below)
+    };
+
+    /**
+     * @brief Convert files in bulk, overlapping the reads and writes with the transforms
+     *
+     * The files are read and written on the calling thread with io_uring where the kernel allows it (plain
+     * blocking reads and writes otherwise) while `transform` runs on worker threads. A new file is only read
+     * while the inputs and outputs held add up to less than `m_maxInFlight`, a single larger file is still
+     * converted on its own. An error on a job does not stop the others.
+     *
+     * @param jobs The files to convert
+     * @param transform Called concurrently from the worker threads for each job
+     * @param options The threads and the limits of the pipeline
+     * @return std::vector<std::exception_ptr> The error of each job, null if it succeeded
+     * @throw std::invalid_argument If the options are invalid
+     */
+    std::vector<std::exception_ptr> convertFiles(
+        std::span<const FileJob> jobs,
+        const FileTransform&     transform,
+        FilePipelineOptions      options = {}
+    ) noexcept(false);
+
+    // the instruction sets the encode and decode loops are compiled for, ordered from the least capable
+    // `Baseline` is what the library is compiled for: SSE2 on x86-64, NEON on AArch64
+    enum class Kernel : int
+    {
+        Baseline = 0,
+        SSE42    = 1,
+        AVX2     = 2,
+        AVX512   = 3,    // AVX-512 F, BW, VL and DQ
+    };
+
+    /**
+     * @brief Get the kernel used by encode and decode
+     *
+     * Picked on first use as the most capable kernel the CPU supports, unless set with `setKernel`.
+     *
+     * @return Kernel The active kernel
+     */
+    Kernel activeKernel() noexcept;
+
+    /**
+     * @brief Check whether a kernel is built in and can run on this CPU
+     *
+     * @param kernel The kernel to check
+     * @return bool True if `kernel` can be passed to `setKernel`
+     */
+    bool isKernelSupported(Kernel kernel) noexcept;
+
+    /**
+     * @brief Use the given kernel from now on, for all threads (e.g. to compare kernels or to test them)
+     *
+     * @param kernel The kernel to use
+     * @throw std::invalid_argument If the kernel is not supported
+     */
+    void setKernel(Kernel kernel) noexcept(false);
+
+    /**
+     * @brief Get a short name of a kernel for reports, like "avx2"
+     *
+     * @param kernel The kernel
+     * @return std::string_view The name of the kernel
+     */
+    std::string_view kernelName(Kernel kernel) noexcept;
+
+    // whether the library is built with the QOIPP_ENABLE_STATS option, `stats` is always empty otherwise
+#if defined(QOIPP_ENABLE_STATS)
+    inline constexpr bool statsEnabled = true;
+#else
+    inline constexpr bool statsEnabled = false;
+#endif
+
+    // the number of ops of each type, an op type's size is fixed so `m_bytes` only adds up to their sum
+    struct OpStats
+    {
+        std::size_t m_rgb       = 0;
+        std::size_t m_rgba      = 0;
+        std::size_t m_index     = 0;
+        std::size_t m_diff      = 0;
+        std::size_t m_luma      = 0;
+        std::size_t m_run       = 0;
+        std::size_t m_runPixels = 0;    // pixels covered by OP_RUN
+        std::size_t m_bytes     = 0;    // total size of the ops (header and end marker excluded)
+    };
+
+    // hardware counters are read with perf_event_open on Linux, `m_hardware` is false if they couldn't be
+    // opened (unsupported platform, perf_event_paranoid or containers) and only `m_nanoseconds` is set
+    struct PerfStats
+    {
+        std::uint64_t m_nanoseconds  = 0;
+        std::uint64_t m_cycles       = 0;
+        std::uint64_t m_instructions = 0;
+        std::uint64_t m_branchMisses = 0;
+        std::uint64_t m_cacheMisses  = 0;
+        bool          m_hardware     = false;
+    };
+
+    struct Stats
+    {
+        OpStats   m_encodeOps  = {};
+        OpStats   m_decodeOps  = {};
+        PerfStats m_encodePerf = {};
+        PerfStats m_decodePerf = {};
+    };
+
+    /**
+     * @brief Get the statistics recorded on the calling thread since the last reset
+     *
+     * Work done on other threads (striped encode/decode, batches) is recorded on those threads.
+     *
+     * @return Stats The statistics, all zero if the library is built without QOIPP_ENABLE_STATS
+     */
+    Stats stats() noexcept;
+
+    /**
+     * @brief Reset the statistics of the calling thread
+     */
+    void resetStats() noexcept;
+}
+
+#if defined(QOIPP_HEADER_ONLY)
+#    include "qoipp.cpp"
+#endif
 
 #endif /* end of include guard: QOIPP_HPP_O4A387W5ER6OW7E */
@@ -1,25 +1,84 @@
 #include "qoipp.hpp"
 
+#include <algorithm>
 #include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
 #include <concepts>
+#include <condition_variable>
 #include <cstddef>
 #include <cstdint>
 #include <cstring>
+#include <deque>
+#include <exception>
 #include <filesystem>
 #include <format>
 #include <fstream>
+#include <memory>
+#include <mutex>
 #include <ranges>
 #include <span>
 #include <stdexcept>
+#include <thread>
 #include <type_traits>
 #include <utility>
 #include <vector>
 
-namespace sv = std::views;
+#if defined(__SSE2__) || defined(_M_X64)
+#    include <immintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#    include <arm_neon.h>
+#endif
+
+#if defined(_WIN32)
+#    define WIN32_LEAN_AND_MEAN
+#    define NOMINMAX
+#    include <windows.h>
+#    define QOIPP_MMAP_WINDOWS
+#elif defined(__unix__) || defined(__APPLE__)
+#    include <cerrno>
+#    include <fcntl.h>
+#    include <sys/mman.h>
+#    include <sys/stat.h>
+#    include <unistd.h>
+#    define QOIPP_MMAP_POSIX
+#endif
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#    include <linux/io_uring.h>
+#    include <sys/eventfd.h>
+#    include <sys/syscall.h>
+#    define QOIPP_IO_URING
+#endif
+
+#if defined(QOIPP_ENABLE_STATS) && defined(__linux__)
+#    include <linux/perf_event.h>
+#    include <sys/syscall.h>
+#    include <unistd.h>
+#    define QOIPP_PERF_EVENTS
+#endif
+
+// the kernels above the baseline are compiled with target attributes and picked at runtime, see `Kernel`
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#    define QOIPP_KERNEL_DISPATCH
+#    define QOIPP_ISA_SSE42  "sse4.2,popcnt"
+#    define QOIPP_ISA_AVX2   "avx2,bmi,bmi2,popcnt"
+#    define QOIPP_ISA_AVX512 "avx512f,avx512bw,avx512vl,avx512dq,avx2,bmi,bmi2,popcnt"
+#endif
+
+// with QOIPP_HEADER_ONLY this file is included by qoipp.hpp, so the public definitions must be inline
+#if defined(QOIPP_HEADER_ONLY)
+#    define QOIPP_INLINE inline
+#else
+#    define QOIPP_INLINE
+#endif
 
 // utils ana aliases
 namespace qoipp
 {
+    namespace sv = std::views;
+
     using i8  = std::int8_t;
     using i16 = std::int16_t;
     using i32 = std::int32_t;
@@ -65,11 +124,10 @@ namespace qoipp
         if constexpr (std::endian::native == std::endian::big) {
             return value;
         } else {
-            T result  = 0;
-            result   |= (value & 0x000000FF) << 24;
-            result   |= (value & 0x0000FF00) << 8;
-            result   |= (value & 0x00FF0000) >> 8;
-            result   |= (value & 0xFF000000) >> 24;
+            T result = 0;
+            for (usize i = 0; i < sizeof(T); ++i) {
+                result = static_cast<T>((result << 8) | ((value >> (i * 8)) & 0xFF));
+            }
             return result;
         }
     }
@@ -115,6 +173,18 @@ namespace qoipp::constants
     constexpr i8 maxLumaRB    = 7;
 
     constexpr Pixel start = { 0x00, 0x00, 0x00, 0xFF };
+
+    // the stripe table written after the end marker by the striped encoder ends with this
+    constexpr std::array<char, 4> stripeMagic       = { 'q', 'o', 'i', 's' };
+    constexpr usize               stripeTrailerSize = 12;    // stripe count, stripe height and magic
+
+    // the sidecar or chunk after the end marker written by `indexRows` ends with this
+    constexpr std::array<char, 4> rowIndexMagic       = { 'q', 'o', 'i', 'r' };
+    constexpr usize               rowIndexTrailerSize = 28;     // width, height, end, interval, count, magic
+    constexpr usize               checkpointSize      = 272;    // offset, run, previous and seen pixels
+
+    // the delta frames written by `SequenceEncoder` end with this after the end marker
+    constexpr std::array<char, 4> deltaFrameMagic = { 'q', 'o', 'i', 'd' };
 }
 
 namespace qoipp::data
@@ -127,14 +197,43 @@ namespace qoipp::data
     // clang-format on
 
     template <typename T>
-    concept DataChunkVec = DataChunk<T, ByteVec>;
+    concept DataChunkSpan = DataChunk<T, std::span<Byte>>;
+
+    inline void write32(std::span<Byte> out, usize& index, u32 value) noexcept
+    {
+        out[index++] = static_cast<Byte>((value >> 24) & 0xFF);
+        out[index++] = static_cast<Byte>((value >> 16) & 0xFF);
+        out[index++] = static_cast<Byte>((value >> 8) & 0xFF);
+        out[index++] = static_cast<Byte>(value & 0xFF);
+    }
+
+    inline void write64(std::span<Byte> out, usize& index, u64 value) noexcept
+    {
+        write32(out, index, static_cast<u32>(value >> 32));
+        write32(out, index, static_cast<u32>(value & 0xFFFF'FFFF));
+    }
+
+    // the hot chunks (ops and the end marker) are also written through a raw cursor, a single memcpy of the
+    // bytes lets the compiler emit one store for all of them instead of a store per byte
+    template <typename T>
+    concept CursorChunk = requires(const T t, Byte*& cursor) {
+        { t.write(cursor) } noexcept -> std::same_as<void>;
+    };
+
+    template <usize N>
+    inline void put(Byte*& cursor, const std::array<u8, N>& bytes) noexcept
+    {
+        std::memcpy(cursor, bytes.data(), N);
+        cursor += N;
+    }
 
-    inline void write32(ByteVec& vec, usize& index, u32 value) noexcept
+    // the span interface of a chunk written through a cursor
+    template <CursorChunk T>
+    inline void writeSpan(const T& chunk, std::span<Byte> out, usize& index) noexcept
     {
-        vec[index++] = static_cast<Byte>((value >> 24) & 0xFF);
-        vec[index++] = static_cast<Byte>((value >> 16) & 0xFF);
-        vec[index++] = static_cast<Byte>((value >> 8) & 0xFF);
-        vec[index++] = static_cast<Byte>(value & 0xFF);
+        auto* cursor = out.data() + index;
+        chunk.write(cursor);
+        index = static_cast<usize>(cursor - out.data());
     }
 
     struct QoiHeader
@@ -146,31 +245,105 @@ namespace qoipp::data
         u8  m_channels;
         u8  m_colorspace;
 
-        void write(ByteVec& vec, usize& index) const noexcept
+        void write(std::span<Byte> out, usize& index) const noexcept
         {
             for (char c : m_magic) {
-                vec[index++] = static_cast<Byte>(c);
+                out[index++] = static_cast<Byte>(c);
             }
 
-            write32(vec, index, m_width);
-            write32(vec, index, m_height);
+            write32(out, index, m_width);
+            write32(out, index, m_height);
 
-            vec[index++] = static_cast<Byte>(m_channels);
-            vec[index++] = static_cast<Byte>(m_colorspace);
+            out[index++] = static_cast<Byte>(m_channels);
+            out[index++] = static_cast<Byte>(m_colorspace);
         }
     };
-    static_assert(DataChunkVec<QoiHeader>);
+    static_assert(DataChunkSpan<QoiHeader>);
 
     struct EndMarker
     {
-        static void write(ByteVec& vec, usize& index) noexcept
+        static void write(Byte*& cursor) noexcept
+        {
+            std::memcpy(cursor, constants::endMarker.data(), constants::endMarker.size());
+            cursor += constants::endMarker.size();
+        }
+
+        static void write(std::span<Byte> out, usize& index) noexcept { writeSpan(EndMarker{}, out, index); }
+    };
+    static_assert(DataChunkSpan<EndMarker> and CursorChunk<EndMarker>);
+
+    // offset of the first op of each stripe followed by the stripe count, the stripe height, and the magic
+    struct StripeTrailer
+    {
+        std::span<const u64> m_offsets;
+        u32                  m_stripeHeight;
+
+        void write(std::span<Byte> out, usize& index) const noexcept
+        {
+            for (auto offset : m_offsets) {
+                write64(out, index, offset);
+            }
+
+            write32(out, index, static_cast<u32>(m_offsets.size()));
+            write32(out, index, m_stripeHeight);
+
+            for (char c : constants::stripeMagic) {
+                out[index++] = static_cast<Byte>(c);
+            }
+        }
+    };
+    static_assert(DataChunkSpan<StripeTrailer>);
+
+    // the decoder state at the first pixel of a row, the seen pixels are stored in their hash order
+    struct RowCheckpoint
+    {
+        using SeenPixels = std::span<const Pixel, constants::runningArraySize>;
+
+        u64        m_offset;    // of the next op to read
+        u32        m_run;       // pixels of the run before `m_offset` left for the row and the ones after
+        Pixel      m_prevPixel;
+        SeenPixels m_seenPixels;
+
+        void write(std::span<Byte> out, usize& index) const noexcept
+        {
+            write64(out, index, m_offset);
+            write32(out, index, m_run);
+
+            std::memcpy(out.data() + index, &m_prevPixel, sizeof(Pixel));
+            index += sizeof(Pixel);
+
+            for (auto pixel : m_seenPixels) {
+                std::memcpy(out.data() + index, &pixel, sizeof(Pixel));
+                index += sizeof(Pixel);
+            }
+        }
+    };
+    static_assert(DataChunkSpan<RowCheckpoint>);
+    static_assert(constants::checkpointSize == 12 + sizeof(Pixel) * (1 + constants::runningArraySize));
+
+    // follows the checkpoints, `m_end` is the offset of the end marker of the image the index is for
+    struct RowIndexTrailer
+    {
+        u32 m_width;
+        u32 m_height;
+        u64 m_end;
+        u32 m_interval;
+        u32 m_count;
+
+        void write(std::span<Byte> out, usize& index) const noexcept
         {
-            for (auto byte : constants::endMarker) {
-                vec[index++] = byte;
+            write32(out, index, m_width);
+            write32(out, index, m_height);
+            write64(out, index, m_end);
+            write32(out, index, m_interval);
+            write32(out, index, m_count);
+
+            for (char c : constants::rowIndexMagic) {
+                out[index++] = static_cast<Byte>(c);
             }
         }
     };
-    static_assert(DataChunkVec<EndMarker>);
+    static_assert(DataChunkSpan<RowIndexTrailer>);
 
     namespace op
     {
@@ -190,15 +363,10 @@ namespace qoipp::data
             u8 m_g = 0;
             u8 m_b = 0;
 
-            void write(ByteVec& vec, usize& index) const noexcept
-            {
-                vec[index++] = static_cast<Byte>(OP_RGB);
-                vec[index++] = static_cast<Byte>(m_r);
-                vec[index++] = static_cast<Byte>(m_g);
-                vec[index++] = static_cast<Byte>(m_b);
-            }
+            void write(Byte*& cursor) const noexcept { put<4>(cursor, { OP_RGB, m_r, m_g, m_b }); }
+            void write(std::span<Byte> out, usize& index) const noexcept { writeSpan(*this, out, index); }
         };
-        static_assert(DataChunkVec<Rgb>);
+        static_assert(DataChunkSpan<Rgb> and CursorChunk<Rgb>);
 
         struct Rgba
         {
@@ -207,27 +375,19 @@ namespace qoipp::data
             u8 m_b = 0;
             u8 m_a = 0;
 
-            void write(ByteVec& vec, usize& index) const noexcept
-            {
-                vec[index++] = static_cast<Byte>(OP_RGBA);
-                vec[index++] = static_cast<Byte>(m_r);
-                vec[index++] = static_cast<Byte>(m_g);
-                vec[index++] = static_cast<Byte>(m_b);
-                vec[index++] = static_cast<Byte>(m_a);
-            }
+            void write(Byte*& cursor) const noexcept { put<5>(cursor, { OP_RGBA, m_r, m_g, m_b, m_a }); }
+            void write(std::span<Byte> out, usize& index) const noexcept { writeSpan(*this, out, index); }
         };
-        static_assert(DataChunkVec<Rgba>);
+        static_assert(DataChunkSpan<Rgba> and CursorChunk<Rgba>);
 
         struct Index
         {
             u32 m_index = 0;
 
-            void write(ByteVec& vec, usize& index) const noexcept
-            {
-                vec[index++] = static_cast<Byte>(OP_INDEX | m_index);
-            }
+            void write(Byte*& cursor) const noexcept { *cursor++ = static_cast<Byte>(OP_INDEX | m_index); }
+            void write(std::span<Byte> out, usize& index) const noexcept { writeSpan(*this, out, index); }
         };
-        static_assert(DataChunkVec<Index>);
+        static_assert(DataChunkSpan<Index> and CursorChunk<Index>);
 
         struct Diff
         {
@@ -235,16 +395,18 @@ namespace qoipp::data
             i8 m_dg = 0;
             i8 m_db = 0;
 
-            void write(ByteVec& vec, usize& index) const noexcept
+            void write(Byte*& cursor) const noexcept
             {
                 constexpr auto bias = constants::biasOpDiff;
 
-                vec[index++] = static_cast<Byte>(
+                *cursor++ = static_cast<Byte>(
                     OP_DIFF | (m_dr + bias) << 4 | (m_dg + bias) << 2 | (m_db + bias)
                 );
             }
+
+            void write(std::span<Byte> out, usize& index) const noexcept { writeSpan(*this, out, index); }
         };
-        static_assert(DataChunkVec<Diff>);
+        static_assert(DataChunkSpan<Diff> and CursorChunk<Diff>);
 
         struct Luma
         {
@@ -252,27 +414,33 @@ namespace qoipp::data
             i8 m_dr_dg = 0;
             i8 m_db_dg = 0;
 
-            void write(ByteVec& vec, usize& index) const noexcept
+            void write(Byte*& cursor) const noexcept
             {
                 constexpr auto biasG  = constants::biasOpLumaG;
                 constexpr auto biasRB = constants::biasOpLumaRB;
 
-                vec[index++] = static_cast<Byte>(OP_LUMA | (m_dg + biasG));
-                vec[index++] = static_cast<Byte>((m_dr_dg + biasRB) << 4 | (m_db_dg + biasRB));
+                put<2>(cursor, {
+                    static_cast<u8>(OP_LUMA | (m_dg + biasG)),
+                    static_cast<u8>((m_dr_dg + biasRB) << 4 | (m_db_dg + biasRB)),
+                });
             }
+
+            void write(std::span<Byte> out, usize& index) const noexcept { writeSpan(*this, out, index); }
         };
-        static_assert(DataChunkVec<Luma>);
+        static_assert(DataChunkSpan<Luma> and CursorChunk<Luma>);
 
         struct Run
         {
             i8 m_run = 0;
 
-            void write(ByteVec& vec, usize& index) const noexcept
+            void write(Byte*& cursor) const noexcept
             {
-                vec[index++] = static_cast<Byte>(OP_RUN | (m_run + constants::biasOpRun));
+                *cursor++ = static_cast<Byte>(OP_RUN | (m_run + constants::biasOpRun));
             }
+
+            void write(std::span<Byte> out, usize& index) const noexcept { writeSpan(*this, out, index); }
         };
-        static_assert(DataChunkVec<Run>);
+        static_assert(DataChunkSpan<Run> and CursorChunk<Run>);
 
         template <typename T>
         concept Op = AnyOf<T, Rgb, Rgba, Index, Diff, Luma, Run>;
@@ -293,48 +461,365 @@ namespace qoipp::data
     }
 }
 
+// statistics, see `qoipp::stats`: without QOIPP_ENABLE_STATS nothing here is ever called or compiled in
+namespace qoipp::impl
+{
+    inline Stats& threadStats() noexcept
+    {
+        thread_local Stats stats;
+        return stats;
+    }
+
+    template <data::op::Op T>
+    void countOp(OpStats& ops, const T& op, usize bytes) noexcept
+    {
+        ops.m_bytes += bytes;
+
+        if constexpr (std::same_as<T, data::op::Rgb>) {
+            ++ops.m_rgb;
+        } else if constexpr (std::same_as<T, data::op::Rgba>) {
+            ++ops.m_rgba;
+        } else if constexpr (std::same_as<T, data::op::Index>) {
+            ++ops.m_index;
+        } else if constexpr (std::same_as<T, data::op::Diff>) {
+            ++ops.m_diff;
+        } else if constexpr (std::same_as<T, data::op::Luma>) {
+            ++ops.m_luma;
+        } else {
+            ++ops.m_run;
+            ops.m_runPixels += static_cast<usize>(op.m_run);
+        }
+    }
+
+#if defined(QOIPP_PERF_EVENTS)
+    // a group of user space hardware counters for the calling thread, opened on first use and kept open
+    class PerfCounters
+    {
+    public:
+        static constexpr usize count = 4;    // cycles, instructions, branch misses, cache misses
+        using Values                 = std::array<u64, count>;
+
+        static PerfCounters& get() noexcept
+        {
+            thread_local PerfCounters counters;
+            return counters;
+        }
+
+        PerfCounters(const PerfCounters&)            = delete;
+        PerfCounters& operator=(const PerfCounters&) = delete;
+
+        ~PerfCounters() { closeAll(); }
+
+        bool read(Values& values) const noexcept
+        {
+            if (m_fds[0] < 0) {
+                return false;
+            }
+
+            struct
+            {
+                u64 m_nr;
+                u64 m_values[count];
+            } group;
+
+            const auto size = ::read(m_fds[0], &group, sizeof(group));
+            if (size != static_cast<isize>(sizeof(group)) || group.m_nr != count) {
+                return false;
+            }
+
+            std::copy_n(group.m_values, count, values.begin());
+            return true;
+        }
+
+    private:
+        PerfCounters() noexcept
+        {
+            constexpr std::array<u64, count> configs = {
+                PERF_COUNT_HW_CPU_CYCLES,
+                PERF_COUNT_HW_INSTRUCTIONS,
+                PERF_COUNT_HW_BRANCH_MISSES,
+                PERF_COUNT_HW_CACHE_MISSES,
+            };
+
+            for (usize i = 0; i < count; ++i) {
+                perf_event_attr attr = {};
+
+                attr.type           = PERF_TYPE_HARDWARE;
+                attr.size           = sizeof(attr);
+                attr.config         = configs[i];
+                attr.read_format    = PERF_FORMAT_GROUP;
+                attr.exclude_kernel = 1;
+                attr.exclude_hv     = 1;
+
+                const int leader = i == 0 ? -1 : m_fds[0];
+                m_fds[i]         = static_cast<int>(::syscall(SYS_perf_event_open, &attr, 0, -1, leader, 0));
+
+                // all or nothing, a partial group would make the counters ambiguous
+                if (m_fds[i] < 0) {
+                    closeAll();
+                    return;
+                }
+            }
+        }
+
+        void closeAll() noexcept
+        {
+            for (auto& fd : m_fds) {
+                if (fd >= 0) {
+                    ::close(fd);
+                }
+                fd = -1;
+            }
+        }
+
+        std::array<int, count> m_fds = { -1, -1, -1, -1 };
+    };
+#endif
+
+#if defined(QOIPP_ENABLE_STATS)
+    // adds the time and hardware counters spent in its scope to `target` of the calling thread's stats
+    class PerfScope
+    {
+    public:
+        using Clock = std::chrono::steady_clock;
+
+        explicit PerfScope(PerfStats Stats::* target) noexcept
+            : m_target{ target }
+        {
+#    if defined(QOIPP_PERF_EVENTS)
+            m_hardware = PerfCounters::get().read(m_counters);
+#    endif
+            m_start = Clock::now();
+        }
+
+        PerfScope(const PerfScope&)            = delete;
+        PerfScope& operator=(const PerfScope&) = delete;
+
+        ~PerfScope()
+        {
+            const auto elapsed = Clock::now() - m_start;
+            auto&      perf    = threadStats().*m_target;
+
+            perf.m_nanoseconds += static_cast<u64>(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()
+            );
+
+#    if defined(QOIPP_PERF_EVENTS)
+            PerfCounters::Values end;
+            if (m_hardware && PerfCounters::get().read(end)) {
+                perf.m_cycles       += end[0] - m_counters[0];
+                perf.m_instructions += end[1] - m_counters[1];
+                perf.m_branchMisses += end[2] - m_counters[2];
+                perf.m_cacheMisses  += end[3] - m_counters[3];
+                perf.m_hardware      = true;
+            }
+#    endif
+        }
+
+    private:
+        PerfStats Stats::* m_target;
+        Clock::time_point  m_start;
+#    if defined(QOIPP_PERF_EVENTS)
+        PerfCounters::Values m_counters = {};
+        bool                 m_hardware = false;
+#    endif
+    };
+#else
+    struct PerfScope
+    {
+        explicit PerfScope(PerfStats Stats::*) noexcept { }
+    };
+#endif
+}
+
+namespace qoipp::impl
+{
+    // the most capable kernel the CPU supports, this also checks that the OS saves the vector registers
+    inline Kernel detectKernel() noexcept
+    {
+#if defined(QOIPP_KERNEL_DISPATCH)
+        __builtin_cpu_init();
+
+        const bool sse42 = __builtin_cpu_supports("sse4.2") && __builtin_cpu_supports("popcnt");
+        const bool avx2  = sse42 && __builtin_cpu_supports("avx2") && __builtin_cpu_supports("bmi")
+                       && __builtin_cpu_supports("bmi2");
+        const bool avx512 = avx2 && __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw")
+                         && __builtin_cpu_supports("avx512vl") && __builtin_cpu_supports("avx512dq");
+
+        if (avx512) {
+            return Kernel::AVX512;
+        } else if (avx2) {
+            return Kernel::AVX2;
+        } else if (sse42) {
+            return Kernel::SSE42;
+        }
+#endif
+        return Kernel::Baseline;
+    }
+
+    inline Kernel supportedKernel() noexcept
+    {
+        static const Kernel kernel = detectKernel();
+        return kernel;
+    }
+
+    inline std::atomic<Kernel>& kernelSetting() noexcept
+    {
+        static std::atomic<Kernel> kernel = supportedKernel();
+        return kernel;
+    }
+}
+
 namespace qoipp::impl
 {
     using RunningArray = std::array<Pixel, constants::runningArraySize>;
 
+    // the emitter of the encoder: a cursor into a buffer that is sized for the worst case up front, so no
+    // chunk written through it needs a bounds check; a vector or a sink is written to through such a buffer
     class DataChunkArray
     {
     public:
-        DataChunkArray(usize size)
-            : m_bytes(size)
+        DataChunkArray(std::span<Byte> bytes)
+            : m_bytes{ bytes }
+            , m_cursor{ bytes.data() }
         {
         }
 
         template <typename T>
-            requires(data::op::Op<T> or AnyOf<T, data::QoiHeader, data::EndMarker>)
+            requires(data::op::Op<T> or AnyOf<T, data::QoiHeader, data::EndMarker, data::StripeTrailer>)
         void push(T&& t) noexcept
         {
-            t.write(m_bytes, m_index);
-        }
+            [[maybe_unused]] const auto start = m_cursor;
 
-        ByteVec get() noexcept
-        {
-            m_bytes.resize(m_index);
-            return std::exchange(m_bytes, {});
+            if constexpr (data::CursorChunk<std::remove_cvref_t<T>>) {
+                t.write(m_cursor);
+            } else {
+                auto index = size();
+                t.write(m_bytes, index);
+                m_cursor = m_bytes.data() + index;
+            }
+
+            if constexpr (statsEnabled && data::op::Op<std::remove_cvref_t<T>>) {
+                countOp(threadStats().m_encodeOps, t, static_cast<usize>(m_cursor - start));
+            }
         }
 
+        usize size() const noexcept { return static_cast<usize>(m_cursor - m_bytes.data()); }
+
     private:
-        ByteVec m_bytes;
-        usize   m_index = 0;
+        std::span<Byte> m_bytes;
+        Byte*           m_cursor;
     };
 
-    template <Channels Chan>
+#if defined(QOIPP_KERNEL_DISPATCH)
+    // the AVX2 part of `PixelWriter::fill` for RGBA, returns the end of the bytes written; RGB runs are too
+    // short on average to pay for setting up a wider repeating pattern than the SSE2 one
+    [[gnu::target(QOIPP_ISA_AVX2)]] inline Byte* fillAvx2(Byte* dest, const Byte* end, u32 value) noexcept
+    {
+        const auto pattern = _mm256_set1_epi32(static_cast<i32>(value));
+        for (; end - dest >= 32; dest += 32) {
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dest), pattern);
+        }
+        return dest;
+    }
+#endif
+
+    // `Opaque` writes every pixel with alpha 255, for expanding RGB images into RGBA buffers
+    // `K` is the kernel the writer is compiled into, see `encodeKernel` and `decodeKernel`
+    template <Channels Chan, bool Opaque = false, Kernel K = Kernel::Baseline>
     struct PixelWriter
     {
         std::span<Byte> m_dest;
 
+        // the pixel as the bytes to be written, setting the alpha in a register instead of through memory
+        // avoids a store forwarding stall on the write that follows
+        static u32 bytes(const Pixel& pixel) noexcept
+        {
+            constexpr u32 alpha = std::endian::native == std::endian::little ? 0xFF00'0000 : 0x0000'00FF;
+
+            auto value = std::bit_cast<u32>(pixel);
+            if constexpr (Opaque) {
+                value |= alpha;
+            }
+            return value;
+        }
+
         void operator()(usize index, const Pixel& pixel) noexcept
         {
             const usize dataIndex = index * static_cast<usize>(Chan);
+            const auto  value     = bytes(pixel);
+
             if constexpr (Chan == Channels::RGB) {
-                std::memcpy(m_dest.data() + dataIndex, &pixel, 3);
+                // a single 4 byte store is cheaper than a 3 byte one, the extra byte is overwritten by the
+                // next pixel; only the last pixel in the buffer needs to be written exactly
+                if (dataIndex + 4 <= m_dest.size()) [[likely]] {
+                    std::memcpy(m_dest.data() + dataIndex, &value, 4);
+                } else {
+                    std::memcpy(m_dest.data() + dataIndex, &value, 3);
+                }
+            } else {
+                std::memcpy(m_dest.data() + dataIndex, &value, 4);
+            }
+        }
+
+        // write `count` copies of `pixel` starting from `index`
+        void fill(usize index, usize count, const Pixel& pixel) noexcept
+        {
+            constexpr auto channels = static_cast<usize>(Chan);
+
+            const auto  value = bytes(pixel);
+            auto*       dest  = m_dest.data() + index * channels;
+            const auto* end   = dest + count * channels;
+
+#if defined(QOIPP_KERNEL_DISPATCH)
+            if constexpr (K >= Kernel::AVX2 && Chan == Channels::RGBA) {
+                dest = fillAvx2(dest, end, value);
+            }
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64)
+            if constexpr (Chan == Channels::RGBA) {
+                const auto pattern = _mm_set1_epi32(static_cast<i32>(value));
+                for (; end - dest >= 16; dest += 16) {
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(dest), pattern);
+                }
+            } else if (end - dest >= 48) {
+                // 16 RGB pixels span exactly three vectors
+                ByteArr<48> pattern;
+                for (usize i = 0; i < pattern.size(); i += 3) {
+                    std::memcpy(pattern.data() + i, &value, 3);
+                }
+
+                const auto* vectors  = reinterpret_cast<const __m128i*>(pattern.data());
+                const auto  pattern0 = _mm_loadu_si128(vectors + 0);
+                const auto  pattern1 = _mm_loadu_si128(vectors + 1);
+                const auto  pattern2 = _mm_loadu_si128(vectors + 2);
+                for (; end - dest >= 48; dest += 48) {
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(dest) + 0, pattern0);
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(dest) + 1, pattern1);
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(dest) + 2, pattern2);
+                }
+            }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+            if constexpr (Chan == Channels::RGBA) {
+                const auto pattern = vdupq_n_u32(value);
+                for (; end - dest >= 16; dest += 16) {
+                    vst1q_u32(reinterpret_cast<u32*>(dest), pattern);
+                }
             } else {
-                std::memcpy(m_dest.data() + dataIndex, &pixel, 4);
+                const auto pattern = uint8x16x3_t{ {
+                    vdupq_n_u8(pixel.m_r),
+                    vdupq_n_u8(pixel.m_g),
+                    vdupq_n_u8(pixel.m_b),
+                } };
+                for (; end - dest >= 48; dest += 48) {
+                    vst3q_u8(reinterpret_cast<u8*>(dest), pattern);
+                }
+            }
+#endif
+
+            for (; dest < end; dest += channels) {
+                std::memcpy(dest, &value, channels);
             }
         }
     };
@@ -366,42 +851,225 @@ namespace qoipp::impl
         return (r * 3 + g * 5 + b * 7 + a * 11);
     }
 
-    template <Channels Chan>
-    ByteVec encode(std::span<const Byte> data, u32 width, u32 height, bool srgb)
+    constexpr usize maxEncodedSize(usize width, usize height, Channels channels) noexcept
     {
         // worst possible scenario is when no data is compressed + header + endMarker + tag (rgb/rgba)
-        const usize maxSize = width * height * (static_cast<usize>(Chan) + 1) + constants::headerSize
-                            + constants::endMarker.size();
+        return width * height * (static_cast<usize>(channels) + 1) + constants::headerSize
+             + constants::endMarker.size();
+    }
 
-        DataChunkArray chunks{ maxSize };    // the encoded data goes here
-        RunningArray   seenPixels{};
-        seenPixels.fill({ 0x00, 0x00, 0x00, 0x00 });
+    constexpr usize decodedSize(usize width, usize height, Channels channels) noexcept
+    {
+        return width * height * static_cast<usize>(channels);
+    }
 
-        chunks.push(data::QoiHeader{
-            .m_width      = width,
-            .m_height     = height,
-            .m_channels   = static_cast<u8>(Chan),
-            .m_colorspace = static_cast<u8>(srgb ? 0 : 1),
-        });
+    // RGB pixels don't line up with the vector lanes, so they are compared against a repeating pattern of the
+    // pixel bytes, advancing by the largest whole number of pixels that fits in a vector
+    template <usize N>
+    std::array<u8, N> rgbPattern(Pixel pixel) noexcept
+    {
+        std::array<u8, N> bytes;
+        for (usize i = 0; i < N; ++i) {
+            bytes[i] = i % 3 == 0 ? pixel.m_r : i % 3 == 1 ? pixel.m_g : pixel.m_b;
+        }
+        return bytes;
+    }
+
+#if defined(QOIPP_KERNEL_DISPATCH)
+    // the AVX2 and AVX-512 parts of `runLength`, continuing from `index`: return the index of the first pixel
+    // not equal to `pixel` or the index where there are not enough pixels left for a vector
+    template <Channels Chan>
+    [[gnu::target(QOIPP_ISA_AVX2)]] usize runLengthAvx2(
+        const Byte* data,
+        usize       count,
+        Pixel       pixel,
+        usize       index
+    ) noexcept
+    {
+        if constexpr (Chan == Channels::RGBA) {
+            const auto needle = _mm256_set1_epi32(std::bit_cast<i32>(pixel));
+            for (; index + 8 <= count; index += 8) {
+                const auto chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + index * 4));
+                const auto mask  = static_cast<u32>(_mm256_movemask_epi8(_mm256_cmpeq_epi32(chunk, needle)));
+                if (mask != 0xFFFF'FFFF) {
+                    return index + static_cast<usize>(std::countr_one(mask)) / 4;
+                }
+            }
+        } else {
+            const auto bytes  = rgbPattern<32>(pixel);
+            const auto needle = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(bytes.data()));
+            for (; (count - index) * 3 >= 32; index += 10) {
+                const auto chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + index * 3));
+                const auto mask  = static_cast<u32>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, needle)));
+                if (const auto equal = static_cast<usize>(std::countr_one(mask)); equal < 30) {
+                    return index + equal / 3;
+                }
+            }
+        }
+        return index;
+    }
+
+    template <Channels Chan>
+    [[gnu::target(QOIPP_ISA_AVX512)]] usize runLengthAvx512(
+        const Byte* data,
+        usize       count,
+        Pixel       pixel,
+        usize       index
+    ) noexcept
+    {
+        if constexpr (Chan == Channels::RGBA) {
+            const auto needle = _mm512_set1_epi32(std::bit_cast<i32>(pixel));
+            for (; index + 16 <= count; index += 16) {
+                const auto chunk = _mm512_loadu_si512(data + index * 4);
+                const auto mask  = static_cast<u32>(_mm512_cmpeq_epi32_mask(chunk, needle));
+                if (mask != 0xFFFF) {
+                    return index + static_cast<usize>(std::countr_one(mask));
+                }
+            }
+        } else {
+            const auto bytes  = rgbPattern<64>(pixel);
+            const auto needle = _mm512_loadu_si512(bytes.data());
+            for (; (count - index) * 3 >= 64; index += 21) {
+                const auto chunk = _mm512_loadu_si512(data + index * 3);
+                const auto mask  = static_cast<u64>(_mm512_cmpeq_epi8_mask(chunk, needle));
+                if (const auto equal = static_cast<usize>(std::countr_one(mask)); equal < 63) {
+                    return index + equal / 3;
+                }
+            }
+        }
+        return index;
+    }
+#endif
+
+    // get the number of leading pixels in `data` (which holds `count` pixels) that are equal to `pixel`
+    template <Channels Chan, Kernel K = Kernel::Baseline>
+    usize runLength(const Byte* data, usize count, Pixel pixel) noexcept
+    {
+        constexpr auto channels = static_cast<usize>(Chan);
+
+        // most runs are short, check a few pixels one at a time before paying for the vector setup
+        constexpr usize scalarPrefix = 8;
+
+        usize index = 0;
+        for (; index < std::min(count, scalarPrefix); ++index) {
+            if (std::memcmp(data + index * channels, &pixel, channels) != 0) {
+                return index;
+            }
+        }
+
+        // the wider loops stop at a mismatch, which the loops below then find again right away
+#if defined(QOIPP_KERNEL_DISPATCH)
+        if constexpr (K >= Kernel::AVX512) {
+            index = runLengthAvx512<Chan>(data, count, pixel, index);
+        }
+        if constexpr (K >= Kernel::AVX2) {
+            index = runLengthAvx2<Chan>(data, count, pixel, index);
+        }
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64)
+        if constexpr (Chan == Channels::RGBA) {
+            const auto needle = _mm_set1_epi32(std::bit_cast<i32>(pixel));
+            for (; index + 4 <= count; index += 4) {
+                const auto chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + index * 4));
+                const auto mask  = static_cast<u32>(_mm_movemask_epi8(_mm_cmpeq_epi32(chunk, needle)));
+                if (mask != 0xFFFF) {
+                    return index + static_cast<usize>(std::countr_one(mask)) / 4;
+                }
+            }
+        } else {
+            const auto bytes  = rgbPattern<16>(pixel);
+            const auto needle = _mm_loadu_si128(reinterpret_cast<const __m128i*>(bytes.data()));
+            for (; (count - index) * 3 >= 16; index += 5) {
+                const auto chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + index * 3));
+                const auto mask  = static_cast<u32>(_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, needle)));
+                if (const auto equal = static_cast<usize>(std::countr_one(mask)); equal < 15) {
+                    return index + equal / 3;
+                }
+            }
+        }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+        // on a mismatch the scalar loop below finds the exact pixel
+        if constexpr (Chan == Channels::RGBA) {
+            const auto needle = vdupq_n_u32(std::bit_cast<u32>(pixel));
+            for (; index + 4 <= count; index += 4) {
+                const auto chunk = vld1q_u32(reinterpret_cast<const u32*>(data + index * 4));
+                if (vminvq_u32(vceqq_u32(chunk, needle)) == 0) {
+                    break;
+                }
+            }
+        } else {
+            const auto r = vdupq_n_u8(pixel.m_r);
+            const auto g = vdupq_n_u8(pixel.m_g);
+            const auto b = vdupq_n_u8(pixel.m_b);
+            for (; index + 16 <= count; index += 16) {
+                const auto chunk = vld3q_u8(reinterpret_cast<const u8*>(data + index * 3));
+                const auto equal = vandq_u8(
+                    vandq_u8(vceqq_u8(chunk.val[0], r), vceqq_u8(chunk.val[1], g)), vceqq_u8(chunk.val[2], b)
+                );
+                if (vminvq_u8(equal) == 0) {
+                    break;
+                }
+            }
+        }
+#endif
+
+        for (; index < count; ++index) {
+            if (std::memcmp(data + index * channels, &pixel, channels) != 0) {
+                return index;
+            }
+        }
+
+        return count;
+    }
+
+    struct EncodeState
+    {
+        RunningArray m_seenPixels = {};
+        Pixel        m_prevPixel  = constants::start;
+        i32          m_run        = 0;
+    };
+
+    // encode the pixels in `data` continuing from `state`, the pending run is flushed if `last` is true
+    template <Channels Chan, Kernel K, Effort E = Effort::Default>
+    void encodeKernel(
+        EncodeState&          state,
+        DataChunkArray&       chunks,
+        std::span<const Byte> data,
+        bool                  last
+    ) noexcept
+    {
+        auto& [seenPixels, prevPixel, run] = state;
+
+        constexpr auto channels = static_cast<usize>(Chan);
 
         PixelReader<Chan> reader{ data };
 
-        auto prevPixel = constants::start;
-        auto currPixel = constants::start;
-        i32  run       = 0;
+        auto currPixel = prevPixel;
 
-        for (const auto pixelIndex : sv::iota(0u, static_cast<usize>(width * height))) {
+        const usize count = data.size() / channels;
+        for (usize pixelIndex = 0; pixelIndex < count; ++pixelIndex) {
             reader(currPixel, pixelIndex);
 
             if (prevPixel == currPixel) {
-                run++;
+                // scan for the end of the run at once instead of going through the pixel reader
+                const auto next   = pixelIndex + 1;
+                const auto rest   = data.data() + next * channels;
+                const auto length = 1 + runLength<Chan, K>(rest, count - next, prevPixel);
+                const auto total  = static_cast<usize>(run) + length;
 
-                const bool runLimit  = run == constants::runLimit;
-                const bool lastPixel = pixelIndex == static_cast<usize>(width * height) - 1;
-                if (runLimit || lastPixel) {
-                    chunks.push(data::op::Run{ .m_run = static_cast<i8>(run) });
-                    run = 0;
+                for (auto full = total / constants::runLimit; full-- > 0;) {
+                    chunks.push(data::op::Run{ .m_run = constants::runLimit });
+                }
+
+                run         = static_cast<i32>(total % constants::runLimit);
+                pixelIndex += length - 1;
+
+                // the decoder indexes every pixel, the start pixel included when the image begins with a run
+                if constexpr (E == Effort::Best) {
+                    seenPixels[hash(prevPixel) % constants::runningArraySize] = prevPixel;
                 }
+                continue;
             } else {
                 if (run > 0) {
                     // ends of OP_RUN
@@ -409,13 +1077,15 @@ namespace qoipp::impl
                     run = 0;
                 }
 
-                const u8 index = hash(currPixel) % constants::runningArraySize;
+                const u8 index = E == Effort::Fast ? 0 : hash(currPixel) % constants::runningArraySize;
 
                 // OP_INDEX
-                if (seenPixels[index] == currPixel) {
+                if (E != Effort::Fast && seenPixels[index] == currPixel) {
                     chunks.push(data::op::Index{ .m_index = index });
                 } else {
-                    seenPixels[index] = currPixel;
+                    if constexpr (E != Effort::Fast) {
+                        seenPixels[index] = currPixel;
+                    }
 
                     if constexpr (Chan == Channels::RGBA) {
                         if (prevPixel.m_a != currPixel.m_a) {
@@ -466,163 +1136,629 @@ namespace qoipp::impl
             prevPixel = currPixel;
         }
 
+        if (last && run > 0) {
+            chunks.push(data::op::Run{ .m_run = static_cast<i8>(run) });
+            run = 0;
+        }
+    }
+
+#if defined(QOIPP_KERNEL_DISPATCH)
+    // everything the kernels call is inlined into these (flatten), so the whole loop is compiled for the ISA
+    template <Channels Chan, Effort E>
+    [[gnu::target(QOIPP_ISA_SSE42), gnu::flatten]] void encodeSse42(
+        EncodeState&          state,
+        DataChunkArray&       chunks,
+        std::span<const Byte> data,
+        bool                  last
+    ) noexcept
+    {
+        encodeKernel<Chan, Kernel::SSE42, E>(state, chunks, data, last);
+    }
+
+    template <Channels Chan, Effort E>
+    [[gnu::target(QOIPP_ISA_AVX2), gnu::flatten]] void encodeAvx2(
+        EncodeState&          state,
+        DataChunkArray&       chunks,
+        std::span<const Byte> data,
+        bool                  last
+    ) noexcept
+    {
+        encodeKernel<Chan, Kernel::AVX2, E>(state, chunks, data, last);
+    }
+
+    template <Channels Chan, Effort E>
+    [[gnu::target(QOIPP_ISA_AVX512), gnu::flatten]] void encodeAvx512(
+        EncodeState&          state,
+        DataChunkArray&       chunks,
+        std::span<const Byte> data,
+        bool                  last
+    ) noexcept
+    {
+        encodeKernel<Chan, Kernel::AVX512, E>(state, chunks, data, last);
+    }
+#endif
+
+    // `encodeKernel` compiled for the active kernel
+    template <Channels Chan, Effort E = Effort::Default>
+    void encodePixels(
+        EncodeState&          state,
+        DataChunkArray&       chunks,
+        std::span<const Byte> data,
+        bool                  last
+    ) noexcept
+    {
+        switch (kernelSetting().load(std::memory_order_relaxed)) {
+#if defined(QOIPP_KERNEL_DISPATCH)
+        case Kernel::AVX512: return encodeAvx512<Chan, E>(state, chunks, data, last);
+        case Kernel::AVX2: return encodeAvx2<Chan, E>(state, chunks, data, last);
+        case Kernel::SSE42: return encodeSse42<Chan, E>(state, chunks, data, last);
+#endif
+        default: return encodeKernel<Chan, Kernel::Baseline, E>(state, chunks, data, last);
+        }
+    }
+
+    // `encodePixels` with the effort chosen at run time
+    template <Channels Chan>
+    void encodePixels(
+        EncodeState&          state,
+        DataChunkArray&       chunks,
+        std::span<const Byte> data,
+        bool                  last,
+        Effort                effort
+    ) noexcept
+    {
+        switch (effort) {
+        case Effort::Fast: return encodePixels<Chan, Effort::Fast>(state, chunks, data, last);
+        case Effort::Best: return encodePixels<Chan, Effort::Best>(state, chunks, data, last);
+        default: return encodePixels<Chan, Effort::Default>(state, chunks, data, last);
+        }
+    }
+
+    // `out` must be at least `maxEncodedSize(width, height, Chan)` bytes long
+    template <Channels Chan, Effort E = Effort::Default>
+    usize encode(std::span<const Byte> data, std::span<Byte> out, u32 width, u32 height, bool srgb)
+    {
+        PerfScope perf{ &Stats::m_encodePerf };
+
+        DataChunkArray chunks{ out };    // the encoded data goes here
+        EncodeState    state;
+
+        chunks.push(data::QoiHeader{
+            .m_width      = width,
+            .m_height     = height,
+            .m_channels   = static_cast<u8>(Chan),
+            .m_colorspace = static_cast<u8>(srgb ? 0 : 1),
+        });
+
+        encodePixels<Chan, E>(state, chunks, data, true);
+
         chunks.push(data::EndMarker{});
 
-        return chunks.get();
-    }
-
-    // TODO: implement
-    template <Channels Src, Channels Dest = Src>
-    ByteVec decode(std::span<const Byte> data, usize width, usize height) noexcept(false)
-    {
-        ByteVec decodedData(static_cast<usize>(width * height * static_cast<i32>(Dest)));
-
-        RunningArray seenPixels{};
-        seenPixels.fill({ 0x00, 0x00, 0x00, 0x00 });
-
-        Pixel prevPixel = constants::start;
-
-        const auto        get = [&](usize index) -> u8 { return std::to_integer<u8>(data[index]); };
-        PixelWriter<Dest> write{ decodedData };
-
-        seenPixels[hash(prevPixel) % constants::runningArraySize] = prevPixel;
-
-        usize chunksSize = data.size() - constants::headerSize - constants::endMarker.size();
-        for (usize pixelIndex = 0, dataIndex = constants::headerSize;
-             dataIndex < chunksSize || pixelIndex < width * height;
-             ++pixelIndex) {
-
-            const auto tag       = get(dataIndex++);
-            auto       currPixel = prevPixel;
-
-            using T = data::op::Tag;
-            switch (tag) {
-            case T::OP_RGB: {
-                currPixel.m_r = get(dataIndex++);
-                currPixel.m_g = get(dataIndex++);
-                currPixel.m_b = get(dataIndex++);
-                if constexpr (Src == Channels::RGBA) {
-                    currPixel.m_a = prevPixel.m_a;
-                }
-            } break;
-            case T::OP_RGBA: {
-                currPixel.m_r = get(dataIndex++);
-                currPixel.m_g = get(dataIndex++);
-                currPixel.m_b = get(dataIndex++);
-                if constexpr (Src == Channels::RGBA) {
-                    currPixel.m_a = get(dataIndex++);
-                }
-            } break;
-            default:
-                switch (tag & 0b11000000) {
-                case T::OP_INDEX: {
-                    auto& pixel = seenPixels[tag & 0b00111111];
-                    currPixel   = pixel;
-                } break;
-                case T::OP_DIFF: {
-                    const i8 dr = ((tag & 0b00110000) >> 4) - constants::biasOpDiff;
-                    const i8 dg = ((tag & 0b00001100) >> 2) - constants::biasOpDiff;
-                    const i8 db = ((tag & 0b00000011)) - constants::biasOpDiff;
-
-                    currPixel.m_r = static_cast<u8>(dr + prevPixel.m_r);
-                    currPixel.m_g = static_cast<u8>(dg + prevPixel.m_g);
-                    currPixel.m_b = static_cast<u8>(db + prevPixel.m_b);
-                    if constexpr (Src == Channels::RGBA) {
-                        currPixel.m_a = static_cast<u8>(prevPixel.m_a);
+        return chunks.size();
+    }
+
+
+    struct DecodeState
+    {
+        RunningArray m_seenPixels = {};
+        Pixel        m_prevPixel  = constants::start;
+    };
+
+    // the size of an op in bytes is determined by its tag alone
+    constexpr usize opSize(u8 tag) noexcept
+    {
+        using T = data::op::Tag;
+        switch (tag) {
+        case T::OP_RGB: return 4;
+        case T::OP_RGBA: return 5;
+        default: return (tag & 0b11000000) == T::OP_LUMA ? 2 : 1;
+        }
+    }
+
+    inline void countTag(OpStats& ops, u8 tag, usize count) noexcept
+    {
+        using T = data::op::Tag;
+
+        ops.m_bytes += opSize(tag);
+
+        switch (tag) {
+        case T::OP_RGB: ++ops.m_rgb; return;
+        case T::OP_RGBA: ++ops.m_rgba; return;
+        }
+
+        switch (tag & 0b11000000) {
+        case T::OP_INDEX: ++ops.m_index; break;
+        case T::OP_DIFF: ++ops.m_diff; break;
+        case T::OP_LUMA: ++ops.m_luma; break;
+        case T::OP_RUN:
+            ++ops.m_run;
+            ops.m_runPixels += count;
+            break;
+        }
+    }
+
+    // everything about an op that can be read off its first byte
+    struct OpInfo
+    {
+        enum Kind : u8
+        {
+            Rgb,
+            Rgba,
+            Index,
+            Delta,    // OP_DIFF and OP_LUMA
+            Run,
+        };
+
+        Kind m_kind;
+        u8   m_size;         // in bytes
+        u8   m_arg;          // the index for Index, the length for Run, the second byte mask for Delta
+        i8   m_delta[3];     // per channel for Delta, the green delta is part of red and blue for OP_LUMA
+    };
+
+    constexpr std::array<OpInfo, 256> opTable = [] {
+        using T = data::op::Tag;
+
+        std::array<OpInfo, 256> table = {};
+        for (usize i = 0; i < table.size(); ++i) {
+            const auto tag   = static_cast<u8>(i);
+            const auto value = static_cast<u8>(tag & 0b00111111);
+
+            auto& info  = table[i];
+            info.m_size = static_cast<u8>(opSize(tag));
+
+            if (tag == T::OP_RGB) {
+                info.m_kind = OpInfo::Rgb;
+            } else if (tag == T::OP_RGBA) {
+                info.m_kind = OpInfo::Rgba;
+            } else if ((tag & 0b11000000) == T::OP_INDEX) {
+                info.m_kind = OpInfo::Index;
+                info.m_arg  = value;
+            } else if ((tag & 0b11000000) == T::OP_DIFF) {
+                info.m_kind     = OpInfo::Delta;
+                info.m_arg      = 0x00;
+                info.m_delta[0] = static_cast<i8>(((value >> 4) & 0b11) - constants::biasOpDiff);
+                info.m_delta[1] = static_cast<i8>(((value >> 2) & 0b11) - constants::biasOpDiff);
+                info.m_delta[2] = static_cast<i8>((value & 0b11) - constants::biasOpDiff);
+            } else if ((tag & 0b11000000) == T::OP_LUMA) {
+                const auto dg   = static_cast<i8>(value - constants::biasOpLumaG);
+                info.m_kind     = OpInfo::Delta;
+                info.m_arg      = 0xFF;
+                info.m_delta[0] = dg;
+                info.m_delta[1] = dg;
+                info.m_delta[2] = dg;
+            } else {
+                info.m_kind = OpInfo::Run;
+                info.m_arg  = static_cast<u8>(value - constants::biasOpRun);
+            }
+        }
+        return table;
+    }();
+
+    // the red and blue deltas relative to green held by the second byte of OP_LUMA
+    constexpr std::array<std::array<u8, 2>, 256> lumaTable = [] {
+        std::array<std::array<u8, 2>, 256> table = {};
+        for (usize i = 0; i < table.size(); ++i) {
+            table[i][0] = static_cast<u8>(static_cast<i8>((i >> 4) - constants::biasOpLumaRB));
+            table[i][1] = static_cast<u8>(static_cast<i8>((i & 0b1111) - constants::biasOpLumaRB));
+        }
+        return table;
+    }();
+
+    // decode the op at `data[index]` into `state.m_prevPixel`, `data` must contain the whole op
+    // returns the number of pixels the op produces (the run length for OP_RUN, 1 otherwise)
+    //
+    // The tag is looked up in `opTable` so OP_DIFF and OP_LUMA share a single branch free path: OP_DIFF reads
+    // its own tag as the "second byte" and masks the red/blue deltas it gets from it off.
+    inline usize decodeOp(DecodeState& state, const Byte* data, usize& index) noexcept
+    {
+        auto& [seenPixels, prevPixel] = state;
+
+        const auto get = [&](usize index) -> u8 { return std::to_integer<u8>(data[index]); };
+
+        const auto  tag       = get(index);
+        const auto& op        = opTable[tag];
+        auto        currPixel = prevPixel;
+        usize       count     = 1;
+
+        // the sizes are constants wherever possible: the position of the next tag then only depends on the
+        // predicted branch instead of on another load from the table
+        switch (op.m_kind) {
+        case OpInfo::Rgb: {
+            currPixel.m_r  = get(index + 1);
+            currPixel.m_g  = get(index + 2);
+            currPixel.m_b  = get(index + 3);
+            index         += 4;
+        } break;
+        case OpInfo::Rgba: {
+            currPixel.m_r  = get(index + 1);
+            currPixel.m_g  = get(index + 2);
+            currPixel.m_b  = get(index + 3);
+            currPixel.m_a  = get(index + 4);
+            index         += 5;
+        } break;
+        case OpInfo::Index: {
+            currPixel  = seenPixels[tag & 0b00111111];
+            index     += 1;
+        } break;
+        case OpInfo::Delta: {
+            const auto& redBlue = lumaTable[get(index + op.m_size - 1)];
+
+            currPixel.m_r  = static_cast<u8>(prevPixel.m_r + op.m_delta[0] + (redBlue[0] & op.m_arg));
+            currPixel.m_g  = static_cast<u8>(prevPixel.m_g + op.m_delta[1]);
+            currPixel.m_b  = static_cast<u8>(prevPixel.m_b + op.m_delta[2] + (redBlue[1] & op.m_arg));
+            index         += op.m_size;
+        } break;
+        case OpInfo::Run: {
+            count  = static_cast<usize>((tag & 0b00111111) - constants::biasOpRun);
+            index += 1;
+        } break;
+        }
+
+        seenPixels[hash(currPixel) % constants::runningArraySize] = currPixel;
+        prevPixel                                                 = currPixel;
+
+        if constexpr (statsEnabled) {
+            countTag(threadStats().m_decodeOps, tag, count);
+        }
+
+        return count;
+    }
+
+    // Decode the ops in `data[index, end)` into `pixelCount` pixels, `index` is left after the last op read.
+    // `out` must be exactly `pixelCount * Dest` bytes long.
+    //
+    // When `Checked`, no op is started past `end`. Since an op is at most 5 bytes and `end` is at least an
+    // end marker away from the end of `data`, the bytes of an op never need to be checked individually.
+    // Returns false if the ops run out before all the pixels are decoded or if the last op overlaps `end`.
+    // When not `Checked`, only the pixel count is checked: the stream must be trusted to be well formed.
+    template <Channels Src, Channels Dest, bool Checked, Kernel K>
+    bool decodeKernel(
+        std::span<const Byte> data,
+        usize&                index,
+        usize                 end,
+        std::span<Byte>       out,
+        usize                 pixelCount
+    ) noexcept
+    {
+        static_assert(constants::endMarker.size() >= opSize(data::op::OP_RGBA));
+
+        constexpr bool expand = Src == Channels::RGB && Dest == Channels::RGBA;
+
+        PerfScope                    perf{ &Stats::m_decodePerf };
+        DecodeState                  state;
+        PixelWriter<Dest, expand, K> write{ out };
+
+        const auto* bytes = data.data();
+
+        usize pixelIndex = 0;
+
+        while (pixelIndex < pixelCount) {
+            if constexpr (Checked) {
+                if (index >= end) [[unlikely]] {
+                    return false;
+                }
+            }
+
+            const auto count = decodeOp(state, bytes, index);
+            if (count == 1) [[likely]] {
+                write(pixelIndex++, state.m_prevPixel);
+                continue;
+            }
+
+            // a run may not go past the end of the image
+            const auto run = std::min(count, pixelCount - pixelIndex);
+            write.fill(pixelIndex, run, state.m_prevPixel);
+            pixelIndex += run;
+        }
+
+        return !Checked || index <= end;
+    }
+
+#if defined(QOIPP_KERNEL_DISPATCH)
+    template <Channels Src, Channels Dest, bool Checked>
+    [[gnu::target(QOIPP_ISA_SSE42), gnu::flatten]] bool decodeSse42(
+        std::span<const Byte> data,
+        usize&                index,
+        usize                 end,
+        std::span<Byte>       out,
+        usize                 pixelCount
+    ) noexcept
+    {
+        return decodeKernel<Src, Dest, Checked, Kernel::SSE42>(data, index, end, out, pixelCount);
+    }
+
+    template <Channels Src, Channels Dest, bool Checked>
+    [[gnu::target(QOIPP_ISA_AVX2), gnu::flatten]] bool decodeAvx2(
+        std::span<const Byte> data,
+        usize&                index,
+        usize                 end,
+        std::span<Byte>       out,
+        usize                 pixelCount
+    ) noexcept
+    {
+        return decodeKernel<Src, Dest, Checked, Kernel::AVX2>(data, index, end, out, pixelCount);
+    }
+
+    template <Channels Src, Channels Dest, bool Checked>
+    [[gnu::target(QOIPP_ISA_AVX512), gnu::flatten]] bool decodeAvx512(
+        std::span<const Byte> data,
+        usize&                index,
+        usize                 end,
+        std::span<Byte>       out,
+        usize                 pixelCount
+    ) noexcept
+    {
+        return decodeKernel<Src, Dest, Checked, Kernel::AVX512>(data, index, end, out, pixelCount);
+    }
+#endif
+
+    // `decodeKernel` compiled for the active kernel
+    template <Channels Src, Channels Dest = Src, bool Checked = true>
+    bool decode(
+        std::span<const Byte> data,
+        usize&                index,
+        usize                 end,
+        std::span<Byte>       out,
+        usize                 pixelCount
+    ) noexcept
+    {
+        switch (kernelSetting().load(std::memory_order_relaxed)) {
+#if defined(QOIPP_KERNEL_DISPATCH)
+        case Kernel::AVX512: return decodeAvx512<Src, Dest, Checked>(data, index, end, out, pixelCount);
+        case Kernel::AVX2: return decodeAvx2<Src, Dest, Checked>(data, index, end, out, pixelCount);
+        case Kernel::SSE42: return decodeSse42<Src, Dest, Checked>(data, index, end, out, pixelCount);
+#endif
+        default: return decodeKernel<Src, Dest, Checked, Kernel::Baseline>(data, index, end, out, pixelCount);
+        }
+    }
+
+    // Takes every pixel of an image in order and keeps the ones in a region, averaged over blocks of
+    // `scale` x `scale` pixels. The sums of the blocks of the current output row are kept between rows.
+    template <Channels Src, Channels Dest>
+    class RegionWriter
+    {
+    public:
+        RegionWriter(u32 imageWidth, Region region, u32 scale, std::span<Byte> out) noexcept(false)
+            : m_imageWidth{ imageWidth }
+            , m_x{ region.m_x }
+            , m_xEnd{ region.m_x + region.m_width }
+            , m_y{ region.m_y }
+            , m_yEnd{ region.m_y + region.m_height }
+            , m_scale{ scale }
+            , m_outWidth{ (region.m_width + scale - 1) / scale }
+            , m_out{ out }
+            , m_sums(scale > 1 ? m_outWidth * 4 : 0)
+        {
+        }
+
+        // push `count` pixels of `pixel`, false once the last row of the region is complete
+        bool push(Pixel pixel, usize count) noexcept
+        {
+            if constexpr (Src == Channels::RGB) {
+                pixel.m_a = 0xFF;
+            }
+
+            while (count > 0) {
+                const auto length = static_cast<u32>(std::min<usize>(count, m_imageWidth - m_col));
+
+                if (m_row >= m_y) {
+                    const auto from = std::max(m_col, m_x);
+                    const auto to   = std::min(m_col + length, m_xEnd);
+                    if (from < to) {
+                        add(from - m_x, to - from, pixel);
                     }
-                } break;
-                case T::OP_LUMA: {
-                    const auto redBlue = get(dataIndex++);
-
-                    const u8 dg    = (tag & 0b00111111) - constants::biasOpLumaG;
-                    const u8 dr_dg = ((redBlue & 0b11110000) >> 4) - constants::biasOpLumaRB;
-                    const u8 db_dg = (redBlue & 0b00001111) - constants::biasOpLumaRB;
-
-                    currPixel.m_r = static_cast<u8>(dg + dr_dg + prevPixel.m_r);
-                    currPixel.m_g = static_cast<u8>(dg + prevPixel.m_g);
-                    currPixel.m_b = static_cast<u8>(dg + db_dg + prevPixel.m_b);
-                    if constexpr (Src == Channels::RGBA) {
-                        currPixel.m_a = static_cast<u8>(prevPixel.m_a);
+                }
+
+                m_col += length;
+                count -= length;
+
+                if (m_col == m_imageWidth) {
+                    if (m_row >= m_y) {
+                        endRow();
                     }
-                } break;
-                case T::OP_RUN: {
-                    auto run = (tag & 0b00111111) - constants::biasOpRun;
-                    while (run-- > 0) {
-                        write(pixelIndex++, prevPixel);
+                    m_col = 0;
+                    if (++m_row == m_yEnd) {
+                        return false;
                     }
-                    --pixelIndex;
-                } break;
-                default: [[unlikely]] /* invalid tag (is this eve possible?)*/;
                 }
             }
 
-            write(pixelIndex, currPixel);
-            seenPixels[hash(currPixel) % constants::runningArraySize] = currPixel;
-            prevPixel                                                 = currPixel;
+            return true;
+        }
+
+    private:
+        static constexpr auto channels = static_cast<usize>(Dest);
+
+        // add `count` pixels starting at column `col` of the region
+        void add(u32 col, u32 count, Pixel pixel) noexcept
+        {
+            if (m_scale == 1) {
+                auto* out = m_out.data() + (static_cast<usize>(m_row - m_y) * m_outWidth + col) * channels;
+                for (u32 i = 0; i < count; ++i, out += channels) {
+                    std::memcpy(out, &pixel, channels);
+                }
+                return;
+            }
+
+            auto* sum    = m_sums.data() + col / m_scale * 4;
+            auto  length = std::min(count, m_scale - col % m_scale);
+            while (count > 0) {
+                sum[0] += pixel.m_r * length;
+                sum[1] += pixel.m_g * length;
+                sum[2] += pixel.m_b * length;
+                sum[3] += pixel.m_a * length;
+
+                sum    += 4;
+                count  -= length;
+                length  = std::min(count, m_scale);
+            }
+        }
+
+        void endRow() noexcept
+        {
+            if (m_scale == 1 || (++m_rowsInBlock < m_scale && m_row + 1 < m_yEnd)) {
+                return;
+            }
+
+            auto* out = m_out.data() + static_cast<usize>(m_outRow++) * m_outWidth * channels;
+            for (usize col = 0; col < m_outWidth; ++col) {
+                const auto width = std::min<usize>(m_scale, (m_xEnd - m_x) - col * m_scale);
+                const auto count = width * m_rowsInBlock;
+                for (usize c = 0; c < channels; ++c) {
+                    out[col * channels + c] = static_cast<Byte>((m_sums[col * 4 + c] + count / 2) / count);
+                }
+            }
+
+            std::ranges::fill(m_sums, 0);
+            m_rowsInBlock = 0;
+        }
+
+        u32 m_imageWidth;
+        u32 m_x;
+        u32 m_xEnd;
+        u32 m_y;
+        u32 m_yEnd;
+        u32 m_scale;
+        u32 m_outWidth;
+
+        std::span<Byte>  m_out;
+        std::vector<u64> m_sums;
+
+        u32 m_row         = 0;
+        u32 m_col         = 0;
+        u32 m_rowsInBlock = 0;
+        u32 m_outRow      = 0;
+    };
+
+    // where the decoding of a region starts from: the start of the stream or a checkpoint of a row index
+    struct DecodeStart
+    {
+        usize       m_offset = constants::headerSize;
+        u32         m_row    = 0;
+        u32         m_run    = 0;    // pixels of the run before `m_offset` left to push
+        DecodeState m_state  = {};
+    };
+
+    // decode the ops from `start` until the last row of the region of `write` is complete, the rows of the
+    // region are counted from the row of `start`
+    // returns false if the ops run out before that row or if the last op read overlaps `end`
+    template <Channels Src, Channels Dest>
+    bool decodeRegion(
+        std::span<const Byte>    data,
+        usize                    end,
+        DecodeStart              start,
+        RegionWriter<Src, Dest>& write
+    ) noexcept
+    {
+        PerfScope perf{ &Stats::m_decodePerf };
+
+        auto&       state = start.m_state;
+        const auto* bytes = data.data();
+
+        if (start.m_run > 0 && !write.push(state.m_prevPixel, start.m_run)) {
+            return true;
+        }
+
+        usize index = start.m_offset;
+        while (index < end) {
+            const auto count = decodeOp(state, bytes, index);
+            if (!write.push(state.m_prevPixel, count)) {
+                return index <= end;
+            }
         }
 
-        return decodedData;
+        return false;
     }
-}
 
-namespace qoipp
-{
-    std::optional<ImageDesc> readHeader(ByteSpan data) noexcept
+    // the checks of the `validate` functions below without the message, for the `try` functions
+    inline Error checkDesc(ImageDesc desc) noexcept
     {
-        if (data.size() < constants::headerSize) {
-            return std::nullopt;
+        const auto [width, height, channels, colorspace] = desc;
+
+        if (width <= 0 || height <= 0) {
+            return Error::BadDimensions;
+        } else if (static_cast<i32>(channels) != 3 && static_cast<i32>(channels) != 4) {
+            return Error::BadChannels;
         }
+        return Error::None;
+    }
 
-        using Magic = decltype(data::QoiHeader::m_magic);
-        auto* magic = reinterpret_cast<const Magic*>(data.data());
+    inline Error checkEncode(std::span<const Byte> data, ImageDesc desc) noexcept
+    {
+        if (const auto error = checkDesc(desc); error != Error::None) {
+            return error;
+        }
 
-        if (std::memcmp(magic, constants::magic.data(), constants::magic.size()) != 0) {
-            return std::nullopt;
+        const auto [width, height, channels, colorspace] = desc;
+        return data.size() == decodedSize(width, height, channels) ? Error::None : Error::SizeMismatch;
+    }
+
+    inline Result<ImageDesc> checkHeader(std::span<const Byte> data) noexcept
+    {
+        if (data.size() < constants::headerSize) {
+            return { .m_error = Error::Truncated };
+        } else if (auto header = readHeader(data); header.has_value()) {
+            return { .m_value = *header };
         }
+        return { .m_error = Error::BadMagic };
+    }
 
-        usize index = constants::magic.size();
-        u32   width, height;
-        u32   channels, colorspace;
+    inline Error checkDecode(std::span<const Byte> data, ImageDesc desc) noexcept
+    {
+        if (const auto error = checkDesc(desc); error != Error::None) {
+            return error;
+        }
 
-        std::memcpy(&width, data.data() + index, sizeof(u32));
-        index += sizeof(u32);
-        std::memcpy(&height, data.data() + index, sizeof(u32));
-        index      += sizeof(u32);
-        channels    = std::to_integer<u8>(data[index++]);
-        colorspace  = std::to_integer<u8>(data[index++]);
+        const auto minSize = constants::headerSize + constants::endMarker.size();
+        if (data.size() <= minSize) {
+            return Error::Truncated;
+        }
 
-        return ImageDesc{
-            .m_width      = fromBigEndian(width),
-            .m_height     = fromBigEndian(height),
-            .m_channels   = static_cast<Channels>(channels),
-            .m_colorspace = static_cast<Colorspace>(colorspace),
-        };
+        // each byte of the op stream decodes to at most `runLimit` pixels
+        const auto pixelCount = static_cast<usize>(desc.m_width) * desc.m_height;
+        const auto maxPixels  = (data.size() - minSize) * static_cast<usize>(constants::runLimit);
+        return pixelCount > maxPixels ? Error::PixelOverflow : Error::None;
+    }
+
+    inline Error checkTarget(std::optional<Channels> target) noexcept
+    {
+        if (target.has_value() && *target != Channels::RGB && *target != Channels::RGBA) {
+            return Error::BadChannels;
+        }
+        return Error::None;
     }
 
-    std::vector<Byte> encode(std::span<const Byte> data, ImageDesc desc) noexcept(false)
+    inline void validateDesc(ImageDesc desc) noexcept(false)
     {
         const auto [width, height, channels, colorspace] = desc;
-        const auto maxSize = static_cast<usize>(width * height * static_cast<u32>(channels));
 
-        if (width <= 0 || height <= 0) {
+        switch (checkDesc(desc)) {
+        case Error::BadDimensions:
             throw std::invalid_argument{ std::format(
                 "Invalid image description: w = {}, h = {}, c = {}", width, height, static_cast<i32>(channels)
             ) };
-        }
-
-        if (static_cast<i32>(channels) != 3 && static_cast<i32>(channels) != 4) {
+        case Error::BadChannels:
             throw std::invalid_argument{ std::format(
                 "Invalid number of channels: expected 3 (RGB) or 4 (RGBA), got {}", static_cast<i32>(channels)
             ) };
+        default: break;
         }
+    }
+
+    inline void validateEncode(std::span<const Byte> data, ImageDesc desc) noexcept(false)
+    {
+        validateDesc(desc);
+
+        const auto [width, height, channels, colorspace] = desc;
 
-        if (data.size() != maxSize) {
+        const auto size = decodedSize(width, height, channels);
+        if (data.size() != size) {
             throw std::invalid_argument{ std::format(
                 "Data size does not match the image description: expected {} x {} x {} = {}, got {}",
                 width,
                 height,
                 static_cast<i32>(channels),
-                maxSize,
+                size,
                 data.size()
             ) };
         }
@@ -636,114 +1772,5090 @@ namespace qoipp
                 "Data does not align with the number of channels: expected multiple of 4 bytes"
             };
         }
+    }
+
+    template <Effort E>
+    usize encodeInto(std::span<const Byte> data, std::span<Byte> out, ImageDesc desc) noexcept
+    {
+        const auto [width, height, channels, colorspace] = desc;
 
         bool isSrgb = colorspace == Colorspace::sRGB;
         if (channels == Channels::RGB) {
-            return impl::encode<Channels::RGB>(data, width, height, isSrgb);
+            return encode<Channels::RGB, E>(data, out, width, height, isSrgb);
         } else {
-            return impl::encode<Channels::RGBA>(data, width, height, isSrgb);
+            return encode<Channels::RGBA, E>(data, out, width, height, isSrgb);
         }
     }
 
-    // TODO: implement
-    Image decode(ByteSpan data, bool rgbOnly) noexcept(false)
+    inline usize encodeInto(
+        std::span<const Byte> data,
+        std::span<Byte>       out,
+        ImageDesc             desc,
+        Effort                effort = Effort::Default
+    ) noexcept
     {
-        if (data.size() == 0) {
-            throw std::invalid_argument{ "Data is empty" };
+        switch (effort) {
+        case Effort::Fast: return encodeInto<Effort::Fast>(data, out, desc);
+        case Effort::Best: return encodeInto<Effort::Best>(data, out, desc);
+        default: return encodeInto<Effort::Default>(data, out, desc);
         }
+    }
 
-        auto desc = [&] {
-            if (auto header = readHeader(data); header.has_value()) {
-                return header.value();
-            } else {
-                throw std::invalid_argument{ "Invalid header" };
-            }
-        }();
-
-        if (desc.m_channels == Channels::RGB) {
-            return {
-                .m_data = impl::decode<Channels::RGB>(data, desc.m_width, desc.m_height),
-                .m_desc = desc,
-            };
-        } else if (rgbOnly) {
-            desc.m_channels = Channels::RGB;
-            return {
-                .m_data = impl::decode<Channels::RGBA, Channels::RGB>(data, desc.m_width, desc.m_height),
-                .m_desc = desc,
-            };
-        } else {
-            return {
-                .m_data = impl::decode<Channels::RGBA>(data, desc.m_width, desc.m_height),
-                .m_desc = desc,
-            };
+    // encode into the worst case buffer of the thread, kept between calls, then copy only what is used
+    inline ByteVec encodeScratch(std::span<const Byte> data, ImageDesc desc, Effort effort) noexcept(false)
+    {
+        thread_local ByteVec scratch;
+        if (const auto size = maxEncodedSize(desc); scratch.size() < size) {
+            scratch.resize(size);
         }
+
+        const auto size = encodeInto(data, scratch, desc, effort);
+        return ByteVec(scratch.begin(), scratch.begin() + static_cast<std::ptrdiff_t>(size));
     }
 
-    std::optional<ImageDesc> readHeaderFromFile(const std::filesystem::path& path) noexcept
+    inline ImageDesc readDecodeHeader(std::span<const Byte> data) noexcept(false)
     {
-        namespace fs = std::filesystem;
-
-        if (!fs::exists(path) || fs::file_size(path) < constants::headerSize || !fs::is_regular_file(path)) {
-            return std::nullopt;
+        if (data.size() == 0) {
+            throw std::invalid_argument{ "Data is empty" };
         }
 
-        std::ifstream file{ path, std::ios::binary };
-        if (!file.is_open()) {
-            return std::nullopt;
+        if (auto header = checkHeader(data); header) {
+            return header.m_value;
+        } else {
+            throw std::invalid_argument{ "Invalid header" };
         }
-
-        ByteVec data(constants::headerSize);
-        file.read(reinterpret_cast<char*>(data.data()), constants::headerSize);
-
-        return readHeader(data);
     }
 
-    void encodeToFile(
-        const std::filesystem::path& path,
-        std::span<const Byte>        data,
-        ImageDesc                    desc,
-        bool                         overwrite
-    ) noexcept(false)
+    // validate the header up front so that a short stream can't make us allocate or loop for a huge image
+    inline void validateDecode(std::span<const Byte> data, ImageDesc desc) noexcept(false)
     {
-        namespace fs = std::filesystem;
+        validateDesc(desc);
 
-        if (fs::exists(path) && !overwrite) {
-            throw std::invalid_argument{ "File already exists and overwrite is false" };
-        }
+        const auto minSize    = constants::headerSize + constants::endMarker.size();
+        const auto pixelCount = static_cast<usize>(desc.m_width) * desc.m_height;
 
-        if (fs::exists(path) && !fs::is_regular_file(path)) {
-            throw std::invalid_argument{ "Path is not a regular file, cannot overwrite" };
+        switch (checkDecode(data, desc)) {
+        case Error::Truncated:
+            throw std::invalid_argument{ std::format(
+                "Data is too small: expected more than {} bytes, got {}", minSize, data.size()
+            ) };
+        case Error::PixelOverflow:
+            throw std::invalid_argument{ std::format(
+                "Data is truncated: {} bytes can't hold {} pixels", data.size(), pixelCount
+            ) };
+        default: break;
         }
+    }
 
-        auto encodedData = encode(data, desc);
+    // `target` is the number of channels to decode to, the channels of the image itself if empty
+    inline ImageDesc decodedDesc(ImageDesc src, std::optional<Channels> target) noexcept
+    {
+        src.m_channels = target.value_or(src.m_channels);
+        return src;
+    }
 
-        std::ofstream file{ path, std::ios::binary | std::ios::trunc };
-        if (!file.is_open()) {
-            throw std::invalid_argument{ "Could not open file for writing" };
+    inline void validateTarget(std::optional<Channels> target) noexcept(false)
+    {
+        if (checkTarget(target) != Error::None) {
+            throw std::invalid_argument{ std::format(
+                "Invalid number of target channels: expected 3 (RGB) or 4 (RGBA), got {}",
+                static_cast<i32>(*target)
+            ) };
         }
+    }
 
-        file.write(
-            reinterpret_cast<const char*>(encodedData.data()),
-            static_cast<std::streamsize>(encodedData.size())
-        );
+    inline std::optional<Channels> decodeTarget(bool rgbOnly) noexcept
+    {
+        return rgbOnly ? std::optional{ Channels::RGB } : std::nullopt;
     }
 
-    Image decodeFromFile(const std::filesystem::path& path, bool rgbOnly) noexcept(false)
+    // decode the ops in `data[index, end)` into `out`, see `decode` above
+    template <bool Checked>
+    bool decodeRange(
+        std::span<const Byte> data,
+        usize&                index,
+        usize                 end,
+        std::span<Byte>       out,
+        Channels              src,
+        Channels              dest
+    ) noexcept
     {
-        namespace fs = std::filesystem;
+        constexpr auto RGB  = Channels::RGB;
+        constexpr auto RGBA = Channels::RGBA;
 
-        if (!fs::exists(path) || !fs::is_regular_file(path)) {
-            throw std::invalid_argument{ "Path does not exist or is not a regular file" };
-        }
+        const auto pixelCount = out.size() / static_cast<usize>(dest);
+
+        if (src == RGB && dest == RGB) {
+            return decode<RGB, RGB, Checked>(data, index, end, out, pixelCount);
+        } else if (src == RGB) {
+            return decode<RGB, RGBA, Checked>(data, index, end, out, pixelCount);
+        } else if (dest == RGB) {
+            return decode<RGBA, RGB, Checked>(data, index, end, out, pixelCount);
+        } else {
+            return decode<RGBA, RGBA, Checked>(data, index, end, out, pixelCount);
+        }
+    }
+
+    template <bool Checked>
+    Error tryDecodeInto(
+        std::span<const Byte> data,
+        std::span<Byte>       out,
+        ImageDesc             src,
+        ImageDesc             dest
+    ) noexcept
+    {
+        const auto size = decodedSize(dest.m_width, dest.m_height, dest.m_channels);
+        const auto end  = data.size() - constants::endMarker.size();
+
+        // the last op must not overlap the end marker
+        usize      index    = constants::headerSize;
+        const auto complete = decodeRange<Checked>(
+            data, index, end, out.first(size), src.m_channels, dest.m_channels
+        );
+
+        return complete ? Error::None : Error::Truncated;
+    }
+
+    template <bool Checked>
+    void decodeInto(
+        std::span<const Byte> data,
+        std::span<Byte>       out,
+        ImageDesc             src,
+        ImageDesc             dest
+    ) noexcept(false)
+    {
+        if (tryDecodeInto<Checked>(data, out, src, dest) != Error::None) {
+            throw std::invalid_argument{ "Data is truncated: the op stream ends before the last pixel" };
+        }
+    }
+
+    // read the header and validate the data before any decoding, returns the source and decoded descs
+    template <bool Checked>
+    std::pair<ImageDesc, ImageDesc> prepareDecode(
+        std::span<const Byte>   data,
+        std::optional<Channels> target
+    ) noexcept(false)
+    {
+        validateTarget(target);
+
+        const auto src = readDecodeHeader(data);
+        if constexpr (Checked) {
+            validateDecode(data, src);
+        }
+
+        return { src, decodedDesc(src, target) };
+    }
+
+    // `prepareDecode` reporting failure with an error code, always checked
+    inline Result<std::pair<ImageDesc, ImageDesc>> tryPrepareDecode(
+        std::span<const Byte>   data,
+        std::optional<Channels> target
+    ) noexcept
+    {
+        if (const auto error = checkTarget(target); error != Error::None) {
+            return { .m_error = error };
+        }
+
+        const auto header = checkHeader(data);
+        if (!header) {
+            return { .m_error = header.m_error };
+        } else if (const auto error = checkDecode(data, header.m_value); error != Error::None) {
+            return { .m_error = error };
+        }
+
+        return { .m_value = { header.m_value, decodedDesc(header.m_value, target) } };
+    }
+
+    // get the checkpoint of the row index at the end of `index` to start decoding `row` of `data` from,
+    // std::nullopt if there is no row index or it doesn't fit the image
+    inline std::optional<DecodeStart> readCheckpoint(
+        std::span<const Byte> data,
+        ImageDesc             desc,
+        std::span<const Byte> index,
+        u32                   row
+    ) noexcept
+    {
+        const auto read = [&]<typename T>(usize at, T) {
+            T value;
+            std::memcpy(&value, index.data() + at, sizeof(T));
+            return fromBigEndian(value);
+        };
+
+        const auto& magic = constants::rowIndexMagic;
+
+        if (index.size() < constants::rowIndexTrailerSize + constants::checkpointSize) {
+            return std::nullopt;
+        }
+
+        if (std::memcmp(index.data() + index.size() - magic.size(), magic.data(), magic.size()) != 0) {
+            return std::nullopt;
+        }
+
+        const auto trailerIndex = index.size() - constants::rowIndexTrailerSize;
+        const auto width        = read(trailerIndex, u32{});
+        const auto height       = read(trailerIndex + 4, u32{});
+        const auto end          = read(trailerIndex + 8, u64{});
+        const auto interval     = read(trailerIndex + 16, u32{});
+        const auto count        = read(trailerIndex + 20, u32{});
+
+        if (width != desc.m_width || height != desc.m_height) {
+            return std::nullopt;
+        }
+        if (interval == 0 || count != (static_cast<u64>(height) + interval - 1) / interval) {
+            return std::nullopt;
+        }
+        if (trailerIndex / constants::checkpointSize < count) {
+            return std::nullopt;
+        }
+
+        const auto& marker = constants::endMarker;
+        if (end < constants::headerSize || end > data.size() - marker.size()) {
+            return std::nullopt;
+        }
+        if (std::memcmp(data.data() + end, marker.data(), marker.size()) != 0) {
+            return std::nullopt;
+        }
+
+        const auto checkpoint = row / interval;
+        const auto at         = trailerIndex - (count - checkpoint) * constants::checkpointSize;
+
+        DecodeStart start{
+            .m_offset = static_cast<usize>(read(at, u64{})),
+            .m_row    = checkpoint * interval,
+            .m_run    = read(at + 8, u32{}),
+        };
+
+        if (start.m_offset < constants::headerSize || start.m_offset > end) {
+            return std::nullopt;
+        }
+        if (start.m_run > static_cast<u32>(constants::runLimit)) {
+            return std::nullopt;
+        }
+
+        auto& [seenPixels, prevPixel] = start.m_state;
+        std::memcpy(&prevPixel, index.data() + at + 12, sizeof(Pixel));
+        std::memcpy(seenPixels.data(), index.data() + at + 16, sizeof(seenPixels));
+
+        return start;
+    }
+
+    // `region` with a width or a height of 0 extended to the rest of the image
+    inline Region fillRegion(Region region, ImageDesc src) noexcept
+    {
+        if (region.m_width == 0 && region.m_x < src.m_width) {
+            region.m_width = src.m_width - region.m_x;
+        }
+        if (region.m_height == 0 && region.m_y < src.m_height) {
+            region.m_height = src.m_height - region.m_y;
+        }
+        return region;
+    }
+
+    inline bool regionFits(Region region, ImageDesc src) noexcept
+    {
+        const auto fits = [](u32 offset, u32 size, u32 limit) {
+            return size > 0 && offset < limit && size <= limit - offset;
+        };
+
+        return fits(region.m_x, region.m_width, src.m_width)
+            && fits(region.m_y, region.m_height, src.m_height);
+    }
+
+    inline Error checkRegion(Region region, u32 scale, ImageDesc src) noexcept
+    {
+        return regionFits(region, src) && scale > 0 ? Error::None : Error::BadRegion;
+    }
+
+    // where to start decoding `row` from: the checkpoint of `rowIndex` before it if there is one
+    //
+    // An empty `rowIndex` is looked for at the end of `data`, the region is then decoded from the start of
+    // the stream if there is none. One that is given must fit the image.
+    inline Result<DecodeStart> findStart(
+        std::span<const Byte>                data,
+        ImageDesc                            src,
+        std::optional<std::span<const Byte>> rowIndex,
+        u32                                  row
+    ) noexcept
+    {
+        if (!rowIndex.has_value()) {
+            return {};
+        }
+
+        const auto index      = rowIndex->empty() ? data : *rowIndex;
+        const auto checkpoint = readCheckpoint(data, src, index, row);
+
+        if (checkpoint.has_value()) {
+            return { .m_value = *checkpoint };
+        } else if (!rowIndex->empty()) {
+            return { .m_error = Error::BadTable };
+        }
+        return {};
+    }
+
+    inline ImageDesc regionDesc(Region region, u32 scale, ImageDesc dest) noexcept
+    {
+        return {
+            .m_width      = (region.m_width + scale - 1) / scale,
+            .m_height     = (region.m_height + scale - 1) / scale,
+            .m_channels   = dest.m_channels,
+            .m_colorspace = dest.m_colorspace,
+        };
+    }
+
+    // decode `region` of an image checked with `checkRegion` from `start` into `out`, which is
+    // `regionDesc` sized
+    inline Error decodeRegionInto(
+        std::span<const Byte> data,
+        ImageDesc             src,
+        ImageDesc             dest,
+        Region                region,
+        u32                   scale,
+        DecodeStart           start,
+        std::span<Byte>       out
+    ) noexcept
+    {
+        const auto end = data.size() - constants::endMarker.size();
+
+        // the rows of the region are counted from the row of `start`
+        region.m_y -= start.m_row;
+
+        const auto decode = [&]<Channels Src, Channels Dest>() {
+            auto write = RegionWriter<Src, Dest>{ src.m_width, region, scale, out };
+            return decodeRegion<Src, Dest>(data, end, start, write);
+        };
+
+        constexpr auto RGB  = Channels::RGB;
+        constexpr auto RGBA = Channels::RGBA;
+
+        bool complete = false;
+        if (src.m_channels == RGB && dest.m_channels == RGB) {
+            complete = decode.template operator()<RGB, RGB>();
+        } else if (src.m_channels == RGB) {
+            complete = decode.template operator()<RGB, RGBA>();
+        } else if (dest.m_channels == RGB) {
+            complete = decode.template operator()<RGBA, RGB>();
+        } else {
+            complete = decode.template operator()<RGBA, RGBA>();
+        }
+
+        return complete ? Error::None : Error::Truncated;
+    }
+
+    // decode `region` starting from the checkpoint of `rowIndex` before it if there is one, see `findStart`
+    inline Image decodeRegion(
+        std::span<const Byte>                data,
+        Region                               region,
+        u32                                  scale,
+        std::optional<Channels>              target,
+        std::optional<std::span<const Byte>> rowIndex = std::nullopt
+    ) noexcept(false)
+    {
+        const auto [src, dest] = prepareDecode<true>(data, target);
+
+        region = fillRegion(region, src);
+
+        if (!regionFits(region, src)) {
+            throw std::invalid_argument{ std::format(
+                "Region is not within the image: {} x {} at ({}, {}) in a {} x {} image",
+                region.m_width,
+                region.m_height,
+                region.m_x,
+                region.m_y,
+                src.m_width,
+                src.m_height
+            ) };
+        } else if (scale == 0) {
+            throw std::invalid_argument{ "Invalid scale: 0" };
+        }
+
+        const auto start = findStart(data, src, rowIndex, region.m_y);
+        if (!start) {
+            throw std::invalid_argument{ "Row index does not match the image" };
+        }
+
+        const auto desc = regionDesc(region, scale, dest);
+        ByteVec    decoded(decodedSize(desc.m_width, desc.m_height, desc.m_channels));
+
+        if (decodeRegionInto(data, src, dest, region, scale, start.m_value, decoded) != Error::None) {
+            throw std::invalid_argument{ "Data is truncated: the ops end before the end of the region" };
+        }
+
+        return {
+            .m_data = std::move(decoded),
+            .m_desc = desc,
+        };
+    }
+
+    // `decodeRegion` reporting failure with an error code
+    inline Result<Image> tryDecodeRegion(
+        std::span<const Byte>                data,
+        Region                               region,
+        u32                                  scale,
+        std::optional<Channels>              target,
+        std::optional<std::span<const Byte>> rowIndex = std::nullopt
+    ) noexcept(false)
+    {
+        const auto prepared = tryPrepareDecode(data, target);
+        if (!prepared) {
+            return { .m_error = prepared.m_error };
+        }
+
+        const auto [src, dest] = prepared.m_value;
+
+        region = fillRegion(region, src);
+        if (const auto error = checkRegion(region, scale, src); error != Error::None) {
+            return { .m_error = error };
+        }
+
+        const auto start = findStart(data, src, rowIndex, region.m_y);
+        if (!start) {
+            return { .m_error = start.m_error };
+        }
+
+        const auto desc = regionDesc(region, scale, dest);
+        ByteVec    decoded(decodedSize(desc.m_width, desc.m_height, desc.m_channels));
+
+        const auto error = decodeRegionInto(data, src, dest, region, scale, start.m_value, decoded);
+        if (error != Error::None) {
+            return { .m_error = error };
+        }
+
+        return { .m_value = { .m_data = std::move(decoded), .m_desc = desc } };
+    }
+
+    template <bool Checked>
+    Image decodeImage(std::span<const Byte> data, std::optional<Channels> target) noexcept(false)
+    {
+        const auto [src, dest] = prepareDecode<Checked>(data, target);
+
+        ByteVec decoded(decodedSize(dest.m_width, dest.m_height, dest.m_channels));
+        decodeInto<Checked>(data, decoded, src, dest);
+
+        return {
+            .m_data = std::move(decoded),
+            .m_desc = dest,
+        };
+    }
+
+    template <bool Checked>
+    ImageDesc decodeImage(
+        std::span<const Byte>   data,
+        const Allocate&         allocate,
+        std::optional<Channels> target
+    ) noexcept(false)
+    {
+        const auto [src, dest] = prepareDecode<Checked>(data, target);
+
+        const auto required = decodedSize(dest.m_width, dest.m_height, dest.m_channels);
+        const auto out      = allocate(required);
+        if (out.size() < required) {
+            throw std::invalid_argument{ std::format(
+                "Output buffer is too small: expected at least {} bytes, got {}", required, out.size()
+            ) };
+        }
+
+        decodeInto<Checked>(data, out, src, dest);
+        return dest;
+    }
+
+    template <bool Checked>
+    ImageDesc decodeImage(
+        std::span<const Byte>   data,
+        std::span<Byte>         out,
+        std::optional<Channels> target
+    ) noexcept(false)
+    {
+        return decodeImage<Checked>(data, Allocate{ [out](usize) { return out; } }, target);
+    }
+
+    inline Result<Image> tryDecodeImage(
+        std::span<const Byte>   data,
+        std::optional<Channels> target
+    ) noexcept(false)
+    {
+        const auto prepared = tryPrepareDecode(data, target);
+        if (!prepared) {
+            return { .m_error = prepared.m_error };
+        }
+
+        const auto [src, dest] = prepared.m_value;
+
+        ByteVec decoded(decodedSize(dest.m_width, dest.m_height, dest.m_channels));
+        if (const auto error = tryDecodeInto<true>(data, decoded, src, dest); error != Error::None) {
+            return { .m_error = error };
+        }
+
+        return { .m_value = { .m_data = std::move(decoded), .m_desc = dest } };
+    }
+
+    inline Result<ImageDesc> tryDecodeImage(
+        std::span<const Byte>   data,
+        std::span<Byte>         out,
+        std::optional<Channels> target
+    ) noexcept
+    {
+        const auto prepared = tryPrepareDecode(data, target);
+        if (!prepared) {
+            return { .m_error = prepared.m_error };
+        }
+
+        const auto [src, dest] = prepared.m_value;
+
+        if (out.size() < decodedSize(dest.m_width, dest.m_height, dest.m_channels)) {
+            return { .m_error = Error::SizeMismatch };
+        } else if (const auto error = tryDecodeInto<true>(data, out, src, dest); error != Error::None) {
+            return { .m_error = error };
+        }
+
+        return { .m_value = dest };
+    }
+
+    // `allocate` is only called once the header is checked
+    inline Result<ImageDesc> tryDecodeImage(
+        std::span<const Byte>   data,
+        const Allocate&         allocate,
+        std::optional<Channels> target
+    ) noexcept(false)
+    {
+        const auto prepared = tryPrepareDecode(data, target);
+        if (!prepared) {
+            return { .m_error = prepared.m_error };
+        }
+
+        const auto [src, dest] = prepared.m_value;
+
+        const auto required = decodedSize(dest.m_width, dest.m_height, dest.m_channels);
+        const auto out      = allocate(required);
+        if (out.size() < required) {
+            return { .m_error = Error::SizeMismatch };
+        } else if (const auto error = tryDecodeInto<true>(data, out, src, dest); error != Error::None) {
+            return { .m_error = error };
+        }
+
+        return { .m_value = dest };
+    }
+
+    // `prepareDecode` with the channels known at compile time, the image must have `Src` channels
+    template <Channels Src, Channels Dest>
+    ImageDesc prepareDecode(std::span<const Byte> data) noexcept(false)
+    {
+        const auto [src, dest] = prepareDecode<true>(data, Dest);
+
+        if (src.m_channels != Src) {
+            throw std::invalid_argument{ std::format(
+                "Image channels do not match: expected {}, got {}",
+                static_cast<i32>(Src),
+                static_cast<i32>(src.m_channels)
+            ) };
+        }
+
+        return dest;
+    }
+
+    // `tryPrepareDecode` with the channels known at compile time
+    template <Channels Src, Channels Dest>
+    Result<ImageDesc> tryPrepareDecode(std::span<const Byte> data) noexcept
+    {
+        const auto prepared = tryPrepareDecode(data, Dest);
+        if (!prepared) {
+            return { .m_error = prepared.m_error };
+        } else if (prepared.m_value.first.m_channels != Src) {
+            return { .m_error = Error::BadChannels };
+        }
+
+        return { .m_value = prepared.m_value.second };
+    }
+
+    // `tryDecodeInto` without the dispatch on the channels
+    template <Channels Src, Channels Dest>
+    Error tryDecodeInto(std::span<const Byte> data, std::span<Byte> out, ImageDesc dest) noexcept
+    {
+        const auto pixelCount = static_cast<usize>(dest.m_width) * dest.m_height;
+        const auto end        = data.size() - constants::endMarker.size();
+
+        usize      index    = constants::headerSize;
+        const auto complete = decode<Src, Dest, true>(
+            data, index, end, out.first(pixelCount * static_cast<usize>(Dest)), pixelCount
+        );
+
+        return complete ? Error::None : Error::Truncated;
+    }
+
+    template <Channels Src, Channels Dest>
+    void decodeInto(std::span<const Byte> data, std::span<Byte> out, ImageDesc dest) noexcept(false)
+    {
+        if (tryDecodeInto<Src, Dest>(data, out, dest) != Error::None) {
+            throw std::invalid_argument{ "Data is truncated: the op stream ends before the last pixel" };
+        }
+    }
+}
+
+namespace qoipp::impl
+{
+    // the pool for everything that runs in parallel without being given a pool
+    inline ThreadPool& sharedPool() noexcept(false)
+    {
+        static ThreadPool pool;
+        return pool;
+    }
+
+    struct StripeLayout
+    {
+        usize m_count;
+        usize m_height;    // in rows, the last stripe may be shorter
+    };
+
+    inline StripeLayout stripeLayout(usize height, usize stripes) noexcept
+    {
+        if (stripes == 0) {
+            stripes = std::max(std::thread::hardware_concurrency(), 1u);
+        }
+
+        const auto stripeHeight = (height + std::min(stripes, height) - 1) / std::min(stripes, height);
+        return {
+            .m_count  = (height + stripeHeight - 1) / stripeHeight,
+            .m_height = stripeHeight,
+        };
+    }
+
+    constexpr usize stripedSize(usize width, usize height, Channels channels, usize stripes) noexcept
+    {
+        return maxEncodedSize(width, height, channels) + stripes * sizeof(u64) + constants::stripeTrailerSize;
+    }
+
+    // Encode a stripe other than the first so that it decodes the same whatever state the decoder is in when
+    // it gets to the stripe: the first pixel is a full OP_RGB/OP_RGBA and only pixels seen in the stripe are
+    // ever indexed. Since the state matches again after that first pixel, the image as a whole is still a
+    // valid QOI stream.
+    template <Channels Chan>
+    usize encodeStripe(std::span<const Byte> data, std::span<Byte> out, Effort effort) noexcept
+    {
+        constexpr auto channels = static_cast<usize>(Chan);
+
+        PerfScope      perf{ &Stats::m_encodePerf };
+        DataChunkArray chunks{ out };
+        EncodeState    state;
+
+        // an entry can't be matched by any pixel if it holds a pixel that hashes to another entry; the zeroed
+        // pixel hashes to 0 so only the first entry needs another value
+        state.m_seenPixels[0] = { 0x01, 0x00, 0x00, 0x00 };
+
+        Pixel first;
+        PixelReader<Chan>{ data }(first, 0);
+
+        if constexpr (Chan == Channels::RGBA) {
+            chunks.push(data::op::Rgba{
+                .m_r = first.m_r,
+                .m_g = first.m_g,
+                .m_b = first.m_b,
+                .m_a = first.m_a,
+            });
+        } else {
+            chunks.push(data::op::Rgb{
+                .m_r = first.m_r,
+                .m_g = first.m_g,
+                .m_b = first.m_b,
+            });
+        }
+
+        state.m_seenPixels[hash(first) % constants::runningArraySize] = first;
+        state.m_prevPixel                                              = first;
+
+        encodePixels<Chan>(state, chunks, data.subspan(channels), true, effort);
+
+        return chunks.size();
+    }
+
+    // `out` must be at least `stripedSize(width, height, Chan, layout.m_count)` bytes long
+    template <Channels Chan>
+    usize encodeStriped(
+        std::span<const Byte> data,
+        std::span<Byte>       out,
+        u32                   width,
+        u32                   height,
+        bool                  srgb,
+        StripeLayout          layout,
+        Effort                effort
+    ) noexcept(false)
+    {
+        constexpr auto channels = static_cast<usize>(Chan);
+
+        const auto stripeSize = layout.m_height * width * channels;
+        const auto worstSize  = layout.m_height * width * (channels + 1);
+        const auto slotOffset = [&](usize stripe) { return constants::headerSize + stripe * worstSize; };
+
+        DataChunkArray header{ out };
+        header.push(data::QoiHeader{
+            .m_width      = width,
+            .m_height     = height,
+            .m_channels   = static_cast<u8>(Chan),
+            .m_colorspace = static_cast<u8>(srgb ? 0 : 1),
+        });
+
+        // each stripe is encoded into its worst case slot then moved next to the previous one, the slot of a
+        // shorter last stripe is sized from its own rows so that it stays inside `out`
+        std::vector<usize> sizes(layout.m_count);
+        sharedPool().run(layout.m_count, [&](usize stripe) {
+            const auto begin  = stripe * stripeSize;
+            const auto pixels = data.subspan(begin, std::min(stripeSize, data.size() - begin));
+            const auto slot   = out.subspan(slotOffset(stripe), pixels.size() / channels * (channels + 1));
+
+            if (stripe == 0) {
+                DataChunkArray chunks{ slot };
+                EncodeState    state;
+                encodePixels<Chan>(state, chunks, pixels, true, effort);
+                sizes[stripe] = chunks.size();
+            } else {
+                sizes[stripe] = encodeStripe<Chan>(pixels, slot, effort);
+            }
+        });
+
+        std::vector<u64> offsets(layout.m_count);
+        usize            index = constants::headerSize;
+
+        for (usize stripe = 0; stripe < layout.m_count; ++stripe) {
+            std::memmove(out.data() + index, out.data() + slotOffset(stripe), sizes[stripe]);
+
+            offsets[stripe]  = index;
+            index           += sizes[stripe];
+        }
+
+        DataChunkArray chunks{ out.subspan(index) };
+        chunks.push(data::EndMarker{});
+        chunks.push(data::StripeTrailer{
+            .m_offsets      = offsets,
+            .m_stripeHeight = static_cast<u32>(layout.m_height),
+        });
+
+        return index + chunks.size();
+    }
+
+    struct Stripes
+    {
+        std::vector<usize> m_offsets;    // of the first op of each stripe
+        usize              m_height;     // in rows, the last stripe may be shorter
+        usize              m_end;        // the offset of the end marker
+    };
+
+    // get the stripe table of `data`, std::nullopt if the data has none or it doesn't fit the image
+    inline std::optional<Stripes> readStripes(std::span<const Byte> data, ImageDesc desc) noexcept
+    {
+        const auto read = [&]<typename T>(usize index, T) {
+            T value;
+            std::memcpy(&value, data.data() + index, sizeof(T));
+            return fromBigEndian(value);
+        };
+
+        const auto& magic = constants::stripeMagic;
+
+        // everything but the offsets
+        const auto fixedSize = constants::headerSize + constants::endMarker.size()
+                             + constants::stripeTrailerSize;
+
+        if (data.size() < fixedSize + sizeof(u64)) {
+            return std::nullopt;
+        }
+
+        if (std::memcmp(data.data() + data.size() - magic.size(), magic.data(), magic.size()) != 0) {
+            return std::nullopt;
+        }
+
+        const auto  trailerIndex = data.size() - constants::stripeTrailerSize;
+        const usize count        = read(trailerIndex, u32{});
+        const usize stripeHeight = read(trailerIndex + sizeof(u32), u32{});
+        const usize height       = desc.m_height;
+
+        // the stripe height must be the one `stripeLayout` gives for the count
+        if (count == 0 || stripeHeight == 0) {
+            return std::nullopt;
+        }
+        if ((count - 1) * stripeHeight >= height || count * stripeHeight < height) {
+            return std::nullopt;
+        }
+
+        if ((data.size() - fixedSize) / sizeof(u64) < count) {
+            return std::nullopt;
+        }
+
+        const auto tableIndex = trailerIndex - count * sizeof(u64);
+        const auto end        = tableIndex - constants::endMarker.size();
+
+        if (std::memcmp(data.data() + end, constants::endMarker.data(), constants::endMarker.size()) != 0) {
+            return std::nullopt;
+        }
+
+        Stripes stripes{
+            .m_offsets = std::vector<usize>(count),
+            .m_height  = stripeHeight,
+            .m_end     = end,
+        };
+
+        auto previous = constants::headerSize;
+        for (usize stripe = 0; stripe < count; ++stripe) {
+            const auto offset = read(tableIndex + stripe * sizeof(u64), u64{});
+            if (stripe == 0 ? offset != constants::headerSize : offset <= previous) {
+                return std::nullopt;
+            }
+            if (offset >= end) {
+                return std::nullopt;
+            }
+            stripes.m_offsets[stripe] = previous = static_cast<usize>(offset);
+        }
+
+        return stripes;
+    }
+
+    inline ByteVec encodeStriped(
+        std::span<const Byte> data,
+        ImageDesc             desc,
+        usize                 stripes,
+        Effort                effort
+    ) noexcept(false)
+    {
+        const auto [width, height, channels, colorspace] = desc;
+
+        const auto layout = stripeLayout(height, stripes);
+        const bool isSrgb = colorspace == Colorspace::sRGB;
+
+        ByteVec encoded(stripedSize(width, height, channels, layout.m_count));
+
+        usize size;
+        if (channels == Channels::RGB) {
+            size = encodeStriped<Channels::RGB>(data, encoded, width, height, isSrgb, layout, effort);
+        } else {
+            size = encodeStriped<Channels::RGBA>(data, encoded, width, height, isSrgb, layout, effort);
+        }
+
+        encoded.resize(size);
+        return encoded;
+    }
+
+    // decode each stripe of an image checked with `tryPrepareDecode` on its own thread into `out`, or the
+    // whole image at once if there is no stripe table
+    inline Error decodeStripedInto(
+        std::span<const Byte> data,
+        std::span<Byte>       out,
+        ImageDesc             src,
+        ImageDesc             dest
+    ) noexcept(false)
+    {
+        const auto stripes = readStripes(data, src);
+        if (!stripes.has_value()) {
+            return tryDecodeInto<true>(data, out, src, dest);
+        }
+
+        const auto count   = stripes->m_offsets.size();
+        const auto rowSize = static_cast<usize>(dest.m_width) * static_cast<usize>(dest.m_channels);
+
+        // each thread writes to its own element
+        std::vector<Error> errors(count);
+
+        sharedPool().run(count, [&](usize stripe) {
+            const auto first = stripe * stripes->m_height;
+            const auto rows  = std::min<usize>(stripes->m_height, dest.m_height - first);
+            const auto last  = stripe + 1 == count;
+            const auto end   = last ? stripes->m_end : stripes->m_offsets[stripe + 1];
+            const auto part  = out.subspan(first * rowSize, rows * rowSize);
+
+            // the ops of a stripe must end exactly where the next stripe starts
+            auto index = stripes->m_offsets[stripe];
+            if (!decodeRange<true>(data, index, end, part, src.m_channels, dest.m_channels)) {
+                errors[stripe] = Error::Truncated;
+            } else if (!last && index != end) {
+                errors[stripe] = Error::BadTable;
+            }
+        });
+
+        const auto failed = std::ranges::find_if(errors, [](Error error) { return error != Error::None; });
+        return failed == errors.end() ? Error::None : *failed;
+    }
+
+    inline Image decodeStriped(std::span<const Byte> data, std::optional<Channels> target) noexcept(false)
+    {
+        const auto [src, dest] = prepareDecode<true>(data, target);
+
+        ByteVec decoded(decodedSize(dest.m_width, dest.m_height, dest.m_channels));
+
+        const auto error = decodeStripedInto(data, decoded, src, dest);
+        if (error == Error::BadTable) {
+            throw std::invalid_argument{ "Stripes do not match the stripe table" };
+        } else if (error != Error::None) {
+            throw std::invalid_argument{ "Data is truncated: the op stream ends before the last pixel" };
+        }
+
+        return {
+            .m_data = std::move(decoded),
+            .m_desc = dest,
+        };
+    }
+
+    // `decodeStriped` reporting failure with an error code
+    inline Result<Image> tryDecodeStriped(
+        std::span<const Byte>   data,
+        std::optional<Channels> target
+    ) noexcept(false)
+    {
+        const auto prepared = tryPrepareDecode(data, target);
+        if (!prepared) {
+            return { .m_error = prepared.m_error };
+        }
+
+        const auto [src, dest] = prepared.m_value;
+
+        ByteVec decoded(decodedSize(dest.m_width, dest.m_height, dest.m_channels));
+        if (const auto error = decodeStripedInto(data, decoded, src, dest); error != Error::None) {
+            return { .m_error = error };
+        }
+
+        return { .m_value = { .m_data = std::move(decoded), .m_desc = dest } };
+    }
+
+    // decode an image checked with `tryPrepareDecode` once and save the decoder state at the first pixel of
+    // every `interval` rows, `interval` must not be 0
+    inline Result<ByteVec> rowIndex(std::span<const Byte> data, ImageDesc src, u32 interval) noexcept(false)
+    {
+        const auto width  = static_cast<usize>(src.m_width);
+        const auto height = static_cast<usize>(src.m_height);
+        const auto count  = (height + interval - 1) / interval;
+        const auto total  = width * height;
+        const auto step   = width * interval;    // pixels between checkpoints
+
+        ByteVec index(count * constants::checkpointSize + constants::rowIndexTrailerSize);
+        usize   indexSize = 0;
+
+        DecodeState state;
+        const auto  checkpoint = [&](usize offset, usize run) {
+            const auto chunk = data::RowCheckpoint{
+                .m_offset     = offset,
+                .m_run        = static_cast<u32>(run),
+                .m_prevPixel  = state.m_prevPixel,
+                .m_seenPixels = state.m_seenPixels,
+            };
+            chunk.write(index, indexSize);
+        };
+
+        const auto* bytes = data.data();
+        const auto  end   = data.size() - constants::endMarker.size();
+
+        usize offset = constants::headerSize;
+        usize pixel  = 0;
+        usize next   = 0;    // the pixel of the next checkpoint
+
+        while (pixel < total && offset < end) {
+            if (pixel == next) {
+                checkpoint(offset, 0);
+                next += step;
+            }
+
+            pixel += decodeOp(state, bytes, offset);
+
+            // a run ending past a checkpoint leaves its pixel as the previous pixel, already seen
+            for (; next < std::min(pixel, total); next += step) {
+                checkpoint(offset, pixel - next);
+            }
+        }
+
+        const auto& marker = constants::endMarker;
+        if (pixel < total || offset > end) {
+            return { .m_error = Error::Truncated };
+        } else if (std::memcmp(bytes + offset, marker.data(), marker.size()) != 0) {
+            return { .m_error = Error::BadEndMarker };
+        }
+
+        const auto trailer = data::RowIndexTrailer{
+            .m_width    = src.m_width,
+            .m_height   = src.m_height,
+            .m_end      = offset,
+            .m_interval = interval,
+            .m_count    = static_cast<u32>(count),
+        };
+        trailer.write(index, indexSize);
+
+        return { .m_value = std::move(index) };
+    }
+
+    inline ByteVec indexRows(std::span<const Byte> data, u32 interval) noexcept(false)
+    {
+        const auto [src, _] = prepareDecode<true>(data, std::nullopt);
+
+        if (interval == 0) {
+            throw std::invalid_argument{ "Invalid row index interval: 0" };
+        }
+
+        auto index = rowIndex(data, src, interval);
+        if (index.m_error == Error::Truncated) {
+            throw std::invalid_argument{ "Data is truncated: the op stream ends before the last pixel" };
+        } else if (index.m_error == Error::BadEndMarker) {
+            throw std::invalid_argument{ "Data does not have an end marker after the last op" };
+        }
+
+        return std::move(index.m_value);
+    }
+
+    // `indexRows` reporting failure with an error code
+    inline Result<ByteVec> tryIndexRows(std::span<const Byte> data, u32 interval) noexcept(false)
+    {
+        const auto prepared = tryPrepareDecode(data, std::nullopt);
+        if (!prepared) {
+            return { .m_error = prepared.m_error };
+        } else if (interval == 0) {
+            return { .m_error = Error::BadRegion };
+        }
+
+        return rowIndex(data, prepared.m_value.first, interval);
+    }
+
+    // The state of the decoder at a point of a segment decoded from the start state instead of the state the
+    // previous segment ends with. The seen pixels that matter from here on are the ones read by an OP_INDEX
+    // before being written again: if those and the previous pixel are the same in both states, the segment
+    // decodes the same from here.
+    struct Snapshot
+    {
+        usize       m_offset;
+        usize       m_pixel;      // in the segment
+        u64         m_read;       // the seen pixels read before they are written after this point
+        u64         m_written;    // the seen pixels written after this point
+        DecodeState m_state;
+    };
+
+    // a range of ops decoded on its own by `decodeParallel`
+    struct Segment
+    {
+        usize m_begin;
+        usize m_end;
+        usize m_pixel;
+        usize m_pixels;
+
+        std::vector<Snapshot> m_snapshots = {};
+        DecodeState           m_state     = {};    // at the end of the segment, decoded from the start state
+    };
+
+    // an op and the number of pixels before it
+    struct OpCursor
+    {
+        usize m_offset;
+        usize m_pixels;
+
+        // the size of an op and the number of pixels it decodes only depend on its tag
+        void next(const Byte* bytes) noexcept
+        {
+            const auto& op  = opTable[std::to_integer<u8>(bytes[m_offset])];
+            m_offset       += op.m_size;
+            m_pixels       += op.m_kind == OpInfo::Run ? op.m_arg : 1;
+        }
+    };
+
+    // Split the ops in `data[headerSize, end)` into at most `count` segments of about the same size in bytes
+    // without decoding them.
+    //
+    // The tags can only be told from the other bytes by reading the ops in order from the first one, so
+    // each range of bytes is read in parallel as if an op started at its first byte. Since most ops are one
+    // or two bytes long, such a read soon falls in step with the real ops: the read of the range before is
+    // then carried on until it reaches an op the range was read to have, where the segment starts. The last
+    // segment ends with the last pixel. Returns std::nullopt if the reads of two ranges don't fall in step
+    // within their first ops or if the ops decode fewer than `pixelCount` pixels.
+    inline std::optional<std::vector<Segment>> splitOps(
+        std::span<const Byte> data,
+        usize                 end,
+        usize                 pixelCount,
+        usize                 count,
+        ThreadPool&           pool
+    ) noexcept(false)
+    {
+        constexpr usize trailLength = 64;    // ops
+
+        const auto* bytes = data.data();
+        const auto  step  = (end - constants::headerSize) / count;
+        const auto  begin = [&](usize range) { return constants::headerSize + range * step; };
+
+        // the first ops of each range as read from its first byte and where the read ends
+        std::vector<std::vector<OpCursor>> trails(count);
+        std::vector<OpCursor>              ends(count);
+
+        pool.run(count, [&](usize range) {
+            const auto limit  = range + 1 < count ? begin(range + 1) : end;
+            auto       cursor = OpCursor{ begin(range), 0 };
+            auto&      trail  = trails[range];
+
+            trail.reserve(trailLength);
+            for (; trail.size() < trailLength && cursor.m_offset < limit; cursor.next(bytes)) {
+                trail.push_back(cursor);
+            }
+            while (cursor.m_offset < limit) {
+                cursor.next(bytes);
+            }
+
+            ends[range] = cursor;
+        });
+
+        std::vector<Segment> segments;
+        segments.reserve(count);
+
+        usize first  = 0;    // the op of the trail of the current range the segment starts with
+        usize pixels = 0;    // before the segment
+
+        for (usize range = 0; range < count; ++range) {
+            const auto& start  = trails[range][first];
+            auto        cursor = ends[range];
+
+            // the first op of the next range that is also an op of this one
+            usize next = 0;
+            if (range + 1 < count) {
+                const auto& trail = trails[range + 1];
+                while (next < trail.size() && trail[next].m_offset != cursor.m_offset) {
+                    if (trail[next].m_offset < cursor.m_offset) {
+                        ++next;
+                    } else {
+                        cursor.next(bytes);
+                    }
+                }
+                if (next == trail.size()) {
+                    return std::nullopt;
+                }
+            }
+
+            const auto size = cursor.m_pixels - start.m_pixels;
+            const auto last = range + 1 == count || pixels + size >= pixelCount;
+
+            segments.push_back({
+                .m_begin  = start.m_offset,
+                .m_end    = last ? end : cursor.m_offset,
+                .m_pixel  = pixels,
+                .m_pixels = last ? pixelCount - pixels : size,
+            });
+
+            if (last) {
+                return pixels + size >= pixelCount ? std::optional{ std::move(segments) } : std::nullopt;
+            }
+
+            first   = next;
+            pixels += size;
+        }
+
+        return std::nullopt;
+    }
+
+    // decode a segment from the start state into `out`, which holds the pixels of the segment only
+    // returns false if the ops run out before the last pixel of the segment or if its last op overlaps
+    // the end of the segment
+    template <Channels Src, Channels Dest>
+    bool decodeSegment(std::span<const Byte> data, Segment& segment, std::span<Byte> out) noexcept(false)
+    {
+        constexpr bool  expand        = Src == Channels::RGB && Dest == Channels::RGBA;
+        constexpr usize snapshotEvery = 4096;    // pixels
+
+        PerfScope                 perf{ &Stats::m_decodePerf };
+        DecodeState               state;
+        PixelWriter<Dest, expand> write{ out };
+
+        auto& snapshots = segment.m_snapshots;
+
+        // the number of snapshots taken at the last read or write and at the last write of each seen pixel,
+        // the snapshots taken since then are the ones whose masks an event on the seen pixel updates
+        std::array<u32, constants::runningArraySize> lastEvent = {};
+        std::array<u32, constants::runningArraySize> lastWrite = {};
+
+        const auto mark = [&](u64 Snapshot::* mask, u32& since, usize slot) {
+            for (; since < snapshots.size(); ++since) {
+                snapshots[since].*mask |= u64{ 1 } << slot;
+            }
+        };
+
+        const auto* bytes = data.data();
+
+        usize index = segment.m_begin;
+        usize pixel = 0;
+        usize next  = 0;
+
+        while (index < segment.m_end && pixel < segment.m_pixels) {
+            if (pixel >= next) {
+                snapshots.push_back({
+                    .m_offset  = index,
+                    .m_pixel   = pixel,
+                    .m_read    = 0,
+                    .m_written = 0,
+                    .m_state   = state,
+                });
+                next = pixel + snapshotEvery;
+            }
+
+            const auto& op = opTable[std::to_integer<u8>(bytes[index])];
+            if (op.m_kind == OpInfo::Index) {
+                mark(&Snapshot::m_read, lastEvent[op.m_arg], op.m_arg);
+            }
+
+            const auto count = std::min(decodeOp(state, bytes, index), segment.m_pixels - pixel);
+            const auto slot  = hash(state.m_prevPixel) % constants::runningArraySize;
+
+            mark(&Snapshot::m_written, lastWrite[slot], slot);
+            lastEvent[slot] = lastWrite[slot];
+
+            if (count == 1) {
+                write(pixel, state.m_prevPixel);
+            } else {
+                write.fill(pixel, count, state.m_prevPixel);
+            }
+            pixel += count;
+        }
+
+        segment.m_state = state;
+        return pixel == segment.m_pixels && index <= segment.m_end;
+    }
+
+    // Redecode the start of a segment decoded by `decodeSegment` from `state`, the state the previous segment
+    // ends with, until it reaches a snapshot from which the segment decodes the same. Returns the state the
+    // segment ends with.
+    template <Channels Src, Channels Dest>
+    DecodeState resolveSegment(
+        std::span<const Byte> data,
+        const Segment&        segment,
+        DecodeState           state,
+        std::span<Byte>       out
+    ) noexcept
+    {
+        constexpr bool expand = Src == Channels::RGB && Dest == Channels::RGBA;
+
+        const auto& snapshots = segment.m_snapshots;
+        const auto* bytes     = data.data();
+
+        const auto matches = [&](const Snapshot& snapshot) {
+            const auto& [seenPixels, prevPixel] = snapshot.m_state;
+            if (prevPixel != state.m_prevPixel) {
+                return false;
+            }
+            for (usize slot = 0; slot < constants::runningArraySize; ++slot) {
+                const auto read = (snapshot.m_read >> slot) & 1;
+                if (read != 0 && seenPixels[slot] != state.m_seenPixels[slot]) {
+                    return false;
+                }
+            }
+            return true;
+        };
+
+        for (usize i = 0; i < snapshots.size(); ++i) {
+            const auto& snapshot = snapshots[i];
+
+            // the seen pixels that are not written again keep the value they have here
+            if (matches(snapshot)) {
+                auto result = segment.m_state;
+                for (usize slot = 0; slot < constants::runningArraySize; ++slot) {
+                    if (((snapshot.m_written >> slot) & 1) == 0) {
+                        result.m_seenPixels[slot] = state.m_seenPixels[slot];
+                    }
+                }
+                return result;
+            }
+
+            const auto last = i + 1 == snapshots.size();
+            const auto end  = last ? segment.m_end : snapshots[i + 1].m_offset;
+            const auto stop = last ? segment.m_pixels : snapshots[i + 1].m_pixel;
+
+            // the writer must not go past the pixels decoded again, the ones after are already right
+            auto index = snapshot.m_offset;
+            auto pixel = snapshot.m_pixel;
+            auto write = PixelWriter<Dest, expand>{ out.first(stop * static_cast<usize>(Dest)) };
+
+            while (index < end && pixel < stop) {
+                const auto count = std::min(decodeOp(state, bytes, index), segment.m_pixels - pixel);
+                if (count == 1) {
+                    write(pixel, state.m_prevPixel);
+                } else {
+                    write.fill(pixel, count, state.m_prevPixel);
+                }
+                pixel += count;
+            }
+        }
+
+        return state;
+    }
+
+    // Decode the ops of an image checked with `tryPrepareDecode` in segments in parallel, each from the start
+    // state, then fix the start of each segment up with the state the previous one really ends with. Only
+    // the pixels of a segment up to the point where it no longer depends on the state it starts with are
+    // decoded twice.
+    inline Error decodeParallelInto(
+        std::span<const Byte> data,
+        std::span<Byte>       decoded,
+        ImageDesc             src,
+        ImageDesc             dest,
+        ThreadPool&           pool
+    ) noexcept(false)
+    {
+        constexpr usize minSegmentSize = 256 * 1024;    // bytes of ops
+
+        const auto end        = data.size() - constants::endMarker.size();
+        const auto count      = std::min(pool.size(), (end - constants::headerSize) / minSegmentSize);
+        const auto pixelCount = static_cast<usize>(src.m_width) * src.m_height;
+        const auto channels   = static_cast<usize>(dest.m_channels);
+
+        // images that can't be split are decoded in order, which reports truncated data too
+        auto segments = count > 1 ? splitOps(data, end, pixelCount, count, pool) : std::nullopt;
+        if (!segments.has_value()) {
+            return tryDecodeInto<true>(data, decoded, src, dest);
+        }
+
+        // not std::vector<bool>, each thread writes to its own element
+        std::vector<u8> complete(segments->size());
+
+        const auto decode = [&]<Channels Src, Channels Dest>() {
+            const auto out = [&](const Segment& segment) {
+                return decoded.subspan(segment.m_pixel * channels, segment.m_pixels * channels);
+            };
+
+            pool.run(segments->size(), [&](usize i) {
+                auto& segment = (*segments)[i];
+                complete[i]   = decodeSegment<Src, Dest>(data, segment, out(segment));
+            });
+
+            if (!std::ranges::all_of(complete, [](u8 done) { return done != 0; })) {
+                return Error::Truncated;
+            }
+
+            auto state = DecodeState{};
+            for (const auto& segment : *segments) {
+                state = resolveSegment<Src, Dest>(data, segment, state, out(segment));
+            }
+            return Error::None;
+        };
+
+        constexpr auto RGB  = Channels::RGB;
+        constexpr auto RGBA = Channels::RGBA;
+
+        if (src.m_channels == RGB && dest.m_channels == RGB) {
+            return decode.template operator()<RGB, RGB>();
+        } else if (src.m_channels == RGB) {
+            return decode.template operator()<RGB, RGBA>();
+        } else if (dest.m_channels == RGB) {
+            return decode.template operator()<RGBA, RGB>();
+        } else {
+            return decode.template operator()<RGBA, RGBA>();
+        }
+    }
+
+    inline Image decodeParallel(
+        std::span<const Byte>   data,
+        std::optional<Channels> target,
+        ThreadPool&             pool
+    ) noexcept(false)
+    {
+        const auto [src, dest] = prepareDecode<true>(data, target);
+
+        ByteVec decoded(decodedSize(dest.m_width, dest.m_height, dest.m_channels));
+        if (decodeParallelInto(data, decoded, src, dest, pool) != Error::None) {
+            throw std::invalid_argument{ "Data is truncated: the op stream ends before the last pixel" };
+        }
+
+        return {
+            .m_data = std::move(decoded),
+            .m_desc = dest,
+        };
+    }
+
+    // `decodeParallel` reporting failure with an error code
+    inline Result<Image> tryDecodeParallel(
+        std::span<const Byte>   data,
+        std::optional<Channels> target,
+        ThreadPool&             pool
+    ) noexcept(false)
+    {
+        const auto prepared = tryPrepareDecode(data, target);
+        if (!prepared) {
+            return { .m_error = prepared.m_error };
+        }
+
+        const auto [src, dest] = prepared.m_value;
+
+        ByteVec decoded(decodedSize(dest.m_width, dest.m_height, dest.m_channels));
+        if (const auto error = decodeParallelInto(data, decoded, src, dest, pool); error != Error::None) {
+            return { .m_error = error };
+        }
+
+        return { .m_value = { .m_data = std::move(decoded), .m_desc = dest } };
+    }
+}
+
+namespace qoipp::impl
+{
+    struct FormatLayout
+    {
+        std::array<u8, 4> m_order;            // the channel of each byte of a pixel, 0 to 3 for r, g, b, a
+        bool              m_padded;           // the alpha byte is padding
+        bool              m_premultiplied;    // the color is multiplied by alpha
+    };
+
+    constexpr FormatLayout formatLayout(PixelFormat format) noexcept
+    {
+        switch (format) {
+        case PixelFormat::BGRA: return { { 2, 1, 0, 3 }, false, false };
+        case PixelFormat::ARGB: return { { 3, 0, 1, 2 }, false, false };
+        case PixelFormat::ABGR: return { { 3, 2, 1, 0 }, false, false };
+        case PixelFormat::RGBX: return { { 0, 1, 2, 3 }, true, false };
+        case PixelFormat::BGRX: return { { 2, 1, 0, 3 }, true, false };
+        case PixelFormat::RGBAPremultiplied: return { { 0, 1, 2, 3 }, false, true };
+        case PixelFormat::BGRAPremultiplied: return { { 2, 1, 0, 3 }, false, true };
+        default: return { { 0, 1, 2, 3 }, false, false };
+        }
+    }
+
+    // call `fn` with the format as its template argument
+    template <typename Fn>
+    decltype(auto) withFormat(PixelFormat format, Fn&& fn) noexcept(false)
+    {
+        using enum PixelFormat;
+
+        switch (format) {
+        case RGBA: return fn.template operator()<RGBA>();
+        case BGRA: return fn.template operator()<BGRA>();
+        case ARGB: return fn.template operator()<ARGB>();
+        case ABGR: return fn.template operator()<ABGR>();
+        case RGBX: return fn.template operator()<RGBX>();
+        case BGRX: return fn.template operator()<BGRX>();
+        case RGBAPremultiplied: return fn.template operator()<RGBAPremultiplied>();
+        case BGRAPremultiplied: return fn.template operator()<BGRAPremultiplied>();
+        }
+
+        throw std::invalid_argument{ std::format("Invalid pixel format: {}", static_cast<i32>(format)) };
+    }
+
+    // round(c * a / 255) without a division
+    constexpr u8 premultiply(u8 c, u8 a) noexcept
+    {
+        const u32 t = u32{ c } * a + 128;
+        return static_cast<u8>((t + (t >> 8)) >> 8);
+    }
+
+    // ceil(2^32 / a), `(n * m) >> 32` is exactly `n / a` for every `n` below 2^16
+    inline constexpr auto reciprocals = [] {
+        std::array<u64, 256> table = {};
+        for (u64 a = 1; a < table.size(); ++a) {
+            table[a] = ((u64{ 1 } << 32) + a - 1) / a;
+        }
+        return table;
+    }();
+
+    // round(c * 255 / a) clamped to 255 without a division, `a` must not be 0
+    constexpr u8 unpremultiply(u8 c, u8 a) noexcept
+    {
+        const u64 n = u64{ c } * 255 + a / 2;
+        return static_cast<u8>(std::min<u64>((n * reciprocals[a]) >> 32, 0xFF));
+    }
+
+    // move byte `From[i]` of the 4 bytes in `value` to byte `i`, counted in memory order; done on the word
+    // instead of through memory so it compiles to a few shifts (or a single bswap or rotate)
+    template <std::array<u8, 4> From>
+    constexpr u32 permute(u32 value) noexcept
+    {
+        constexpr auto little = std::endian::native == std::endian::little;
+
+        const auto shift = [](u32 i) { return little ? i * 8 : 24 - i * 8; };
+        const auto byte  = [&](u32 i) { return ((value >> shift(From[i])) & 0xFF) << shift(i); };
+
+        // spelled out, a loop would not be unrolled at -O2
+        return byte(0) | byte(1) | byte(2) | byte(3);
+    }
+
+    constexpr std::array<u8, 4> inverse(std::array<u8, 4> order) noexcept
+    {
+        std::array<u8, 4> result = {};
+        for (u8 i = 0; i < 4; ++i) {
+            result[order[i]] = i;
+        }
+        return result;
+    }
+
+    // the straight RGBA pixel of the 4 bytes of a pixel of the format `F`
+    template <PixelFormat F>
+    inline Pixel readFormat(const Byte* bytes) noexcept
+    {
+        constexpr auto layout = formatLayout(F);
+
+        u32 value;
+        std::memcpy(&value, bytes, sizeof(value));
+
+        auto pixel = std::bit_cast<Pixel>(permute<inverse(layout.m_order)>(value));
+        if constexpr (layout.m_padded) {
+            pixel.m_a = 0xFF;
+        } else if constexpr (layout.m_premultiplied) {
+            if (pixel.m_a == 0) {
+                pixel = { 0, 0, 0, 0 };
+            } else if (pixel.m_a != 0xFF) {
+                pixel.m_r = unpremultiply(pixel.m_r, pixel.m_a);
+                pixel.m_g = unpremultiply(pixel.m_g, pixel.m_a);
+                pixel.m_b = unpremultiply(pixel.m_b, pixel.m_a);
+            }
+        }
+        return pixel;
+    }
+
+    // the bytes of the straight RGBA pixel in the format `F`, in the order they are laid out in memory
+    template <PixelFormat F>
+    inline Pixel formatPixel(Pixel pixel) noexcept
+    {
+        constexpr auto layout = formatLayout(F);
+
+        if constexpr (layout.m_padded) {
+            pixel.m_a = 0xFF;
+        } else if constexpr (layout.m_premultiplied) {
+            if (pixel.m_a != 0xFF) {
+                pixel.m_r = premultiply(pixel.m_r, pixel.m_a);
+                pixel.m_g = premultiply(pixel.m_g, pixel.m_a);
+                pixel.m_b = premultiply(pixel.m_b, pixel.m_a);
+            }
+        }
+
+        return std::bit_cast<Pixel>(permute<layout.m_order>(std::bit_cast<u32>(pixel)));
+    }
+
+    // the checks of `withFormat` and the `validate` functions below without the message
+    inline Error checkFormat(PixelFormat format) noexcept
+    {
+        const auto value = static_cast<i32>(format);
+        return value >= 0 && value <= static_cast<i32>(PixelFormat::BGRAPremultiplied) ? Error::None
+                                                                                        : Error::BadFormat;
+    }
+
+    inline Error checkFormatEncode(std::span<const Byte> data, ImageDesc desc, PixelFormat format) noexcept
+    {
+        if (const auto error = checkDesc(desc); error != Error::None) {
+            return error;
+        } else if (const auto error = checkFormat(format); error != Error::None) {
+            return error;
+        }
+
+        const auto size = decodedSize(desc.m_width, desc.m_height, Channels::RGBA);
+        return data.size() == size ? Error::None : Error::SizeMismatch;
+    }
+
+    inline void validateFormatEncode(std::span<const Byte> data, ImageDesc desc) noexcept(false)
+    {
+        validateDesc(desc);
+
+        const auto size = decodedSize(desc.m_width, desc.m_height, Channels::RGBA);
+        if (data.size() != size) {
+            throw std::invalid_argument{ std::format(
+                "Data size does not match the image description: expected {} x {} x 4 = {}, got {}",
+                desc.m_width,
+                desc.m_height,
+                size,
+                data.size()
+            ) };
+        }
+    }
+
+    // `encodePixels` of pixels of the format `F`, converted a block at a time into a buffer that is still in
+    // the cache when the kernel reads it back
+    template <Channels Chan, PixelFormat F>
+    void encodeFormat(
+        EncodeState&          state,
+        DataChunkArray&       chunks,
+        std::span<const Byte> data,
+        bool                  last,
+        Effort                effort
+    ) noexcept
+    {
+        constexpr auto  channels  = static_cast<usize>(Chan);
+        constexpr usize blockSize = 4096;    // pixels
+
+        ByteArr<blockSize * channels> block;
+
+        const auto count = data.size() / 4;
+        for (usize begin = 0; begin < count; begin += blockSize) {
+            const auto size = std::min(blockSize, count - begin);
+            for (usize i = 0; i < size; ++i) {
+                const auto pixel = readFormat<F>(data.data() + (begin + i) * 4);
+                std::memcpy(block.data() + i * channels, &pixel, channels);
+            }
+
+            const auto pixels = std::span{ block }.first(size * channels);
+            encodePixels<Chan>(state, chunks, pixels, last && begin + size == count, effort);
+        }
+    }
+
+    struct ViewLayout
+    {
+        usize m_rowSize;    // of the pixels of a row, without the padding
+        usize m_stride;
+    };
+
+    inline ViewLayout viewLayout(const ImageView& view) noexcept
+    {
+        const auto pixelSize = view.m_format.has_value() ? 4 : static_cast<usize>(view.m_desc.m_channels);
+        const auto rowSize   = view.m_desc.m_width * pixelSize;
+
+        return { rowSize, view.m_stride == 0 ? rowSize : view.m_stride };
+    }
+
+    inline Error checkView(const ImageView& view) noexcept
+    {
+        if (const auto error = checkDesc(view.m_desc); error != Error::None) {
+            return error;
+        } else if (view.m_format.has_value() && checkFormat(*view.m_format) != Error::None) {
+            return Error::BadFormat;
+        }
+
+        // see `validateView`
+        const auto [rowSize, stride] = viewLayout(view);
+
+        const auto size = view.m_data.size();
+        const auto rows = static_cast<usize>(view.m_desc.m_height) - 1;
+
+        if (stride < rowSize || size < rowSize || (rows > 0 && stride > (size - rowSize) / rows)) {
+            return Error::SizeMismatch;
+        }
+        return Error::None;
+    }
+
+    inline void validateView(const ImageView& view) noexcept(false)
+    {
+        validateDesc(view.m_desc);
+
+        if (view.m_format.has_value()) {
+            withFormat(*view.m_format, []<PixelFormat>() {});
+        }
+
+        const auto [rowSize, stride] = viewLayout(view);
+        if (stride < rowSize) {
+            throw std::invalid_argument{ std::format(
+                "Stride is smaller than a row: expected at least {} bytes, got {}", rowSize, stride
+            ) };
+        }
+
+        // the rows after the first must fit in what is left after it, checked with a division so that a huge
+        // stride can't wrap the size of the view around
+        const auto size = view.m_data.size();
+        const auto rows = static_cast<usize>(view.m_desc.m_height) - 1;
+
+        if (size < rowSize || (rows > 0 && stride > (size - rowSize) / rows)) {
+            throw std::invalid_argument{ std::format(
+                "Data is too small for the view: {} rows of {} bytes {} bytes apart do not fit in {} bytes",
+                view.m_desc.m_height,
+                rowSize,
+                stride,
+                size
+            ) };
+        }
+    }
+
+    // encode the rows of a view validated with `validateView` in place, one after the other
+    // `out` must be at least `maxEncodedSize(view.m_desc)` bytes long
+    inline usize encodeView(const ImageView& view, std::span<Byte> out, Effort effort) noexcept(false)
+    {
+        PerfScope perf{ &Stats::m_encodePerf };
+
+        const auto [width, height, channels, colorspace] = view.m_desc;
+        const auto [rowSize, stride]                     = viewLayout(view);
+
+        DataChunkArray chunks{ out };
+        EncodeState    state;
+
+        chunks.push(data::QoiHeader{
+            .m_width      = width,
+            .m_height     = height,
+            .m_channels   = static_cast<u8>(channels),
+            .m_colorspace = static_cast<u8>(colorspace),
+        });
+
+        // packed rows are encoded as one
+        const auto packed = stride == rowSize;
+        const auto rows   = packed ? 1 : height;
+        const auto size   = packed ? rowSize * height : rowSize;
+
+        constexpr auto RGB          = Channels::RGB;
+        constexpr auto RGBA         = Channels::RGBA;
+        constexpr auto packedPixels = false;    // no format, packed pixels of the channels of the image
+
+        const auto encodeAs = [&]<Channels Chan, auto Format>() {
+            for (u32 row = 0; row < rows; ++row) {
+                const auto pixels = view.m_data.subspan(row * stride, size);
+                const auto last   = row + 1 == rows;
+
+                if constexpr (std::same_as<decltype(Format), PixelFormat>) {
+                    encodeFormat<Chan, Format>(state, chunks, pixels, last, effort);
+                } else {
+                    encodePixels<Chan>(state, chunks, pixels, last, effort);
+                }
+            }
+        };
+
+        if (view.m_format.has_value()) {
+            withFormat(*view.m_format, [&]<PixelFormat F>() {
+                if (channels == RGB) {
+                    encodeAs.template operator()<RGB, F>();
+                } else {
+                    encodeAs.template operator()<RGBA, F>();
+                }
+            });
+        } else if (channels == RGB) {
+            encodeAs.template operator()<RGB, packedPixels>();
+        } else {
+            encodeAs.template operator()<RGBA, packedPixels>();
+        }
+
+        chunks.push(data::EndMarker{});
+        return chunks.size();
+    }
+
+    // `decodeKernel` into pixels of the format `F`, `out` must be exactly `pixelCount * 4` bytes long
+    template <Channels Src, PixelFormat F>
+    bool decodeFormat(std::span<const Byte> data, std::span<Byte> out, usize pixelCount) noexcept
+    {
+        PerfScope                   perf{ &Stats::m_decodePerf };
+        DecodeState                 state;
+        PixelWriter<Channels::RGBA> write{ out };
+
+        const auto* bytes = data.data();
+        const auto  end   = data.size() - constants::endMarker.size();
+
+        usize index      = constants::headerSize;
+        usize pixelIndex = 0;
+
+        while (pixelIndex < pixelCount) {
+            if (index >= end) [[unlikely]] {
+                return false;
+            }
+
+            const auto count = decodeOp(state, bytes, index);
+
+            auto pixel = state.m_prevPixel;
+            if constexpr (Src == Channels::RGB) {
+                pixel.m_a = 0xFF;
+            }
+            pixel = formatPixel<F>(pixel);
+
+            if (count == 1) [[likely]] {
+                write(pixelIndex++, pixel);
+                continue;
+            }
+
+            // a run may not go past the end of the image
+            const auto run = std::min(count, pixelCount - pixelIndex);
+            write.fill(pixelIndex, run, pixel);
+            pixelIndex += run;
+        }
+
+        return index <= end;
+    }
+
+    // decode an image checked with `prepareDecode` into `out`, at least `decodedSize(dest)` bytes long
+    // returns false if the ops run out before the last pixel
+    inline bool decodeFormatInto(
+        std::span<const Byte> data,
+        std::span<Byte>       out,
+        ImageDesc             src,
+        PixelFormat           format
+    ) noexcept(false)
+    {
+        const auto pixelCount = static_cast<usize>(src.m_width) * src.m_height;
+        const auto required   = pixelCount * 4;
+
+        return withFormat(format, [&]<PixelFormat F>() {
+            if (src.m_channels == Channels::RGB) {
+                return decodeFormat<Channels::RGB, F>(data, out.first(required), pixelCount);
+            } else {
+                return decodeFormat<Channels::RGBA, F>(data, out.first(required), pixelCount);
+            }
+        });
+    }
+
+    inline ImageDesc decodeFormatted(
+        std::span<const Byte> data,
+        const Allocate&       allocate,
+        PixelFormat           format
+    ) noexcept(false)
+    {
+        const auto [src, dest] = prepareDecode<true>(data, Channels::RGBA);
+
+        const auto required = decodedSize(dest.m_width, dest.m_height, dest.m_channels);
+        const auto out      = allocate(required);
+        if (out.size() < required) {
+            throw std::invalid_argument{ std::format(
+                "Output buffer is too small: expected at least {} bytes, got {}", required, out.size()
+            ) };
+        }
+
+        if (!decodeFormatInto(data, out, src, format)) {
+            throw std::invalid_argument{ "Data is truncated: the op stream ends before the last pixel" };
+        }
+
+        return dest;
+    }
+
+    // `decodeFormatted` reporting failure with an error code, `allocate` is only called once the header is
+    // checked, it is not an `Allocate` so that decoding into a given buffer doesn't allocate
+    template <typename Fn>
+    Result<ImageDesc> tryDecodeFormatted(
+        std::span<const Byte> data,
+        const Fn&             allocate,
+        PixelFormat           format
+    ) noexcept(false)
+    {
+        if (const auto error = checkFormat(format); error != Error::None) {
+            return { .m_error = error };
+        }
+
+        const auto prepared = tryPrepareDecode(data, Channels::RGBA);
+        if (!prepared) {
+            return { .m_error = prepared.m_error };
+        }
+
+        const auto [src, dest] = prepared.m_value;
+
+        const auto required = decodedSize(dest.m_width, dest.m_height, dest.m_channels);
+        const auto out      = allocate(required);
+        if (out.size() < required) {
+            return { .m_error = Error::SizeMismatch };
+        } else if (!decodeFormatInto(data, out, src, format)) {
+            return { .m_error = Error::Truncated };
+        }
+
+        return { .m_value = dest };
+    }
+}
+
+namespace qoipp::impl
+{
+    // the residual of a frame against the previous one is their bytewise difference with the alpha biased
+    // by 255, so an unchanged pixel becomes the start pixel and unchanged areas become runs
+    template <bool Apply>
+    void frameDelta(
+        std::span<const Byte> lhs,
+        std::span<const Byte> rhs,
+        std::span<Byte>       out,
+        Channels              channels
+    ) noexcept
+    {
+        // adding 255 is the same as subtracting 1
+        const u32  bias = channels == Channels::RGBA ? 1 : 0;
+        const auto size = out.size();
+        usize      i    = 0;
+
+        // the bias of four pixels as the lanes of a vector
+        [[maybe_unused]] const u32 alphaBias = std::endian::native == std::endian::little ? bias << 24 : bias;
+
+#if defined(__SSE2__) || defined(_M_X64)
+        const auto biasVec = _mm_set1_epi32(static_cast<i32>(alphaBias));
+        for (; i + 16 <= size; i += 16) {
+            const auto a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(lhs.data() + i));
+            const auto b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rhs.data() + i));
+            const auto r = Apply ? _mm_add_epi8(_mm_add_epi8(a, b), biasVec)
+                                 : _mm_sub_epi8(_mm_sub_epi8(a, b), biasVec);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out.data() + i), r);
+        }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+        const auto biasVec = vreinterpretq_u8_u32(vdupq_n_u32(alphaBias));
+        for (; i + 16 <= size; i += 16) {
+            const auto a = vld1q_u8(reinterpret_cast<const u8*>(lhs.data() + i));
+            const auto b = vld1q_u8(reinterpret_cast<const u8*>(rhs.data() + i));
+            const auto r = Apply ? vaddq_u8(vaddq_u8(a, b), biasVec) : vsubq_u8(vsubq_u8(a, b), biasVec);
+            vst1q_u8(reinterpret_cast<u8*>(out.data() + i), r);
+        }
+#endif
+
+        // the vectors cover whole pixels, so the alpha of the rest is still every fourth byte
+        for (; i < size; ++i) {
+            const auto a = std::to_integer<u8>(lhs[i]);
+            const auto b = std::to_integer<u8>(rhs[i]);
+            const auto c = i % 4 == 3 ? bias : 0;
+            out[i]       = static_cast<Byte>(Apply ? a + b + c : a - b - c);
+        }
+    }
+
+    // `out = frame - previous` as described above
+    inline void frameResidual(
+        std::span<const Byte> frame,
+        std::span<const Byte> previous,
+        std::span<Byte>       out,
+        Channels              channels
+    ) noexcept
+    {
+        frameDelta<false>(frame, previous, out, channels);
+    }
+
+    // `frame = frame + residual`, undoing `frameResidual`
+    inline void applyResidual(
+        std::span<Byte>       frame,
+        std::span<const Byte> residual,
+        Channels              channels
+    ) noexcept
+    {
+        frameDelta<true>(frame, residual, frame, channels);
+    }
+
+    inline bool isDeltaFrame(std::span<const Byte> data) noexcept
+    {
+        const auto& magic = constants::deltaFrameMagic;
+        if (data.size() < constants::headerSize + constants::endMarker.size() + magic.size()) {
+            return false;
+        }
+        return std::memcmp(data.data() + data.size() - magic.size(), magic.data(), magic.size()) == 0;
+    }
+}
+
+namespace qoipp::impl
+{
+    // a file next to `path` that doesn't exist yet (at the time of the call), to write to before renaming it
+    inline std::filesystem::path tempPath(const std::filesystem::path& path) noexcept(false)
+    {
+        static std::atomic<u64> counter = 0;
+
+        const auto ticks = static_cast<u64>(std::chrono::steady_clock::now().time_since_epoch().count());
+
+        auto temp  = path;
+        temp      += std::format(".{:x}.{:x}.tmp", ticks, counter.fetch_add(1, std::memory_order_relaxed));
+        return temp;
+    }
+
+    // why a file can't be written, `fileErrorMessage` is the message the throwing functions use for each
+    enum class FileError : int
+    {
+        None = 0,
+        Exists,        // the path exists and overwrite is false
+        NotRegular,    // the path exists and is not a regular file
+        Open,          // the temporary file can't be created
+        Space,         // the file system has no room for the file
+        Resize,        // the temporary file can't be sized for the encoded image
+        Map,           // the temporary file can't be mapped
+        Shrink,        // the temporary file can't be shrunk to what was written
+        Write,         // the buffer can't be written to the temporary file
+        Move,          // the temporary file can't be renamed to the path
+    };
+
+    constexpr const char* fileErrorMessage(FileError error) noexcept
+    {
+        switch (error) {
+        case FileError::Exists: return "File already exists and overwrite is false";
+        case FileError::NotRegular: return "Path is not a regular file, cannot overwrite";
+        case FileError::Open: return "Could not open file for writing";
+        case FileError::Space: return "Not enough space to write the file";
+        case FileError::Resize: return "Could not resize file for writing";
+        case FileError::Map: return "Could not map file for writing";
+        case FileError::Shrink: return "Could not resize file after writing";
+        case FileError::Move: return "Could not move the written file into place";
+        default: return "Could not write file";
+        }
+    }
+
+    // A whole file mapped into memory. Falls back to reading the file into a buffer (and writing it back on
+    // close) on platforms without memory mapping support.
+    //
+    // A file opened for writing is a temporary file next to the path until `close` renames it into place, so
+    // a write that fails (or an encode that throws) before that removes it and leaves the path untouched.
+    class MappedFile
+    {
+    public:
+        // map an existing regular file for reading, std::nullopt if it can't be opened or mapped
+        static std::optional<MappedFile> read(const std::filesystem::path& path) noexcept;
+
+        // create a temporary file of `size` bytes for `path` and map it for writing, `path` must not exist
+        // unless `overwrite` is true; std::nullopt with `error` set if it can't be, only throws
+        // std::bad_alloc
+        static std::optional<MappedFile> tryWrite(
+            const std::filesystem::path& path,
+            usize                        size,
+            bool                         overwrite,
+            FileError&                   error
+        ) noexcept(false);
+
+        // `tryWrite` throwing std::invalid_argument with the message of the error
+        static MappedFile write(
+            const std::filesystem::path& path,
+            usize                        size,
+            bool                         overwrite
+        ) noexcept(false);
+
+        MappedFile(MappedFile&& other) noexcept;
+        MappedFile& operator=(MappedFile&&) = delete;
+        ~MappedFile();
+
+        std::span<Byte> bytes() noexcept { return { m_data, m_size }; }
+
+        // unmap a file opened for writing, shrink it to the `size` bytes actually written and rename it to
+        // the path it was opened for; the temporary file is still removed on destruction if it fails, only
+        // throws std::bad_alloc
+        FileError tryClose(usize size) noexcept(false);
+
+        // `tryClose` throwing std::invalid_argument with the message of the error
+        void close(usize size) noexcept(false);
+
+    private:
+        MappedFile() = default;
+        void release() noexcept;
+
+        Byte* m_data = nullptr;
+        usize m_size = 0;
+
+#if defined(QOIPP_MMAP_WINDOWS) || defined(QOIPP_MMAP_POSIX)
+        // only set for writing, `m_temp` is cleared once it is renamed to `m_path`
+        std::filesystem::path m_path      = {};
+        std::filesystem::path m_temp      = {};
+        bool                  m_overwrite = false;
+#endif
+
+#if defined(QOIPP_MMAP_WINDOWS)
+        HANDLE m_file = INVALID_HANDLE_VALUE;    // only kept open for writing
+#elif defined(QOIPP_MMAP_POSIX)
+        int m_fd = -1;    // only kept open for writing
+#else
+        ByteVec               m_buffer = {};
+        std::filesystem::path m_path   = {};    // only set for writing
+#endif
+    };
+
+#if defined(QOIPP_MMAP_WINDOWS)
+    inline std::optional<MappedFile> MappedFile::read(const std::filesystem::path& path) noexcept
+    {
+        const auto flags = FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN;
+        const auto share = FILE_SHARE_READ;
+
+        HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, share, nullptr, OPEN_EXISTING, flags, nullptr);
+        if (file == INVALID_HANDLE_VALUE) {
+            return std::nullopt;
+        }
+
+        LARGE_INTEGER size;
+        if (GetFileType(file) != FILE_TYPE_DISK || !GetFileSizeEx(file, &size)) {
+            CloseHandle(file);
+            return std::nullopt;
+        }
+
+        MappedFile mapped;
+        mapped.m_size = static_cast<usize>(size.QuadPart);
+
+        if (mapped.m_size > 0) {
+            HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            if (mapping != nullptr) {
+                mapped.m_data = static_cast<Byte*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+                CloseHandle(mapping);
+            }
+        }
+
+        CloseHandle(file);
+
+        if (mapped.m_size > 0 && mapped.m_data == nullptr) {
+            return std::nullopt;
+        }
+        return mapped;
+    }
+
+    inline std::optional<MappedFile> MappedFile::tryWrite(
+        const std::filesystem::path& path,
+        usize                        size,
+        bool                         overwrite,
+        FileError&                   error
+    ) noexcept(false)
+    {
+        const auto attributes = GetFileAttributesW(path.c_str());
+        if (attributes != INVALID_FILE_ATTRIBUTES) {
+            if (!overwrite) {
+                error = FileError::Exists;
+                return std::nullopt;
+            } else if ((attributes & FILE_ATTRIBUTE_DIRECTORY) != 0) {
+                error = FileError::NotRegular;
+                return std::nullopt;
+            }
+        }
+
+        const auto access = GENERIC_READ | GENERIC_WRITE;
+        const auto flags  = FILE_ATTRIBUTE_NORMAL;
+
+        auto   temp = std::filesystem::path{};
+        HANDLE file = INVALID_HANDLE_VALUE;
+        for (int attempt = 0; file == INVALID_HANDLE_VALUE && attempt < 16; ++attempt) {
+            temp = tempPath(path);
+            file = CreateFileW(temp.c_str(), access, 0, nullptr, CREATE_NEW, flags, nullptr);
+            if (file == INVALID_HANDLE_VALUE && GetLastError() != ERROR_FILE_EXISTS) {
+                break;
+            }
+        }
+
+        if (file == INVALID_HANDLE_VALUE) {
+            error = FileError::Open;
+            return std::nullopt;
+        }
+
+        MappedFile mapped;
+        mapped.m_file      = file;
+        mapped.m_size      = size;
+        mapped.m_path      = path;
+        mapped.m_temp      = std::move(temp);
+        mapped.m_overwrite = overwrite;
+
+        const auto high    = static_cast<DWORD>(static_cast<u64>(size) >> 32);
+        const auto low     = static_cast<DWORD>(static_cast<u64>(size) & 0xFFFFFFFF);
+        HANDLE     mapping = CreateFileMappingW(file, nullptr, PAGE_READWRITE, high, low, nullptr);
+
+        if (mapping != nullptr) {
+            mapped.m_data = static_cast<Byte*>(MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, size));
+            CloseHandle(mapping);
+        }
+
+        if (mapped.m_data == nullptr) {
+            error = FileError::Map;
+            return std::nullopt;
+        }
+        return mapped;
+    }
+
+    inline FileError MappedFile::tryClose(usize size) noexcept(false)
+    {
+        UnmapViewOfFile(m_data);
+        m_data = nullptr;
+
+        LARGE_INTEGER end;
+        end.QuadPart = static_cast<LONGLONG>(size);
+
+        const bool ok = SetFilePointerEx(m_file, end, nullptr, FILE_BEGIN) && SetEndOfFile(m_file);
+        CloseHandle(std::exchange(m_file, INVALID_HANDLE_VALUE));
+
+        if (!ok) {
+            return FileError::Shrink;
+        }
+
+        // without MOVEFILE_REPLACE_EXISTING the rename fails if the path was created in the meantime
+        const auto replace = m_overwrite ? MOVEFILE_REPLACE_EXISTING : 0;
+        if (!MoveFileExW(m_temp.c_str(), m_path.c_str(), static_cast<DWORD>(replace))) {
+            if (GetLastError() == ERROR_ALREADY_EXISTS) {
+                return FileError::Exists;
+            }
+            return FileError::Move;
+        }
+        m_temp.clear();
+        return FileError::None;
+    }
+
+    inline void MappedFile::release() noexcept
+    {
+        if (m_data != nullptr) {
+            UnmapViewOfFile(m_data);
+        }
+        if (m_file != INVALID_HANDLE_VALUE) {
+            CloseHandle(m_file);
+        }
+        if (!m_temp.empty()) {
+            DeleteFileW(m_temp.c_str());
+        }
+    }
+
+    inline MappedFile::MappedFile(MappedFile&& other) noexcept
+        : m_data{ std::exchange(other.m_data, nullptr) }
+        , m_size{ std::exchange(other.m_size, 0) }
+        , m_path{ std::move(other.m_path) }
+        , m_temp{ std::exchange(other.m_temp, {}) }
+        , m_overwrite{ other.m_overwrite }
+        , m_file{ std::exchange(other.m_file, INVALID_HANDLE_VALUE) }
+    {
+    }
+#elif defined(QOIPP_MMAP_POSIX)
+    inline std::optional<MappedFile> MappedFile::read(const std::filesystem::path& path) noexcept
+    {
+        const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            return std::nullopt;
+        }
+
+        struct stat st;
+        if (::fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+            ::close(fd);
+            return std::nullopt;
+        }
+
+        MappedFile mapped;
+        mapped.m_size = static_cast<usize>(st.st_size);
+
+        if (mapped.m_size > 0) {
+            void* data = ::mmap(nullptr, mapped.m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (data != MAP_FAILED) {
+                mapped.m_data = static_cast<Byte*>(data);
+            }
+        }
+
+        ::close(fd);
+
+        if (mapped.m_size > 0 && mapped.m_data == nullptr) {
+            return std::nullopt;
+        }
+        return mapped;
+    }
+
+    inline std::optional<MappedFile> MappedFile::tryWrite(
+        const std::filesystem::path& path,
+        usize                        size,
+        bool                         overwrite,
+        FileError&                   error
+    ) noexcept(false)
+    {
+        struct stat existing;
+        const bool  exists = ::stat(path.c_str(), &existing) == 0;
+        if (exists) {
+            if (!overwrite) {
+                error = FileError::Exists;
+                return std::nullopt;
+            } else if (!S_ISREG(existing.st_mode)) {
+                error = FileError::NotRegular;
+                return std::nullopt;
+            }
+        }
+
+        auto temp = std::filesystem::path{};
+        int  fd   = -1;
+        for (int attempt = 0; fd < 0 && attempt < 16; ++attempt) {
+            temp = tempPath(path);
+            fd   = ::open(temp.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0666);
+            if (fd < 0 && errno != EEXIST) {
+                break;
+            }
+        }
+
+        if (fd < 0) {
+            error = FileError::Open;
+            return std::nullopt;
+        }
+
+        MappedFile mapped;
+        mapped.m_fd        = fd;
+        mapped.m_size      = size;
+        mapped.m_path      = path;
+        mapped.m_temp      = std::move(temp);
+        mapped.m_overwrite = overwrite;
+
+        // the file that is replaced keeps its permissions
+        if (exists) {
+            ::fchmod(fd, existing.st_mode & 07777);
+        }
+
+        // reserve the blocks up front so that running out of space fails here instead of on a page fault
+#if defined(__linux__)
+        if (const auto res = ::posix_fallocate(fd, 0, static_cast<off_t>(size)); res == ENOSPC) {
+            error = FileError::Space;
+            return std::nullopt;
+        } else if (res != 0 && ::ftruncate(fd, static_cast<off_t>(size)) != 0) {
+            error = FileError::Resize;
+            return std::nullopt;
+        }
+#else
+        if (::ftruncate(fd, static_cast<off_t>(size)) != 0) {
+            error = FileError::Resize;
+            return std::nullopt;
+        }
+#endif
+
+        void* data = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (data == MAP_FAILED) {
+            error = FileError::Map;
+            return std::nullopt;
+        }
+
+        mapped.m_data = static_cast<Byte*>(data);
+        return mapped;
+    }
+
+    inline FileError MappedFile::tryClose(usize size) noexcept(false)
+    {
+        ::munmap(m_data, m_size);
+        m_data = nullptr;
+
+        const bool ok = ::ftruncate(m_fd, static_cast<off_t>(size)) == 0;
+        ::close(std::exchange(m_fd, -1));
+
+        if (!ok) {
+            return FileError::Shrink;
+        }
+
+        // a hard link fails if the path was created in the meantime, unlike a rename; file systems without
+        // hard links get the rename
+        if (!m_overwrite && ::link(m_temp.c_str(), m_path.c_str()) == 0) {
+            ::unlink(m_temp.c_str());
+        } else if (!m_overwrite && errno == EEXIST) {
+            return FileError::Exists;
+        } else if (::rename(m_temp.c_str(), m_path.c_str()) != 0) {
+            return FileError::Move;
+        }
+        m_temp.clear();
+        return FileError::None;
+    }
+
+    inline void MappedFile::release() noexcept
+    {
+        if (m_data != nullptr) {
+            ::munmap(m_data, m_size);
+        }
+        if (m_fd >= 0) {
+            ::close(m_fd);
+        }
+        if (!m_temp.empty()) {
+            ::unlink(m_temp.c_str());
+        }
+    }
+
+    inline MappedFile::MappedFile(MappedFile&& other) noexcept
+        : m_data{ std::exchange(other.m_data, nullptr) }
+        , m_size{ std::exchange(other.m_size, 0) }
+        , m_path{ std::move(other.m_path) }
+        , m_temp{ std::exchange(other.m_temp, {}) }
+        , m_overwrite{ other.m_overwrite }
+        , m_fd{ std::exchange(other.m_fd, -1) }
+    {
+    }
+#else
+    inline std::optional<MappedFile> MappedFile::read(const std::filesystem::path& path) noexcept
+    {
+        namespace fs = std::filesystem;
+
+        auto ec = std::error_code{};
+        if (!fs::is_regular_file(path, ec)) {
+            return std::nullopt;
+        }
+
+        std::ifstream file{ path, std::ios::binary };
+        if (!file.is_open()) {
+            return std::nullopt;
+        }
+
+        const auto size = fs::file_size(path, ec);
+        if (ec) {
+            return std::nullopt;
+        }
+
+        MappedFile mapped;
+        mapped.m_buffer = ByteVec(size);
+        mapped.m_data   = mapped.m_buffer.data();
+        mapped.m_size   = mapped.m_buffer.size();
+
+        file.read(reinterpret_cast<char*>(mapped.m_data), static_cast<std::streamsize>(mapped.m_size));
+        return mapped;
+    }
+
+    inline std::optional<MappedFile> MappedFile::tryWrite(
+        const std::filesystem::path& path,
+        usize                        size,
+        bool                         overwrite,
+        FileError&                   error
+    ) noexcept(false)
+    {
+        namespace fs = std::filesystem;
+
+        if (fs::exists(path) && !overwrite) {
+            error = FileError::Exists;
+            return std::nullopt;
+        }
+
+        if (fs::exists(path) && !fs::is_regular_file(path)) {
+            error = FileError::NotRegular;
+            return std::nullopt;
+        }
+
+        MappedFile mapped;
+        mapped.m_path   = path;
+        mapped.m_buffer = ByteVec(size);
+        mapped.m_data   = mapped.m_buffer.data();
+        mapped.m_size   = mapped.m_buffer.size();
+        return mapped;
+    }
+
+    inline FileError MappedFile::tryClose(usize size) noexcept(false)
+    {
+        namespace fs = std::filesystem;
+
+        const auto temp = tempPath(m_path);
+        const auto fail = [&](FileError error) {
+            auto ec = std::error_code{};
+            fs::remove(temp, ec);
+            return error;
+        };
+
+        {
+            std::ofstream file{ temp, std::ios::binary | std::ios::trunc };
+            if (!file.is_open()) {
+                return fail(FileError::Open);
+            }
+            file.write(reinterpret_cast<const char*>(m_data), static_cast<std::streamsize>(size));
+            if (!file.flush()) {
+                return fail(FileError::Write);
+            }
+        }
+
+        auto ec = std::error_code{};
+        fs::rename(temp, m_path, ec);
+        if (ec) {
+            return fail(FileError::Move);
+        }
+        return FileError::None;
+    }
+
+    inline void MappedFile::release() noexcept
+    {
+        // the buffer frees itself
+    }
+
+    inline MappedFile::MappedFile(MappedFile&& other) noexcept
+        : m_data{ std::exchange(other.m_data, nullptr) }
+        , m_size{ std::exchange(other.m_size, 0) }
+        , m_buffer{ std::move(other.m_buffer) }
+        , m_path{ std::move(other.m_path) }
+    {
+    }
+#endif
+
+    inline MappedFile MappedFile::write(
+        const std::filesystem::path& path,
+        usize                        size,
+        bool                         overwrite
+    ) noexcept(false)
+    {
+        auto error = FileError::None;
+        auto file  = tryWrite(path, size, overwrite, error);
+        if (!file.has_value()) {
+            throw std::invalid_argument{ fileErrorMessage(error) };
+        }
+        return std::move(*file);
+    }
+
+    inline void MappedFile::close(usize size) noexcept(false)
+    {
+        if (const auto error = tryClose(size); error != FileError::None) {
+            throw std::invalid_argument{ fileErrorMessage(error) };
+        }
+    }
+
+    inline MappedFile::~MappedFile()
+    {
+        release();
+    }
+
+    // read only the header of a file, mapping it would cost more than the read itself
+    inline FileHeader readFileHeader(const std::filesystem::path& path) noexcept
+    {
+        auto  buffer = std::array<Byte, constants::headerSize>{};
+        usize size   = 0;
+
+#if defined(QOIPP_MMAP_WINDOWS)
+        const auto flags = FILE_ATTRIBUTE_NORMAL;
+        const auto share = FILE_SHARE_READ | FILE_SHARE_WRITE;
+
+        HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, share, nullptr, OPEN_EXISTING, flags, nullptr);
+        if (file == INVALID_HANDLE_VALUE) {
+            return { .m_error = HeaderError::Open };
+        }
+
+        DWORD read = 0;
+        while (size < buffer.size()) {
+            const auto want = static_cast<DWORD>(buffer.size() - size);
+            if (!ReadFile(file, buffer.data() + size, want, &read, nullptr)) {
+                CloseHandle(file);
+                return { .m_error = HeaderError::Read };
+            } else if (read == 0) {
+                break;
+            }
+            size += read;
+        }
+
+        CloseHandle(file);
+#elif defined(QOIPP_MMAP_POSIX)
+        // O_NONBLOCK so that a fifo can't block the open
+        const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC | O_NONBLOCK);
+        if (fd < 0) {
+            return { .m_error = HeaderError::Open };
+        }
+
+        while (size < buffer.size()) {
+            const auto offset = static_cast<off_t>(size);
+            const auto read   = ::pread(fd, buffer.data() + size, buffer.size() - size, offset);
+            if (read < 0 && errno == EINTR) {
+                continue;
+            } else if (read < 0) {
+                ::close(fd);
+                return { .m_error = HeaderError::Read };
+            } else if (read == 0) {
+                break;
+            }
+            size += static_cast<usize>(read);
+        }
+
+        ::close(fd);
+#else
+        auto ec = std::error_code{};
+        if (!std::filesystem::exists(path, ec)) {
+            return { .m_error = HeaderError::Open };
+        } else if (!std::filesystem::is_regular_file(path, ec)) {
+            return { .m_error = HeaderError::Read };
+        }
 
         std::ifstream file{ path, std::ios::binary };
         if (!file.is_open()) {
-            throw std::invalid_argument{ "Could not open file for reading" };
+            return { .m_error = HeaderError::Open };
+        }
+
+        file.read(reinterpret_cast<char*>(buffer.data()), static_cast<std::streamsize>(buffer.size()));
+        size = static_cast<usize>(file.gcount());
+#endif
+
+        if (size < buffer.size()) {
+            return { .m_error = HeaderError::Truncated };
+        } else if (auto desc = readHeader(buffer); desc.has_value()) {
+            return { .m_desc = desc };
+        }
+        return { .m_error = HeaderError::Invalid };
+    }
+}
+
+namespace qoipp::impl
+{
+#if defined(QOIPP_IO_URING)
+    // a minimal io_uring without liburing, only used from the thread that created it
+    class Uring
+    {
+    public:
+        // nullptr if io_uring can't be used (kernel older than 5.6, seccomp or kernel.io_uring_disabled)
+        static std::unique_ptr<Uring> create(u32 entries) noexcept
+        {
+            auto      params = io_uring_params{};
+            const int fd     = static_cast<int>(::syscall(__NR_io_uring_setup, entries, &params));
+            if (fd < 0) {
+                return nullptr;
+            }
+
+            auto ring  = std::unique_ptr<Uring>{ new Uring{} };
+            ring->m_fd = fd;
+
+            // IORING_OP_READ and IORING_OP_WRITE came with this feature
+            if ((params.features & IORING_FEAT_RW_CUR_POS) == 0) {
+                return nullptr;
+            }
+
+            const bool single = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+
+            ring->m_sqRingSize = params.sq_off.array + params.sq_entries * sizeof(u32);
+            ring->m_cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+            if (single) {
+                ring->m_sqRingSize = ring->m_cqRingSize = std::max(ring->m_sqRingSize, ring->m_cqRingSize);
+            }
+
+            const auto map = [fd](usize size, u64 offset) {
+                return ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, offset);
+            };
+
+            ring->m_sqRing = map(ring->m_sqRingSize, IORING_OFF_SQ_RING);
+            if (ring->m_sqRing == MAP_FAILED) {
+                return nullptr;
+            }
+
+            ring->m_cqRing = single ? ring->m_sqRing : map(ring->m_cqRingSize, IORING_OFF_CQ_RING);
+            if (ring->m_cqRing == MAP_FAILED) {
+                return nullptr;
+            }
+
+            ring->m_sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+            ring->m_sqesMap  = map(ring->m_sqesSize, IORING_OFF_SQES);
+            if (ring->m_sqesMap == MAP_FAILED) {
+                return nullptr;
+            }
+
+            auto* sq = static_cast<u8*>(ring->m_sqRing);
+            auto* cq = static_cast<u8*>(ring->m_cqRing);
+
+            ring->m_entries = params.sq_entries;
+            ring->m_sqHead  = reinterpret_cast<u32*>(sq + params.sq_off.head);
+            ring->m_sqTail  = reinterpret_cast<u32*>(sq + params.sq_off.tail);
+            ring->m_sqMask  = *reinterpret_cast<u32*>(sq + params.sq_off.ring_mask);
+            ring->m_sqArray = reinterpret_cast<u32*>(sq + params.sq_off.array);
+            ring->m_sqes    = static_cast<io_uring_sqe*>(ring->m_sqesMap);
+            ring->m_cqHead  = reinterpret_cast<u32*>(cq + params.cq_off.head);
+            ring->m_cqTail  = reinterpret_cast<u32*>(cq + params.cq_off.tail);
+            ring->m_cqMask  = *reinterpret_cast<u32*>(cq + params.cq_off.ring_mask);
+            ring->m_cqes    = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+            return ring;
+        }
+
+        Uring(Uring&&)            = delete;
+        Uring& operator=(Uring&&) = delete;
+
+        ~Uring()
+        {
+            if (m_sqesMap != MAP_FAILED) {
+                ::munmap(m_sqesMap, m_sqesSize);
+            }
+            if (m_cqRing != MAP_FAILED && m_cqRing != m_sqRing) {
+                ::munmap(m_cqRing, m_cqRingSize);
+            }
+            if (m_sqRing != MAP_FAILED) {
+                ::munmap(m_sqRing, m_sqRingSize);
+            }
+            ::close(m_fd);
+        }
+
+        // queue a read or a write of `size` bytes at `offset`, false if the submission queue is full
+        bool push(u8 opcode, int fd, void* buffer, u32 size, u64 offset, u64 userData) noexcept
+        {
+            const auto tail = std::atomic_ref{ *m_sqTail }.load(std::memory_order_relaxed);
+            const auto head = std::atomic_ref{ *m_sqHead }.load(std::memory_order_acquire);
+            if (tail - head >= m_entries) {
+                return false;
+            }
+
+            const auto index = tail & m_sqMask;
+
+            auto& sqe     = m_sqes[index];
+            sqe           = io_uring_sqe{};
+            sqe.opcode    = opcode;
+            sqe.fd        = fd;
+            sqe.addr      = reinterpret_cast<u64>(buffer);
+            sqe.len       = size;
+            sqe.off       = offset;
+            sqe.user_data = userData;
+
+            m_sqArray[index] = index;
+            std::atomic_ref{ *m_sqTail }.store(tail + 1, std::memory_order_release);
+
+            ++m_pending;
+            return true;
+        }
+
+        // submit the queued entries and wait until at least one completion is available
+        void submitAndWait() noexcept(false)
+        {
+            if (!tryWait()) {
+                throw std::invalid_argument{ std::format("io_uring_enter failed: errno {}", errno) };
+            }
+        }
+
+        // `submitAndWait` returning false on failure, with errno set
+        bool tryWait() noexcept
+        {
+            while (true) {
+                const auto res = ::syscall(
+                    __NR_io_uring_enter, m_fd, m_pending, 1u, IORING_ENTER_GETEVENTS, nullptr, usize{ 0 }
+                );
+                if (res >= 0) {
+                    m_pending -= static_cast<u32>(res);
+                    return true;
+                } else if (errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+                    return false;
+                }
+            }
+        }
+
+        // call `fn(userData, result)` for each available completion
+        template <typename Fn>
+        void drain(Fn&& fn)
+        {
+            auto       head = std::atomic_ref{ *m_cqHead }.load(std::memory_order_relaxed);
+            const auto tail = std::atomic_ref{ *m_cqTail }.load(std::memory_order_acquire);
+
+            for (; head != tail; ++head) {
+                const auto& cqe = m_cqes[head & m_cqMask];
+                std::atomic_ref{ *m_cqHead }.store(head + 1, std::memory_order_release);
+                fn(cqe.user_data, cqe.res);
+            }
+        }
+
+    private:
+        Uring() = default;
+
+        int   m_fd         = -1;
+        u32   m_entries    = 0;
+        u32   m_pending    = 0;    // queued but not submitted yet
+        void* m_sqRing     = MAP_FAILED;
+        void* m_cqRing     = MAP_FAILED;
+        void* m_sqesMap    = MAP_FAILED;
+        usize m_sqRingSize = 0;
+        usize m_cqRingSize = 0;
+        usize m_sqesSize   = 0;
+
+        u32*          m_sqHead  = nullptr;
+        u32*          m_sqTail  = nullptr;
+        u32           m_sqMask  = 0;
+        u32*          m_sqArray = nullptr;
+        io_uring_sqe* m_sqes    = nullptr;
+        u32*          m_cqHead  = nullptr;
+        u32*          m_cqTail  = nullptr;
+        u32           m_cqMask  = 0;
+        io_uring_cqe* m_cqes    = nullptr;
+    };
+#endif
+
+    // Reads the inputs and writes the outputs on the calling thread while the transforms run on workers.
+    // With io_uring the reads and writes of up to `m_queueDepth` files are in flight at once and the
+    // workers wake the calling thread through an eventfd read, otherwise each file is read and written in
+    // one blocking call and the workers wake it through a condition variable.
+    class FilePipeline
+    {
+    public:
+        FilePipeline(
+            std::span<const FileJob> jobs,
+            const FileTransform&     transform,
+            FilePipelineOptions      options
+        )
+            : m_jobs{ jobs }
+            , m_transform{ transform }
+            , m_options{ options }
+            , m_slots(jobs.size())
+            , m_errors(jobs.size())
+        {
+        }
+
+        FilePipeline(FilePipeline&&)            = delete;
+        FilePipeline& operator=(FilePipeline&&) = delete;
+
+        ~FilePipeline()
+        {
+            // before anything the kernel may still read from or write to goes away
+            drainRing();
+
+            for (auto& slot : m_slots) {
+                closeFile(slot);
+            }
+#if defined(QOIPP_IO_URING)
+            if (m_eventFd >= 0) {
+                ::close(m_eventFd);
+            }
+#endif
+        }
+
+        std::vector<std::exception_ptr> run() noexcept(false)
+        {
+#if defined(QOIPP_IO_URING)
+            m_ring = Uring::create(static_cast<u32>(m_options.m_queueDepth + 1));    // +1 for the eventfd
+            if (m_ring != nullptr) {
+                m_eventFd = ::eventfd(0, EFD_CLOEXEC);
+                if (m_eventFd < 0) {
+                    m_ring.reset();
+                } else {
+                    armWake();
+                }
+            }
+#endif
+
+            auto threads = m_options.m_threads;
+            if (threads == 0) {
+                threads = std::max(std::thread::hardware_concurrency(), 1u);
+            }
+
+            // declared last so that they are stopped and joined before anything they use goes away
+            auto workers = std::vector<std::jthread>{};
+            for (usize i = 0; i < threads; ++i) {
+                workers.emplace_back([this](std::stop_token stop) { work(stop); });
+            }
+
+            usize next = 0;
+            while (m_completed < m_jobs.size()) {
+                // writes first, a write that fails to open frees memory for the next read
+                flushWrites();
+
+                // a file larger than the limit is still read once nothing else is held
+                while (next < m_jobs.size() && m_inFlight < m_options.m_queueDepth
+                       && (m_held < m_options.m_maxInFlight || m_held == 0)) {
+                    admit(next++);
+                }
+
+                if (m_completed == m_jobs.size()) {
+                    break;
+                }
+
+                waitForEvents();
+                takeTransformed();
+            }
+
+            return std::move(m_errors);
+        }
+
+    private:
+        struct Slot
+        {
+            std::vector<Byte, UninitAllocator<>> m_input  = {};    // overwritten by the read right away
+            std::optional<MappedFile>            m_mapped = {};    // the input when reading without io_uring
+            ByteVec                              m_output = {};
+            usize                                m_held   = 0;     // bytes counted in `m_held`
+            usize                                m_offset = 0;     // of the read or write in flight
+            int                                  m_fd     = -1;
+        };
+
+        static constexpr u64 wakeTag    = ~u64{ 0 };
+        static constexpr u64 cancelTag  = ~u64{ 1 };
+        static constexpr u32 maxIoBytes = 1u << 30;
+
+        bool async() const noexcept
+        {
+#if defined(QOIPP_IO_URING)
+            return m_ring != nullptr;
+#else
+            return false;
+#endif
+        }
+
+        void hold(Slot& slot, usize bytes) noexcept
+        {
+            slot.m_held += bytes;
+            m_held      += bytes;
+        }
+
+        // frees the input and stops counting every byte of the slot, only called before the output is held
+        void releaseInput(Slot& slot) noexcept
+        {
+            m_held       -= slot.m_held;
+            slot.m_held   = 0;
+            slot.m_input  = {};
+            slot.m_mapped.reset();
+        }
+
+        void release(Slot& slot) noexcept
+        {
+            slot.m_output = {};
+            releaseInput(slot);
+        }
+
+        static void closeFile(Slot& slot) noexcept
+        {
+#if defined(QOIPP_IO_URING)
+            if (slot.m_fd >= 0) {
+                ::close(std::exchange(slot.m_fd, -1));
+            }
+#endif
+        }
+
+        void succeed(usize job) noexcept
+        {
+            release(m_slots[job]);
+            ++m_completed;
+        }
+
+        void fail(usize job, bool writing, std::string_view message) noexcept
+        {
+            auto& slot = m_slots[job];
+            closeFile(slot);
+            release(slot);
+
+            const auto& path = writing ? m_jobs[job].m_output : m_jobs[job].m_input;
+            m_errors[job]    = std::make_exception_ptr(std::invalid_argument{
+                std::format("{}: '{}'", message, path.string()) });
+            ++m_completed;
+        }
+
+        void work(std::stop_token stop) noexcept
+        {
+            while (true) {
+                usize job = 0;
+                {
+                    std::unique_lock lock{ m_mutex };
+                    if (!m_workReady.wait(lock, stop, [&] { return !m_work.empty(); })) {
+                        return;
+                    }
+                    job = m_work.front();
+                    m_work.pop_front();
+                }
+
+                auto& slot = m_slots[job];
+                try {
+                    const auto input = slot.m_mapped.has_value() ? ByteSpan{ slot.m_mapped->bytes() }
+                                                                 : ByteSpan{ slot.m_input };
+                    slot.m_output = m_transform(m_jobs[job], input);
+                } catch (...) {
+                    m_errors[job] = std::current_exception();
+                }
+
+                {
+                    std::lock_guard lock{ m_mutex };
+                    m_transformed.push_back(job);
+                }
+                wake();
+            }
+        }
+
+        void wake() noexcept
+        {
+#if defined(QOIPP_IO_URING)
+            if (async()) {
+                const u64 one = 1;
+                [[maybe_unused]] const auto res = ::write(m_eventFd, &one, sizeof(one));
+                return;
+            }
+#endif
+            m_transformedReady.notify_one();
+        }
+
+        void schedule(usize job) noexcept(false)
+        {
+            {
+                std::lock_guard lock{ m_mutex };
+                m_work.push_back(job);
+            }
+            m_workReady.notify_one();
+        }
+
+        void admit(usize job) noexcept(false)
+        {
+            auto&       slot = m_slots[job];
+            const auto& path = m_jobs[job].m_input;
+
+#if defined(QOIPP_IO_URING)
+            if (async()) {
+                slot.m_fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+                if (slot.m_fd < 0) {
+                    return fail(job, false, "Could not open file for reading");
+                }
+
+                struct stat st;
+                if (::fstat(slot.m_fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+                    return fail(job, false, "Path is not a regular file");
+                }
+
+                const auto size = static_cast<usize>(st.st_size);
+                slot.m_input.resize(size);
+                hold(slot, size);
+
+                if (size == 0) {
+                    closeFile(slot);
+                    return schedule(job);
+                }
+                return submit(job, false);
+            }
+#endif
+
+            auto file = MappedFile::read(path);
+            if (!file.has_value()) {
+                return fail(job, false, "Could not open file for reading");
+            }
+            slot.m_mapped.emplace(std::move(*file));
+            hold(slot, slot.m_mapped->bytes().size());
+            schedule(job);
+        }
+
+        // the transforms done since the last call: the outputs are written, the errors recorded
+        void takeTransformed() noexcept(false)
+        {
+            auto transformed = std::vector<usize>{};
+            {
+                std::lock_guard lock{ m_mutex };
+                std::swap(transformed, m_transformed);
+            }
+
+            for (auto job : transformed) {
+                auto& slot = m_slots[job];
+                if (m_errors[job] != nullptr) {
+                    release(slot);
+                    ++m_completed;
+                    continue;
+                }
+
+                releaseInput(slot);
+                hold(slot, slot.m_output.size());
+
+                if (async()) {
+                    m_pendingWrites.push_back(job);
+                } else {
+                    writeBlocking(job);
+                }
+            }
+        }
+
+        void writeBlocking(usize job) noexcept
+        {
+            const auto& output = m_slots[job].m_output;
+
+            auto file = std::ofstream{ m_jobs[job].m_output, std::ios::binary | std::ios::trunc };
+            const auto size = static_cast<std::streamsize>(output.size());
+            file.write(reinterpret_cast<const char*>(output.data()), size);
+            file.close();
+
+            if (!file) {
+                return fail(job, true, "Could not write file");
+            }
+            succeed(job);
+        }
+
+        void flushWrites() noexcept(false)
+        {
+#if defined(QOIPP_IO_URING)
+            while (!m_pendingWrites.empty() && m_inFlight < m_options.m_queueDepth) {
+                const auto job = m_pendingWrites.front();
+                m_pendingWrites.pop_front();
+
+                constexpr auto flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+
+                auto& slot    = m_slots[job];
+                slot.m_fd     = ::open(m_jobs[job].m_output.c_str(), flags, 0666);
+                slot.m_offset = 0;
+                if (slot.m_fd < 0) {
+                    fail(job, true, "Could not write file");
+                } else if (slot.m_output.empty()) {
+                    closeFile(slot);
+                    succeed(job);
+                } else {
+                    submit(job, true);
+                }
+            }
+#endif
+        }
+
+        void waitForEvents() noexcept(false)
+        {
+#if defined(QOIPP_IO_URING)
+            if (async()) {
+                m_ring->submitAndWait();
+                m_ring->drain([&](u64 userData, i32 res) { complete(userData, res); });
+                return;
+            }
+#endif
+            std::unique_lock lock{ m_mutex };
+            m_transformedReady.wait(lock, [&] { return !m_transformed.empty(); });
+        }
+
+        // wait for every read and write submitted to io_uring to complete and cancel the read of the eventfd,
+        // the buffers, the file descriptors and `m_eventValue` can only be freed after that; `run` leaves
+        // nothing in flight but the eventfd read when it returns, everything it submitted when it throws
+        void drainRing() noexcept
+        {
+#if defined(QOIPP_IO_URING)
+            if (!async()) {
+                return;
+            }
+
+            bool cancelling = false;
+            while (m_inFlight > 0 || m_wakeArmed || cancelling) {
+                if (m_wakeArmed && !cancelling) {
+                    const auto target = reinterpret_cast<void*>(wakeTag);
+                    cancelling        = m_ring->push(IORING_OP_ASYNC_CANCEL, -1, target, 0, 0, cancelTag);
+                }
+
+                // there is no way to get the buffers back from the kernel if waiting fails
+                if (!m_ring->tryWait()) {
+                    std::terminate();
+                }
+
+                m_ring->drain([&](u64 userData, i32) {
+                    if (userData == wakeTag) {
+                        m_wakeArmed = false;
+                    } else if (userData == cancelTag) {
+                        cancelling = false;
+                    } else {
+                        --m_inFlight;
+                    }
+                });
+            }
+#endif
+        }
+
+#if defined(QOIPP_IO_URING)
+        void armWake() noexcept(false)
+        {
+            if (!m_ring->push(IORING_OP_READ, m_eventFd, &m_eventValue, sizeof(m_eventValue), 0, wakeTag)) {
+                throw std::invalid_argument{ "io_uring submission queue is full" };
+            }
+            m_wakeArmed = true;
+        }
+
+        // queue the rest of the read or the write of `job`
+        void submit(usize job, bool write) noexcept(false)
+        {
+            auto&      slot   = m_slots[job];
+            auto*      buffer = write ? slot.m_output.data() : slot.m_input.data();
+            const auto total  = write ? slot.m_output.size() : slot.m_input.size();
+            const auto size   = static_cast<u32>(std::min<usize>(total - slot.m_offset, maxIoBytes));
+            const auto opcode = static_cast<u8>(write ? IORING_OP_WRITE : IORING_OP_READ);
+
+            const auto userData = u64{ job } << 1 | write;
+            if (!m_ring->push(opcode, slot.m_fd, buffer + slot.m_offset, size, slot.m_offset, userData)) {
+                throw std::invalid_argument{ "io_uring submission queue is full" };
+            }
+            ++m_inFlight;
+        }
+
+        void complete(u64 userData, i32 res) noexcept(false)
+        {
+            if (userData == wakeTag) {
+                m_wakeArmed = false;
+                return armWake();
+            }
+
+            --m_inFlight;
+
+            const auto job   = static_cast<usize>(userData >> 1);
+            const bool write = (userData & 1) != 0;
+            auto&      slot  = m_slots[job];
+
+            // a read of 0 bytes means the file got shorter since it was opened
+            if (res <= 0) {
+                return fail(job, write, write ? "Could not write file" : "Could not read file");
+            }
+
+            slot.m_offset += static_cast<usize>(res);
+            if (slot.m_offset < (write ? slot.m_output.size() : slot.m_input.size())) {
+                return submit(job, write);
+            }
+
+            closeFile(slot);
+            slot.m_offset = 0;
+
+            if (write) {
+                succeed(job);
+            } else {
+                schedule(job);
+            }
+        }
+#endif
+
+        std::span<const FileJob>        m_jobs;
+        const FileTransform&            m_transform;
+        FilePipelineOptions             m_options;
+        std::vector<Slot>               m_slots;
+        std::vector<std::exception_ptr> m_errors;
+
+        usize             m_held      = 0;    // bytes of inputs and outputs
+        usize             m_inFlight  = 0;    // reads and writes submitted to io_uring
+        usize             m_completed = 0;
+        std::deque<usize> m_pendingWrites;
+
+#if defined(QOIPP_IO_URING)
+        std::unique_ptr<Uring> m_ring       = nullptr;
+        int                    m_eventFd    = -1;
+        u64                    m_eventValue = 0;
+        bool                   m_wakeArmed  = false;    // the read of `m_eventFd` is in flight
+#endif
+
+        // shared with the workers
+        std::mutex                  m_mutex;
+        std::condition_variable_any m_workReady;
+        std::condition_variable     m_transformedReady;
+        std::deque<usize>           m_work;
+        std::vector<usize>          m_transformed;
+    };
+}
+
+namespace qoipp
+{
+    QOIPP_INLINE std::optional<ImageDesc> readHeader(ByteSpan data) noexcept
+    {
+        if (data.size() < constants::headerSize) {
+            return std::nullopt;
+        }
+
+        using Magic = decltype(data::QoiHeader::m_magic);
+        auto* magic = reinterpret_cast<const Magic*>(data.data());
+
+        if (std::memcmp(magic, constants::magic.data(), constants::magic.size()) != 0) {
+            return std::nullopt;
+        }
+
+        usize index = constants::magic.size();
+        u32   width, height;
+        u32   channels, colorspace;
+
+        std::memcpy(&width, data.data() + index, sizeof(u32));
+        index += sizeof(u32);
+        std::memcpy(&height, data.data() + index, sizeof(u32));
+        index      += sizeof(u32);
+        channels    = std::to_integer<u8>(data[index++]);
+        colorspace  = std::to_integer<u8>(data[index++]);
+
+        return ImageDesc{
+            .m_width      = fromBigEndian(width),
+            .m_height     = fromBigEndian(height),
+            .m_channels   = static_cast<Channels>(channels),
+            .m_colorspace = static_cast<Colorspace>(colorspace),
+        };
+    }
+
+    // the public versions are defined in the header to be usable in constant expressions
+    static_assert(
+        maxEncodedSize({ 7, 5, Channels::RGBA, Colorspace::sRGB })
+        == impl::maxEncodedSize(7, 5, Channels::RGBA)
+    );
+    static_assert(
+        decodedSize({ 7, 5, Channels::RGB, Colorspace::sRGB }) == impl::decodedSize(7, 5, Channels::RGB)
+    );
+
+    QOIPP_INLINE ByteVec encode(ByteSpan data, ImageDesc desc, EncodeOptions options) noexcept(false)
+    {
+        impl::validateEncode(data, desc);
+
+        ByteVec encoded(maxEncodedSize(desc));
+        encoded.resize(impl::encodeInto(data, encoded, desc, options.m_effort));
+        return encoded;
+    }
+
+    QOIPP_INLINE usize encode(
+        ByteSpan        data,
+        ImageDesc       desc,
+        std::span<Byte> out,
+        EncodeOptions   options
+    ) noexcept(false)
+    {
+        impl::validateEncode(data, desc);
+
+        if (const auto required = maxEncodedSize(desc); out.size() < required) {
+            throw std::invalid_argument{ std::format(
+                "Output buffer is too small: expected at least {} bytes, got {}", required, out.size()
+            ) };
+        }
+
+        return impl::encodeInto(data, out, desc, options.m_effort);
+    }
+
+    QOIPP_INLINE usize encode(
+        ByteSpan        data,
+        ImageDesc       desc,
+        const Allocate& allocate,
+        EncodeOptions   options
+    ) noexcept(false)
+    {
+        impl::validateEncode(data, desc);
+
+        const auto required = maxEncodedSize(desc);
+        const auto out      = allocate(required);
+        if (out.size() < required) {
+            throw std::invalid_argument{ std::format(
+                "Output buffer is too small: expected at least {} bytes, got {}", required, out.size()
+            ) };
+        }
+
+        return impl::encodeInto(data, out, desc, options.m_effort);
+    }
+
+    QOIPP_INLINE Image decode(ByteSpan data, bool rgbOnly) noexcept(false)
+    {
+        return impl::decodeImage<true>(data, impl::decodeTarget(rgbOnly));
+    }
+
+    QOIPP_INLINE Image decode(ByteSpan data, Channels target) noexcept(false)
+    {
+        return impl::decodeImage<true>(data, target);
+    }
+
+    QOIPP_INLINE ImageDesc decode(ByteSpan data, std::span<Byte> out, bool rgbOnly) noexcept(false)
+    {
+        return impl::decodeImage<true>(data, out, impl::decodeTarget(rgbOnly));
+    }
+
+    QOIPP_INLINE ImageDesc decode(ByteSpan data, std::span<Byte> out, Channels target) noexcept(false)
+    {
+        return impl::decodeImage<true>(data, out, target);
+    }
+
+    QOIPP_INLINE ByteVec encode(
+        ByteSpan      data,
+        ImageDesc     desc,
+        PixelFormat   format,
+        EncodeOptions options
+    ) noexcept(false)
+    {
+        impl::validateFormatEncode(data, desc);
+
+        const auto view = ImageView{ .m_data = data, .m_desc = desc, .m_format = format };
+
+        ByteVec encoded(maxEncodedSize(desc));
+        encoded.resize(impl::encodeView(view, encoded, options.m_effort));
+        return encoded;
+    }
+
+    QOIPP_INLINE ByteVec encode(const ImageView& view, EncodeOptions options) noexcept(false)
+    {
+        impl::validateView(view);
+
+        ByteVec encoded(maxEncodedSize(view.m_desc));
+        encoded.resize(impl::encodeView(view, encoded, options.m_effort));
+        return encoded;
+    }
+
+    QOIPP_INLINE usize encode(
+        const ImageView& view,
+        std::span<Byte>  out,
+        EncodeOptions    options
+    ) noexcept(false)
+    {
+        impl::validateView(view);
+
+        if (const auto required = maxEncodedSize(view.m_desc); out.size() < required) {
+            throw std::invalid_argument{ std::format(
+                "Output buffer is too small: expected at least {} bytes, got {}", required, out.size()
+            ) };
+        }
+
+        return impl::encodeView(view, out, options.m_effort);
+    }
+
+    QOIPP_INLINE Image decode(ByteSpan data, PixelFormat format) noexcept(false)
+    {
+        ByteVec    decoded;
+        const auto desc = impl::decodeFormatted(
+            data,
+            [&](usize size) {
+                decoded.resize(size);
+                return std::span{ decoded };
+            },
+            format
+        );
+
+        return {
+            .m_data = std::move(decoded),
+            .m_desc = desc,
+        };
+    }
+
+    QOIPP_INLINE ImageDesc decode(ByteSpan data, std::span<Byte> out, PixelFormat format) noexcept(false)
+    {
+        return impl::decodeFormatted(data, Allocate{ [out](usize) { return out; } }, format);
+    }
+
+    QOIPP_INLINE ImageDesc decode(ByteSpan data, const Allocate& allocate, bool rgbOnly) noexcept(false)
+    {
+        return impl::decodeImage<true>(data, allocate, impl::decodeTarget(rgbOnly));
+    }
+
+    QOIPP_INLINE ImageDesc decode(ByteSpan data, const Allocate& allocate, Channels target) noexcept(false)
+    {
+        return impl::decodeImage<true>(data, allocate, target);
+    }
+
+    QOIPP_INLINE Image decodeUnchecked(ByteSpan data, bool rgbOnly) noexcept(false)
+    {
+        return impl::decodeImage<false>(data, impl::decodeTarget(rgbOnly));
+    }
+
+    QOIPP_INLINE Image decodeUnchecked(ByteSpan data, Channels target) noexcept(false)
+    {
+        return impl::decodeImage<false>(data, target);
+    }
+
+    QOIPP_INLINE ImageDesc decodeUnchecked(ByteSpan data, std::span<Byte> out, bool rgbOnly) noexcept(false)
+    {
+        return impl::decodeImage<false>(data, out, impl::decodeTarget(rgbOnly));
+    }
+
+    QOIPP_INLINE Image decodeRegion(
+        ByteSpan     data,
+        Region       region,
+        unsigned int scale,
+        bool         rgbOnly
+    ) noexcept(false)
+    {
+        return impl::decodeRegion(data, region, scale, impl::decodeTarget(rgbOnly));
+    }
+
+    QOIPP_INLINE Image decodeRegion(
+        ByteSpan     data,
+        Region       region,
+        unsigned int scale,
+        Channels     target
+    ) noexcept(false)
+    {
+        return impl::decodeRegion(data, region, scale, target);
+    }
+
+    QOIPP_INLINE ImageDesc decodeUnchecked(
+        ByteSpan        data,
+        std::span<Byte> out,
+        Channels        target
+    ) noexcept(false)
+    {
+        return impl::decodeImage<false>(data, out, target);
+    }
+
+    template <Channels Chan, Colorspace Space>
+    ByteVec encode(ByteSpan data, unsigned int width, unsigned int height) noexcept(false)
+    {
+        const auto desc = ImageDesc{ width, height, Chan, Space };
+        impl::validateEncode(data, desc);
+
+        ByteVec encoded(maxEncodedSize(desc));
+        encoded.resize(impl::encode<Chan>(data, encoded, width, height, Space == Colorspace::sRGB));
+        return encoded;
+    }
+
+    template <Channels Chan, Colorspace Space>
+    usize encode(ByteSpan data, std::span<Byte> out, unsigned int width, unsigned int height) noexcept(false)
+    {
+        const auto desc = ImageDesc{ width, height, Chan, Space };
+        impl::validateEncode(data, desc);
+
+        if (const auto required = maxEncodedSize(desc); out.size() < required) {
+            throw std::invalid_argument{ std::format(
+                "Output buffer is too small: expected at least {} bytes, got {}", required, out.size()
+            ) };
+        }
+
+        return impl::encode<Chan>(data, out, width, height, Space == Colorspace::sRGB);
+    }
+
+    template <Channels Src, Channels Dest>
+    Image decode(ByteSpan data) noexcept(false)
+    {
+        const auto dest = impl::prepareDecode<Src, Dest>(data);
+
+        ByteVec decoded(decodedSize(dest));
+        impl::decodeInto<Src, Dest>(data, decoded, dest);
+
+        return {
+            .m_data = std::move(decoded),
+            .m_desc = dest,
+        };
+    }
+
+    template <Channels Src, Channels Dest>
+    ImageDesc decode(ByteSpan data, std::span<Byte> out) noexcept(false)
+    {
+        const auto dest = impl::prepareDecode<Src, Dest>(data);
+
+        if (const auto required = decodedSize(dest); out.size() < required) {
+            throw std::invalid_argument{ std::format(
+                "Output buffer is too small: expected at least {} bytes, got {}", required, out.size()
+            ) };
+        }
+
+        impl::decodeInto<Src, Dest>(data, out, dest);
+        return dest;
+    }
+
+    template <Channels Chan, Colorspace Space>
+    Result<ByteVec> tryEncode(ByteSpan data, unsigned int width, unsigned int height) noexcept(false)
+    {
+        const auto desc = ImageDesc{ width, height, Chan, Space };
+        if (const auto error = impl::checkEncode(data, desc); error != Error::None) {
+            return { .m_error = error };
+        }
+
+        ByteVec encoded(maxEncodedSize(desc));
+        encoded.resize(impl::encode<Chan>(data, encoded, width, height, Space == Colorspace::sRGB));
+        return { .m_value = std::move(encoded) };
+    }
+
+    template <Channels Chan, Colorspace Space>
+    Result<usize> tryEncode(
+        ByteSpan        data,
+        std::span<Byte> out,
+        unsigned int    width,
+        unsigned int    height
+    ) noexcept
+    {
+        const auto desc = ImageDesc{ width, height, Chan, Space };
+        if (const auto error = impl::checkEncode(data, desc); error != Error::None) {
+            return { .m_error = error };
+        } else if (out.size() < maxEncodedSize(desc)) {
+            return { .m_error = Error::SizeMismatch };
+        }
+
+        return { .m_value = impl::encode<Chan>(data, out, width, height, Space == Colorspace::sRGB) };
+    }
+
+    template <Channels Src, Channels Dest>
+    Result<Image> tryDecode(ByteSpan data) noexcept(false)
+    {
+        const auto dest = impl::tryPrepareDecode<Src, Dest>(data);
+        if (!dest) {
+            return { .m_error = dest.m_error };
+        }
+
+        ByteVec    decoded(decodedSize(dest.m_value));
+        const auto error = impl::tryDecodeInto<Src, Dest>(data, decoded, dest.m_value);
+        if (error != Error::None) {
+            return { .m_error = error };
+        }
+
+        return { .m_value = { .m_data = std::move(decoded), .m_desc = dest.m_value } };
+    }
+
+    template <Channels Src, Channels Dest>
+    Result<ImageDesc> tryDecode(ByteSpan data, std::span<Byte> out) noexcept
+    {
+        const auto dest = impl::tryPrepareDecode<Src, Dest>(data);
+        if (!dest) {
+            return dest;
+        } else if (out.size() < decodedSize(dest.m_value)) {
+            return { .m_error = Error::SizeMismatch };
+        }
+
+        const auto error = impl::tryDecodeInto<Src, Dest>(data, out, dest.m_value);
+        return error == Error::None ? dest : Result<ImageDesc>{ .m_error = error };
+    }
+
+#if !defined(QOIPP_HEADER_ONLY)
+    template ByteVec encode<Channels::RGB, Colorspace::sRGB>(ByteSpan, unsigned int, unsigned int);
+    template ByteVec encode<Channels::RGB, Colorspace::Linear>(ByteSpan, unsigned int, unsigned int);
+    template ByteVec encode<Channels::RGBA, Colorspace::sRGB>(ByteSpan, unsigned int, unsigned int);
+    template ByteVec encode<Channels::RGBA, Colorspace::Linear>(ByteSpan, unsigned int, unsigned int);
+
+    template usize encode<Channels::RGB, Colorspace::sRGB>(
+        ByteSpan, std::span<Byte>, unsigned int, unsigned int
+    );
+    template usize encode<Channels::RGB, Colorspace::Linear>(
+        ByteSpan, std::span<Byte>, unsigned int, unsigned int
+    );
+    template usize encode<Channels::RGBA, Colorspace::sRGB>(
+        ByteSpan, std::span<Byte>, unsigned int, unsigned int
+    );
+    template usize encode<Channels::RGBA, Colorspace::Linear>(
+        ByteSpan, std::span<Byte>, unsigned int, unsigned int
+    );
+
+    template Image decode<Channels::RGB, Channels::RGB>(ByteSpan);
+    template Image decode<Channels::RGB, Channels::RGBA>(ByteSpan);
+    template Image decode<Channels::RGBA, Channels::RGB>(ByteSpan);
+    template Image decode<Channels::RGBA, Channels::RGBA>(ByteSpan);
+
+    template ImageDesc decode<Channels::RGB, Channels::RGB>(ByteSpan, std::span<Byte>);
+    template ImageDesc decode<Channels::RGB, Channels::RGBA>(ByteSpan, std::span<Byte>);
+    template ImageDesc decode<Channels::RGBA, Channels::RGB>(ByteSpan, std::span<Byte>);
+    template ImageDesc decode<Channels::RGBA, Channels::RGBA>(ByteSpan, std::span<Byte>);
+
+    template Result<ByteVec> tryEncode<Channels::RGB, Colorspace::sRGB>(
+        ByteSpan, unsigned int, unsigned int
+    );
+    template Result<ByteVec> tryEncode<Channels::RGB, Colorspace::Linear>(
+        ByteSpan, unsigned int, unsigned int
+    );
+    template Result<ByteVec> tryEncode<Channels::RGBA, Colorspace::sRGB>(
+        ByteSpan, unsigned int, unsigned int
+    );
+    template Result<ByteVec> tryEncode<Channels::RGBA, Colorspace::Linear>(
+        ByteSpan, unsigned int, unsigned int
+    );
+
+    template Result<usize> tryEncode<Channels::RGB, Colorspace::sRGB>(
+        ByteSpan, std::span<Byte>, unsigned int, unsigned int
+    );
+    template Result<usize> tryEncode<Channels::RGB, Colorspace::Linear>(
+        ByteSpan, std::span<Byte>, unsigned int, unsigned int
+    );
+    template Result<usize> tryEncode<Channels::RGBA, Colorspace::sRGB>(
+        ByteSpan, std::span<Byte>, unsigned int, unsigned int
+    );
+    template Result<usize> tryEncode<Channels::RGBA, Colorspace::Linear>(
+        ByteSpan, std::span<Byte>, unsigned int, unsigned int
+    );
+
+    template Result<Image> tryDecode<Channels::RGB, Channels::RGB>(ByteSpan);
+    template Result<Image> tryDecode<Channels::RGB, Channels::RGBA>(ByteSpan);
+    template Result<Image> tryDecode<Channels::RGBA, Channels::RGB>(ByteSpan);
+    template Result<Image> tryDecode<Channels::RGBA, Channels::RGBA>(ByteSpan);
+
+    template Result<ImageDesc> tryDecode<Channels::RGB, Channels::RGB>(ByteSpan, std::span<Byte>);
+    template Result<ImageDesc> tryDecode<Channels::RGB, Channels::RGBA>(ByteSpan, std::span<Byte>);
+    template Result<ImageDesc> tryDecode<Channels::RGBA, Channels::RGB>(ByteSpan, std::span<Byte>);
+    template Result<ImageDesc> tryDecode<Channels::RGBA, Channels::RGBA>(ByteSpan, std::span<Byte>);
+#endif
+
+    QOIPP_INLINE std::optional<ImageDesc> readHeaderFromFile(const std::filesystem::path& path) noexcept
+    {
+        return impl::readFileHeader(path).m_desc;
+    }
+
+    QOIPP_INLINE std::vector<FileHeader> readHeaders(
+        std::span<const std::filesystem::path> paths,
+        ThreadPool&                            pool
+    ) noexcept(false)
+    {
+        std::vector<FileHeader> headers(paths.size());
+
+        // a few syscalls per file, too little to be worth a pool task each
+        constexpr usize chunk  = 64;
+        const auto      chunks = (paths.size() + chunk - 1) / chunk;
+
+        pool.run(chunks, [&](std::size_t index) {
+            const auto end = std::min(paths.size(), (index + 1) * chunk);
+            for (auto i = index * chunk; i < end; ++i) {
+                headers[i] = impl::readFileHeader(paths[i]);
+            }
+        });
+
+        return headers;
+    }
+
+    QOIPP_INLINE std::vector<FileHeader> readHeaders(
+        std::span<const std::filesystem::path> paths
+    ) noexcept(false)
+    {
+        return readHeaders(paths, impl::sharedPool());
+    }
+
+    QOIPP_INLINE void encodeToFile(
+        const std::filesystem::path& path,
+        std::span<const Byte>        data,
+        ImageDesc                    desc,
+        bool                         overwrite,
+        EncodeOptions                options
+    ) noexcept(false)
+    {
+        impl::validateEncode(data, desc);
+
+        // encode straight into the mapped file, then shrink it to the actual encoded size
+        auto file = impl::MappedFile::write(path, maxEncodedSize(desc), overwrite);
+        file.close(impl::encodeInto(data, file.bytes(), desc, options.m_effort));
+    }
+
+    QOIPP_INLINE Image decodeFromFile(const std::filesystem::path& path, bool rgbOnly) noexcept(false)
+    {
+        auto file = impl::MappedFile::read(path);
+        if (!file.has_value()) {
+            throw std::invalid_argument{ "Path does not exist, is not a regular file, or could not be read" };
+        }
+
+        return decode(file->bytes(), rgbOnly);
+    }
+
+    QOIPP_INLINE Image decodeFromFile(const std::filesystem::path& path, Channels target) noexcept(false)
+    {
+        auto file = impl::MappedFile::read(path);
+        if (!file.has_value()) {
+            throw std::invalid_argument{ "Path does not exist, is not a regular file, or could not be read" };
+        }
+
+        return decode(file->bytes(), target);
+    }
+
+    QOIPP_INLINE ImageDesc decodeFromFile(
+        const std::filesystem::path& path,
+        const Allocate&              allocate,
+        bool                         rgbOnly
+    ) noexcept(false)
+    {
+        auto file = impl::MappedFile::read(path);
+        if (!file.has_value()) {
+            throw std::invalid_argument{ "Path does not exist, is not a regular file, or could not be read" };
+        }
+
+        return decode(file->bytes(), allocate, rgbOnly);
+    }
+
+    QOIPP_INLINE ImageDesc decodeFromFile(
+        const std::filesystem::path& path,
+        const Allocate&              allocate,
+        Channels                     target
+    ) noexcept(false)
+    {
+        auto file = impl::MappedFile::read(path);
+        if (!file.has_value()) {
+            throw std::invalid_argument{ "Path does not exist, is not a regular file, or could not be read" };
+        }
+
+        return decode(file->bytes(), allocate, target);
+    }
+
+    QOIPP_INLINE std::string_view errorName(Error error) noexcept
+    {
+        switch (error) {
+        case Error::None: return "none";
+        case Error::BadMagic: return "bad magic";
+        case Error::BadChannels: return "bad channels";
+        case Error::BadDimensions: return "bad dimensions";
+        case Error::SizeMismatch: return "size mismatch";
+        case Error::Truncated: return "truncated";
+        case Error::PixelOverflow: return "pixel overflow";
+        case Error::File: return "file error";
+        case Error::BadRegion: return "bad region";
+        case Error::BadTable: return "bad table";
+        case Error::BadEndMarker: return "bad end marker";
+        case Error::BadFormat: return "bad format";
+        case Error::BadFrame: return "bad frame";
+        }
+        return "unknown";
+    }
+
+    QOIPP_INLINE Result<ByteVec> tryEncode(
+        ByteSpan      data,
+        ImageDesc     desc,
+        EncodeOptions options
+    ) noexcept(false)
+    {
+        if (const auto error = impl::checkEncode(data, desc); error != Error::None) {
+            return { .m_error = error };
+        }
+
+        ByteVec encoded(maxEncodedSize(desc));
+        encoded.resize(impl::encodeInto(data, encoded, desc, options.m_effort));
+        return { .m_value = std::move(encoded) };
+    }
+
+    QOIPP_INLINE Result<usize> tryEncode(
+        ByteSpan        data,
+        ImageDesc       desc,
+        std::span<Byte> out,
+        EncodeOptions   options
+    ) noexcept
+    {
+        if (const auto error = impl::checkEncode(data, desc); error != Error::None) {
+            return { .m_error = error };
+        } else if (out.size() < maxEncodedSize(desc)) {
+            return { .m_error = Error::SizeMismatch };
+        }
+
+        return { .m_value = impl::encodeInto(data, out, desc, options.m_effort) };
+    }
+
+    QOIPP_INLINE Result<Image> tryDecode(ByteSpan data, bool rgbOnly) noexcept(false)
+    {
+        return impl::tryDecodeImage(data, impl::decodeTarget(rgbOnly));
+    }
+
+    QOIPP_INLINE Result<Image> tryDecode(ByteSpan data, Channels target) noexcept(false)
+    {
+        return impl::tryDecodeImage(data, target);
+    }
+
+    QOIPP_INLINE Result<ImageDesc> tryDecode(ByteSpan data, std::span<Byte> out, bool rgbOnly) noexcept
+    {
+        return impl::tryDecodeImage(data, out, impl::decodeTarget(rgbOnly));
+    }
+
+    QOIPP_INLINE Result<ImageDesc> tryDecode(ByteSpan data, std::span<Byte> out, Channels target) noexcept
+    {
+        return impl::tryDecodeImage(data, out, target);
+    }
+
+    QOIPP_INLINE Result<Image> tryDecodeFromFile(
+        const std::filesystem::path& path,
+        bool                         rgbOnly
+    ) noexcept(false)
+    {
+        auto file = impl::MappedFile::read(path);
+        if (!file.has_value()) {
+            return { .m_error = Error::File };
+        }
+
+        return tryDecode(file->bytes(), rgbOnly);
+    }
+
+    QOIPP_INLINE Result<Image> tryDecodeFromFile(
+        const std::filesystem::path& path,
+        Channels                     target
+    ) noexcept(false)
+    {
+        auto file = impl::MappedFile::read(path);
+        if (!file.has_value()) {
+            return { .m_error = Error::File };
+        }
+
+        return tryDecode(file->bytes(), target);
+    }
+
+    QOIPP_INLINE Error tryEncodeToFile(
+        const std::filesystem::path& path,
+        std::span<const Byte>        data,
+        ImageDesc                    desc,
+        bool                         overwrite,
+        EncodeOptions                options
+    ) noexcept(false)
+    {
+        if (const auto error = impl::checkEncode(data, desc); error != Error::None) {
+            return error;
+        }
+
+        auto fileError = impl::FileError::None;
+        auto file      = impl::MappedFile::tryWrite(path, maxEncodedSize(desc), overwrite, fileError);
+        if (!file.has_value()) {
+            return Error::File;
+        }
+
+        const auto size = impl::encodeInto(data, file->bytes(), desc, options.m_effort);
+        return file->tryClose(size) == impl::FileError::None ? Error::None : Error::File;
+    }
+
+    QOIPP_INLINE Result<Image> tryDecodeRegion(
+        ByteSpan     data,
+        Region       region,
+        unsigned int scale,
+        bool         rgbOnly
+    ) noexcept(false)
+    {
+        return impl::tryDecodeRegion(data, region, scale, impl::decodeTarget(rgbOnly));
+    }
+
+    QOIPP_INLINE Result<Image> tryDecodeRegion(
+        ByteSpan     data,
+        Region       region,
+        unsigned int scale,
+        Channels     target
+    ) noexcept(false)
+    {
+        return impl::tryDecodeRegion(data, region, scale, target);
+    }
+
+    QOIPP_INLINE Result<Image> tryDecodeRows(
+        ByteSpan     data,
+        ByteSpan     index,
+        unsigned int firstRow,
+        unsigned int count,
+        bool         rgbOnly
+    ) noexcept(false)
+    {
+        const auto rows = Region{ .m_y = firstRow, .m_height = count };
+        return impl::tryDecodeRegion(data, rows, 1, impl::decodeTarget(rgbOnly), index);
+    }
+
+    QOIPP_INLINE Result<Image> tryDecodeRows(
+        ByteSpan     data,
+        ByteSpan     index,
+        unsigned int firstRow,
+        unsigned int count,
+        Channels     target
+    ) noexcept(false)
+    {
+        const auto rows = Region{ .m_y = firstRow, .m_height = count };
+        return impl::tryDecodeRegion(data, rows, 1, target, index);
+    }
+
+    QOIPP_INLINE Result<Image> tryDecodeStriped(ByteSpan data, bool rgbOnly) noexcept(false)
+    {
+        return impl::tryDecodeStriped(data, impl::decodeTarget(rgbOnly));
+    }
+
+    QOIPP_INLINE Result<Image> tryDecodeStriped(ByteSpan data, Channels target) noexcept(false)
+    {
+        return impl::tryDecodeStriped(data, target);
+    }
+
+    QOIPP_INLINE Result<ByteVec> tryEncodeStriped(
+        ByteSpan      data,
+        ImageDesc     desc,
+        std::size_t   stripes,
+        EncodeOptions options
+    ) noexcept(false)
+    {
+        if (const auto error = impl::checkEncode(data, desc); error != Error::None) {
+            return { .m_error = error };
+        }
+        return { .m_value = impl::encodeStriped(data, desc, stripes, options.m_effort) };
+    }
+
+    QOIPP_INLINE Result<ByteVec> tryIndexRows(ByteSpan data, unsigned int interval) noexcept(false)
+    {
+        return impl::tryIndexRows(data, interval);
+    }
+
+    QOIPP_INLINE Result<ByteVec> tryEncode(
+        ByteSpan      data,
+        ImageDesc     desc,
+        PixelFormat   format,
+        EncodeOptions options
+    ) noexcept(false)
+    {
+        if (const auto error = impl::checkFormatEncode(data, desc, format); error != Error::None) {
+            return { .m_error = error };
+        }
+
+        const auto view = ImageView{ .m_data = data, .m_desc = desc, .m_format = format };
+
+        ByteVec encoded(maxEncodedSize(desc));
+        encoded.resize(impl::encodeView(view, encoded, options.m_effort));
+        return { .m_value = std::move(encoded) };
+    }
+
+    QOIPP_INLINE Result<ByteVec> tryEncode(const ImageView& view, EncodeOptions options) noexcept(false)
+    {
+        if (const auto error = impl::checkView(view); error != Error::None) {
+            return { .m_error = error };
+        }
+
+        ByteVec encoded(maxEncodedSize(view.m_desc));
+        encoded.resize(impl::encodeView(view, encoded, options.m_effort));
+        return { .m_value = std::move(encoded) };
+    }
+
+    QOIPP_INLINE Result<usize> tryEncode(
+        const ImageView& view,
+        std::span<Byte>  out,
+        EncodeOptions    options
+    ) noexcept
+    {
+        if (const auto error = impl::checkView(view); error != Error::None) {
+            return { .m_error = error };
+        } else if (out.size() < maxEncodedSize(view.m_desc)) {
+            return { .m_error = Error::SizeMismatch };
+        }
+
+        // the format is checked, `encodeView` has nothing left to throw
+        return { .m_value = impl::encodeView(view, out, options.m_effort) };
+    }
+
+    QOIPP_INLINE Result<Image> tryDecode(ByteSpan data, PixelFormat format) noexcept(false)
+    {
+        ByteVec    decoded;
+        const auto desc = impl::tryDecodeFormatted(
+            data,
+            [&](usize size) {
+                decoded.resize(size);
+                return std::span{ decoded };
+            },
+            format
+        );
+
+        if (!desc) {
+            return { .m_error = desc.m_error };
+        }
+        return { .m_value = { .m_data = std::move(decoded), .m_desc = desc.m_value } };
+    }
+
+    QOIPP_INLINE Result<ImageDesc> tryDecode(ByteSpan data, std::span<Byte> out, PixelFormat format) noexcept
+    {
+        return impl::tryDecodeFormatted(data, [out](usize) { return out; }, format);
+    }
+
+    QOIPP_INLINE Result<usize> tryEncode(
+        ByteSpan        data,
+        ImageDesc       desc,
+        const Allocate& allocate,
+        EncodeOptions   options
+    ) noexcept(false)
+    {
+        if (const auto error = impl::checkEncode(data, desc); error != Error::None) {
+            return { .m_error = error };
+        }
+
+        const auto required = maxEncodedSize(desc);
+        const auto out      = allocate(required);
+        if (out.size() < required) {
+            return { .m_error = Error::SizeMismatch };
+        }
+
+        return { .m_value = impl::encodeInto(data, out, desc, options.m_effort) };
+    }
+
+    QOIPP_INLINE Result<ImageDesc> tryDecode(
+        ByteSpan        data,
+        const Allocate& allocate,
+        bool            rgbOnly
+    ) noexcept(false)
+    {
+        return impl::tryDecodeImage(data, allocate, impl::decodeTarget(rgbOnly));
+    }
+
+    QOIPP_INLINE Result<ImageDesc> tryDecode(
+        ByteSpan        data,
+        const Allocate& allocate,
+        Channels        target
+    ) noexcept(false)
+    {
+        return impl::tryDecodeImage(data, allocate, target);
+    }
+
+    QOIPP_INLINE Result<ImageDesc> tryDecodeFromFile(
+        const std::filesystem::path& path,
+        const Allocate&              allocate,
+        bool                         rgbOnly
+    ) noexcept(false)
+    {
+        auto file = impl::MappedFile::read(path);
+        if (!file.has_value()) {
+            return { .m_error = Error::File };
+        }
+
+        return tryDecode(file->bytes(), allocate, rgbOnly);
+    }
+
+    QOIPP_INLINE Result<ImageDesc> tryDecodeFromFile(
+        const std::filesystem::path& path,
+        const Allocate&              allocate,
+        Channels                     target
+    ) noexcept(false)
+    {
+        auto file = impl::MappedFile::read(path);
+        if (!file.has_value()) {
+            return { .m_error = Error::File };
+        }
+
+        return tryDecode(file->bytes(), allocate, target);
+    }
+
+    QOIPP_INLINE ByteVec encodeStriped(
+        ByteSpan      data,
+        ImageDesc     desc,
+        std::size_t   stripes,
+        EncodeOptions options
+    ) noexcept(false)
+    {
+        impl::validateEncode(data, desc);
+        return impl::encodeStriped(data, desc, stripes, options.m_effort);
+    }
+
+    QOIPP_INLINE Image decodeStriped(ByteSpan data, bool rgbOnly) noexcept(false)
+    {
+        return impl::decodeStriped(data, impl::decodeTarget(rgbOnly));
+    }
+
+    QOIPP_INLINE Image decodeStriped(ByteSpan data, Channels target) noexcept(false)
+    {
+        return impl::decodeStriped(data, target);
+    }
+
+    QOIPP_INLINE ByteVec indexRows(ByteSpan data, unsigned int interval) noexcept(false)
+    {
+        return impl::indexRows(data, interval);
+    }
+
+    QOIPP_INLINE Image decodeRows(
+        ByteSpan     data,
+        ByteSpan     index,
+        unsigned int firstRow,
+        unsigned int count,
+        bool         rgbOnly
+    ) noexcept(false)
+    {
+        const auto rows = Region{ .m_y = firstRow, .m_height = count };
+        return impl::decodeRegion(data, rows, 1, impl::decodeTarget(rgbOnly), index);
+    }
+
+    QOIPP_INLINE Image decodeRows(
+        ByteSpan     data,
+        ByteSpan     index,
+        unsigned int firstRow,
+        unsigned int count,
+        Channels     target
+    ) noexcept(false)
+    {
+        const auto rows = Region{ .m_y = firstRow, .m_height = count };
+        return impl::decodeRegion(data, rows, 1, target, index);
+    }
+
+    struct ThreadPool::State
+    {
+        // The indices left for a worker packed as `begin << 32 | end`. The owner takes from the front and the
+        // other workers steal from the back, a single word keeps both ends consistent without a lock.
+        struct alignas(64) Range
+        {
+            std::atomic<u64> m_range = 0;
+        };
+
+        static u64 pack(u64 begin, u64 end) noexcept { return begin << 32 | end; }
+
+        std::vector<Range>                      m_ranges;    // the calling thread works on the first one
+        const std::function<void(std::size_t)>* m_task       = nullptr;
+        std::mutex                              m_runMutex;    // held for the whole batch
+        std::mutex                              m_mutex;
+        std::condition_variable                 m_wake;
+        std::condition_variable                 m_done;
+        usize                                   m_generation = 0;
+        usize                                   m_busy       = 0;
+        bool                                    m_stop       = false;
+        std::vector<std::jthread>               m_threads;
+
+        // the call is running on a pool, nested batches run on the calling thread instead of waiting forever
+        static inline thread_local bool t_inPool = false;
+
+        bool take(usize worker, usize& index) noexcept
+        {
+            const auto size = m_ranges.size();
+            for (usize i = 0; i < size; ++i) {
+                const auto victim = (worker + i) % size;
+                const bool steal  = victim != worker;
+
+                auto& range = m_ranges[victim].m_range;
+                auto  value = range.load();
+
+                while ((value >> 32) < (value & 0xFFFF'FFFF)) {
+                    const auto begin = value >> 32;
+                    const auto end   = value & 0xFFFF'FFFF;
+                    const auto rest  = steal ? pack(begin, end - 1) : pack(begin + 1, end);
+
+                    if (range.compare_exchange_weak(value, rest)) {
+                        index = steal ? end - 1 : begin;
+                        return true;
+                    }
+                }
+            }
+            return false;
+        }
+
+        void stop() noexcept
+        {
+            {
+                std::unique_lock lock{ m_mutex };
+                m_stop = true;
+            }
+            m_wake.notify_all();
+            m_threads.clear();
+        }
+
+        void work(usize worker) noexcept
+        {
+            usize index;
+            while (take(worker, index)) {
+                (*m_task)(index);
+            }
+        }
+
+        void loop(usize worker) noexcept
+        {
+            t_inPool = true;
+
+            usize generation = 0;
+            while (true) {
+                {
+                    std::unique_lock lock{ m_mutex };
+                    m_wake.wait(lock, [&] { return m_stop || m_generation != generation; });
+                    if (m_stop) {
+                        return;
+                    }
+                    generation = m_generation;
+                }
+
+                work(worker);
+
+                std::unique_lock lock{ m_mutex };
+                if (--m_busy == 0) {
+                    m_done.notify_all();
+                }
+            }
+        }
+    };
+
+    QOIPP_INLINE ThreadPool::ThreadPool(std::size_t threads) noexcept(false)
+        : m_state{ std::make_unique<State>() }
+    {
+        if (threads == 0) {
+            threads = std::max(std::thread::hardware_concurrency(), 1u);
+        }
+
+        m_state->m_ranges = std::vector<State::Range>(threads);
+        m_state->m_threads.reserve(threads - 1);
+
+        try {
+            for (usize worker = 1; worker < threads; ++worker) {
+                m_state->m_threads.emplace_back([state = m_state.get(), worker] { state->loop(worker); });
+            }
+        } catch (...) {
+            m_state->stop();
+            throw;
+        }
+    }
+
+    QOIPP_INLINE ThreadPool::~ThreadPool()
+    {
+        if (m_state) {
+            m_state->stop();
+        }
+    }
+
+    QOIPP_INLINE ThreadPool::ThreadPool(ThreadPool&&) noexcept            = default;
+    QOIPP_INLINE ThreadPool& ThreadPool::operator=(ThreadPool&&) noexcept = default;
+
+    QOIPP_INLINE std::size_t ThreadPool::size() const noexcept
+    {
+        return m_state->m_ranges.size();
+    }
+
+    QOIPP_INLINE void ThreadPool::run(
+        std::size_t                             count,
+        const std::function<void(std::size_t)>& fn
+    ) noexcept(false)
+    {
+        std::exception_ptr error;
+        std::mutex         errorMutex;
+
+        // keep the first exception and carry on with the rest of the jobs
+        const std::function<void(std::size_t)> task = [&](std::size_t index) {
+            try {
+                fn(index);
+            } catch (...) {
+                std::unique_lock lock{ errorMutex };
+                if (!error) {
+                    error = std::current_exception();
+                }
+            }
+        };
+
+        auto& state = *m_state;
+
+        if (State::t_inPool || state.m_threads.empty() || count <= 1) {
+            for (usize index = 0; index < count; ++index) {
+                task(index);
+            }
+        } else {
+            std::unique_lock run{ state.m_runMutex };
+
+            // the ranges hold 32 bits indices, bigger batches are split
+            constexpr usize maxCount = 0xFFFF'FFFF;
+            for (usize offset = 0; offset < count; offset += maxCount) {
+                const auto size    = std::min(count - offset, maxCount);
+                const auto workers = state.m_ranges.size();
+
+                // split evenly up front, stealing takes care of jobs that take longer than others
+                for (usize worker = 0; worker < workers; ++worker) {
+                    const auto begin = size * worker / workers;
+                    const auto end   = size * (worker + 1) / workers;
+                    state.m_ranges[worker].m_range = State::pack(begin, end);
+                }
+
+                const std::function<void(std::size_t)> shifted = [&](std::size_t index) {
+                    task(offset + index);
+                };
+                {
+                    std::unique_lock lock{ state.m_mutex };
+                    state.m_task  = &shifted;
+                    state.m_busy  = state.m_threads.size();
+                    ++state.m_generation;
+                }
+                state.m_wake.notify_all();
+
+                State::t_inPool = true;
+                state.work(0);
+                State::t_inPool = false;
+
+                std::unique_lock lock{ state.m_mutex };
+                state.m_done.wait(lock, [&] { return state.m_busy == 0; });
+                state.m_task = nullptr;
+            }
+        }
+
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+
+    QOIPP_INLINE std::vector<ByteVec> encodeBatch(
+        std::span<const EncodeJob> jobs,
+        ThreadPool&                pool,
+        EncodeOptions              options
+    ) noexcept(false)
+    {
+        std::vector<ByteVec> encoded(jobs.size());
+
+        pool.run(jobs.size(), [&](std::size_t index) {
+            const auto [data, desc] = jobs[index];
+            impl::validateEncode(data, desc);
+            encoded[index] = impl::encodeScratch(data, desc, options.m_effort);
+        });
+
+        return encoded;
+    }
+
+    QOIPP_INLINE std::vector<ByteVec> encodeBatch(
+        std::span<const EncodeJob> jobs,
+        EncodeOptions              options
+    ) noexcept(false)
+    {
+        return encodeBatch(jobs, impl::sharedPool(), options);
+    }
+
+    QOIPP_INLINE std::vector<Image> decodeBatch(
+        std::span<const ByteSpan> jobs,
+        ThreadPool&               pool,
+        bool                      rgbOnly
+    ) noexcept(false)
+    {
+        std::vector<Image> decoded(jobs.size());
+
+        // no scratch buffer unlike `encodeBatch`: the decoder state lives on the stack and the size of the
+        // output is known from the header, so the only allocation of a job is the image it returns, which a
+        // thread buffer would only add a copy to
+        pool.run(jobs.size(), [&](std::size_t index) {
+            decoded[index] = impl::decodeImage<true>(jobs[index], impl::decodeTarget(rgbOnly));
+        });
+
+        return decoded;
+    }
+
+    QOIPP_INLINE std::vector<Image> decodeBatch(std::span<const ByteSpan> jobs, bool rgbOnly) noexcept(false)
+    {
+        return decodeBatch(jobs, impl::sharedPool(), rgbOnly);
+    }
+
+    QOIPP_INLINE std::vector<Result<Image>> tryDecodeBatch(
+        std::span<const ByteSpan> jobs,
+        ThreadPool&               pool,
+        bool                      rgbOnly
+    ) noexcept(false)
+    {
+        std::vector<Result<Image>> decoded(jobs.size());
+
+        pool.run(jobs.size(), [&](std::size_t index) {
+            decoded[index] = impl::tryDecodeImage(jobs[index], impl::decodeTarget(rgbOnly));
+        });
+
+        return decoded;
+    }
+
+    QOIPP_INLINE std::vector<Result<Image>> tryDecodeBatch(
+        std::span<const ByteSpan> jobs,
+        bool                      rgbOnly
+    ) noexcept(false)
+    {
+        return tryDecodeBatch(jobs, impl::sharedPool(), rgbOnly);
+    }
+
+    QOIPP_INLINE std::vector<Result<ByteVec>> tryEncodeBatch(
+        std::span<const EncodeJob> jobs,
+        ThreadPool&                pool,
+        EncodeOptions              options
+    ) noexcept(false)
+    {
+        std::vector<Result<ByteVec>> encoded(jobs.size());
+
+        pool.run(jobs.size(), [&](std::size_t index) {
+            const auto [data, desc] = jobs[index];
+            if (const auto error = impl::checkEncode(data, desc); error != Error::None) {
+                encoded[index] = { .m_error = error };
+            } else {
+                encoded[index] = { .m_value = impl::encodeScratch(data, desc, options.m_effort) };
+            }
+        });
+
+        return encoded;
+    }
+
+    QOIPP_INLINE std::vector<Result<ByteVec>> tryEncodeBatch(
+        std::span<const EncodeJob> jobs,
+        EncodeOptions              options
+    ) noexcept(false)
+    {
+        return tryEncodeBatch(jobs, impl::sharedPool(), options);
+    }
+
+    QOIPP_INLINE Image decodeParallel(ByteSpan data, ThreadPool& pool, bool rgbOnly) noexcept(false)
+    {
+        return impl::decodeParallel(data, impl::decodeTarget(rgbOnly), pool);
+    }
+
+    QOIPP_INLINE Image decodeParallel(ByteSpan data, bool rgbOnly) noexcept(false)
+    {
+        return impl::decodeParallel(data, impl::decodeTarget(rgbOnly), impl::sharedPool());
+    }
+
+    QOIPP_INLINE Result<Image> tryDecodeParallel(
+        ByteSpan    data,
+        ThreadPool& pool,
+        bool        rgbOnly
+    ) noexcept(false)
+    {
+        return impl::tryDecodeParallel(data, impl::decodeTarget(rgbOnly), pool);
+    }
+
+    QOIPP_INLINE Result<Image> tryDecodeParallel(ByteSpan data, bool rgbOnly) noexcept(false)
+    {
+        return impl::tryDecodeParallel(data, impl::decodeTarget(rgbOnly), impl::sharedPool());
+    }
+
+    QOIPP_INLINE std::vector<std::exception_ptr> convertFiles(
+        std::span<const FileJob> jobs,
+        const FileTransform&     transform,
+        FilePipelineOptions      options
+    ) noexcept(false)
+    {
+        if (options.m_queueDepth == 0 || options.m_queueDepth > 4096) {
+            throw std::invalid_argument{ std::format(
+                "Invalid queue depth: {} (must be between 1 and 4096)", options.m_queueDepth
+            ) };
+        } else if (options.m_maxInFlight == 0) {
+            throw std::invalid_argument{ "Invalid in-flight limit: 0" };
+        } else if (jobs.empty()) {
+            return {};
+        }
+
+        impl::FilePipeline pipeline{ jobs, transform, options };
+        return pipeline.run();
+    }
+
+    QOIPP_INLINE Stats stats() noexcept
+    {
+        if constexpr (statsEnabled) {
+            return impl::threadStats();
+        } else {
+            return {};
+        }
+    }
+
+    QOIPP_INLINE void resetStats() noexcept
+    {
+        if constexpr (statsEnabled) {
+            impl::threadStats() = {};
+        }
+    }
+
+    QOIPP_INLINE Kernel activeKernel() noexcept
+    {
+        return impl::kernelSetting().load(std::memory_order_relaxed);
+    }
+
+    QOIPP_INLINE bool isKernelSupported(Kernel kernel) noexcept
+    {
+        return kernel >= Kernel::Baseline && kernel <= impl::supportedKernel();
+    }
+
+    QOIPP_INLINE void setKernel(Kernel kernel) noexcept(false)
+    {
+        if (!isKernelSupported(kernel)) {
+            throw std::invalid_argument{ std::format(
+                "Kernel is not supported on this CPU: {} (best supported: {})",
+                kernelName(kernel),
+                kernelName(impl::supportedKernel())
+            ) };
+        }
+        impl::kernelSetting().store(kernel, std::memory_order_relaxed);
+    }
+
+    QOIPP_INLINE std::string_view kernelName(Kernel kernel) noexcept
+    {
+        switch (kernel) {
+#if defined(__aarch64__) || defined(_M_ARM64)
+        case Kernel::Baseline: return "neon";
+#elif defined(__x86_64__) || defined(_M_X64)
+        case Kernel::Baseline: return "sse2";
+#else
+        case Kernel::Baseline: return "generic";
+#endif
+        case Kernel::SSE42: return "sse4.2";
+        case Kernel::AVX2: return "avx2";
+        case Kernel::AVX512: return "avx512";
+        }
+        return "unknown";
+    }
+
+    struct Encoder::State
+    {
+        ImageDesc         m_desc;
+        Sink              m_sink;
+        EncodeOptions     m_options;
+        impl::EncodeState m_encodeState = {};
+        ByteVec           m_buffer      = {};
+        usize             m_remaining   = 0;    // in pixels
+        bool              m_finished    = false;
+    };
+
+    QOIPP_INLINE Encoder::Encoder(ImageDesc desc, Sink sink, EncodeOptions options) noexcept(false)
+    {
+        impl::validateDesc(desc);
+
+        if (!sink) {
+            throw std::invalid_argument{ "Sink must not be empty" };
+        }
+
+        m_state = std::make_unique<State>(State{
+            .m_desc      = desc,
+            .m_sink      = std::move(sink),
+            .m_options   = options,
+            .m_buffer    = ByteVec(constants::headerSize),
+            .m_remaining = static_cast<usize>(desc.m_width) * desc.m_height,
+        });
+
+        impl::DataChunkArray chunks{ m_state->m_buffer };
+        chunks.push(data::QoiHeader{
+            .m_width      = desc.m_width,
+            .m_height     = desc.m_height,
+            .m_channels   = static_cast<u8>(desc.m_channels),
+            .m_colorspace = static_cast<u8>(desc.m_colorspace),
+        });
+
+        m_state->m_sink(ByteSpan{ m_state->m_buffer.data(), chunks.size() });
+    }
+
+    QOIPP_INLINE Encoder::~Encoder() = default;
+
+    QOIPP_INLINE Encoder::Encoder(Encoder&&) noexcept            = default;
+    QOIPP_INLINE Encoder& Encoder::operator=(Encoder&&) noexcept = default;
+
+    QOIPP_INLINE void Encoder::push(ByteSpan data) noexcept(false)
+    {
+        auto& [desc, sink, options, encodeState, buffer, remaining, finished] = *m_state;
+
+        if (finished) {
+            throw std::invalid_argument{ "Encoder is already finished" };
+        }
+
+        const auto channels = static_cast<usize>(desc.m_channels);
+        if (data.size() % channels != 0) {
+            throw std::invalid_argument{ std::format(
+                "Data does not align with the number of channels: expected multiple of {} bytes", channels
+            ) };
+        }
+
+        const auto count = data.size() / channels;
+        if (count > remaining) {
+            throw std::invalid_argument{ std::format(
+                "Data exceeds the image description: {} pixels remaining, got {}", remaining, count
+            ) };
+        }
+
+        if (count == 0) {
+            return;
         }
 
-        ByteVec data(fs::file_size(path));
-        file.read(reinterpret_cast<char*>(data.data()), static_cast<std::streamsize>(data.size()));
+        impl::PerfScope perf{ &Stats::m_encodePerf };
 
-        return decode(data, rgbOnly);
+        // worst possible scenario is when no data is compressed + tag (rgb/rgba), after the OP_RUN of a run
+        // left pending by the previous push (shorter than `runLimit`, so a single byte)
+        const auto maxSize = count * (channels + 1) + 1;
+        if (buffer.size() < maxSize) {
+            buffer.resize(maxSize);
+        }
+
+        remaining -= count;
+
+        impl::DataChunkArray chunks{ buffer };
+        if (desc.m_channels == Channels::RGB) {
+            impl::encodePixels<Channels::RGB>(encodeState, chunks, data, remaining == 0, options.m_effort);
+        } else {
+            impl::encodePixels<Channels::RGBA>(encodeState, chunks, data, remaining == 0, options.m_effort);
+        }
+
+        if (chunks.size() > 0) {
+            sink(ByteSpan{ buffer.data(), chunks.size() });
+        }
+    }
+
+    QOIPP_INLINE void Encoder::finish() noexcept(false)
+    {
+        auto& [desc, sink, options, encodeState, buffer, remaining, finished] = *m_state;
+
+        if (finished) {
+            throw std::invalid_argument{ "Encoder is already finished" };
+        }
+
+        if (remaining > 0) {
+            throw std::invalid_argument{ std::format(
+                "Not all pixels have been pushed: {} pixels remaining", remaining
+            ) };
+        }
+
+        impl::DataChunkArray chunks{ buffer };
+        chunks.push(data::EndMarker{});
+
+        finished = true;
+        sink(ByteSpan{ buffer.data(), chunks.size() });
+    }
+
+    QOIPP_INLINE std::size_t Encoder::remaining() const noexcept
+    {
+        return m_state->m_remaining;
+    }
+
+    struct Decoder::State
+    {
+        Sink                           m_sink;
+        std::optional<Channels>        m_target;
+        std::optional<ImageDesc>       m_desc        = std::nullopt;
+        bool                           m_expand      = false;    // RGB image decoded into RGBA rows
+        impl::DecodeState              m_decodeState = {};
+        ByteArr<constants::headerSize> m_pending     = {};    // incomplete header or op from previous push
+        usize                          m_pendingSize = 0;
+        ByteVec                        m_row         = {};
+        usize                          m_rowIndex    = 0;
+        usize                          m_column      = 0;
+        usize                          m_remaining   = 0;    // in pixels
+        usize                          m_endRead     = 0;    // number of end marker bytes consumed
+
+        // move up to `count` bytes from `data[index]` into the pending buffer
+        void takePending(ByteSpan data, usize& index, usize count) noexcept
+        {
+            count = std::min(count, data.size() - index);
+            std::memcpy(m_pending.data() + m_pendingSize, data.data() + index, count);
+            m_pendingSize += count;
+            index         += count;
+        }
+
+        // the header is kept pending when it is rejected, every later push is then rejected the same way
+        Error readHeader(ByteSpan data, usize& index) noexcept
+        {
+            takePending(data, index, constants::headerSize - m_pendingSize);
+            if (m_pendingSize < constants::headerSize) {
+                return Error::None;
+            }
+
+            const auto header = impl::checkHeader(m_pending);
+            if (!header) {
+                return header.m_error;
+            } else if (const auto error = impl::checkDesc(header.m_value); error != Error::None) {
+                return error;
+            }
+
+            const auto desc = header.m_value;
+
+            m_desc        = impl::decodedDesc(desc, m_target);
+            m_expand      = desc.m_channels == Channels::RGB && m_desc->m_channels == Channels::RGBA;
+            m_remaining   = static_cast<usize>(desc.m_width) * desc.m_height;
+            m_pendingSize = 0;
+            m_row.resize(static_cast<usize>(m_desc->m_width) * static_cast<usize>(m_desc->m_channels));
+            return Error::None;
+        }
+
+        template <Channels Dest, bool Opaque>
+        void emit(usize count) noexcept
+        {
+            // a run may not go past the end of the image
+            count        = std::min(count, m_remaining);
+            m_remaining -= count;
+
+            impl::PixelWriter<Dest, Opaque> write{ m_row };
+            while (count > 0) {
+                const auto length = std::min<usize>(count, m_desc->m_width - m_column);
+                if (length == 1) {
+                    write(m_column, m_decodeState.m_prevPixel);
+                } else {
+                    write.fill(m_column, length, m_decodeState.m_prevPixel);
+                }
+
+                count    -= length;
+                m_column += length;
+                if (m_column == m_desc->m_width) {
+                    m_sink(m_rowIndex++, m_row);
+                    m_column = 0;
+                }
+            }
+        }
+
+        template <Channels Dest, bool Opaque>
+        void readOps(ByteSpan data, usize& index) noexcept
+        {
+            if (m_pendingSize > 0) {
+                const auto size = impl::opSize(std::to_integer<u8>(m_pending[0]));
+                takePending(data, index, size - m_pendingSize);
+                if (m_pendingSize < size) {
+                    return;
+                }
+
+                usize pendingIndex = 0;
+                m_pendingSize      = 0;
+                emit<Dest, Opaque>(impl::decodeOp(m_decodeState, m_pending.data(), pendingIndex));
+            }
+
+            while (m_remaining > 0 && index < data.size()) {
+                const auto size = impl::opSize(std::to_integer<u8>(data[index]));
+                if (index + size > data.size()) {
+                    takePending(data, index, size);
+                    return;
+                }
+                emit<Dest, Opaque>(impl::decodeOp(m_decodeState, data.data(), index));
+            }
+        }
+
+        Error readEndMarker(ByteSpan data, usize& index) noexcept
+        {
+            const auto count  = std::min(constants::endMarker.size() - m_endRead, data.size() - index);
+            const auto marker = constants::endMarker.data() + m_endRead;
+            if (std::memcmp(marker, data.data() + index, count) != 0) {
+                return Error::BadEndMarker;
+            }
+
+            m_endRead += count;
+            index     += count;
+            return Error::None;
+        }
+
+        // only throws what the sink throws
+        Error push(ByteSpan data) noexcept(false)
+        {
+            impl::PerfScope perf{ &Stats::m_decodePerf };
+
+            usize index = 0;
+
+            if (!m_desc.has_value()) {
+                if (const auto error = readHeader(data, index); error != Error::None) {
+                    return error;
+                } else if (!m_desc.has_value()) {
+                    return Error::None;
+                }
+            }
+
+            if (m_remaining > 0) {
+                if (m_desc->m_channels == Channels::RGB) {
+                    readOps<Channels::RGB, false>(data, index);
+                } else if (m_expand) {
+                    readOps<Channels::RGBA, true>(data, index);
+                } else {
+                    readOps<Channels::RGBA, false>(data, index);
+                }
+            }
+
+            if (m_remaining == 0) {
+                return readEndMarker(data, index);
+            }
+            return Error::None;
+        }
+    };
+
+    QOIPP_INLINE Decoder::Decoder(Sink sink, bool rgbOnly) noexcept(false)
+        : Decoder{ std::move(sink), impl::decodeTarget(rgbOnly) }
+    {
+    }
+
+    QOIPP_INLINE Decoder::Decoder(Sink sink, Channels target) noexcept(false)
+        : Decoder{ std::move(sink), std::optional{ target } }
+    {
+    }
+
+    QOIPP_INLINE Decoder::Decoder(Sink sink, std::optional<Channels> target) noexcept(false)
+    {
+        if (!sink) {
+            throw std::invalid_argument{ "Sink must not be empty" };
+        }
+
+        impl::validateTarget(target);
+
+        m_state = std::make_unique<State>(State{
+            .m_sink   = std::move(sink),
+            .m_target = target,
+        });
+    }
+
+    QOIPP_INLINE Decoder::~Decoder() = default;
+
+    QOIPP_INLINE Decoder::Decoder(Decoder&&) noexcept            = default;
+    QOIPP_INLINE Decoder& Decoder::operator=(Decoder&&) noexcept = default;
+
+    QOIPP_INLINE void Decoder::push(ByteSpan data) noexcept(false)
+    {
+        auto& state = *m_state;
+
+        const auto error = state.push(data);
+        if (error == Error::BadMagic) {
+            throw std::invalid_argument{ "Invalid header" };
+        } else if (error == Error::BadEndMarker) {
+            throw std::invalid_argument{ "Invalid end marker" };
+        } else if (error != Error::None) {
+            // the rejected header is still pending
+            impl::validateDesc(*qoipp::readHeader(state.m_pending));
+            throw std::invalid_argument{ "Invalid header" };
+        }
+    }
+
+    QOIPP_INLINE Error Decoder::tryPush(ByteSpan data) noexcept(false)
+    {
+        return m_state->push(data);
+    }
+
+    QOIPP_INLINE std::optional<ImageDesc> Decoder::desc() const noexcept
+    {
+        return m_state->m_desc;
+    }
+
+    QOIPP_INLINE bool Decoder::done() const noexcept
+    {
+        const auto& state = *m_state;
+        return state.m_desc.has_value() && state.m_remaining == 0
+            && state.m_endRead == constants::endMarker.size();
+    }
+
+    struct SequenceEncoder::State
+    {
+        EncodeOptions            m_options;
+        std::optional<ImageDesc> m_desc     = std::nullopt;    // of the previous frame
+        ByteVec                  m_previous = {};
+        ByteVec                  m_residual = {};
+        ByteVec                  m_encoded  = {};
+        usize                    m_keySize  = 0;    // size of the last key frame
+
+        ByteSpan encodeKey(ByteSpan data, ImageDesc desc) noexcept
+        {
+            m_encoded.resize(maxEncodedSize(desc));
+            m_keySize = impl::encodeInto(data, m_encoded, desc, m_options.m_effort);
+            return ByteSpan{ m_encoded }.first(m_keySize);
+        }
+
+        // std::nullopt if the delta frame would be larger than the last key frame
+        std::optional<ByteSpan> encodeDelta(ByteSpan data, ImageDesc desc) noexcept
+        {
+            const auto& magic = constants::deltaFrameMagic;
+
+            m_residual.resize(data.size());
+            impl::frameResidual(data, m_previous, m_residual, desc.m_channels);
+
+            m_encoded.resize(maxEncodedSize(desc) + magic.size());
+            auto size = impl::encodeInto(m_residual, m_encoded, desc, m_options.m_effort);
+            if (size + magic.size() > m_keySize) {
+                return std::nullopt;
+            }
+
+            for (char c : magic) {
+                m_encoded[size++] = static_cast<Byte>(c);
+            }
+            return ByteSpan{ m_encoded }.first(size);
+        }
+
+        // `data` must be checked against `desc`
+        ByteSpan encode(ByteSpan data, ImageDesc desc, bool key) noexcept(false)
+        {
+            auto encoded = std::optional<ByteSpan>{};
+            if (!key && m_desc == desc) {
+                encoded = encodeDelta(data, desc);
+            }
+            if (!encoded.has_value()) {
+                encoded = encodeKey(data, desc);
+            }
+
+            m_desc = desc;
+            m_previous.assign(data.begin(), data.end());
+
+            return *encoded;
+        }
+    };
+
+    QOIPP_INLINE SequenceEncoder::SequenceEncoder(EncodeOptions options)
+        : m_state{ std::make_unique<State>(State{ .m_options = options }) }
+    {
+    }
+
+    QOIPP_INLINE SequenceEncoder::~SequenceEncoder() = default;
+
+    QOIPP_INLINE SequenceEncoder::SequenceEncoder(SequenceEncoder&&) noexcept            = default;
+    QOIPP_INLINE SequenceEncoder& SequenceEncoder::operator=(SequenceEncoder&&) noexcept = default;
+
+    QOIPP_INLINE ByteSpan SequenceEncoder::encode(ByteSpan data, ImageDesc desc, bool key) noexcept(false)
+    {
+        impl::validateEncode(data, desc);
+        return m_state->encode(data, desc, key);
+    }
+
+    QOIPP_INLINE Result<ByteSpan> SequenceEncoder::tryEncode(
+        ByteSpan  data,
+        ImageDesc desc,
+        bool      key
+    ) noexcept(false)
+    {
+        if (const auto error = impl::checkEncode(data, desc); error != Error::None) {
+            return { .m_error = error };
+        }
+        return { .m_value = m_state->encode(data, desc, key) };
+    }
+
+    QOIPP_INLINE void SequenceEncoder::reset() noexcept
+    {
+        m_state->m_desc = std::nullopt;
+    }
+
+    struct SequenceDecoder::State
+    {
+        std::optional<Channels> m_target;
+        Image                   m_frame    = {};
+        ByteVec                 m_residual = {};
+        bool                    m_valid    = false;    // whether `m_frame` holds the previous frame
+
+        // decode a frame checked with `prepareDecode`, a delta frame must follow a valid frame of `dest`
+        Error decode(ByteSpan data, ImageDesc src, ImageDesc dest, bool delta) noexcept(false)
+        {
+            const auto size = impl::decodedSize(dest.m_width, dest.m_height, dest.m_channels);
+
+            // a frame that fails to decode leaves nothing to apply the next delta frame to
+            m_valid = false;
+
+            auto& out = delta ? m_residual : m_frame.m_data;
+            out.resize(size);
+            if (const auto error = impl::tryDecodeInto<true>(data, out, src, dest); error != Error::None) {
+                return error;
+            }
+
+            if (delta) {
+                impl::applyResidual(m_frame.m_data, m_residual, dest.m_channels);
+            } else {
+                m_frame.m_desc = dest;
+            }
+
+            m_valid = true;
+            return Error::None;
+        }
+    };
+
+    QOIPP_INLINE SequenceDecoder::SequenceDecoder(bool rgbOnly)
+        : SequenceDecoder{ impl::decodeTarget(rgbOnly) }
+    {
+    }
+
+    QOIPP_INLINE SequenceDecoder::SequenceDecoder(Channels target) noexcept(false)
+        : SequenceDecoder{ std::optional{ target } }
+    {
+    }
+
+    QOIPP_INLINE SequenceDecoder::SequenceDecoder(std::optional<Channels> target) noexcept(false)
+    {
+        impl::validateTarget(target);
+        m_state = std::make_unique<State>(State{ .m_target = target });
+    }
+
+    QOIPP_INLINE SequenceDecoder::~SequenceDecoder() = default;
+
+    QOIPP_INLINE SequenceDecoder::SequenceDecoder(SequenceDecoder&&) noexcept            = default;
+    QOIPP_INLINE SequenceDecoder& SequenceDecoder::operator=(SequenceDecoder&&) noexcept = default;
+
+    QOIPP_INLINE const Image& SequenceDecoder::decode(ByteSpan data) noexcept(false)
+    {
+        auto& state = *m_state;
+
+        const auto delta       = impl::isDeltaFrame(data);
+        const auto [src, dest] = impl::prepareDecode<true>(data, state.m_target);
+
+        if (delta && !state.m_valid) {
+            throw std::invalid_argument{ "Delta frame without a previous frame" };
+        } else if (delta && state.m_frame.m_desc != dest) {
+            throw std::invalid_argument{ "Delta frame does not match the description of the previous frame" };
+        }
+
+        if (state.decode(data, src, dest, delta) != Error::None) {
+            throw std::invalid_argument{ "Data is truncated: the op stream ends before the last pixel" };
+        }
+        return state.m_frame;
+    }
+
+    QOIPP_INLINE Result<ImageView> SequenceDecoder::tryDecode(ByteSpan data) noexcept(false)
+    {
+        auto& state = *m_state;
+
+        const auto prepared = impl::tryPrepareDecode(data, state.m_target);
+        if (!prepared) {
+            return { .m_error = prepared.m_error };
+        }
+
+        const auto [src, dest] = prepared.m_value;
+        const auto delta       = impl::isDeltaFrame(data);
+
+        if (delta && (!state.m_valid || state.m_frame.m_desc != dest)) {
+            return { .m_error = Error::BadFrame };
+        } else if (const auto error = state.decode(data, src, dest, delta); error != Error::None) {
+            return { .m_error = error };
+        }
+
+        return { .m_value = { .m_data = state.m_frame.m_data, .m_desc = dest } };
+    }
+
+    QOIPP_INLINE bool SequenceDecoder::isDeltaFrame(ByteSpan data) noexcept
+    {
+        return impl::isDeltaFrame(data);
+    }
+
+    struct Codec::State
+    {
+        using Buffer = std::vector<Byte, UninitAllocator<>>;
+
+        EncodeOptions            m_options;
+        std::optional<ImageDesc> m_desc    = std::nullopt;    // of the last image encoded or decoded
+        Buffer                   m_encoded = {};
+        Buffer                   m_decoded = {};
+
+        // the first `size` bytes of `buffer`, grown without copying the old contents if it's too small
+        static std::span<Byte> fit(Buffer& buffer, usize size) noexcept(false)
+        {
+            if (buffer.size() < size) {
+                buffer.clear();
+                buffer.resize(size);
+            }
+            return std::span{ buffer }.first(size);
+        }
+
+        // the description of the last image is known to be valid, leaving only the size of the data
+        bool isChecked(ByteSpan data, ImageDesc desc) const noexcept
+        {
+            return m_desc == desc && data.size() == decodedSize(desc);
+        }
+
+        ByteSpan encode(ByteSpan data, ImageDesc desc) noexcept(false)
+        {
+            const auto out  = fit(m_encoded, maxEncodedSize(desc));
+            const auto size = impl::encodeInto(data, out, desc, m_options.m_effort);
+
+            m_desc = desc;
+            return out.first(size);
+        }
+
+        // `view` must be checked with `checkView`
+        ByteSpan encode(const ImageView& view) noexcept(false)
+        {
+            const auto out  = fit(m_encoded, maxEncodedSize(view.m_desc));
+            const auto size = impl::encodeView(view, out, m_options.m_effort);
+
+            m_desc = view.m_desc;
+            return out.first(size);
+        }
+
+        ImageView decode(ByteSpan data, std::optional<Channels> target) noexcept(false)
+        {
+            const auto [src, dest] = impl::prepareDecode<true>(data, target);
+
+            const auto out = fit(m_decoded, decodedSize(dest));
+            impl::decodeInto<true>(data, out, src, dest);
+
+            m_desc = dest;
+            return { .m_data = out, .m_desc = dest };
+        }
+
+        Result<ImageView> tryDecode(ByteSpan data, std::optional<Channels> target) noexcept(false)
+        {
+            const auto prepared = impl::tryPrepareDecode(data, target);
+            if (!prepared) {
+                return { .m_error = prepared.m_error };
+            }
+
+            const auto [src, dest] = prepared.m_value;
+
+            const auto out = fit(m_decoded, decodedSize(dest));
+            if (const auto error = impl::tryDecodeInto<true>(data, out, src, dest); error != Error::None) {
+                return { .m_error = error };
+            }
+
+            m_desc = dest;
+            return { .m_value = { .m_data = out, .m_desc = dest } };
+        }
+    };
+
+    QOIPP_INLINE Codec::Codec(EncodeOptions options)
+        : m_state{ std::make_unique<State>(State{ .m_options = options }) }
+    {
+    }
+
+    QOIPP_INLINE Codec::~Codec() = default;
+
+    QOIPP_INLINE Codec::Codec(Codec&&) noexcept            = default;
+    QOIPP_INLINE Codec& Codec::operator=(Codec&&) noexcept = default;
+
+    QOIPP_INLINE void Codec::reserve(ImageDesc desc) noexcept(false)
+    {
+        impl::validateDesc(desc);
+
+        // a 3-channel image may be decoded into 4 channels
+        auto rgba       = desc;
+        rgba.m_channels = Channels::RGBA;
+
+        State::fit(m_state->m_encoded, maxEncodedSize(desc));
+        State::fit(m_state->m_decoded, decodedSize(rgba));
+    }
+
+    QOIPP_INLINE ByteSpan Codec::encode(ByteSpan data, ImageDesc desc) noexcept(false)
+    {
+        if (!m_state->isChecked(data, desc)) {
+            impl::validateEncode(data, desc);
+        }
+        return m_state->encode(data, desc);
+    }
+
+    QOIPP_INLINE ByteSpan Codec::encode(const ImageView& view) noexcept(false)
+    {
+        impl::validateView(view);
+        return m_state->encode(view);
+    }
+
+    QOIPP_INLINE ImageView Codec::decode(ByteSpan data, bool rgbOnly) noexcept(false)
+    {
+        return m_state->decode(data, impl::decodeTarget(rgbOnly));
+    }
+
+    QOIPP_INLINE ImageView Codec::decode(ByteSpan data, Channels target) noexcept(false)
+    {
+        return m_state->decode(data, target);
+    }
+
+    QOIPP_INLINE Result<ByteSpan> Codec::tryEncode(ByteSpan data, ImageDesc desc) noexcept(false)
+    {
+        if (!m_state->isChecked(data, desc)) {
+            if (const auto error = impl::checkEncode(data, desc); error != Error::None) {
+                return { .m_error = error };
+            }
+        }
+        return { .m_value = m_state->encode(data, desc) };
+    }
+
+    QOIPP_INLINE Result<ByteSpan> Codec::tryEncode(const ImageView& view) noexcept(false)
+    {
+        if (const auto error = impl::checkView(view); error != Error::None) {
+            return { .m_error = error };
+        }
+        return { .m_value = m_state->encode(view) };
+    }
+
+    QOIPP_INLINE Result<ImageView> Codec::tryDecode(ByteSpan data, bool rgbOnly) noexcept(false)
+    {
+        return m_state->tryDecode(data, impl::decodeTarget(rgbOnly));
+    }
+
+    QOIPP_INLINE Result<ImageView> Codec::tryDecode(ByteSpan data, Channels target) noexcept(false)
+    {
+        return m_state->tryDecode(data, target);
+    }
+
+    QOIPP_INLINE std::optional<ImageDesc> Codec::desc() const noexcept
+    {
+        return m_state->m_desc;
     }
 }
@@ -9,6 +9,8 @@ class Recipe(ConanFile):
         "boost-ext-ut/1.1.9",
         "range-v3/0.12.0",
         "stb/cci.20230920",
+        "benchmark/1.8.3",
+        "perlinnoise/3.0.0",
     ]
 
     def layout(self):
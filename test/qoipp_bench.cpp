@@ -0,0 +1,720 @@
+// the internals live in the library's translation unit, it is compiled into this benchmark directly so each
+// kernel can be measured in isolation (this target doesn't link the qoipp library)
+#include <qoipp.cpp>
+
+#include <PerlinNoise.hpp>
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using qoipp::i8;
+using qoipp::u32;
+using qoipp::u8;
+using qoipp::usize;
+
+using qoipp::Byte;
+using qoipp::ByteSpan;
+using qoipp::ByteVec;
+using qoipp::Channels;
+using qoipp::Pixel;
+
+namespace impl = qoipp::impl;
+
+// ------------------
+// synthetic inputs
+// ------------------
+
+// every generated stream is dominated by one op type so a regression can be attributed to it
+enum class Stream
+{
+    rgb,      // unrelated pixels, alpha constant
+    rgba,     // unrelated pixels, alpha changes
+    index,    // a handful of pixels that keep hitting the running array
+    diff,     // small steps from the previous pixel
+    luma,     // medium steps, the same in every channel
+    run,      // one pixel repeated
+};
+
+// small deterministic generator so results don't depend on the standard library's distributions
+struct Lcg
+{
+    u32 m_state = 0x1234'5678;
+
+    u8 operator()() noexcept
+    {
+        m_state = m_state * 1'664'525u + 1'013'904'223u;
+        return static_cast<u8>(m_state >> 24);
+    }
+};
+
+std::vector<Pixel> makePixels(Stream stream, usize count)
+{
+    std::vector<Pixel> pixels(count);
+
+    Lcg   random;
+    Pixel pixel = { 10, 20, 30, 255 };
+
+    // index: pixels whose hashes land on distinct slots, cycling so consecutive pixels never repeat
+    std::vector<Pixel> palette;
+    for (u8 i = 0; palette.size() < 16; ++i) {
+        auto candidate = Pixel{ i, static_cast<u8>(i * 7), static_cast<u8>(i * 13), 255 };
+        auto slot      = impl::hash(candidate) % qoipp::constants::runningArraySize;
+        auto taken     = std::ranges::any_of(palette, [&](const Pixel& p) {
+            return impl::hash(p) % qoipp::constants::runningArraySize == slot;
+        });
+        if (!taken) {
+            palette.push_back(candidate);
+        }
+    }
+
+    for (usize i = 0; i < count; ++i) {
+        switch (stream) {
+        case Stream::rgb: pixel = { random(), random(), random(), 255 }; break;
+        case Stream::rgba: pixel = { random(), random(), random(), random() }; break;
+        case Stream::index: pixel = palette[i % palette.size()]; break;
+        case Stream::diff:
+            pixel.m_r = static_cast<u8>(pixel.m_r + 1);
+            pixel.m_g = static_cast<u8>(pixel.m_g - 1);
+            pixel.m_b = static_cast<u8>(pixel.m_b + 1);
+            break;
+        case Stream::luma:
+            pixel.m_r = static_cast<u8>(pixel.m_r + 10);
+            pixel.m_g = static_cast<u8>(pixel.m_g + 10);
+            pixel.m_b = static_cast<u8>(pixel.m_b + 10);
+            break;
+        case Stream::run: break;
+        }
+        pixels[i] = pixel;
+    }
+
+    return pixels;
+}
+
+ByteVec toBytes(const std::vector<Pixel>& pixels, Channels channels)
+{
+    const auto chan = static_cast<usize>(channels);
+
+    ByteVec bytes(pixels.size() * chan);
+    for (usize i = 0; i < pixels.size(); ++i) {
+        std::memcpy(bytes.data() + i * chan, &pixels[i], chan);
+    }
+    return bytes;
+}
+
+ByteVec makePerlin(usize size, Channels channels)
+{
+    const auto chan = static_cast<usize>(channels);
+
+    std::vector<siv::PerlinNoise> noise;
+    for (usize c = 0; c < chan; ++c) {
+        noise.emplace_back(static_cast<siv::PerlinNoise::seed_type>(c + 1));
+    }
+
+    ByteVec bytes(size * size * chan);
+    for (usize y = 0; y < size; ++y) {
+        for (usize x = 0; x < size; ++x) {
+            for (usize c = 0; c < chan; ++c) {
+                const auto fx    = static_cast<double>(x) * 4.0 / static_cast<double>(size);
+                const auto fy    = static_cast<double>(y) * 4.0 / static_cast<double>(size);
+                const auto value = noise[c].octave2D_01(fx, fy, 3) * 0xFF;
+
+                bytes[(y * size + x) * chan + c] = static_cast<Byte>(static_cast<u8>(value));
+            }
+        }
+    }
+    return bytes;
+}
+
+constexpr usize g_pixelCount = 1 << 16;
+
+void setThroughput(benchmark::State& state, usize pixels, usize bytes)
+{
+    const auto iterations = static_cast<std::int64_t>(state.iterations());
+
+    state.SetItemsProcessed(iterations * static_cast<std::int64_t>(pixels));
+    state.SetBytesProcessed(iterations * static_cast<std::int64_t>(bytes));
+}
+
+// ---------
+// kernels
+// ---------
+
+void BM_hash(benchmark::State& state)
+{
+    const auto pixels = makePixels(Stream::rgba, g_pixelCount);
+
+    for (auto _ : state) {
+        usize sum = 0;
+        for (const auto& pixel : pixels) {
+            sum += impl::hash(pixel) % qoipp::constants::runningArraySize;
+        }
+        benchmark::DoNotOptimize(sum);
+    }
+
+    setThroughput(state, pixels.size(), pixels.size() * sizeof(Pixel));
+}
+BENCHMARK(BM_hash);
+
+// the Diff/Luma classification the encoder does for every pixel with unchanged alpha
+void BM_classify(benchmark::State& state)
+{
+    const auto stream = static_cast<Stream>(state.range(0));
+    const auto pixels = makePixels(stream, g_pixelCount);
+
+    for (auto _ : state) {
+        usize diffs = 0;
+        usize lumas = 0;
+        for (usize i = 1; i < pixels.size(); ++i) {
+            const auto& prev = pixels[i - 1];
+            const auto& curr = pixels[i];
+
+            const auto dr = static_cast<i8>(curr.m_r - prev.m_r);
+            const auto dg = static_cast<i8>(curr.m_g - prev.m_g);
+            const auto db = static_cast<i8>(curr.m_b - prev.m_b);
+
+            if (qoipp::data::op::shouldDiff(dr, dg, db)) {
+                ++diffs;
+            } else if (qoipp::data::op::shouldLuma(dg, static_cast<i8>(dr - dg), static_cast<i8>(db - dg))) {
+                ++lumas;
+            }
+        }
+        benchmark::DoNotOptimize(diffs);
+        benchmark::DoNotOptimize(lumas);
+    }
+
+    setThroughput(state, pixels.size(), pixels.size() * sizeof(Pixel));
+}
+BENCHMARK(BM_classify)
+    ->ArgName("stream")
+    ->Arg(static_cast<int>(Stream::rgb))
+    ->Arg(static_cast<int>(Stream::diff))
+    ->Arg(static_cast<int>(Stream::luma));
+
+template <Channels Chan>
+void BM_runLength(benchmark::State& state)
+{
+    const auto length = static_cast<usize>(state.range(0));
+    const auto bytes  = toBytes(makePixels(Stream::run, length), Chan);
+    const auto pixel  = Pixel{ 10, 20, 30, 255 };
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(impl::runLength<Chan>(bytes.data(), length, pixel));
+    }
+
+    setThroughput(state, length, bytes.size());
+}
+BENCHMARK(BM_runLength<Channels::RGB>)->RangeMultiplier(8)->Range(8, 1 << 12);
+BENCHMARK(BM_runLength<Channels::RGBA>)->RangeMultiplier(8)->Range(8, 1 << 12);
+
+template <Channels Chan>
+void BM_PixelReader(benchmark::State& state)
+{
+    const auto bytes = toBytes(makePixels(Stream::rgba, g_pixelCount), Chan);
+
+    impl::PixelReader<Chan> read{ bytes };
+
+    for (auto _ : state) {
+        Pixel pixel;
+        u32   sum = 0;
+        for (usize i = 0; i < g_pixelCount; ++i) {
+            read(pixel, i);
+            sum += pixel.m_r ^ pixel.m_a;
+        }
+        benchmark::DoNotOptimize(sum);
+    }
+
+    setThroughput(state, g_pixelCount, bytes.size());
+}
+BENCHMARK(BM_PixelReader<Channels::RGB>);
+BENCHMARK(BM_PixelReader<Channels::RGBA>);
+
+template <Channels Chan, bool Opaque>
+void BM_PixelWriter(benchmark::State& state)
+{
+    const auto pixels = makePixels(Stream::rgba, g_pixelCount);
+
+    ByteVec                          out(g_pixelCount * static_cast<usize>(Chan));
+    impl::PixelWriter<Chan, Opaque> write{ out };
+
+    for (auto _ : state) {
+        for (usize i = 0; i < pixels.size(); ++i) {
+            write(i, pixels[i]);
+        }
+        benchmark::ClobberMemory();
+    }
+
+    setThroughput(state, g_pixelCount, out.size());
+}
+BENCHMARK(BM_PixelWriter<Channels::RGB, false>);
+BENCHMARK(BM_PixelWriter<Channels::RGBA, false>);
+BENCHMARK(BM_PixelWriter<Channels::RGBA, true>);
+
+// run fills in the decoder, the argument is the run length
+template <Channels Chan>
+void BM_PixelWriterFill(benchmark::State& state)
+{
+    const auto length = static_cast<usize>(state.range(0));
+    const auto count  = g_pixelCount / length;
+
+    ByteVec                  out(g_pixelCount * static_cast<usize>(Chan));
+    impl::PixelWriter<Chan> write{ out };
+
+    for (auto _ : state) {
+        for (usize i = 0; i < count; ++i) {
+            write.fill(i * length, length, Pixel{ static_cast<u8>(i), 20, 30, 255 });
+        }
+        benchmark::ClobberMemory();
+    }
+
+    setThroughput(state, count * length, out.size());
+}
+BENCHMARK(BM_PixelWriterFill<Channels::RGB>)->RangeMultiplier(4)->Range(2, 62);
+BENCHMARK(BM_PixelWriterFill<Channels::RGBA>)->RangeMultiplier(4)->Range(2, 62);
+
+// -------------------
+// single op streams
+// -------------------
+
+template <Channels Chan>
+void BM_encodeStream(benchmark::State& state)
+{
+    const auto stream = static_cast<Stream>(state.range(0));
+    const auto bytes  = toBytes(makePixels(stream, g_pixelCount), Chan);
+
+    ByteVec out(impl::maxEncodedSize(g_pixelCount, 1, Chan));
+
+    usize size = 0;
+    for (auto _ : state) {
+        size = impl::encode<Chan>(bytes, out, g_pixelCount, 1, true);
+        benchmark::DoNotOptimize(size);
+    }
+
+    state.counters["bytes/px"] = static_cast<double>(size) / g_pixelCount;
+    setThroughput(state, g_pixelCount, bytes.size());
+}
+
+template <Channels Chan>
+void BM_decodeStream(benchmark::State& state)
+{
+    const auto stream  = static_cast<Stream>(state.range(0));
+    const auto bytes   = toBytes(makePixels(stream, g_pixelCount), Chan);
+    const auto encoded = qoipp::encode(bytes, { g_pixelCount, 1, Chan, qoipp::Colorspace::sRGB });
+
+    ByteVec out(bytes.size());
+
+    for (auto _ : state) {
+        usize index = qoipp::constants::headerSize;
+        auto  end   = encoded.size() - qoipp::constants::endMarker.size();
+        benchmark::DoNotOptimize(impl::decode<Chan>(encoded, index, end, out, g_pixelCount));
+        benchmark::ClobberMemory();
+    }
+
+    state.counters["bytes/px"] = static_cast<double>(encoded.size()) / g_pixelCount;
+    setThroughput(state, g_pixelCount, bytes.size());
+}
+
+void streamArgs(benchmark::internal::Benchmark* bench)
+{
+    bench->ArgName("stream");
+    for (auto stream = 0; stream <= static_cast<int>(Stream::run); ++stream) {
+        bench->Arg(stream);
+    }
+}
+
+BENCHMARK(BM_encodeStream<Channels::RGB>)->Apply(streamArgs);
+BENCHMARK(BM_encodeStream<Channels::RGBA>)->Apply(streamArgs);
+BENCHMARK(BM_decodeStream<Channels::RGB>)->Apply(streamArgs);
+BENCHMARK(BM_decodeStream<Channels::RGBA>)->Apply(streamArgs);
+
+// --------------------------------------------------
+// whole images from the qoigen perlin noise scheme
+// --------------------------------------------------
+
+template <Channels Chan>
+void BM_encodePerlin(benchmark::State& state)
+{
+    const auto size  = static_cast<usize>(state.range(0));
+    const auto bytes = makePerlin(size, Chan);
+    const auto side  = static_cast<u32>(size);
+    const auto desc  = qoipp::ImageDesc{ side, side, Chan, qoipp::Colorspace::sRGB };
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(qoipp::encode(bytes, desc));
+    }
+
+    setThroughput(state, size * size, bytes.size());
+}
+
+template <Channels Chan>
+void BM_decodePerlin(benchmark::State& state)
+{
+    const auto size    = static_cast<usize>(state.range(0));
+    const auto bytes   = makePerlin(size, Chan);
+    const auto side    = static_cast<u32>(size);
+    const auto desc    = qoipp::ImageDesc{ side, side, Chan, qoipp::Colorspace::sRGB };
+    const auto encoded = qoipp::encode(bytes, desc);
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(qoipp::decode(encoded));
+    }
+
+    setThroughput(state, size * size, bytes.size());
+}
+
+BENCHMARK(BM_encodePerlin<Channels::RGB>)->Arg(64)->Arg(512)->Arg(2048);
+BENCHMARK(BM_encodePerlin<Channels::RGBA>)->Arg(64)->Arg(512)->Arg(2048);
+BENCHMARK(BM_decodePerlin<Channels::RGB>)->Arg(64)->Arg(512)->Arg(2048);
+BENCHMARK(BM_decodePerlin<Channels::RGBA>)->Arg(64)->Arg(512)->Arg(2048);
+
+// the encoded size is reported as a counter, the levels trade it for speed
+template <Channels Chan>
+void BM_encodeEffort(benchmark::State& state)
+{
+    const auto size    = static_cast<usize>(state.range(0));
+    const auto bytes   = makePerlin(size, Chan);
+    const auto side    = static_cast<u32>(size);
+    const auto desc    = qoipp::ImageDesc{ side, side, Chan, qoipp::Colorspace::sRGB };
+    const auto options = qoipp::EncodeOptions{ .m_effort = static_cast<qoipp::Effort>(state.range(1)) };
+
+    usize encodedSize = 0;
+    for (auto _ : state) {
+        auto encoded = qoipp::encode(bytes, desc, options);
+        encodedSize  = encoded.size();
+        benchmark::DoNotOptimize(encoded);
+    }
+
+    setThroughput(state, size * size, bytes.size());
+    state.counters["encoded"] = static_cast<double>(encodedSize);
+}
+
+BENCHMARK(BM_encodeEffort<Channels::RGB>)->ArgsProduct({ { 512, 2048 }, { 0, 1, 2 } });
+BENCHMARK(BM_encodeEffort<Channels::RGBA>)->ArgsProduct({ { 512, 2048 }, { 0, 1, 2 } });
+
+// a quarter of the image in the middle, args are the image size and the downscale factor
+template <Channels Chan>
+void BM_decodeRegion(benchmark::State& state)
+{
+    const auto size    = static_cast<usize>(state.range(0));
+    const auto scale   = static_cast<u32>(state.range(1));
+    const auto bytes   = makePerlin(size, Chan);
+    const auto side    = static_cast<u32>(size);
+    const auto desc    = qoipp::ImageDesc{ side, side, Chan, qoipp::Colorspace::sRGB };
+    const auto encoded = qoipp::encode(bytes, desc);
+    const auto region  = qoipp::Region{ side / 4, side / 4, side / 2, side / 2 };
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(qoipp::decodeRegion(encoded, region, scale));
+    }
+
+    setThroughput(state, size * size / 4, bytes.size() / 4);
+}
+
+BENCHMARK(BM_decodeRegion<Channels::RGB>)->ArgsProduct({ { 512, 2048 }, { 1, 4 } });
+BENCHMARK(BM_decodeRegion<Channels::RGBA>)->ArgsProduct({ { 512, 2048 }, { 1, 4 } });
+
+// 64 rows near the bottom of the image, with the second arg as the index interval or without an index for 0
+template <Channels Chan>
+void BM_decodeRows(benchmark::State& state)
+{
+    const auto size     = static_cast<usize>(state.range(0));
+    const auto interval = static_cast<u32>(state.range(1));
+    const auto bytes    = makePerlin(size, Chan);
+    const auto side     = static_cast<u32>(size);
+    const auto desc     = qoipp::ImageDesc{ side, side, Chan, qoipp::Colorspace::sRGB };
+    const auto encoded  = qoipp::encode(bytes, desc);
+    const auto index    = interval > 0 ? qoipp::indexRows(encoded, interval) : ByteVec{};
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(qoipp::decodeRows(encoded, index, side - 100, 64));
+    }
+
+    setThroughput(state, size * 64, bytes.size() / size * 64);
+}
+
+BENCHMARK(BM_decodeRows<Channels::RGB>)->ArgsProduct({ { 512, 2048 }, { 0, 16, 64 } });
+BENCHMARK(BM_decodeRows<Channels::RGBA>)->ArgsProduct({ { 512, 2048 }, { 0, 16, 64 } });
+
+// 4 byte pixels of the format given by the second arg, converted as they are encoded and decoded
+template <Channels Chan>
+void BM_encodeFormat(benchmark::State& state)
+{
+    const auto size   = static_cast<usize>(state.range(0));
+    const auto format = static_cast<qoipp::PixelFormat>(state.range(1));
+    const auto bytes  = makePerlin(size, Channels::RGBA);
+    const auto side   = static_cast<u32>(size);
+    const auto desc   = qoipp::ImageDesc{ side, side, Chan, qoipp::Colorspace::sRGB };
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(qoipp::encode(bytes, desc, format));
+    }
+
+    setThroughput(state, size * size, bytes.size());
+}
+
+template <Channels Chan>
+void BM_decodeFormat(benchmark::State& state)
+{
+    const auto size    = static_cast<usize>(state.range(0));
+    const auto format  = static_cast<qoipp::PixelFormat>(state.range(1));
+    const auto bytes   = makePerlin(size, Chan);
+    const auto side    = static_cast<u32>(size);
+    const auto desc    = qoipp::ImageDesc{ side, side, Chan, qoipp::Colorspace::sRGB };
+    const auto encoded = qoipp::encode(bytes, desc);
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(qoipp::decode(encoded, format));
+    }
+
+    setThroughput(state, size * size, size * size * 4);
+}
+
+// a readback with rows padded to a 256 byte pitch, the second arg picks compacting the rows first (0) or
+// encoding them in place through a view (1)
+template <Channels Chan>
+void BM_encodeView(benchmark::State& state)
+{
+    const auto size    = static_cast<usize>(state.range(0));
+    const auto inPlace = state.range(1) != 0;
+    const auto bytes   = makePerlin(size, Chan);
+    const auto side    = static_cast<u32>(size);
+    const auto desc    = qoipp::ImageDesc{ side, side, Chan, qoipp::Colorspace::sRGB };
+    const auto rowSize = size * static_cast<usize>(Chan);
+    const auto stride  = (rowSize + 255) / 256 * 256 + 256;
+
+    auto pitched = ByteVec(stride * size);
+    for (usize row = 0; row < size; ++row) {
+        std::memcpy(pitched.data() + row * stride, bytes.data() + row * rowSize, rowSize);
+    }
+
+    const auto view = qoipp::ImageView{ .m_data = pitched, .m_desc = desc, .m_stride = stride };
+
+    for (auto _ : state) {
+        if (inPlace) {
+            benchmark::DoNotOptimize(qoipp::encode(view));
+        } else {
+            auto packed = ByteVec(bytes.size());
+            for (usize row = 0; row < size; ++row) {
+                std::memcpy(packed.data() + row * rowSize, pitched.data() + row * stride, rowSize);
+            }
+            benchmark::DoNotOptimize(qoipp::encode(packed, desc));
+        }
+    }
+
+    setThroughput(state, size * size, bytes.size());
+}
+
+BENCHMARK(BM_encodeView<Channels::RGB>)->ArgsProduct({ { 512, 2048 }, { 0, 1 } });
+BENCHMARK(BM_encodeView<Channels::RGBA>)->ArgsProduct({ { 512, 2048 }, { 0, 1 } });
+
+// rejecting malformed uploads: bad magic, a short header, too many pixels for the stream and a stream cut
+// short, the arg picks the throwing decode (0) or the error code one into a buffer (1)
+void BM_decodeMalformed(benchmark::State& state)
+{
+    const auto useTry  = state.range(0) != 0;
+    const auto bytes   = makePerlin(64, Channels::RGBA);
+    const auto desc    = qoipp::ImageDesc{ 64, 64, Channels::RGBA, qoipp::Colorspace::sRGB };
+    const auto encoded = qoipp::encode(bytes, desc);
+
+    auto badMagic = encoded;
+    auto overflow = encoded;
+    badMagic[0]   = std::byte{ 'x' };
+    overflow[4]   = std::byte{ 0x7F };
+
+    const auto inputs = std::array{
+        ByteSpan{ badMagic },
+        ByteSpan{ encoded }.first(10),
+        ByteSpan{ overflow },
+        ByteSpan{ encoded }.first(encoded.size() - 8),
+    };
+
+    auto out = ByteVec(bytes.size());
+    for (auto _ : state) {
+        for (auto input : inputs) {
+            if (useTry) {
+                benchmark::DoNotOptimize(qoipp::tryDecode(input, out));
+            } else {
+                try {
+                    benchmark::DoNotOptimize(qoipp::decode(input, out));
+                } catch (const std::invalid_argument& e) {
+                    benchmark::DoNotOptimize(e.what());
+                }
+            }
+        }
+    }
+
+    state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations() * inputs.size()));
+}
+
+BENCHMARK(BM_decodeMalformed)->Arg(0)->Arg(1);
+
+// a worker encoding and decoding frames of the same size, the second arg picks the free functions (0) or a
+// reused `Codec` (1)
+template <Channels Chan>
+void BM_codec(benchmark::State& state)
+{
+    const auto size  = static_cast<usize>(state.range(0));
+    const auto reuse = state.range(1) != 0;
+    const auto bytes = makePerlin(size, Chan);
+    const auto side  = static_cast<u32>(size);
+    const auto desc  = qoipp::ImageDesc{ side, side, Chan, qoipp::Colorspace::sRGB };
+    const auto frame = qoipp::encode(bytes, desc);
+    auto       codec = qoipp::Codec{};
+
+    for (auto _ : state) {
+        if (reuse) {
+            benchmark::DoNotOptimize(codec.encode(bytes, desc));
+            benchmark::DoNotOptimize(codec.decode(frame));
+        } else {
+            benchmark::DoNotOptimize(qoipp::encode(bytes, desc));
+            benchmark::DoNotOptimize(qoipp::decode(frame));
+        }
+    }
+
+    setThroughput(state, size * size * 2, bytes.size() * 2);
+}
+
+BENCHMARK(BM_codec<Channels::RGB>)->ArgsProduct({ { 64, 512, 2048 }, { 0, 1 } });
+BENCHMARK(BM_codec<Channels::RGBA>)->ArgsProduct({ { 64, 512, 2048 }, { 0, 1 } });
+
+// RGBA, BGRA and RGBAPremultiplied
+BENCHMARK(BM_encodeFormat<Channels::RGB>)->ArgsProduct({ { 2048 }, { 0, 1, 6 } });
+BENCHMARK(BM_encodeFormat<Channels::RGBA>)->ArgsProduct({ { 2048 }, { 0, 1, 6 } });
+BENCHMARK(BM_decodeFormat<Channels::RGB>)->ArgsProduct({ { 2048 }, { 0, 1, 6 } });
+BENCHMARK(BM_decodeFormat<Channels::RGBA>)->ArgsProduct({ { 2048 }, { 0, 1, 6 } });
+
+// the second arg is the number of threads, on fewer cores this shows the cost of the speculative decode
+template <Channels Chan>
+void BM_decodeParallel(benchmark::State& state)
+{
+    const auto size    = static_cast<usize>(state.range(0));
+    const auto bytes   = makePerlin(size, Chan);
+    const auto side    = static_cast<u32>(size);
+    const auto desc    = qoipp::ImageDesc{ side, side, Chan, qoipp::Colorspace::sRGB };
+    const auto encoded = qoipp::encode(bytes, desc);
+
+    auto pool = qoipp::ThreadPool{ static_cast<usize>(state.range(1)) };
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(qoipp::decodeParallel(encoded, pool));
+    }
+
+    setThroughput(state, size * size, bytes.size());
+}
+
+BENCHMARK(BM_decodeParallel<Channels::RGB>)->ArgsProduct({ { 2048, 4096 }, { 1, 4 } })->UseRealTime();
+BENCHMARK(BM_decodeParallel<Channels::RGBA>)->ArgsProduct({ { 2048, 4096 }, { 1, 4 } })->UseRealTime();
+
+// frames of a screen recording where a 64x64 block moves around, the second arg picks independent frames
+// (0) or a `SequenceEncoder` (1), the average encoded size of a frame is reported as a counter
+template <Channels Chan>
+void BM_encodeSequence(benchmark::State& state)
+{
+    constexpr usize frameCount = 8;
+    constexpr usize blockSize  = 64;
+
+    const auto size     = static_cast<usize>(state.range(0));
+    const auto sequence = state.range(1) != 0;
+    const auto chan     = static_cast<usize>(Chan);
+    const auto side     = static_cast<u32>(size);
+    const auto desc     = qoipp::ImageDesc{ side, side, Chan, qoipp::Colorspace::sRGB };
+
+    auto frames = std::vector<ByteVec>(frameCount, makePerlin(size, Chan));
+    for (usize f = 0; f < frameCount; ++f) {
+        const auto offset = f * (size - blockSize) / frameCount;
+        for (usize y = offset; y < offset + blockSize; ++y) {
+            for (usize x = offset * chan; x < (offset + blockSize) * chan; ++x) {
+                frames[f][y * size * chan + x] = Byte{ 0xFF };
+            }
+        }
+    }
+
+    auto  encoder     = qoipp::SequenceEncoder{};
+    usize encodedSize = 0;
+    for (auto _ : state) {
+        encodedSize = 0;
+        for (const auto& frame : frames) {
+            encodedSize += sequence ? encoder.encode(frame, desc).size() : qoipp::encode(frame, desc).size();
+        }
+        encoder.reset();
+    }
+
+    setThroughput(state, size * size * frameCount, frames[0].size() * frameCount);
+    state.counters["encoded"] = static_cast<double>(encodedSize / frameCount);
+}
+
+BENCHMARK(BM_encodeSequence<Channels::RGB>)->ArgsProduct({ { 512, 2048 }, { 0, 1 } });
+BENCHMARK(BM_encodeSequence<Channels::RGBA>)->ArgsProduct({ { 512, 2048 }, { 0, 1 } });
+
+// --------------------------------------------------
+// one image through each of the kernels
+// --------------------------------------------------
+
+// runs `fn` with `kernel` active, the benchmark is skipped if the cpu doesn't support it
+template <typename Fn>
+void withKernel(benchmark::State& state, Fn&& fn)
+{
+    const auto kernel = static_cast<qoipp::Kernel>(state.range(0));
+    if (!qoipp::isKernelSupported(kernel)) {
+        state.SkipWithError("kernel not supported on this cpu");
+        return;
+    }
+
+    const auto previous = qoipp::activeKernel();
+    qoipp::setKernel(kernel);
+    state.SetLabel(std::string{ qoipp::kernelName(kernel) });
+
+    fn();
+
+    qoipp::setKernel(previous);
+}
+
+template <Channels Chan>
+void BM_encodeKernel(benchmark::State& state)
+{
+    const auto bytes = makePerlin(512, Chan);
+    const auto desc  = qoipp::ImageDesc{ 512, 512, Chan, qoipp::Colorspace::sRGB };
+
+    withKernel(state, [&] {
+        for (auto _ : state) {
+            benchmark::DoNotOptimize(qoipp::encode(bytes, desc));
+        }
+        setThroughput(state, 512 * 512, bytes.size());
+    });
+}
+
+template <Channels Chan>
+void BM_decodeKernel(benchmark::State& state)
+{
+    const auto bytes   = makePerlin(512, Chan);
+    const auto desc    = qoipp::ImageDesc{ 512, 512, Chan, qoipp::Colorspace::sRGB };
+    const auto encoded = qoipp::encode(bytes, desc);
+
+    withKernel(state, [&] {
+        for (auto _ : state) {
+            benchmark::DoNotOptimize(qoipp::decode(encoded));
+        }
+        setThroughput(state, 512 * 512, bytes.size());
+    });
+}
+
+void kernelArgs(benchmark::internal::Benchmark* bench)
+{
+    bench->ArgName("kernel");
+    for (auto kernel = 0; kernel <= static_cast<int>(qoipp::Kernel::AVX512); ++kernel) {
+        bench->Arg(kernel);
+    }
+}
+
+BENCHMARK(BM_encodeKernel<Channels::RGB>)->Apply(kernelArgs);
+BENCHMARK(BM_encodeKernel<Channels::RGBA>)->Apply(kernelArgs);
+BENCHMARK(BM_decodeKernel<Channels::RGB>)->Apply(kernelArgs);
+BENCHMARK(BM_decodeKernel<Channels::RGBA>)->Apply(kernelArgs);
+
+BENCHMARK_MAIN();
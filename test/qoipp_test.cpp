@@ -13,6 +13,8 @@
 #include <fmt/color.h>
 #include <range/v3/view.hpp>
 
+#include <algorithm>
+#include <array>
 #include <cstddef>
 #include <cstdint>
 #include <cstring>
@@ -20,7 +22,13 @@
 #include <fstream>
 #include <filesystem>
 #include <initializer_list>
+#include <limits>
+#include <map>
+#include <memory_resource>
+#include <random>
 #include <string>
+#include <utility>
+#include <vector>
 
 namespace rv = ranges::views;
 
@@ -90,6 +98,23 @@ ByteVec rgbOnly(ByteSpan data)
     return result;
 }
 
+ByteVec withAlpha(ByteSpan data)
+{
+    if (data.size() % 3) {
+        throw std::invalid_argument("data size must be a multiple of 3");
+    }
+
+    ByteVec result;
+    result.reserve(data.size() / 3 * 4);
+
+    for (const auto& chunk : rv::chunk(data, 3)) {
+        result.insert(result.end(), chunk.begin(), chunk.end());
+        result.push_back(Byte{ 0xFF });
+    }
+
+    return result;
+}
+
 Image loadImageRaw(const fs::path& file)
 {
     int   width, height, channels;
@@ -169,6 +194,104 @@ Image qoiDecode(const Image& image)
     return result;
 }
 
+// reference for decodeRegion: crop the raw pixels then average every scale x scale block
+ByteVec cropScaled(ByteSpan data, qoipp::ImageDesc desc, qoipp::Region region, u32 scale)
+{
+    const auto channels = static_cast<usize>(desc.m_channels);
+    const auto width    = (region.m_width + scale - 1) / scale;
+    const auto height   = (region.m_height + scale - 1) / scale;
+
+    ByteVec result;
+    result.reserve(width * height * channels);
+
+    for (auto y : rv::iota(0u, height)) {
+        for (auto x : rv::iota(0u, width)) {
+            const auto x0 = region.m_x + x * scale;
+            const auto y0 = region.m_y + y * scale;
+            const auto x1 = std::min(x0 + scale, region.m_x + region.m_width);
+            const auto y1 = std::min(y0 + scale, region.m_y + region.m_height);
+            const auto n  = static_cast<u64>((x1 - x0) * (y1 - y0));
+
+            for (auto c : rv::iota(0u, channels)) {
+                u64 sum = 0;
+                for (auto yy : rv::iota(y0, y1)) {
+                    for (auto xx : rv::iota(x0, x1)) {
+                        sum += static_cast<u8>(data[(yy * desc.m_width + xx) * channels + c]);
+                    }
+                }
+                result.push_back(static_cast<Byte>((sum + n / 2) / n));
+            }
+        }
+    }
+
+    return result;
+}
+
+// 4 byte pixels with the channels in the given order, `order` is the channel (3 for alpha) of each byte
+ByteVec swizzle(ByteSpan data, qoipp::ImageDesc desc, std::array<usize, 4> order, bool premultiplied = false)
+{
+    const auto channels = static_cast<usize>(desc.m_channels);
+
+    ByteVec result;
+    result.reserve(data.size() / channels * 4);
+
+    for (const auto& pixel : rv::chunk(data, static_cast<isize>(channels))) {
+        auto rgba = std::array<u32, 4>{ 0, 0, 0, 0xFF };
+        for (auto c : rv::iota(0u, channels)) {
+            rgba[c] = std::to_integer<u32>(pixel[static_cast<isize>(c)]);
+        }
+        if (premultiplied) {
+            for (auto c : rv::iota(0u, 3u)) {
+                rgba[c] = (rgba[c] * rgba[3] + 127) / 255;
+            }
+        }
+        for (auto channel : order) {
+            result.push_back(static_cast<Byte>(rgba[channel]));
+        }
+    }
+
+    return result;
+}
+
+// repeat an image `across` times horizontally and `down` times vertically
+Image tile(ByteSpan data, qoipp::ImageDesc desc, u32 across, u32 down)
+{
+    const auto rowSize = data.size() / desc.m_height;
+
+    Image result{
+        .m_data = {},
+        .m_desc = { desc.m_width * across, desc.m_height * down, desc.m_channels, desc.m_colorspace },
+    };
+    result.m_data.reserve(data.size() * across * down);
+
+    for ([[maybe_unused]] auto y : rv::iota(0u, down)) {
+        for (const auto& row : rv::chunk(data, static_cast<isize>(rowSize))) {
+            for ([[maybe_unused]] auto x : rv::iota(0u, across)) {
+                result.m_data.insert(result.m_data.end(), row.begin(), row.end());
+            }
+        }
+    }
+
+    return result;
+}
+
+// flip the bits of every channel of the pixels in the region, like a part of the screen that changed
+ByteVec changeRegion(ByteSpan data, qoipp::ImageDesc desc, qoipp::Region region)
+{
+    const auto channels = static_cast<usize>(desc.m_channels);
+
+    auto result = ByteVec{ data.begin(), data.end() };
+    for (auto y : rv::iota(region.m_y, region.m_y + region.m_height)) {
+        for (auto x : rv::iota(region.m_x, region.m_x + region.m_width)) {
+            for (auto c : rv::iota(0u, channels)) {
+                result[(static_cast<usize>(y) * desc.m_width + x) * channels + c] ^= Byte{ 0x5A };
+            }
+        }
+    }
+
+    return result;
+}
+
 // too bad ut doesn't have something like this that can show diff between two spans
 std::string compare(ByteSpan lhs, ByteSpan rhs)
 {
@@ -242,14 +365,921 @@ ut::suite threeChannelImage = [] {
             << compare(rawImage, decoded);
     };
 
+    "3-channel image decode into 4 channels"_test = [&] {
+        auto rgbaImage = withAlpha(rawImage);
+        auto rgbaDesc  = qoipp::ImageDesc{
+            desc.m_width, desc.m_height, qoipp::Channels::RGBA, desc.m_colorspace
+        };
+
+        const auto [decoded, actualdesc] = qoipp::decode(qoiImage, qoipp::Channels::RGBA);
+        ut::expect(actualdesc == rgbaDesc);
+        ut::expect(ut::that % decoded.size() == rgbaImage.size());
+        ut::expect(std::memcmp(decoded.data(), rgbaImage.data(), rgbaImage.size()) == 0_i)
+            << compare(rgbaImage, decoded);
+
+        ByteVec buffer(rgbaImage.size());
+        ut::expect(ut::nothrow([&] { qoipp::decode(qoiImage, buffer, qoipp::Channels::RGBA); }));
+        ut::expect(std::memcmp(buffer.data(), rgbaImage.data(), rgbaImage.size()) == 0_i)
+            << compare(rgbaImage, buffer);
+
+        ByteVec rows;
+        auto    sink = [&](usize, ByteSpan row) { rows.insert(rows.end(), row.begin(), row.end()); };
+
+        qoipp::Decoder decoder{ sink, qoipp::Channels::RGBA };
+        ut::expect(ut::nothrow([&] { decoder.push(qoiImage); }));
+        ut::expect(decoder.desc() == rgbaDesc);
+        ut::expect(std::memcmp(rows.data(), rgbaImage.data(), rgbaImage.size()) == 0_i)
+            << compare(rgbaImage, rows);
+
+        ut::expect(ut::throws([&] { qoipp::decode(qoiImage, static_cast<qoipp::Channels>(2)); }))
+            << "Invalid target channels should throw";
+    };
+
+    "3-channel image decode truncated and unchecked"_test = [&] {
+        const auto [decoded, actualdesc] = qoipp::decodeUnchecked(qoiImage);
+        ut::expect(actualdesc == desc);
+        ut::expect(ut::that % decoded.size() == rawImage.size());
+        ut::expect(std::memcmp(decoded.data(), rawImage.data(), rawImage.size()) == 0_i)
+            << compare(rawImage, decoded);
+
+        const auto truncated = ByteSpan{ qoiImage }.first(qoiImage.size() / 2);
+        ut::expect(ut::throws([&] { qoipp::decode(truncated); })) << "Truncated data should throw";
+
+        const auto noEndMarker = ByteSpan{ qoiImage }.first(qoiImage.size() - 8);
+        ut::expect(ut::throws([&] { qoipp::decode(noEndMarker); })) << "Missing end marker should throw";
+
+        auto overlong = qoiImage;
+        overlong.insert(overlong.end(), 32, Byte{ 0xFF });
+        ut::expect(ut::nothrow([&] { qoipp::decode(overlong); })) << "Trailing data should be ignored";
+    };
+
+    "3-channel image error codes"_test = [&] {
+        using qoipp::Error;
+
+        const auto encoded = qoipp::tryEncode(rawImage, desc);
+        ut::expect(encoded.m_error == Error::None);
+        ut::expect(encoded.m_value == qoiImage) << compare(qoiImage, encoded.m_value);
+
+        ByteVec    out(qoipp::maxEncodedSize(desc));
+        const auto written = qoipp::tryEncode(rawImage, desc, out);
+        ut::expect(static_cast<bool>(written));
+        ut::expect(ut::that % written.m_value == qoiImage.size());
+        const auto small = qoipp::tryEncode(rawImage, desc, std::span{ out }.first(16));
+        ut::expect(small.m_error == Error::SizeMismatch);
+
+        auto noWidth = desc;
+        auto badChan = desc;
+        noWidth.m_width    = 0;
+        badChan.m_channels = static_cast<qoipp::Channels>(5);
+        ut::expect(qoipp::tryEncode(rawImage, noWidth).m_error == Error::BadDimensions);
+        ut::expect(qoipp::tryEncode(rawImage, badChan).m_error == Error::BadChannels);
+        ut::expect(qoipp::tryEncode(ByteSpan{ rawImage }.first(7), desc).m_error == Error::SizeMismatch);
+
+        const auto decoded = qoipp::tryDecode(qoiImage);
+        ut::expect(decoded.m_error == Error::None);
+        ut::expect(decoded.m_value.m_desc == desc);
+        ut::expect(decoded.m_value.m_data == rawImage) << compare(rawImage, decoded.m_value.m_data);
+
+        const auto expanded = qoipp::tryDecode(qoiImage, qoipp::Channels::RGBA);
+        ut::expect(expanded.m_value.m_data == withAlpha(rawImage));
+
+        ByteVec buffer(rawImage.size());
+        ut::expect(qoipp::tryDecode(qoiImage, buffer).m_value == desc);
+        ut::expect(buffer == rawImage) << compare(rawImage, buffer);
+        ut::expect(qoipp::tryDecode(qoiImage, std::span{ buffer }.first(7)).m_error == Error::SizeMismatch);
+
+        auto badMagic = qoiImage;
+        auto overflow = qoiImage;
+        auto badHead  = qoiImage;
+        badMagic[0]   = Byte{ 'x' };
+        overflow[4]   = Byte{ 0x7F };    // a width of 2^31 and change
+        badHead[12]   = Byte{ 5 };
+
+        const auto truncated   = ByteSpan{ qoiImage }.first(qoiImage.size() / 2);
+        const auto noEndMarker = ByteSpan{ qoiImage }.first(qoiImage.size() - 8);
+
+        ut::expect(qoipp::tryDecode(badMagic).m_error == Error::BadMagic);
+        ut::expect(qoipp::tryDecode(overflow).m_error == Error::PixelOverflow);
+        ut::expect(qoipp::tryDecode(badHead).m_error == Error::BadChannels);
+        ut::expect(qoipp::tryDecode(ByteSpan{ qoiImage }.first(10)).m_error == Error::Truncated);
+        ut::expect(qoipp::tryDecode(truncated).m_error == Error::Truncated);
+        ut::expect(qoipp::tryDecode(noEndMarker, buffer).m_error == Error::Truncated);
+        ut::expect(qoipp::tryDecode(qoiImage, static_cast<qoipp::Channels>(2)).m_error == Error::BadChannels);
+
+        ut::expect(qoipp::errorName(Error::Truncated) == "truncated");
+
+        // the other entry points reading untrusted data
+        const auto area   = qoipp::Region{ 1, 1, 4, 3 };
+        const auto region = qoipp::tryDecodeRegion(qoiImage, area, 2);
+        ut::expect(static_cast<bool>(region));
+        ut::expect(region.m_value.m_data == qoipp::decodeRegion(qoiImage, area, 2).m_data);
+        ut::expect(qoipp::tryDecodeRegion(qoiImage, { desc.m_width, 0 }).m_error == Error::BadRegion);
+        ut::expect(qoipp::tryDecodeRegion(qoiImage, area, 0).m_error == Error::BadRegion);
+        ut::expect(qoipp::tryDecodeRegion(truncated, {}).m_error == Error::Truncated);
+        ut::expect(qoipp::tryDecodeRegion(badMagic, area).m_error == Error::BadMagic);
+
+        const auto index = qoipp::indexRows(qoiImage, 4);
+        const auto rows  = qoipp::tryDecodeRows(qoiImage, index, 5, 3);
+        ut::expect(rows.m_value.m_data == qoipp::decodeRows(qoiImage, index, 5, 3).m_data);
+        const auto shortIndex = ByteSpan{ index }.first(7);
+        ut::expect(qoipp::tryDecodeRows(qoiImage, shortIndex, 5, 3).m_error == Error::BadTable);
+        ut::expect(qoipp::tryDecodeRows(overflow, index, 5, 3).m_error == Error::PixelOverflow);
+
+        const auto striped = qoipp::encodeStriped(rawImage, desc, 4);
+        auto       shifted = striped;
+        shifted.end()[-13] = Byte(std::to_integer<u8>(shifted.end()[-13]) + 1);
+        ut::expect(qoipp::tryDecodeStriped(striped).m_value.m_data == rawImage);
+        ut::expect(qoipp::tryDecodeStriped(shifted).m_error == Error::BadTable);
+        const auto halfStriped = ByteSpan{ striped }.first(striped.size() / 2);
+        ut::expect(qoipp::tryDecodeStriped(halfStriped).m_error == Error::Truncated);
+
+        const auto jobs  = std::vector<ByteSpan>{ qoiImage, badMagic, truncated };
+        const auto batch = qoipp::tryDecodeBatch(jobs);
+        ut::expect(ut::that % batch.size() == jobs.size());
+        ut::expect(batch[0].m_value.m_data == rawImage) << "A rejected image should not fail the batch";
+        ut::expect(batch[1].m_error == Error::BadMagic);
+        ut::expect(batch[2].m_error == Error::Truncated);
+
+        ByteVec        streamed;
+        qoipp::Decoder decoder{ [&](usize, ByteSpan row) {
+            streamed.insert(streamed.end(), row.begin(), row.end());
+        } };
+        ut::expect(decoder.tryPush(ByteSpan{ qoiImage }.first(100)) == Error::None);
+        ut::expect(decoder.tryPush(ByteSpan{ qoiImage }.subspan(100)) == Error::None);
+        ut::expect(decoder.done());
+        ut::expect(streamed == rawImage) << compare(rawImage, streamed);
+
+        const auto ignore = [](usize, ByteSpan) {};
+        auto       badEnd = qoiImage;
+        badEnd.back()     = Byte{ 0x02 };
+
+        qoipp::Decoder rejected{ ignore };
+        ut::expect(rejected.tryPush(badMagic) == Error::BadMagic);
+        ut::expect(rejected.tryPush(qoiImage) == Error::BadMagic) << "A rejected header should stay rejected";
+        ut::expect(qoipp::Decoder{ ignore }.tryPush(badHead) == Error::BadChannels);
+        ut::expect(ut::throws([&] { qoipp::Decoder{ ignore }.push(badHead); }));
+        ut::expect(qoipp::Decoder{ ignore }.tryPush(badEnd) == Error::BadEndMarker);
+
+        const auto qoifile = mktemp();
+        ut::expect(qoipp::tryEncodeToFile(qoifile, rawImage, desc) == Error::None);
+        ut::expect(qoipp::tryEncodeToFile(qoifile, rawImage, desc) == Error::File) << "File exists";
+        const auto partial = ByteSpan{ rawImage }.first(7);
+        ut::expect(qoipp::tryEncodeToFile(qoifile, partial, desc, true) == Error::SizeMismatch);
+        ut::expect(qoipp::decodeFromFile(qoifile).m_data == rawImage);
+
+        ByteVec    arena(qoipp::decodedSize(desc));
+        const auto allocate = [&](usize size) { return std::span{ arena }.first(size); };
+        const auto fileDesc = qoipp::tryDecodeFromFile(qoifile, allocate);
+        ut::expect(fileDesc.m_value == desc);
+        ut::expect(arena == rawImage) << compare(rawImage, arena);
+        const auto fileImage = qoipp::tryDecodeFromFile(qoifile, qoipp::UninitAllocator<>{});
+        ut::expect(std::ranges::equal(fileImage.m_value.m_data, rawImage));
+        fs::remove(qoifile);
+        ut::expect(qoipp::tryDecodeFromFile(qoifile, allocate).m_error == Error::File);
+
+        // the allocator overloads
+        const auto tooSmall = [&](usize size) { return std::span{ arena }.first(size - 1); };
+        ut::expect(qoipp::tryDecode(qoiImage, allocate).m_value == desc);
+        ut::expect(qoipp::tryDecode(qoiImage, tooSmall).m_error == Error::SizeMismatch);
+        ut::expect(qoipp::tryDecode(badMagic, allocate).m_error == Error::BadMagic);
+        ut::expect(qoipp::tryEncode(rawImage, desc, tooSmall).m_error == Error::SizeMismatch);
+
+        const auto allocEncoded = qoipp::tryEncode(rawImage, desc, qoipp::UninitAllocator<>{});
+        ut::expect(std::ranges::equal(allocEncoded.m_value, qoiImage));
+        ut::expect(qoipp::tryEncode(rawImage, noWidth, qoipp::UninitAllocator<>{}).m_value.empty());
+        const auto allocDecoded = qoipp::tryDecode(truncated, qoipp::UninitAllocator<>{});
+        ut::expect(allocDecoded.m_error == Error::Truncated);
+        ut::expect(allocDecoded.m_value.m_data.empty()) << "A rejected image should leave no data";
+
+        // pixel formats and views
+        const auto badFormat = static_cast<qoipp::PixelFormat>(99);
+        const auto rgba      = qoipp::tryDecode(qoiImage, qoipp::PixelFormat::RGBA);
+        ut::expect(rgba.m_value.m_data == qoipp::decode(qoiImage, qoipp::PixelFormat::RGBA).m_data);
+        ut::expect(qoipp::tryDecode(qoiImage, badFormat).m_error == Error::BadFormat);
+        ut::expect(qoipp::tryDecode(truncated, qoipp::PixelFormat::BGRA).m_error == Error::Truncated);
+        const auto shortOut = std::span{ arena }.first(7);
+        const auto shortRgba = qoipp::tryDecode(qoiImage, shortOut, qoipp::PixelFormat::RGBA);
+        ut::expect(shortRgba.m_error == Error::SizeMismatch);
+
+        const auto pixel = qoipp::decode(qoiImage, qoipp::PixelFormat::BGRA).m_data;
+        ut::expect(qoipp::tryEncode(pixel, desc, qoipp::PixelFormat::BGRA).m_value == qoiImage);
+        ut::expect(qoipp::tryEncode(pixel, desc, badFormat).m_error == Error::BadFormat);
+        const auto pixelNoWidth = qoipp::tryEncode(pixel, noWidth, qoipp::PixelFormat::BGRA);
+        ut::expect(pixelNoWidth.m_error == Error::BadDimensions);
+
+        const auto view      = qoipp::ImageView{ .m_data = rawImage, .m_desc = desc };
+        auto       narrow    = view;
+        auto       formatted = view;
+        narrow.m_stride    = 1;
+        formatted.m_format = badFormat;
+        ut::expect(qoipp::tryEncode(view).m_value == qoiImage);
+        ut::expect(qoipp::tryEncode(narrow).m_error == Error::SizeMismatch);
+        ut::expect(qoipp::tryEncode(formatted).m_error == Error::BadFormat);
+        ut::expect(qoipp::tryEncode(view, out).m_value == qoiImage.size());
+        ut::expect(qoipp::tryEncode(view, std::span{ out }.first(16)).m_error == Error::SizeMismatch);
+
+        qoipp::Codec codec;
+        ut::expect(std::ranges::equal(codec.tryEncode(view).m_value, qoiImage));
+        ut::expect(codec.tryEncode(narrow).m_error == Error::SizeMismatch);
+
+        // the compile-time overloads
+        const auto fixed = qoipp::tryEncode<qoipp::Channels::RGB>(rawImage, desc.m_width, desc.m_height);
+        ut::expect(fixed.m_value == qoiImage);
+        ut::expect(qoipp::tryEncode<qoipp::Channels::RGB>(rawImage, 0, 1).m_error == Error::BadDimensions);
+        ut::expect(qoipp::tryDecode<qoipp::Channels::RGB>(qoiImage).m_value.m_data == rawImage);
+        ut::expect(qoipp::tryDecode<qoipp::Channels::RGBA>(qoiImage).m_error == Error::BadChannels);
+        ut::expect(qoipp::tryDecode<qoipp::Channels::RGB>(qoiImage, arena).m_value == desc);
+        ut::expect(qoipp::tryDecode<qoipp::Channels::RGB>(truncated, arena).m_error == Error::Truncated);
+
+        std::array<Byte, qoipp::decodedSize(desc)> decodedArr{};
+        constexpr auto swapped = qoipp::ImageDesc{
+            desc.m_height, desc.m_width, desc.m_channels, desc.m_colorspace
+        };
+        ut::expect(qoipp::tryDecode<desc>(qoiImage, decodedArr).m_value == desc);
+        ut::expect(qoipp::tryDecode<swapped>(qoiImage, decodedArr).m_error == Error::BadDimensions);
+
+        // the remaining encoders and decoders
+        const auto stripedTry = qoipp::tryEncodeStriped(rawImage, desc, 4);
+        ut::expect(stripedTry.m_value == striped);
+        ut::expect(qoipp::tryEncodeStriped(partial, desc).m_error == Error::SizeMismatch);
+
+        auto encodeJobs      = std::vector<qoipp::EncodeJob>(3, { rawImage, desc });
+        encodeJobs[1].m_data = partial;
+        const auto encodedBatch = qoipp::tryEncodeBatch(encodeJobs);
+        ut::expect(encodedBatch[0].m_value == qoiImage) << "A rejected job should not fail the batch";
+        ut::expect(encodedBatch[1].m_error == Error::SizeMismatch);
+        ut::expect(encodedBatch[2].m_value == qoiImage);
+
+        const auto tryIndex = qoipp::tryIndexRows(qoiImage, 4);
+        ut::expect(tryIndex.m_value == index);
+        ut::expect(qoipp::tryIndexRows(qoiImage, 0).m_error == Error::BadRegion);
+        ut::expect(qoipp::tryIndexRows(truncated).m_error == Error::Truncated);
+
+        auto pool = qoipp::ThreadPool{ 2 };
+        ut::expect(qoipp::tryDecodeParallel(qoiImage, pool).m_value.m_data == rawImage);
+        ut::expect(qoipp::tryDecodeParallel(truncated, pool).m_error == Error::Truncated);
+        ut::expect(qoipp::tryDecodeParallel(badMagic).m_error == Error::BadMagic);
+
+        qoipp::SequenceEncoder sequence;
+        const auto key   = qoipp::SequenceDecoder{}.tryDecode(sequence.tryEncode(rawImage, desc).m_value);
+        const auto frame = sequence.tryEncode(rawImage, desc).m_value;
+        const auto delta = ByteVec{ frame.begin(), frame.end() };
+        ut::expect(key.m_error == Error::None);
+        ut::expect(sequence.tryEncode(partial, desc).m_error == Error::SizeMismatch);
+        ut::expect(qoipp::SequenceDecoder{}.tryDecode(delta).m_error == Error::BadFrame);
+        ut::expect(qoipp::SequenceDecoder{}.tryDecode(truncated).m_error == Error::Truncated);
+
+        ut::expect(qoipp::errorName(Error::BadFormat) == "bad format");
+        ut::expect(qoipp::errorName(Error::BadFrame) == "bad frame");
+    };
+
+    "3-channel image codec context"_test = [&] {
+        qoipp::Codec codec;
+        ut::expect(!codec.desc().has_value());
+
+        const auto encoded = codec.encode(rawImage, desc);
+        ut::expect(std::ranges::equal(encoded, qoiImage)) << compare(qoiImage, encoded);
+        ut::expect(codec.desc() == desc);
+        ut::expect(codec.encode(rawImage, desc).data() == encoded.data()) << "Buffer should be reused";
+
+        const auto decoded = codec.decode(qoiImage);
+        ut::expect(decoded.m_desc == desc);
+        ut::expect(std::ranges::equal(decoded.m_data, rawImage)) << compare(rawImage, decoded.m_data);
+        ut::expect(codec.decode(qoiImage).m_data.data() == decoded.m_data.data())
+            << "Buffer should be reused";
+        ut::expect(std::ranges::equal(codec.encode(codec.decode(qoiImage)), qoiImage));
+
+        const auto expanded = codec.decode(qoiImage, qoipp::Channels::RGBA);
+        ut::expect(expanded.m_desc.m_channels == qoipp::Channels::RGBA);
+        ut::expect(std::ranges::equal(expanded.m_data, withAlpha(rawImage)));
+
+        ut::expect(ut::throws([&] { codec.encode(ByteSpan{ rawImage }.first(7), desc); }));
+        ut::expect(ut::throws([&] { codec.decode(ByteSpan{ qoiImage }.first(qoiImage.size() / 2)); }));
+        const auto mismatch = codec.tryEncode(ByteSpan{ rawImage }.first(7), desc);
+        ut::expect(mismatch.m_error == qoipp::Error::SizeMismatch);
+        ut::expect(codec.tryDecode(ByteSpan{ qoiImage }.first(10)).m_error == qoipp::Error::Truncated);
+
+        const auto tried = codec.tryDecode(qoiImage);
+        ut::expect(static_cast<bool>(tried));
+        ut::expect(std::ranges::equal(tried.m_value.m_data, rawImage));
+        ut::expect(std::ranges::equal(codec.tryEncode(rawImage, desc).m_value, qoiImage));
+
+        qoipp::Codec reserved;
+        reserved.reserve(desc);
+
+        const auto before = reserved.decode(qoiImage, qoipp::Channels::RGBA).m_data.data();
+        ut::expect(reserved.decode(qoiImage).m_data.data() == before) << "Reserve should fit 4 channels";
+
+        auto moved = std::move(reserved);
+        ut::expect(moved.decode(qoiImage).m_data.data() == before) << "Buffers should move with the context";
+        reserved = qoipp::Codec{};
+        ut::expect(!reserved.desc().has_value()) << "A moved-from context should be assignable";
+    };
+
+    "3-channel image encode and decode pixel formats"_test = [&] {
+        using Format = qoipp::PixelFormat;
+
+        const auto formats = std::array{
+            std::pair{ Format::RGBA, std::array<usize, 4>{ 0, 1, 2, 3 } },
+            std::pair{ Format::BGRA, std::array<usize, 4>{ 2, 1, 0, 3 } },
+            std::pair{ Format::ARGB, std::array<usize, 4>{ 3, 0, 1, 2 } },
+            std::pair{ Format::ABGR, std::array<usize, 4>{ 3, 2, 1, 0 } },
+        };
+
+        for (const auto& [format, order] : formats) {
+            const auto pixels = swizzle(rawImage, desc, order);
+
+            const auto encoded = qoipp::encode(pixels, desc, format);
+            ut::expect(ut::that % encoded.size() == qoiImage.size());
+            ut::expect(encoded == qoiImage) << compare(qoiImage, encoded);
+
+            const auto decoded = qoipp::decode(qoiImage, format);
+            ut::expect(decoded.m_desc.m_channels == qoipp::Channels::RGBA);
+            ut::expect(decoded.m_data == pixels) << compare(pixels, decoded.m_data);
+
+            ByteVec    buffer(pixels.size());
+            const auto bufferDesc = qoipp::decode(qoiImage, buffer, format);
+            ut::expect(bufferDesc == decoded.m_desc);
+            ut::expect(buffer == pixels);
+        }
+
+        // the padding byte is ignored, and the alpha of an RGB image is 255 so premultiplying is a no-op
+        auto padded = swizzle(rawImage, desc, { 2, 1, 0, 3 });
+        ut::expect(qoipp::decode(qoiImage, Format::BGRX).m_data == padded);
+        ut::expect(qoipp::decode(qoiImage, Format::BGRAPremultiplied).m_data == padded);
+        ut::expect(qoipp::encode(padded, desc, Format::BGRAPremultiplied) == qoiImage);
+
+        for (usize i = 3; i < padded.size(); i += 4) {
+            padded[i] = Byte{ 0x42 };
+        }
+        ut::expect(qoipp::encode(padded, desc, Format::BGRX) == qoiImage);
+
+        const auto packed = rgbOnly(swizzle(rawImage, desc, { 0, 1, 2, 3 }));
+        ut::expect(ut::throws([&] { qoipp::encode(packed, desc, Format::BGRA); }))
+            << "Data that is not 4 bytes per pixel should throw";
+        ut::expect(ut::throws([&] { qoipp::decode(qoiImage, static_cast<Format>(42)); }))
+            << "Invalid pixel format should throw";
+    };
+
+    "3-channel image region decode"_test = [&] {
+        const auto region = qoipp::Region{ .m_x = 3, .m_y = 2, .m_width = 10, .m_height = 7 };
+
+        for (auto scale : { 1u, 2u, 3u }) {
+            const auto expected = cropScaled(rawImage, desc, region, scale);
+            const auto [decoded, actualDesc] = qoipp::decodeRegion(qoiImage, region, scale);
+
+            ut::expect(ut::that % actualDesc.m_width == (region.m_width + scale - 1) / scale);
+            ut::expect(ut::that % actualDesc.m_height == (region.m_height + scale - 1) / scale);
+            ut::expect(actualDesc.m_channels == desc.m_channels);
+            ut::expect(ut::that % decoded.size() == expected.size());
+            ut::expect(std::memcmp(decoded.data(), expected.data(), expected.size()) == 0_i)
+                << compare(expected, decoded);
+        }
+
+        const auto full = qoipp::decodeRegion(qoiImage, {});
+        ut::expect(full.m_desc == desc) << "Empty region should decode the whole image";
+        ut::expect(std::memcmp(full.m_data.data(), rawImage.data(), rawImage.size()) == 0_i)
+            << compare(rawImage, full.m_data);
+
+        const auto rest = qoipp::decodeRegion(qoiImage, { .m_x = 20, .m_y = 10 });
+        ut::expect(ut::that % rest.m_desc.m_width == desc.m_width - 20);
+        ut::expect(ut::that % rest.m_desc.m_height == desc.m_height - 10);
+
+        const auto truncated = ByteSpan{ qoiImage }.first(qoiImage.size() / 2);
+        ut::expect(ut::nothrow([&] { qoipp::decodeRegion(truncated, { .m_height = 1 }); }))
+            << "Data after the region should not be read";
+        ut::expect(ut::throws([&] { qoipp::decodeRegion(truncated, { .m_y = desc.m_height - 1 }); }))
+            << "Truncated data before the end of the region should throw";
+
+        const auto converted = withAlpha(cropScaled(rawImage, desc, region, 1));
+        const auto target    = qoipp::decodeRegion(qoiImage, region, 1, qoipp::Channels::RGBA);
+        ut::expect(target.m_desc.m_channels == qoipp::Channels::RGBA);
+        ut::expect(std::memcmp(target.m_data.data(), converted.data(), converted.size()) == 0_i)
+            << compare(converted, target.m_data);
+
+        ut::expect(ut::throws([&] { qoipp::decodeRegion(qoiImage, { .m_x = desc.m_width }); }))
+            << "Region outside of the image should throw";
+        const auto overflowing = qoipp::Region{ .m_y = 1, .m_height = desc.m_height };
+        ut::expect(ut::throws([&] { qoipp::decodeRegion(qoiImage, overflowing); }))
+            << "Region overflowing the image should throw";
+        ut::expect(ut::throws([&] { qoipp::decodeRegion(qoiImage, region, 0); }))
+            << "Zero scale should throw";
+    };
+
+    "3-channel image row index"_test = [&] {
+        const auto rowSize = rawImage.size() / desc.m_height;
+        const auto rows    = [&](usize first, usize count) {
+            return ByteSpan{ rawImage }.subspan(first * rowSize, count * rowSize);
+        };
+
+        for (auto interval : { 1u, 4u, 64u }) {
+            const auto index = qoipp::indexRows(qoiImage, interval);
+
+            auto appended = qoiImage;
+            appended.insert(appended.end(), index.begin(), index.end());
+            ut::expect(qoipp::decode(appended).m_data == rawImage) << "Appended index should be ignored";
+
+            const auto last = desc.m_height - 1;
+            for (auto [first, count] : { std::pair{ 0u, 1u }, { 5u, 3u }, { 9u, last - 8 }, { last, 1u } }) {
+                const auto expected = rows(first, count);
+                const auto sidecar  = qoipp::decodeRows(qoiImage, index, first, count);
+                const auto trailing = qoipp::decodeRows(appended, {}, first, count);
+
+                ut::expect(ut::that % sidecar.m_desc.m_height == count);
+                ut::expect(ut::that % sidecar.m_data.size() == expected.size());
+                ut::expect(std::memcmp(sidecar.m_data.data(), expected.data(), expected.size()) == 0_i)
+                    << compare(expected, sidecar.m_data);
+                ut::expect(trailing.m_data == sidecar.m_data);
+            }
+        }
+
+        const auto index = qoipp::indexRows(qoiImage, 4);
+        const auto plain = qoipp::decodeRows(qoiImage, {}, 10, 0);
+        const auto rest  = rows(10, desc.m_height - 10);
+        ut::expect(ut::that % plain.m_desc.m_height == desc.m_height - 10) << "Count 0 should be the rest";
+        ut::expect(std::memcmp(plain.m_data.data(), rest.data(), rest.size()) == 0_i)
+            << "Image without an index should decode from the start";
+
+        const auto broken = ByteSpan{ index }.first(index.size() - 1);
+        ut::expect(ut::throws([&] { qoipp::decodeRows(qoiImage, broken, 5, 3); }))
+            << "Index that doesn't match should throw";
+        ut::expect(ut::throws([&] { qoipp::decodeRows(qoiImage, index, desc.m_height, 1); }))
+            << "Rows outside of the image should throw";
+        ut::expect(ut::throws([&] { qoipp::indexRows(qoiImage, 0); })) << "Zero interval should throw";
+        ut::expect(ut::throws([&] { qoipp::indexRows(ByteSpan{ qoiImage }.first(qoiImage.size() / 2)); }))
+            << "Truncated data should throw";
+    };
+
+    "3-channel image parallel decode"_test = [&] {
+        auto pool = qoipp::ThreadPool{ 4 };
+
+        const auto small = qoipp::decodeParallel(qoiImage, pool);
+        ut::expect(small.m_desc == desc);
+        ut::expect(small.m_data == rawImage) << "Small image should decode like decode";
+
+        // big enough for its ops to be split between the threads
+        const auto tiled   = tile(rawImage, desc, 40, 40);
+        const auto encoded = qoipp::encode(tiled.m_data, tiled.m_desc);
+        const auto decoded = qoipp::decodeParallel(encoded, pool);
+
+        ut::expect(decoded.m_desc == tiled.m_desc);
+        ut::expect(ut::that % decoded.m_data.size() == tiled.m_data.size());
+        ut::expect(decoded.m_data == tiled.m_data) << compare(tiled.m_data, decoded.m_data);
+
+        const auto truncated = ByteSpan{ encoded }.first(encoded.size() * 3 / 4);
+        ut::expect(ut::throws([&] { qoipp::decodeParallel(truncated, pool); }))
+            << "Truncated data should throw";
+    };
+
+    "3-channel image strided encode"_test = [&] {
+        const auto rowSize = desc.m_width * static_cast<usize>(desc.m_channels);
+        const auto stride  = rowSize + 13;
+
+        // rows with padding in between, like a buffer with a row pitch
+        auto padded = ByteVec(stride * desc.m_height, Byte{ 0xAB });
+        for (auto row : rv::iota(0u, desc.m_height)) {
+            std::memcpy(padded.data() + row * stride, rawImage.data() + row * rowSize, rowSize);
+        }
+
+        const auto view    = qoipp::ImageView{ .m_data = padded, .m_desc = desc, .m_stride = stride };
+        const auto encoded = qoipp::encode(view);
+        ut::expect(encoded == qoiImage) << compare(qoiImage, encoded);
+
+        ByteVec    buffer(qoipp::maxEncodedSize(desc));
+        const auto size = qoipp::encode(view, buffer);
+        ut::expect(ut::that % size == qoiImage.size());
+        ut::expect(std::memcmp(buffer.data(), qoiImage.data(), size) == 0_i);
+
+        // the view may end right after the last pixel
+        const auto tight     = ByteSpan{ padded }.first(stride * (desc.m_height - 1) + rowSize);
+        const auto tightView = qoipp::ImageView{ .m_data = tight, .m_desc = desc, .m_stride = stride };
+        ut::expect(qoipp::encode(tightView) == qoiImage);
+
+        ut::expect(qoipp::encode(qoipp::ImageView{ .m_data = rawImage, .m_desc = desc }) == qoiImage)
+            << "A stride of 0 should be packed rows";
+
+        // a crop of the image is a view with the stride of the image
+        const auto region   = qoipp::Region{ 3, 2, desc.m_width - 7, desc.m_height - 4 };
+        auto       cropDesc = desc;
+        cropDesc.m_width    = region.m_width;
+        cropDesc.m_height   = region.m_height;
+
+        const auto first   = region.m_y * rowSize + region.m_x * static_cast<usize>(desc.m_channels);
+        const auto cropped = qoipp::encode(qoipp::ImageView{
+            .m_data   = ByteSpan{ rawImage }.subspan(first),
+            .m_desc   = cropDesc,
+            .m_stride = rowSize,
+        });
+        ut::expect(cropped == qoipp::encode(cropScaled(rawImage, desc, region, 1), cropDesc));
+
+        // a pitched buffer of BGRA pixels
+        const auto bgra    = swizzle(rawImage, desc, { 2, 1, 0, 3 });
+        const auto bgraRow = desc.m_width * usize{ 4 };
+        auto       pitched = ByteVec(256 * desc.m_height);
+        for (auto row : rv::iota(0u, desc.m_height)) {
+            std::memcpy(pitched.data() + row * 256, bgra.data() + row * bgraRow, bgraRow);
+        }
+        const auto bgraView = qoipp::ImageView{
+            .m_data   = pitched,
+            .m_desc   = desc,
+            .m_stride = 256,
+            .m_format = qoipp::PixelFormat::BGRA,
+        };
+        ut::expect(qoipp::encode(bgraView) == qoiImage);
+
+        auto narrow     = view;
+        narrow.m_stride = rowSize - 1;
+        ut::expect(ut::throws([&] { qoipp::encode(narrow); })) << "Stride smaller than a row should throw";
+
+        // a stride that wraps the size of the view around to less than the data
+        auto huge     = view;
+        huge.m_stride = std::numeric_limits<usize>::max() / (desc.m_height - 1) + 1;
+        ut::expect(ut::throws([&] { qoipp::encode(huge); })) << "Stride overflowing the view should throw";
+
+        auto truncated   = tightView;
+        truncated.m_data = tight.first(tight.size() - 1);
+        ut::expect(ut::throws([&] { qoipp::encode(truncated); }))
+            << "Data too small for the view should throw";
+
+        ut::expect(ut::throws([&] { qoipp::encode(view, std::span{ buffer }.first(10)); }))
+            << "Output buffer too small should throw";
+    };
+
+    "3-channel image encode into buffer"_test = [&] {
+        ByteVec buffer(qoipp::maxEncodedSize(desc));
+        usize   written = 0;
+
+        ut::expect(ut::nothrow([&] { written = qoipp::encode(rawImage, desc, buffer); }));
+        ut::expect(ut::that % written == qoiImage.size());
+        ut::expect(std::memcmp(buffer.data(), qoiImage.data(), qoiImage.size()) == 0_i)
+            << compare(qoiImage, { buffer.data(), written });
+
+        ByteVec small(qoiImage.size() - 1);
+        ut::expect(ut::throws([&] { qoipp::encode(rawImage, desc, small); })) << "Small buffer should throw";
+    };
+
+    "3-channel image encode at every effort level"_test = [&] {
+        std::map<qoipp::Effort, ByteVec> encoded;
+        for (auto effort : { qoipp::Effort::Fast, qoipp::Effort::Default, qoipp::Effort::Best }) {
+            ut::expect(ut::nothrow([&] { encoded[effort] = qoipp::encode(rawImage, desc, { effort }); }));
+
+            const auto decoded = qoipp::decode(encoded[effort]);
+            ut::expect(decoded.m_desc == desc);
+            ut::expect(std::memcmp(decoded.m_data.data(), rawImage.data(), rawImage.size()) == 0_i)
+                << compare(rawImage, decoded.m_data);
+        }
+
+        ut::expect(encoded[qoipp::Effort::Default] == qoiImage) << "Default should match the reference";
+        ut::expect(encoded[qoipp::Effort::Best].size() <= encoded[qoipp::Effort::Default].size());
+        ut::expect(encoded[qoipp::Effort::Default].size() <= encoded[qoipp::Effort::Fast].size());
+
+        // an image starting with a run of the start pixel, which only `Best` indexes, then going back to it
+        const auto runDesc  = qoipp::ImageDesc{ 4, 1, desc.m_channels, desc.m_colorspace };
+        const auto channels = static_cast<usize>(desc.m_channels);
+        const auto pixels   = std::array<std::array<u8, 4>, 4>{ {
+            { 0, 0, 0, 255 },
+            { 0, 0, 0, 255 },
+            { 200, 100, 50, 255 },
+            { 0, 0, 0, 255 },
+        } };
+
+        ByteVec runImage;
+        for (const auto& pixel : pixels) {
+            for (auto channel : rv::iota(usize{ 0 }, channels)) {
+                runImage.push_back(Byte{ pixel[channel] });
+            }
+        }
+
+        const auto best        = qoipp::encode(runImage, runDesc, { qoipp::Effort::Best });
+        const auto defaultSize = qoipp::encode(runImage, runDesc, { qoipp::Effort::Default }).size();
+        ut::expect(ut::that % best.size() < defaultSize) << "Best should index the start pixel of a run";
+
+        const auto decoded = qoipp::decode(best);
+        ut::expect(decoded.m_desc == runDesc);
+        ut::expect(decoded.m_data == runImage) << compare(runImage, decoded.m_data);
+
+        // every other encoder taking options chooses the same ops
+        ByteVec    allocated;
+        const auto size = qoipp::encode(runImage, runDesc, [&](usize required) {
+            allocated.resize(required);
+            return std::span{ allocated };
+        }, { qoipp::Effort::Best });
+        allocated.resize(size);
+        ut::expect(allocated == best) << compare(best, allocated);
+
+        const auto vector = qoipp::encode(runImage, runDesc, std::allocator<Byte>{}, { qoipp::Effort::Best });
+        ut::expect(ByteVec(vector.begin(), vector.end()) == best) << "Allocator overload should use options";
+
+        const auto jobs  = std::array{ qoipp::EncodeJob{ runImage, runDesc } };
+        const auto batch = qoipp::encodeBatch(jobs, { qoipp::Effort::Best });
+        ut::expect(batch.at(0) == best) << compare(best, batch.at(0));
+
+        ByteVec        streamed;
+        qoipp::Encoder encoder{
+            runDesc,
+            [&](ByteSpan bytes) { streamed.insert(streamed.end(), bytes.begin(), bytes.end()); },
+            { qoipp::Effort::Best },
+        };
+        encoder.push(runImage);
+        encoder.finish();
+        ut::expect(streamed == best) << compare(best, streamed);
+
+        const auto striped = qoipp::encodeStriped(runImage, runDesc, 1, { qoipp::Effort::Best });
+        ut::expect(ut::that % striped.size() < qoipp::encodeStriped(runImage, runDesc, 1).size());
+        ut::expect(qoipp::decodeStriped(striped).m_data == runImage) << "Best stripes should decode";
+    };
+
+    "3-channel image decode into buffer"_test = [&] {
+        ByteVec          buffer(qoipp::decodedSize(desc));
+        qoipp::ImageDesc actualDesc;
+
+        ut::expect(ut::nothrow([&] { actualDesc = qoipp::decode(qoiImage, buffer); }));
+        ut::expect(actualDesc == desc);
+        ut::expect(std::memcmp(buffer.data(), rawImage.data(), rawImage.size()) == 0_i)
+            << compare(rawImage, buffer);
+
+        ByteVec small(rawImage.size() - 1);
+        ut::expect(ut::throws([&] { qoipp::decode(qoiImage, small); })) << "Small buffer should throw";
+    };
+
+    "3-channel image encode and decode with custom allocation"_test = [&] {
+        std::array<std::byte, 1 << 16> arena;
+
+        auto resource = std::pmr::monotonic_buffer_resource{
+            arena.data(), arena.size(), std::pmr::null_memory_resource()
+        };
+
+        const auto alloc   = std::pmr::polymorphic_allocator<std::byte>{ &resource };
+        const auto encoded = qoipp::encode(rawImage, desc, alloc);
+        ut::expect(std::ranges::equal(encoded, qoiImage)) << "pmr encode";
+        ut::expect(encoded.data() >= arena.data() && encoded.data() < arena.data() + arena.size());
+
+        const auto decoded = qoipp::decode(qoiImage, qoipp::UninitAllocator<>{});
+        ut::expect(decoded.m_desc == desc);
+        ut::expect(std::ranges::equal(decoded.m_data, rawImage)) << "uninit decode";
+
+        usize requested = 0;
+        auto  small     = [&](usize size) {
+            requested = size;
+            return std::span<std::byte>{ arena.data(), size - 1 };
+        };
+        ut::expect(ut::throws([&] { qoipp::decode(qoiImage, small); })) << "Small buffer should throw";
+        ut::expect(ut::that % requested == qoipp::decodedSize(desc));
+        ut::expect(ut::throws([&] { qoipp::encode(rawImage, desc, small); })) << "Small buffer should throw";
+        ut::expect(ut::that % requested == qoipp::maxEncodedSize(desc));
+    };
+
+    "3-channel image compile-time encode and decode"_test = [&] {
+        const auto encoded = qoipp::encode<qoipp::Channels::RGB>(rawImage, desc.m_width, desc.m_height);
+        ut::expect(encoded == qoiImage) << compare(qoiImage, encoded);
+
+        const auto [decoded, actualDesc] = qoipp::decode<qoipp::Channels::RGB>(qoiImage);
+        ut::expect(actualDesc == desc);
+        ut::expect(decoded == rawImage) << compare(rawImage, decoded);
+
+        const auto expanded = qoipp::decode<qoipp::Channels::RGB, qoipp::Channels::RGBA>(qoiImage);
+        ut::expect(expanded.m_data == qoipp::decode(qoiImage, qoipp::Channels::RGBA).m_data);
+
+        ut::expect(ut::throws([&] { qoipp::decode<qoipp::Channels::RGBA>(qoiImage); }))
+            << "Channel mismatch should throw";
+
+        using RawSpan = std::span<const Byte, qoipp::decodedSize(desc)>;
+
+        std::array<Byte, qoipp::maxEncodedSize(desc)> encodedArr{};
+        std::array<Byte, qoipp::decodedSize(desc)>    decodedArr{};
+
+        const auto written = qoipp::encode<desc>(RawSpan{ rawImage.data(), rawImage.size() }, encodedArr);
+        ut::expect(ut::that % written == qoiImage.size());
+        ut::expect(std::memcmp(encodedArr.data(), qoiImage.data(), qoiImage.size()) == 0_i);
+
+        ut::expect(qoipp::decode<desc>(qoiImage, decodedArr) == desc);
+        ut::expect(std::memcmp(decodedArr.data(), rawImage.data(), rawImage.size()) == 0_i);
+
+        constexpr auto swapped = qoipp::ImageDesc{
+            desc.m_height, desc.m_width, desc.m_channels, desc.m_colorspace
+        };
+        ut::expect(ut::throws([&] { qoipp::decode<swapped>(qoiImage, decodedArr); }))
+            << "Dimension mismatch should throw";
+    };
+
+    "3-channel image striped encode and decode"_test = [&] {
+        for (auto stripes : { 1u, 4u, 17u, 100u }) {
+            const auto encoded   = qoipp::encodeStriped(rawImage, desc, stripes);
+            const auto reference = qoiDecode({ .m_data = encoded, .m_desc = desc });
+            ut::expect(std::memcmp(reference.m_data.data(), rawImage.data(), rawImage.size()) == 0_i)
+                << "Striped image should decode as a single stream with the reference decoder";
+
+            const auto [decoded, actualDesc] = qoipp::decodeStriped(encoded);
+            ut::expect(actualDesc == desc);
+            ut::expect(ut::that % decoded.size() == rawImage.size());
+            ut::expect(std::memcmp(decoded.data(), rawImage.data(), rawImage.size()) == 0_i)
+                << compare(rawImage, decoded);
+
+            if (stripes > 1) {
+                // the last byte of the offset of the last stripe
+                auto shifted  = encoded;
+                auto lastByte = shifted.end() - 13;
+                *lastByte     = Byte(std::to_integer<u8>(*lastByte) + 1);
+                ut::expect(ut::throws([&] { qoipp::decodeStriped(shifted); }))
+                    << "Stripe offsets that don't match the stripes should throw";
+            }
+        }
+
+        // 10 rows in 4 stripes is 3, 3, 3 and 1 rows, the last stripe is shorter than the others
+        const auto shortDesc = qoipp::ImageDesc{ desc.m_width, 10, desc.m_channels, desc.m_colorspace };
+        const auto shortRaw  = ByteSpan{ rawImage }.first(qoipp::decodedSize(shortDesc));
+        const auto uneven    = qoipp::encodeStriped(shortRaw, shortDesc, 4);
+        const auto [unevenDecoded, unevenDesc] = qoipp::decodeStriped(uneven);
+        ut::expect(unevenDesc == shortDesc);
+        ut::expect(std::memcmp(unevenDecoded.data(), shortRaw.data(), shortRaw.size()) == 0_i)
+            << "A height that isn't a multiple of the stripe count should round trip";
+
+        const auto single = qoipp::encodeStriped(rawImage, desc, 1);
+        ut::expect(std::memcmp(single.data(), qoiImage.data(), qoiImage.size()) == 0_i)
+            << "A single stripe should be encoded like `encode`";
+
+        const auto [decoded, actualDesc] = qoipp::decodeStriped(qoiImage);
+        ut::expect(std::memcmp(decoded.data(), rawImage.data(), rawImage.size()) == 0_i)
+            << "Image without stripe table should be decoded as a single stream";
+    };
+
+    "3-channel image batch encode and decode"_test = [&] {
+        qoipp::ThreadPool pool{ 3 };
+        ut::expect(ut::that % pool.size() == usize{ 3 });
+
+        const auto jobs    = std::vector<qoipp::EncodeJob>(10, { rawImage, desc });
+        const auto encoded = qoipp::encodeBatch(jobs, pool);
+        ut::expect(ut::that % encoded.size() == jobs.size());
+        for (const auto& image : encoded) {
+            ut::expect(ut::that % image.size() == qoiImage.size());
+            ut::expect(std::memcmp(image.data(), qoiImage.data(), qoiImage.size()) == 0_i)
+                << compare(qoiImage, image);
+        }
+
+        const auto spans   = std::vector<ByteSpan>(10, qoiImage);
+        const auto decoded = qoipp::decodeBatch(spans, pool);
+        ut::expect(ut::that % decoded.size() == spans.size());
+        for (const auto& [image, actualDesc] : decoded) {
+            ut::expect(actualDesc == desc);
+            ut::expect(std::memcmp(image.data(), rawImage.data(), rawImage.size()) == 0_i)
+                << compare(rawImage, image);
+        }
+
+        auto badJobs      = jobs;
+        badJobs[7].m_data = ByteSpan{ rawImage }.first(10);
+        ut::expect(ut::throws([&] { qoipp::encodeBatch(badJobs, pool); })) << "Invalid job should throw";
+    };
+
+    "3-channel image incremental encode"_test = [&] {
+        ByteVec encoded;
+        auto    sink = [&](ByteSpan bytes) { encoded.insert(encoded.end(), bytes.begin(), bytes.end()); };
+
+        qoipp::Encoder encoder{ desc, sink };
+
+        const auto rowSize = desc.m_width * static_cast<usize>(desc.m_channels);
+        for (auto row : rv::iota(0u, desc.m_height)) {
+            const auto rowData = ByteSpan{ rawImage }.subspan(row * rowSize, rowSize);
+            ut::expect(ut::nothrow([&] { encoder.push(rowData); }));
+        }
+
+        ut::expect(ut::throws([&] { encoder.push(ByteSpan{ rawImage }.first(rowSize)); }))
+            << "Pushing more pixels than the image has should throw";
+
+        ut::expect(ut::nothrow([&] { encoder.finish(); }));
+        ut::expect(ut::throws([&] { encoder.finish(); })) << "Finishing twice should throw";
+
+        ut::expect(ut::that % encoded.size() == qoiImage.size());
+        ut::expect(std::memcmp(encoded.data(), qoiImage.data(), qoiImage.size()) == 0_i)
+            << compare(qoiImage, encoded);
+
+        // chunks of random sizes so that runs are left pending across pushes and the buffer grows between
+        const auto size = static_cast<usize>(desc.m_channels);
+        for (auto seed : rv::iota(0u, 8u)) {
+            auto random = std::mt19937{ seed };
+
+            ByteVec        chunked;
+            qoipp::Encoder chunkEncoder{ desc, [&](ByteSpan bytes) {
+                chunked.insert(chunked.end(), bytes.begin(), bytes.end());
+            } };
+
+            const auto pixels = ByteSpan{ rawImage };
+            for (usize pushed = 0; pushed < pixels.size();) {
+                const auto count = std::uniform_int_distribution<usize>{ 1, 3 * desc.m_width }(random);
+                const auto bytes = std::min(count * size, pixels.size() - pushed);
+                chunkEncoder.push(pixels.subspan(pushed, bytes));
+                pushed += bytes;
+            }
+            chunkEncoder.finish();
+
+            ut::expect(chunked == qoipp::encode(rawImage, desc)) << compare(qoiImage, chunked);
+        }
+
+        // a run left pending by a push followed by pixels that all need a full op
+        const auto tail = qoipp::ImageDesc{ 10, 1, desc.m_channels, desc.m_colorspace };
+        ByteVec    tailImage(qoipp::decodedSize(tail));
+        for (auto i : rv::iota(usize{ 0 }, tailImage.size())) {
+            tailImage[i] = i < 2 * size ? Byte{ 7 } : Byte(static_cast<u8>(i * 67 + 13));
+        }
+
+        ByteVec        tailEncoded;
+        qoipp::Encoder tailEncoder{ tail, [&](ByteSpan bytes) {
+            tailEncoded.insert(tailEncoded.end(), bytes.begin(), bytes.end());
+        } };
+        tailEncoder.push(ByteSpan{ tailImage }.first(2 * size));
+        tailEncoder.push(ByteSpan{ tailImage }.subspan(2 * size));
+        tailEncoder.finish();
+        ut::expect(tailEncoded == qoipp::encode(tailImage, tail));
+    };
+
+    "3-channel image incremental decode"_test = [&] {
+        ByteVec decoded;
+        usize   rows = 0;
+        auto    sink = [&](usize row, ByteSpan bytes) {
+            ut::expect(ut::that % row == rows++);
+            decoded.insert(decoded.end(), bytes.begin(), bytes.end());
+        };
+
+        qoipp::Decoder decoder{ sink };
+
+        // odd chunk size so that both the header and the ops are split across pushes
+        for (const auto& chunk : rv::chunk(qoiImage, 3)) {
+            ut::expect(!decoder.done());
+            ut::expect(ut::nothrow([&] { decoder.push(ByteVec{ chunk.begin(), chunk.end() }); }));
+        }
+
+        ut::expect(decoder.done());
+        ut::expect(decoder.desc() == desc);
+        ut::expect(ut::that % rows == desc.m_height);
+        ut::expect(ut::that % decoded.size() == rawImage.size());
+        ut::expect(std::memcmp(decoded.data(), rawImage.data(), rawImage.size()) == 0_i)
+            << compare(rawImage, decoded);
+
+        qoipp::Decoder invalid{ sink };
+        ut::expect(ut::throws([&] { invalid.push(rawImage); })) << "Invalid header should throw";
+    };
+
+    "3-channel image sequence encode and decode"_test = [&] {
+        const auto changed = changeRegion(rawImage, desc, { 5, 3, 7, 4 });
+        const auto toVec   = [](ByteSpan bytes) { return ByteVec{ bytes.begin(), bytes.end() }; };
+
+        auto encoder = qoipp::SequenceEncoder{};
+        auto decoder = qoipp::SequenceDecoder{};
+
+        const auto first  = toVec(encoder.encode(rawImage, desc));
+        const auto second = toVec(encoder.encode(changed, desc));
+        const auto third  = toVec(encoder.encode(changed, desc));
+
+        ut::expect(first == qoiImage) << "The first frame should be a plain QOI image";
+        ut::expect(!qoipp::SequenceDecoder::isDeltaFrame(first));
+        ut::expect(qoipp::SequenceDecoder::isDeltaFrame(second));
+        ut::expect(qoipp::SequenceDecoder::isDeltaFrame(third));
+        ut::expect(ut::that % second.size() < first.size());
+        ut::expect(ut::that % third.size() < second.size()) << "An unchanged frame should be all runs";
+
+        const auto* buffer = decoder.decode(first).m_data.data();
+        ut::expect(decoder.decode(first).m_data == rawImage);
+        ut::expect(decoder.decode(second).m_data == changed);
+
+        const auto& frame = decoder.decode(third);
+        ut::expect(frame.m_desc == desc);
+        ut::expect(frame.m_data == changed) << compare(changed, frame.m_data);
+        ut::expect(frame.m_data.data() == buffer) << "Frames should be decoded into the same buffer";
+
+        // an RGB image decoded into RGBA gets opaque alpha in the delta frames too
+        auto       expand = qoipp::SequenceDecoder{ qoipp::Channels::RGBA };
+        const auto rgba   = qoipp::decode(qoipp::encode(changed, desc), qoipp::Channels::RGBA);
+        expand.decode(first);
+        ut::expect(expand.decode(second).m_data == rgba.m_data);
+
+        ut::expect(toVec(encoder.encode(rawImage, desc, true)) == qoiImage) << "Forced key frame";
+        encoder.reset();
+        ut::expect(!qoipp::SequenceDecoder::isDeltaFrame(encoder.encode(changed, desc)));
+
+        ut::expect(ut::throws([&] { encoder.encode(ByteSpan{ rawImage }.first(4), desc); }))
+            << "Data not matching the description should throw";
+
+        auto fresh = qoipp::SequenceDecoder{};
+        ut::expect(ut::throws([&] { fresh.decode(second); }))
+            << "Delta frame without a previous frame should throw";
+
+        const auto otherDesc = qoipp::ImageDesc{ desc.m_width, 3, desc.m_channels, desc.m_colorspace };
+        const auto otherSize = qoipp::decodedSize(otherDesc);
+        fresh.decode(qoipp::encode(ByteSpan{ rawImage }.first(otherSize), otherDesc));
+        ut::expect(ut::throws([&] { fresh.decode(second); }))
+            << "Delta frame after a frame of another size should throw";
+    };
+
     "3-channel image encode to and decode from file"_test = [&] {
         const auto qoifile = mktemp();
 
         ut::expect(ut::nothrow([&] { qoipp::encodeToFile(qoifile, rawImage, desc, false); }));
         ut::expect(ut::throws([&] { qoipp::encodeToFile(qoifile, rawImage, desc, false); }));    // file exist
+        ut::expect(ut::nothrow([&] { qoipp::encodeToFile(qoifile, rawImage, desc, true); }));     // overwrite
+        ut::expect(ut::that % fs::file_size(qoifile) == qoiImage.size()) << "File should be shrunk to fit";
 
         qoipp::Image decoded;
         ut::expect(ut::nothrow([&] { decoded = qoipp::decodeFromFile(qoifile); }));
+        ut::expect(qoipp::tryDecodeFromFile(qoifile).m_value.m_data == decoded.m_data);
         ut::expect(decoded.m_desc == desc);
         ut::expect(ut::that % decoded.m_data.size() == rawImage.size());
         ut::expect(std::memcmp(decoded.m_data.data(), rawImage.data(), rawImage.size()) == 0_i)
@@ -259,9 +1289,27 @@ ut::suite threeChannelImage = [] {
         ut::expect(fs::is_empty(qoifile));
 
         ut::expect(ut::throws([&] { qoipp::decodeFromFile(qoifile); })) << "Empty file should throw";
+        ut::expect(qoipp::tryDecodeFromFile(qoifile).m_error == qoipp::Error::Truncated);
         fs::remove(qoifile);
         ut::expect(ut::throws([&] { qoipp::decodeFromFile(qoifile); })) << "Non-existent file should throw";
+        ut::expect(qoipp::tryDecodeFromFile(qoifile).m_error == qoipp::Error::File);
         ut::expect(!fs::exists(qoifile)) << "File should not be created if it previously not exist";
+        ut::expect(ut::throws([&] { qoipp::decodeFromFile(fs::temp_directory_path()); }))
+            << "Directory should throw";
+
+        // the image is written next to the path then renamed into place, nothing else is left behind
+        const auto dir = mktemp();
+        fs::create_directory(dir);
+        const auto placed = dir / "image.qoi";
+        qoipp::encodeToFile(placed, rawImage, desc);
+        qoipp::encodeToFile(placed, rawImage, desc, true);
+        const auto partial = ByteSpan{ rawImage }.first(3);
+        ut::expect(ut::throws([&] { qoipp::encodeToFile(placed, partial, desc, true); }));
+        ut::expect(ut::that % std::distance(fs::directory_iterator{ dir }, {}) == 1)
+            << "Temporary files should not be left behind";
+        ut::expect(qoipp::decodeFromFile(placed).m_data == qoipp::decode(qoiImage).m_data)
+            << "A failed overwrite should leave the file intact";
+        fs::remove_all(dir);
     };
 
     "3-channel image header read"_test = [&] {
@@ -292,6 +1340,92 @@ ut::suite threeChannelImage = [] {
 
         fs::remove(qoifile);
     };
+
+    "3-channel image header read from many files"_test = [&] {
+        const auto write = [](const fs::path& path, ByteSpan data) {
+            std::ofstream ofs{ path, std::ios::binary };
+            ofs.write(reinterpret_cast<const char*>(data.data()), std::ssize(data));
+        };
+
+        // enough files for the batch to be split between threads
+        std::vector<fs::path> paths;
+        for (usize i = 0; i < 200; ++i) {
+            write(paths.emplace_back(mktemp()), qoiImage);
+        }
+
+        const auto valid = paths.size();
+        write(paths.emplace_back(mktemp()), ByteSpan{ qoiImage }.first(10));    // truncated
+        write(paths.emplace_back(mktemp()), rawImage);                          // not a QOI image
+        paths.push_back(mktemp());                                              // missing
+        paths.push_back(fs::temp_directory_path());                             // a directory
+
+        std::vector<qoipp::FileHeader> headers;
+        ut::expect(ut::nothrow([&] { headers = qoipp::readHeaders(paths); }));
+        ut::expect(ut::that % headers.size() == paths.size());
+
+        for (auto i : rv::iota(0u, valid)) {
+            ut::expect(headers[i].m_error == qoipp::HeaderError::None);
+            ut::expect(headers[i].m_desc.has_value() and *headers[i].m_desc == desc);
+        }
+
+        ut::expect(headers[valid + 0].m_error == qoipp::HeaderError::Truncated);
+        ut::expect(headers[valid + 1].m_error == qoipp::HeaderError::Invalid);
+        ut::expect(headers[valid + 2].m_error == qoipp::HeaderError::Open);
+        ut::expect(headers[valid + 3].m_error == qoipp::HeaderError::Read);
+        for (auto i : rv::iota(valid, paths.size())) {
+            ut::expect(!headers[i].m_desc.has_value());
+        }
+
+        for (auto i : rv::iota(0u, paths.size() - 1)) {
+            fs::remove(paths[i]);
+        }
+    };
+
+    "3-channel image bulk file conversion"_test = [&] {
+        std::vector<qoipp::FileJob> jobs;
+        for (auto i : rv::iota(0, 8)) {
+            auto& job = jobs.emplace_back(mktemp(), mktemp());
+            if (i != 5) {
+                std::ofstream ofs{ job.m_input, std::ios::binary };
+                ofs.write(reinterpret_cast<const char*>(rawImage.data()), std::ssize(rawImage));
+            }
+        }
+        jobs[6].m_output = mktemp() / "missing" / "output.qoi";    // directory does not exist
+
+        const auto transform = [&](const qoipp::FileJob&, qoipp::ByteSpan input) {
+            return qoipp::encode(input, desc);
+        };
+
+        // small limits so that most of the jobs wait for the ones before them
+        const auto options = qoipp::FilePipelineOptions{
+            .m_threads     = 2,
+            .m_queueDepth  = 2,
+            .m_maxInFlight = 1,
+        };
+
+        std::vector<std::exception_ptr> errors;
+        ut::expect(ut::nothrow([&] { errors = qoipp::convertFiles(jobs, transform, options); }));
+        ut::expect(ut::that % errors.size() == jobs.size());
+
+        for (auto i : rv::iota(0u, jobs.size())) {
+            const auto& job = jobs[i];
+            if (i == 5 || i == 6) {
+                ut::expect(errors[i] != nullptr) << "Job" << i << "should fail";
+            } else {
+                ut::expect(errors[i] == nullptr) << "Job" << i << "should succeed";
+
+                const auto encoded = qoipp::decodeFromFile(job.m_output);
+                ut::expect(encoded.m_desc == desc);
+                ut::expect(std::memcmp(encoded.m_data.data(), rawImage.data(), rawImage.size()) == 0_i);
+                ut::expect(ut::that % fs::file_size(job.m_output) == qoiImage.size());
+            }
+            fs::remove(job.m_input);
+            fs::remove(job.m_output);
+        }
+
+        const auto invalid = qoipp::FilePipelineOptions{ .m_queueDepth = 0 };
+        ut::expect(ut::throws([&] { qoipp::convertFiles(jobs, transform, invalid); }));
+    };
 };
 
 ut::suite fourChannelImage = [] {
@@ -338,14 +1472,933 @@ ut::suite fourChannelImage = [] {
             << compare(rgbImage, decoded);
     };
 
+    "4-channel image decode into target channels"_test = [&] {
+        auto rgbImage = rgbOnly(rawImage);
+
+        const auto [rgbDecoded, rgbDesc] = qoipp::decode(qoiImage, qoipp::Channels::RGB);
+        ut::expect(rgbDesc.m_channels == qoipp::Channels::RGB);
+        ut::expect(ut::that % rgbDecoded.size() == rgbImage.size());
+        ut::expect(std::memcmp(rgbDecoded.data(), rgbImage.data(), rgbImage.size()) == 0_i)
+            << compare(rgbImage, rgbDecoded);
+
+        const auto [rgbaDecoded, rgbaDesc] = qoipp::decode(qoiImage, qoipp::Channels::RGBA);
+        ut::expect(rgbaDesc == desc);
+        ut::expect(ut::that % rgbaDecoded.size() == rawImage.size());
+        ut::expect(std::memcmp(rgbaDecoded.data(), rawImage.data(), rawImage.size()) == 0_i)
+            << compare(rawImage, rgbaDecoded);
+    };
+
+    "4-channel image decode truncated and unchecked"_test = [&] {
+        const auto [decoded, actualdesc] = qoipp::decodeUnchecked(qoiImage);
+        ut::expect(actualdesc == desc);
+        ut::expect(ut::that % decoded.size() == rawImage.size());
+        ut::expect(std::memcmp(decoded.data(), rawImage.data(), rawImage.size()) == 0_i)
+            << compare(rawImage, decoded);
+
+        const auto truncated = ByteSpan{ qoiImage }.first(qoiImage.size() / 2);
+        ut::expect(ut::throws([&] { qoipp::decode(truncated); })) << "Truncated data should throw";
+
+        const auto noEndMarker = ByteSpan{ qoiImage }.first(qoiImage.size() - 8);
+        ut::expect(ut::throws([&] { qoipp::decode(noEndMarker); })) << "Missing end marker should throw";
+
+        auto overlong = qoiImage;
+        overlong.insert(overlong.end(), 32, Byte{ 0xFF });
+        ut::expect(ut::nothrow([&] { qoipp::decode(overlong); })) << "Trailing data should be ignored";
+    };
+
+    "4-channel image error codes"_test = [&] {
+        using qoipp::Error;
+
+        const auto encoded = qoipp::tryEncode(rawImage, desc);
+        ut::expect(encoded.m_error == Error::None);
+        ut::expect(encoded.m_value == qoiImage) << compare(qoiImage, encoded.m_value);
+
+        ByteVec    out(qoipp::maxEncodedSize(desc));
+        const auto written = qoipp::tryEncode(rawImage, desc, out);
+        ut::expect(static_cast<bool>(written));
+        ut::expect(ut::that % written.m_value == qoiImage.size());
+        const auto small = qoipp::tryEncode(rawImage, desc, std::span{ out }.first(16));
+        ut::expect(small.m_error == Error::SizeMismatch);
+
+        auto noWidth = desc;
+        auto badChan = desc;
+        noWidth.m_width    = 0;
+        badChan.m_channels = static_cast<qoipp::Channels>(5);
+        ut::expect(qoipp::tryEncode(rawImage, noWidth).m_error == Error::BadDimensions);
+        ut::expect(qoipp::tryEncode(rawImage, badChan).m_error == Error::BadChannels);
+        ut::expect(qoipp::tryEncode(ByteSpan{ rawImage }.first(7), desc).m_error == Error::SizeMismatch);
+
+        const auto decoded = qoipp::tryDecode(qoiImage);
+        ut::expect(decoded.m_error == Error::None);
+        ut::expect(decoded.m_value.m_desc == desc);
+        ut::expect(decoded.m_value.m_data == rawImage) << compare(rawImage, decoded.m_value.m_data);
+
+        const auto rgb = qoipp::tryDecode(qoiImage, true);
+        ut::expect(rgb.m_value.m_desc.m_channels == qoipp::Channels::RGB);
+        ut::expect(rgb.m_value.m_data == rgbOnly(rawImage));
+
+        ByteVec buffer(rawImage.size());
+        ut::expect(qoipp::tryDecode(qoiImage, buffer).m_value == desc);
+        ut::expect(buffer == rawImage) << compare(rawImage, buffer);
+        ut::expect(qoipp::tryDecode(qoiImage, std::span{ buffer }.first(7)).m_error == Error::SizeMismatch);
+
+        auto badMagic = qoiImage;
+        auto overflow = qoiImage;
+        auto badHead  = qoiImage;
+        badMagic[0]   = Byte{ 'x' };
+        overflow[4]   = Byte{ 0x7F };    // a width of 2^31 and change
+        badHead[12]   = Byte{ 5 };
+
+        const auto truncated   = ByteSpan{ qoiImage }.first(qoiImage.size() / 2);
+        const auto noEndMarker = ByteSpan{ qoiImage }.first(qoiImage.size() - 8);
+
+        ut::expect(qoipp::tryDecode(badMagic).m_error == Error::BadMagic);
+        ut::expect(qoipp::tryDecode(overflow).m_error == Error::PixelOverflow);
+        ut::expect(qoipp::tryDecode(badHead).m_error == Error::BadChannels);
+        ut::expect(qoipp::tryDecode(ByteSpan{ qoiImage }.first(10)).m_error == Error::Truncated);
+        ut::expect(qoipp::tryDecode(truncated).m_error == Error::Truncated);
+        ut::expect(qoipp::tryDecode(noEndMarker, buffer).m_error == Error::Truncated);
+        ut::expect(qoipp::tryDecode(qoiImage, static_cast<qoipp::Channels>(2)).m_error == Error::BadChannels);
+
+        ut::expect(qoipp::errorName(Error::Truncated) == "truncated");
+
+        // the other entry points reading untrusted data
+        const auto area   = qoipp::Region{ 1, 1, 4, 3 };
+        const auto region = qoipp::tryDecodeRegion(qoiImage, area, 2);
+        ut::expect(static_cast<bool>(region));
+        ut::expect(region.m_value.m_data == qoipp::decodeRegion(qoiImage, area, 2).m_data);
+        ut::expect(qoipp::tryDecodeRegion(qoiImage, { desc.m_width, 0 }).m_error == Error::BadRegion);
+        ut::expect(qoipp::tryDecodeRegion(qoiImage, area, 0).m_error == Error::BadRegion);
+        ut::expect(qoipp::tryDecodeRegion(truncated, {}).m_error == Error::Truncated);
+        ut::expect(qoipp::tryDecodeRegion(badMagic, area).m_error == Error::BadMagic);
+
+        const auto index = qoipp::indexRows(qoiImage, 4);
+        const auto rows  = qoipp::tryDecodeRows(qoiImage, index, 5, 3);
+        ut::expect(rows.m_value.m_data == qoipp::decodeRows(qoiImage, index, 5, 3).m_data);
+        const auto shortIndex = ByteSpan{ index }.first(7);
+        ut::expect(qoipp::tryDecodeRows(qoiImage, shortIndex, 5, 3).m_error == Error::BadTable);
+        ut::expect(qoipp::tryDecodeRows(overflow, index, 5, 3).m_error == Error::PixelOverflow);
+
+        const auto striped = qoipp::encodeStriped(rawImage, desc, 4);
+        auto       shifted = striped;
+        shifted.end()[-13] = Byte(std::to_integer<u8>(shifted.end()[-13]) + 1);
+        ut::expect(qoipp::tryDecodeStriped(striped).m_value.m_data == rawImage);
+        ut::expect(qoipp::tryDecodeStriped(shifted).m_error == Error::BadTable);
+        const auto halfStriped = ByteSpan{ striped }.first(striped.size() / 2);
+        ut::expect(qoipp::tryDecodeStriped(halfStriped).m_error == Error::Truncated);
+
+        const auto jobs  = std::vector<ByteSpan>{ qoiImage, badMagic, truncated };
+        const auto batch = qoipp::tryDecodeBatch(jobs);
+        ut::expect(ut::that % batch.size() == jobs.size());
+        ut::expect(batch[0].m_value.m_data == rawImage) << "A rejected image should not fail the batch";
+        ut::expect(batch[1].m_error == Error::BadMagic);
+        ut::expect(batch[2].m_error == Error::Truncated);
+
+        ByteVec        streamed;
+        qoipp::Decoder decoder{ [&](usize, ByteSpan row) {
+            streamed.insert(streamed.end(), row.begin(), row.end());
+        } };
+        ut::expect(decoder.tryPush(ByteSpan{ qoiImage }.first(100)) == Error::None);
+        ut::expect(decoder.tryPush(ByteSpan{ qoiImage }.subspan(100)) == Error::None);
+        ut::expect(decoder.done());
+        ut::expect(streamed == rawImage) << compare(rawImage, streamed);
+
+        const auto ignore = [](usize, ByteSpan) {};
+        auto       badEnd = qoiImage;
+        badEnd.back()     = Byte{ 0x02 };
+
+        qoipp::Decoder rejected{ ignore };
+        ut::expect(rejected.tryPush(badMagic) == Error::BadMagic);
+        ut::expect(rejected.tryPush(qoiImage) == Error::BadMagic) << "A rejected header should stay rejected";
+        ut::expect(qoipp::Decoder{ ignore }.tryPush(badHead) == Error::BadChannels);
+        ut::expect(ut::throws([&] { qoipp::Decoder{ ignore }.push(badHead); }));
+        ut::expect(qoipp::Decoder{ ignore }.tryPush(badEnd) == Error::BadEndMarker);
+
+        const auto qoifile = mktemp();
+        ut::expect(qoipp::tryEncodeToFile(qoifile, rawImage, desc) == Error::None);
+        ut::expect(qoipp::tryEncodeToFile(qoifile, rawImage, desc) == Error::File) << "File exists";
+        const auto partial = ByteSpan{ rawImage }.first(7);
+        ut::expect(qoipp::tryEncodeToFile(qoifile, partial, desc, true) == Error::SizeMismatch);
+        ut::expect(qoipp::decodeFromFile(qoifile).m_data == rawImage);
+
+        ByteVec    arena(qoipp::decodedSize(desc));
+        const auto allocate = [&](usize size) { return std::span{ arena }.first(size); };
+        const auto fileDesc = qoipp::tryDecodeFromFile(qoifile, allocate);
+        ut::expect(fileDesc.m_value == desc);
+        ut::expect(arena == rawImage) << compare(rawImage, arena);
+        const auto fileImage = qoipp::tryDecodeFromFile(qoifile, qoipp::UninitAllocator<>{});
+        ut::expect(std::ranges::equal(fileImage.m_value.m_data, rawImage));
+        fs::remove(qoifile);
+        ut::expect(qoipp::tryDecodeFromFile(qoifile, allocate).m_error == Error::File);
+
+        // the allocator overloads
+        const auto tooSmall = [&](usize size) { return std::span{ arena }.first(size - 1); };
+        ut::expect(qoipp::tryDecode(qoiImage, allocate).m_value == desc);
+        ut::expect(qoipp::tryDecode(qoiImage, tooSmall).m_error == Error::SizeMismatch);
+        ut::expect(qoipp::tryDecode(badMagic, allocate).m_error == Error::BadMagic);
+        ut::expect(qoipp::tryEncode(rawImage, desc, tooSmall).m_error == Error::SizeMismatch);
+
+        const auto allocEncoded = qoipp::tryEncode(rawImage, desc, qoipp::UninitAllocator<>{});
+        ut::expect(std::ranges::equal(allocEncoded.m_value, qoiImage));
+        ut::expect(qoipp::tryEncode(rawImage, noWidth, qoipp::UninitAllocator<>{}).m_value.empty());
+        const auto allocDecoded = qoipp::tryDecode(truncated, qoipp::UninitAllocator<>{});
+        ut::expect(allocDecoded.m_error == Error::Truncated);
+        ut::expect(allocDecoded.m_value.m_data.empty()) << "A rejected image should leave no data";
+
+        // pixel formats and views
+        const auto badFormat = static_cast<qoipp::PixelFormat>(99);
+        const auto rgba      = qoipp::tryDecode(qoiImage, qoipp::PixelFormat::RGBA);
+        ut::expect(rgba.m_value.m_data == qoipp::decode(qoiImage, qoipp::PixelFormat::RGBA).m_data);
+        ut::expect(qoipp::tryDecode(qoiImage, badFormat).m_error == Error::BadFormat);
+        ut::expect(qoipp::tryDecode(truncated, qoipp::PixelFormat::BGRA).m_error == Error::Truncated);
+        const auto shortOut = std::span{ arena }.first(7);
+        const auto shortRgba = qoipp::tryDecode(qoiImage, shortOut, qoipp::PixelFormat::RGBA);
+        ut::expect(shortRgba.m_error == Error::SizeMismatch);
+
+        const auto pixel = qoipp::decode(qoiImage, qoipp::PixelFormat::BGRA).m_data;
+        ut::expect(qoipp::tryEncode(pixel, desc, qoipp::PixelFormat::BGRA).m_value == qoiImage);
+        ut::expect(qoipp::tryEncode(pixel, desc, badFormat).m_error == Error::BadFormat);
+        const auto pixelNoWidth = qoipp::tryEncode(pixel, noWidth, qoipp::PixelFormat::BGRA);
+        ut::expect(pixelNoWidth.m_error == Error::BadDimensions);
+
+        const auto view      = qoipp::ImageView{ .m_data = rawImage, .m_desc = desc };
+        auto       narrow    = view;
+        auto       formatted = view;
+        narrow.m_stride    = 1;
+        formatted.m_format = badFormat;
+        ut::expect(qoipp::tryEncode(view).m_value == qoiImage);
+        ut::expect(qoipp::tryEncode(narrow).m_error == Error::SizeMismatch);
+        ut::expect(qoipp::tryEncode(formatted).m_error == Error::BadFormat);
+        ut::expect(qoipp::tryEncode(view, out).m_value == qoiImage.size());
+        ut::expect(qoipp::tryEncode(view, std::span{ out }.first(16)).m_error == Error::SizeMismatch);
+
+        qoipp::Codec codec;
+        ut::expect(std::ranges::equal(codec.tryEncode(view).m_value, qoiImage));
+        ut::expect(codec.tryEncode(narrow).m_error == Error::SizeMismatch);
+
+        // the compile-time overloads
+        const auto fixed = qoipp::tryEncode<qoipp::Channels::RGBA>(rawImage, desc.m_width, desc.m_height);
+        ut::expect(fixed.m_value == qoiImage);
+        ut::expect(qoipp::tryEncode<qoipp::Channels::RGBA>(rawImage, 0, 1).m_error == Error::BadDimensions);
+        ut::expect(qoipp::tryDecode<qoipp::Channels::RGBA>(qoiImage).m_value.m_data == rawImage);
+        ut::expect(qoipp::tryDecode<qoipp::Channels::RGB>(qoiImage).m_error == Error::BadChannels);
+        ut::expect(qoipp::tryDecode<qoipp::Channels::RGBA>(qoiImage, arena).m_value == desc);
+        ut::expect(qoipp::tryDecode<qoipp::Channels::RGBA>(truncated, arena).m_error == Error::Truncated);
+
+        std::array<Byte, qoipp::decodedSize(desc)> decodedArr{};
+        constexpr auto swapped = qoipp::ImageDesc{
+            desc.m_height, desc.m_width, desc.m_channels, desc.m_colorspace
+        };
+        ut::expect(qoipp::tryDecode<desc>(qoiImage, decodedArr).m_value == desc);
+        ut::expect(qoipp::tryDecode<swapped>(qoiImage, decodedArr).m_error == Error::BadDimensions);
+
+        // the remaining encoders and decoders
+        const auto stripedTry = qoipp::tryEncodeStriped(rawImage, desc, 4);
+        ut::expect(stripedTry.m_value == striped);
+        ut::expect(qoipp::tryEncodeStriped(partial, desc).m_error == Error::SizeMismatch);
+
+        auto encodeJobs      = std::vector<qoipp::EncodeJob>(3, { rawImage, desc });
+        encodeJobs[1].m_data = partial;
+        const auto encodedBatch = qoipp::tryEncodeBatch(encodeJobs);
+        ut::expect(encodedBatch[0].m_value == qoiImage) << "A rejected job should not fail the batch";
+        ut::expect(encodedBatch[1].m_error == Error::SizeMismatch);
+        ut::expect(encodedBatch[2].m_value == qoiImage);
+
+        const auto tryIndex = qoipp::tryIndexRows(qoiImage, 4);
+        ut::expect(tryIndex.m_value == index);
+        ut::expect(qoipp::tryIndexRows(qoiImage, 0).m_error == Error::BadRegion);
+        ut::expect(qoipp::tryIndexRows(truncated).m_error == Error::Truncated);
+
+        auto pool = qoipp::ThreadPool{ 2 };
+        ut::expect(qoipp::tryDecodeParallel(qoiImage, pool).m_value.m_data == rawImage);
+        ut::expect(qoipp::tryDecodeParallel(truncated, pool).m_error == Error::Truncated);
+        ut::expect(qoipp::tryDecodeParallel(badMagic).m_error == Error::BadMagic);
+
+        qoipp::SequenceEncoder sequence;
+        const auto key   = qoipp::SequenceDecoder{}.tryDecode(sequence.tryEncode(rawImage, desc).m_value);
+        const auto frame = sequence.tryEncode(rawImage, desc).m_value;
+        const auto delta = ByteVec{ frame.begin(), frame.end() };
+        ut::expect(key.m_error == Error::None);
+        ut::expect(sequence.tryEncode(partial, desc).m_error == Error::SizeMismatch);
+        ut::expect(qoipp::SequenceDecoder{}.tryDecode(delta).m_error == Error::BadFrame);
+        ut::expect(qoipp::SequenceDecoder{}.tryDecode(truncated).m_error == Error::Truncated);
+
+        ut::expect(qoipp::errorName(Error::BadFormat) == "bad format");
+        ut::expect(qoipp::errorName(Error::BadFrame) == "bad frame");
+    };
+
+    "4-channel image codec context"_test = [&] {
+        qoipp::Codec codec;
+        ut::expect(!codec.desc().has_value());
+
+        const auto encoded = codec.encode(rawImage, desc);
+        ut::expect(std::ranges::equal(encoded, qoiImage)) << compare(qoiImage, encoded);
+        ut::expect(codec.desc() == desc);
+        ut::expect(codec.encode(rawImage, desc).data() == encoded.data()) << "Buffer should be reused";
+
+        const auto decoded = codec.decode(qoiImage);
+        ut::expect(decoded.m_desc == desc);
+        ut::expect(std::ranges::equal(decoded.m_data, rawImage)) << compare(rawImage, decoded.m_data);
+        ut::expect(codec.decode(qoiImage).m_data.data() == decoded.m_data.data())
+            << "Buffer should be reused";
+        ut::expect(std::ranges::equal(codec.encode(codec.decode(qoiImage)), qoiImage));
+
+        const auto rgb = codec.decode(qoiImage, true);
+        ut::expect(rgb.m_desc.m_channels == qoipp::Channels::RGB);
+        ut::expect(std::ranges::equal(rgb.m_data, rgbOnly(rawImage)));
+
+        ut::expect(ut::throws([&] { codec.encode(ByteSpan{ rawImage }.first(7), desc); }));
+        ut::expect(ut::throws([&] { codec.decode(ByteSpan{ qoiImage }.first(qoiImage.size() / 2)); }));
+        const auto mismatch = codec.tryEncode(ByteSpan{ rawImage }.first(7), desc);
+        ut::expect(mismatch.m_error == qoipp::Error::SizeMismatch);
+        ut::expect(codec.tryDecode(ByteSpan{ qoiImage }.first(10)).m_error == qoipp::Error::Truncated);
+
+        const auto tried = codec.tryDecode(qoiImage);
+        ut::expect(static_cast<bool>(tried));
+        ut::expect(std::ranges::equal(tried.m_value.m_data, rawImage));
+        ut::expect(std::ranges::equal(codec.tryEncode(rawImage, desc).m_value, qoiImage));
+
+        qoipp::Codec reserved;
+        reserved.reserve(desc);
+
+        const auto before = reserved.decode(qoiImage, qoipp::Channels::RGBA).m_data.data();
+        ut::expect(reserved.decode(qoiImage).m_data.data() == before) << "Reserve should fit 4 channels";
+
+        auto moved = std::move(reserved);
+        ut::expect(moved.decode(qoiImage).m_data.data() == before) << "Buffers should move with the context";
+        reserved = qoipp::Codec{};
+        ut::expect(!reserved.desc().has_value()) << "A moved-from context should be assignable";
+    };
+
+    "4-channel image encode and decode pixel formats"_test = [&] {
+        using Format = qoipp::PixelFormat;
+
+        const auto formats = std::array{
+            std::pair{ Format::RGBA, std::array<usize, 4>{ 0, 1, 2, 3 } },
+            std::pair{ Format::BGRA, std::array<usize, 4>{ 2, 1, 0, 3 } },
+            std::pair{ Format::ARGB, std::array<usize, 4>{ 3, 0, 1, 2 } },
+            std::pair{ Format::ABGR, std::array<usize, 4>{ 3, 2, 1, 0 } },
+        };
+
+        for (const auto& [format, order] : formats) {
+            const auto pixels = swizzle(rawImage, desc, order);
+
+            const auto encoded = qoipp::encode(pixels, desc, format);
+            ut::expect(ut::that % encoded.size() == qoiImage.size());
+            ut::expect(encoded == qoiImage) << compare(qoiImage, encoded);
+
+            const auto decoded = qoipp::decode(qoiImage, format);
+            ut::expect(decoded.m_desc.m_channels == qoipp::Channels::RGBA);
+            ut::expect(decoded.m_data == pixels) << compare(pixels, decoded.m_data);
+
+            ByteVec    buffer(pixels.size());
+            const auto bufferDesc = qoipp::decode(qoiImage, buffer, format);
+            ut::expect(bufferDesc == decoded.m_desc);
+            ut::expect(buffer == pixels);
+        }
+
+        // the padding byte is read as opaque and written as 255
+        auto opaque = swizzle(rawImage, desc, { 0, 1, 2, 3 });
+        for (usize i = 3; i < opaque.size(); i += 4) {
+            opaque[i] = Byte{ 0xFF };
+        }
+        auto rgbDesc       = desc;
+        rgbDesc.m_channels = qoipp::Channels::RGB;
+        ut::expect(qoipp::decode(qoiImage, Format::RGBX).m_data == opaque);
+        ut::expect(qoipp::encode(opaque, rgbDesc, Format::RGBX) == qoipp::encode(rgbOnly(rawImage), rgbDesc));
+
+        const auto premultipliedFormats = std::array{
+            std::pair{ Format::RGBAPremultiplied, std::array<usize, 4>{ 0, 1, 2, 3 } },
+            std::pair{ Format::BGRAPremultiplied, std::array<usize, 4>{ 2, 1, 0, 3 } },
+        };
+
+        // premultiplying the colors that were unpremultiplied gives them back
+        for (const auto& [format, order] : premultipliedFormats) {
+            const auto premultiplied = swizzle(rawImage, desc, order, true);
+            ut::expect(qoipp::decode(qoiImage, format).m_data == premultiplied);
+
+            const auto encoded = qoipp::encode(premultiplied, desc, format);
+            ut::expect(qoipp::decode(encoded, format).m_data == premultiplied);
+        }
+
+        const auto packed = rgbOnly(swizzle(rawImage, desc, { 0, 1, 2, 3 }));
+        ut::expect(ut::throws([&] { qoipp::encode(packed, desc, Format::BGRA); }))
+            << "Data that is not 4 bytes per pixel should throw";
+        ut::expect(ut::throws([&] { qoipp::decode(qoiImage, static_cast<Format>(42)); }))
+            << "Invalid pixel format should throw";
+    };
+
+    "4-channel image region decode"_test = [&] {
+        const auto region = qoipp::Region{ .m_x = 3, .m_y = 2, .m_width = 10, .m_height = 7 };
+
+        for (auto scale : { 1u, 2u, 3u }) {
+            const auto expected = cropScaled(rawImage, desc, region, scale);
+            const auto [decoded, actualDesc] = qoipp::decodeRegion(qoiImage, region, scale);
+
+            ut::expect(ut::that % actualDesc.m_width == (region.m_width + scale - 1) / scale);
+            ut::expect(ut::that % actualDesc.m_height == (region.m_height + scale - 1) / scale);
+            ut::expect(actualDesc.m_channels == desc.m_channels);
+            ut::expect(ut::that % decoded.size() == expected.size());
+            ut::expect(std::memcmp(decoded.data(), expected.data(), expected.size()) == 0_i)
+                << compare(expected, decoded);
+        }
+
+        const auto full = qoipp::decodeRegion(qoiImage, {});
+        ut::expect(full.m_desc == desc) << "Empty region should decode the whole image";
+        ut::expect(std::memcmp(full.m_data.data(), rawImage.data(), rawImage.size()) == 0_i)
+            << compare(rawImage, full.m_data);
+
+        const auto rest = qoipp::decodeRegion(qoiImage, { .m_x = 20, .m_y = 10 });
+        ut::expect(ut::that % rest.m_desc.m_width == desc.m_width - 20);
+        ut::expect(ut::that % rest.m_desc.m_height == desc.m_height - 10);
+
+        const auto truncated = ByteSpan{ qoiImage }.first(qoiImage.size() / 2);
+        ut::expect(ut::nothrow([&] { qoipp::decodeRegion(truncated, { .m_height = 1 }); }))
+            << "Data after the region should not be read";
+        ut::expect(ut::throws([&] { qoipp::decodeRegion(truncated, { .m_y = desc.m_height - 1 }); }))
+            << "Truncated data before the end of the region should throw";
+
+        const auto converted = rgbOnly(cropScaled(rawImage, desc, region, 1));
+        const auto target    = qoipp::decodeRegion(qoiImage, region, 1, qoipp::Channels::RGB);
+        ut::expect(target.m_desc.m_channels == qoipp::Channels::RGB);
+        ut::expect(std::memcmp(target.m_data.data(), converted.data(), converted.size()) == 0_i)
+            << compare(converted, target.m_data);
+
+        ut::expect(ut::throws([&] { qoipp::decodeRegion(qoiImage, { .m_x = desc.m_width }); }))
+            << "Region outside of the image should throw";
+        const auto overflowing = qoipp::Region{ .m_y = 1, .m_height = desc.m_height };
+        ut::expect(ut::throws([&] { qoipp::decodeRegion(qoiImage, overflowing); }))
+            << "Region overflowing the image should throw";
+        ut::expect(ut::throws([&] { qoipp::decodeRegion(qoiImage, region, 0); }))
+            << "Zero scale should throw";
+    };
+
+    "4-channel image row index"_test = [&] {
+        const auto rowSize = rawImage.size() / desc.m_height;
+        const auto rows    = [&](usize first, usize count) {
+            return ByteSpan{ rawImage }.subspan(first * rowSize, count * rowSize);
+        };
+
+        for (auto interval : { 1u, 4u, 64u }) {
+            const auto index = qoipp::indexRows(qoiImage, interval);
+
+            auto appended = qoiImage;
+            appended.insert(appended.end(), index.begin(), index.end());
+            ut::expect(qoipp::decode(appended).m_data == rawImage) << "Appended index should be ignored";
+
+            const auto last = desc.m_height - 1;
+            for (auto [first, count] : { std::pair{ 0u, 1u }, { 5u, 3u }, { 9u, last - 8 }, { last, 1u } }) {
+                const auto expected = rows(first, count);
+                const auto sidecar  = qoipp::decodeRows(qoiImage, index, first, count);
+                const auto trailing = qoipp::decodeRows(appended, {}, first, count);
+
+                ut::expect(ut::that % sidecar.m_desc.m_height == count);
+                ut::expect(ut::that % sidecar.m_data.size() == expected.size());
+                ut::expect(std::memcmp(sidecar.m_data.data(), expected.data(), expected.size()) == 0_i)
+                    << compare(expected, sidecar.m_data);
+                ut::expect(trailing.m_data == sidecar.m_data);
+            }
+        }
+
+        const auto index = qoipp::indexRows(qoiImage, 4);
+        const auto plain = qoipp::decodeRows(qoiImage, {}, 10, 0);
+        const auto rest  = rows(10, desc.m_height - 10);
+        ut::expect(ut::that % plain.m_desc.m_height == desc.m_height - 10) << "Count 0 should be the rest";
+        ut::expect(std::memcmp(plain.m_data.data(), rest.data(), rest.size()) == 0_i)
+            << "Image without an index should decode from the start";
+
+        const auto broken = ByteSpan{ index }.first(index.size() - 1);
+        ut::expect(ut::throws([&] { qoipp::decodeRows(qoiImage, broken, 5, 3); }))
+            << "Index that doesn't match should throw";
+        ut::expect(ut::throws([&] { qoipp::decodeRows(qoiImage, index, desc.m_height, 1); }))
+            << "Rows outside of the image should throw";
+        ut::expect(ut::throws([&] { qoipp::indexRows(qoiImage, 0); })) << "Zero interval should throw";
+        ut::expect(ut::throws([&] { qoipp::indexRows(ByteSpan{ qoiImage }.first(qoiImage.size() / 2)); }))
+            << "Truncated data should throw";
+    };
+
+    "4-channel image parallel decode"_test = [&] {
+        auto pool = qoipp::ThreadPool{ 4 };
+
+        const auto small = qoipp::decodeParallel(qoiImage, pool);
+        ut::expect(small.m_desc == desc);
+        ut::expect(small.m_data == rawImage) << "Small image should decode like decode";
+
+        // big enough for its ops to be split between the threads
+        const auto tiled   = tile(rawImage, desc, 40, 40);
+        const auto encoded = qoipp::encode(tiled.m_data, tiled.m_desc);
+        const auto decoded = qoipp::decodeParallel(encoded, pool);
+
+        ut::expect(decoded.m_desc == tiled.m_desc);
+        ut::expect(ut::that % decoded.m_data.size() == tiled.m_data.size());
+        ut::expect(decoded.m_data == tiled.m_data) << compare(tiled.m_data, decoded.m_data);
+
+        const auto rgbDecoded = qoipp::decodeParallel(encoded, pool, true);
+        ut::expect(rgbDecoded.m_data == rgbOnly(tiled.m_data)) << "rgbOnly should match";
+
+        const auto truncated = ByteSpan{ encoded }.first(encoded.size() * 3 / 4);
+        ut::expect(ut::throws([&] { qoipp::decodeParallel(truncated, pool); }))
+            << "Truncated data should throw";
+    };
+
+    "4-channel image strided encode"_test = [&] {
+        const auto rowSize = desc.m_width * static_cast<usize>(desc.m_channels);
+        const auto stride  = rowSize + 13;
+
+        // rows with padding in between, like a buffer with a row pitch
+        auto padded = ByteVec(stride * desc.m_height, Byte{ 0xAB });
+        for (auto row : rv::iota(0u, desc.m_height)) {
+            std::memcpy(padded.data() + row * stride, rawImage.data() + row * rowSize, rowSize);
+        }
+
+        const auto view    = qoipp::ImageView{ .m_data = padded, .m_desc = desc, .m_stride = stride };
+        const auto encoded = qoipp::encode(view);
+        ut::expect(encoded == qoiImage) << compare(qoiImage, encoded);
+
+        ByteVec    buffer(qoipp::maxEncodedSize(desc));
+        const auto size = qoipp::encode(view, buffer);
+        ut::expect(ut::that % size == qoiImage.size());
+        ut::expect(std::memcmp(buffer.data(), qoiImage.data(), size) == 0_i);
+
+        // the view may end right after the last pixel
+        const auto tight     = ByteSpan{ padded }.first(stride * (desc.m_height - 1) + rowSize);
+        const auto tightView = qoipp::ImageView{ .m_data = tight, .m_desc = desc, .m_stride = stride };
+        ut::expect(qoipp::encode(tightView) == qoiImage);
+
+        ut::expect(qoipp::encode(qoipp::ImageView{ .m_data = rawImage, .m_desc = desc }) == qoiImage)
+            << "A stride of 0 should be packed rows";
+
+        // a crop of the image is a view with the stride of the image
+        const auto region   = qoipp::Region{ 3, 2, desc.m_width - 7, desc.m_height - 4 };
+        auto       cropDesc = desc;
+        cropDesc.m_width    = region.m_width;
+        cropDesc.m_height   = region.m_height;
+
+        const auto first   = region.m_y * rowSize + region.m_x * static_cast<usize>(desc.m_channels);
+        const auto cropped = qoipp::encode(qoipp::ImageView{
+            .m_data   = ByteSpan{ rawImage }.subspan(first),
+            .m_desc   = cropDesc,
+            .m_stride = rowSize,
+        });
+        ut::expect(cropped == qoipp::encode(cropScaled(rawImage, desc, region, 1), cropDesc));
+
+        // a pitched buffer of BGRA pixels
+        const auto bgra    = swizzle(rawImage, desc, { 2, 1, 0, 3 });
+        const auto bgraRow = desc.m_width * usize{ 4 };
+        auto       pitched = ByteVec(256 * desc.m_height);
+        for (auto row : rv::iota(0u, desc.m_height)) {
+            std::memcpy(pitched.data() + row * 256, bgra.data() + row * bgraRow, bgraRow);
+        }
+        const auto bgraView = qoipp::ImageView{
+            .m_data   = pitched,
+            .m_desc   = desc,
+            .m_stride = 256,
+            .m_format = qoipp::PixelFormat::BGRA,
+        };
+        ut::expect(qoipp::encode(bgraView) == qoiImage);
+
+        auto narrow     = view;
+        narrow.m_stride = rowSize - 1;
+        ut::expect(ut::throws([&] { qoipp::encode(narrow); })) << "Stride smaller than a row should throw";
+
+        // a stride that wraps the size of the view around to less than the data
+        auto huge     = view;
+        huge.m_stride = std::numeric_limits<usize>::max() / (desc.m_height - 1) + 1;
+        ut::expect(ut::throws([&] { qoipp::encode(huge); })) << "Stride overflowing the view should throw";
+
+        auto truncated   = tightView;
+        truncated.m_data = tight.first(tight.size() - 1);
+        ut::expect(ut::throws([&] { qoipp::encode(truncated); }))
+            << "Data too small for the view should throw";
+
+        ut::expect(ut::throws([&] { qoipp::encode(view, std::span{ buffer }.first(10)); }))
+            << "Output buffer too small should throw";
+    };
+
+    "4-channel image encode into buffer"_test = [&] {
+        ByteVec buffer(qoipp::maxEncodedSize(desc));
+        usize   written = 0;
+
+        ut::expect(ut::nothrow([&] { written = qoipp::encode(rawImage, desc, buffer); }));
+        ut::expect(ut::that % written == qoiImage.size());
+        ut::expect(std::memcmp(buffer.data(), qoiImage.data(), qoiImage.size()) == 0_i)
+            << compare(qoiImage, { buffer.data(), written });
+
+        ByteVec small(qoiImage.size() - 1);
+        ut::expect(ut::throws([&] { qoipp::encode(rawImage, desc, small); })) << "Small buffer should throw";
+    };
+
+    "4-channel image encode at every effort level"_test = [&] {
+        std::map<qoipp::Effort, ByteVec> encoded;
+        for (auto effort : { qoipp::Effort::Fast, qoipp::Effort::Default, qoipp::Effort::Best }) {
+            ut::expect(ut::nothrow([&] { encoded[effort] = qoipp::encode(rawImage, desc, { effort }); }));
+
+            const auto decoded = qoipp::decode(encoded[effort]);
+            ut::expect(decoded.m_desc == desc);
+            ut::expect(std::memcmp(decoded.m_data.data(), rawImage.data(), rawImage.size()) == 0_i)
+                << compare(rawImage, decoded.m_data);
+        }
+
+        ut::expect(encoded[qoipp::Effort::Default] == qoiImage) << "Default should match the reference";
+        ut::expect(encoded[qoipp::Effort::Best].size() <= encoded[qoipp::Effort::Default].size());
+        ut::expect(encoded[qoipp::Effort::Default].size() <= encoded[qoipp::Effort::Fast].size());
+
+        // an image starting with a run of the start pixel, which only `Best` indexes, then going back to it
+        const auto runDesc  = qoipp::ImageDesc{ 4, 1, desc.m_channels, desc.m_colorspace };
+        const auto channels = static_cast<usize>(desc.m_channels);
+        const auto pixels   = std::array<std::array<u8, 4>, 4>{ {
+            { 0, 0, 0, 255 },
+            { 0, 0, 0, 255 },
+            { 200, 100, 50, 255 },
+            { 0, 0, 0, 255 },
+        } };
+
+        ByteVec runImage;
+        for (const auto& pixel : pixels) {
+            for (auto channel : rv::iota(usize{ 0 }, channels)) {
+                runImage.push_back(Byte{ pixel[channel] });
+            }
+        }
+
+        const auto best        = qoipp::encode(runImage, runDesc, { qoipp::Effort::Best });
+        const auto defaultSize = qoipp::encode(runImage, runDesc, { qoipp::Effort::Default }).size();
+        ut::expect(ut::that % best.size() < defaultSize) << "Best should index the start pixel of a run";
+
+        const auto decoded = qoipp::decode(best);
+        ut::expect(decoded.m_desc == runDesc);
+        ut::expect(decoded.m_data == runImage) << compare(runImage, decoded.m_data);
+
+        // every other encoder taking options chooses the same ops
+        ByteVec    allocated;
+        const auto size = qoipp::encode(runImage, runDesc, [&](usize required) {
+            allocated.resize(required);
+            return std::span{ allocated };
+        }, { qoipp::Effort::Best });
+        allocated.resize(size);
+        ut::expect(allocated == best) << compare(best, allocated);
+
+        const auto vector = qoipp::encode(runImage, runDesc, std::allocator<Byte>{}, { qoipp::Effort::Best });
+        ut::expect(ByteVec(vector.begin(), vector.end()) == best) << "Allocator overload should use options";
+
+        const auto jobs  = std::array{ qoipp::EncodeJob{ runImage, runDesc } };
+        const auto batch = qoipp::encodeBatch(jobs, { qoipp::Effort::Best });
+        ut::expect(batch.at(0) == best) << compare(best, batch.at(0));
+
+        ByteVec        streamed;
+        qoipp::Encoder encoder{
+            runDesc,
+            [&](ByteSpan bytes) { streamed.insert(streamed.end(), bytes.begin(), bytes.end()); },
+            { qoipp::Effort::Best },
+        };
+        encoder.push(runImage);
+        encoder.finish();
+        ut::expect(streamed == best) << compare(best, streamed);
+
+        const auto striped = qoipp::encodeStriped(runImage, runDesc, 1, { qoipp::Effort::Best });
+        ut::expect(ut::that % striped.size() < qoipp::encodeStriped(runImage, runDesc, 1).size());
+        ut::expect(qoipp::decodeStriped(striped).m_data == runImage) << "Best stripes should decode";
+    };
+
+    "4-channel image decode into buffer"_test = [&] {
+        auto rgbImage = rgbOnly(rawImage);
+        auto rgbDesc  = qoipp::ImageDesc{
+            desc.m_width, desc.m_height, qoipp::Channels::RGB, desc.m_colorspace
+        };
+
+        ByteVec          buffer(qoipp::decodedSize(desc));
+        qoipp::ImageDesc actualDesc;
+
+        ut::expect(ut::nothrow([&] { actualDesc = qoipp::decode(qoiImage, buffer); }));
+        ut::expect(actualDesc == desc);
+        ut::expect(std::memcmp(buffer.data(), rawImage.data(), rawImage.size()) == 0_i)
+            << compare(rawImage, buffer);
+
+        ut::expect(ut::nothrow([&] { actualDesc = qoipp::decode(qoiImage, buffer, true); }));
+        ut::expect(actualDesc == rgbDesc);
+        ut::expect(std::memcmp(buffer.data(), rgbImage.data(), rgbImage.size()) == 0_i)
+            << compare(rgbImage, { buffer.data(), rgbImage.size() });
+
+        ut::expect(ut::throws([&] { qoipp::decode(qoiImage, { buffer.data(), rgbImage.size() }); }))
+            << "Small buffer should throw";
+    };
+
+    "4-channel image encode and decode with custom allocation"_test = [&] {
+        std::array<std::byte, 1 << 16> arena;
+
+        auto resource = std::pmr::monotonic_buffer_resource{
+            arena.data(), arena.size(), std::pmr::null_memory_resource()
+        };
+
+        const auto alloc   = std::pmr::polymorphic_allocator<std::byte>{ &resource };
+        const auto encoded = qoipp::encode(rawImage, desc, alloc);
+        ut::expect(std::ranges::equal(encoded, qoiImage)) << "pmr encode";
+        ut::expect(encoded.data() >= arena.data() && encoded.data() < arena.data() + arena.size());
+
+        const auto decoded = qoipp::decode(qoiImage, qoipp::UninitAllocator<>{});
+        ut::expect(decoded.m_desc == desc);
+        ut::expect(std::ranges::equal(decoded.m_data, rawImage)) << "uninit decode";
+
+        usize requested = 0;
+        auto  small     = [&](usize size) {
+            requested = size;
+            return std::span<std::byte>{ arena.data(), size - 1 };
+        };
+        ut::expect(ut::throws([&] { qoipp::decode(qoiImage, small); })) << "Small buffer should throw";
+        ut::expect(ut::that % requested == qoipp::decodedSize(desc));
+        ut::expect(ut::throws([&] { qoipp::encode(rawImage, desc, small); })) << "Small buffer should throw";
+        ut::expect(ut::that % requested == qoipp::maxEncodedSize(desc));
+    };
+
+    "4-channel image compile-time encode and decode"_test = [&] {
+        const auto encoded = qoipp::encode<qoipp::Channels::RGBA>(rawImage, desc.m_width, desc.m_height);
+        ut::expect(encoded == qoiImage) << compare(qoiImage, encoded);
+
+        const auto [decoded, actualDesc] = qoipp::decode<qoipp::Channels::RGBA>(qoiImage);
+        ut::expect(actualDesc == desc);
+        ut::expect(decoded == rawImage) << compare(rawImage, decoded);
+
+        const auto shrunk = qoipp::decode<qoipp::Channels::RGBA, qoipp::Channels::RGB>(qoiImage);
+        ut::expect(shrunk.m_data == qoipp::decode(qoiImage, qoipp::Channels::RGB).m_data);
+
+        ut::expect(ut::throws([&] { qoipp::decode<qoipp::Channels::RGB>(qoiImage); }))
+            << "Channel mismatch should throw";
+
+        using RawSpan = std::span<const Byte, qoipp::decodedSize(desc)>;
+
+        std::array<Byte, qoipp::maxEncodedSize(desc)> encodedArr{};
+        std::array<Byte, qoipp::decodedSize(desc)>    decodedArr{};
+
+        const auto written = qoipp::encode<desc>(RawSpan{ rawImage.data(), rawImage.size() }, encodedArr);
+        ut::expect(ut::that % written == qoiImage.size());
+        ut::expect(std::memcmp(encodedArr.data(), qoiImage.data(), qoiImage.size()) == 0_i);
+
+        ut::expect(qoipp::decode<desc>(qoiImage, decodedArr) == desc);
+        ut::expect(std::memcmp(decodedArr.data(), rawImage.data(), rawImage.size()) == 0_i);
+
+        constexpr auto swapped = qoipp::ImageDesc{
+            desc.m_height, desc.m_width, desc.m_channels, desc.m_colorspace
+        };
+        ut::expect(ut::throws([&] { qoipp::decode<swapped>(qoiImage, decodedArr); }))
+            << "Dimension mismatch should throw";
+    };
+
+    "4-channel image striped encode and decode"_test = [&] {
+        for (auto stripes : { 1u, 4u, 17u, 100u }) {
+            const auto encoded   = qoipp::encodeStriped(rawImage, desc, stripes);
+            const auto reference = qoiDecode({ .m_data = encoded, .m_desc = desc });
+            ut::expect(std::memcmp(reference.m_data.data(), rawImage.data(), rawImage.size()) == 0_i)
+                << "Striped image should decode as a single stream with the reference decoder";
+
+            const auto [decoded, actualDesc] = qoipp::decodeStriped(encoded);
+            ut::expect(actualDesc == desc);
+            ut::expect(ut::that % decoded.size() == rawImage.size());
+            ut::expect(std::memcmp(decoded.data(), rawImage.data(), rawImage.size()) == 0_i)
+                << compare(rawImage, decoded);
+
+            if (stripes > 1) {
+                // the last byte of the offset of the last stripe
+                auto shifted  = encoded;
+                auto lastByte = shifted.end() - 13;
+                *lastByte     = Byte(std::to_integer<u8>(*lastByte) + 1);
+                ut::expect(ut::throws([&] { qoipp::decodeStriped(shifted); }))
+                    << "Stripe offsets that don't match the stripes should throw";
+            }
+        }
+
+        // 10 rows in 4 stripes is 3, 3, 3 and 1 rows, the last stripe is shorter than the others
+        const auto shortDesc = qoipp::ImageDesc{ desc.m_width, 10, desc.m_channels, desc.m_colorspace };
+        const auto shortRaw  = ByteSpan{ rawImage }.first(qoipp::decodedSize(shortDesc));
+        const auto uneven    = qoipp::encodeStriped(shortRaw, shortDesc, 4);
+        const auto [unevenDecoded, unevenDesc] = qoipp::decodeStriped(uneven);
+        ut::expect(unevenDesc == shortDesc);
+        ut::expect(std::memcmp(unevenDecoded.data(), shortRaw.data(), shortRaw.size()) == 0_i)
+            << "A height that isn't a multiple of the stripe count should round trip";
+
+        const auto single = qoipp::encodeStriped(rawImage, desc, 1);
+        ut::expect(std::memcmp(single.data(), qoiImage.data(), qoiImage.size()) == 0_i)
+            << "A single stripe should be encoded like `encode`";
+
+        const auto [decoded, actualDesc] = qoipp::decodeStriped(qoiImage);
+        ut::expect(std::memcmp(decoded.data(), rawImage.data(), rawImage.size()) == 0_i)
+            << "Image without stripe table should be decoded as a single stream";
+    };
+
+    "4-channel image batch encode and decode"_test = [&] {
+        qoipp::ThreadPool pool{ 3 };
+        ut::expect(ut::that % pool.size() == usize{ 3 });
+
+        const auto jobs    = std::vector<qoipp::EncodeJob>(10, { rawImage, desc });
+        const auto encoded = qoipp::encodeBatch(jobs, pool);
+        ut::expect(ut::that % encoded.size() == jobs.size());
+        for (const auto& image : encoded) {
+            ut::expect(ut::that % image.size() == qoiImage.size());
+            ut::expect(std::memcmp(image.data(), qoiImage.data(), qoiImage.size()) == 0_i)
+                << compare(qoiImage, image);
+        }
+
+        const auto spans   = std::vector<ByteSpan>(10, qoiImage);
+        const auto decoded = qoipp::decodeBatch(spans, pool);
+        ut::expect(ut::that % decoded.size() == spans.size());
+        for (const auto& [image, actualDesc] : decoded) {
+            ut::expect(actualDesc == desc);
+            ut::expect(std::memcmp(image.data(), rawImage.data(), rawImage.size()) == 0_i)
+                << compare(rawImage, image);
+        }
+
+        auto badJobs      = jobs;
+        badJobs[7].m_data = ByteSpan{ rawImage }.first(10);
+        ut::expect(ut::throws([&] { qoipp::encodeBatch(badJobs, pool); })) << "Invalid job should throw";
+    };
+
+    "4-channel image incremental encode"_test = [&] {
+        ByteVec encoded;
+        auto    sink = [&](ByteSpan bytes) { encoded.insert(encoded.end(), bytes.begin(), bytes.end()); };
+
+        qoipp::Encoder encoder{ desc, sink };
+
+        const auto rowSize = desc.m_width * static_cast<usize>(desc.m_channels);
+        for (auto row : rv::iota(0u, desc.m_height)) {
+            const auto rowData = ByteSpan{ rawImage }.subspan(row * rowSize, rowSize);
+            ut::expect(ut::nothrow([&] { encoder.push(rowData); }));
+        }
+
+        ut::expect(ut::throws([&] { encoder.push(ByteSpan{ rawImage }.first(rowSize)); }))
+            << "Pushing more pixels than the image has should throw";
+
+        ut::expect(ut::nothrow([&] { encoder.finish(); }));
+        ut::expect(ut::throws([&] { encoder.finish(); })) << "Finishing twice should throw";
+
+        ut::expect(ut::that % encoded.size() == qoiImage.size());
+        ut::expect(std::memcmp(encoded.data(), qoiImage.data(), qoiImage.size()) == 0_i)
+            << compare(qoiImage, encoded);
+
+        // chunks of random sizes so that runs are left pending across pushes and the buffer grows between
+        const auto size = static_cast<usize>(desc.m_channels);
+        for (auto seed : rv::iota(0u, 8u)) {
+            auto random = std::mt19937{ seed };
+
+            ByteVec        chunked;
+            qoipp::Encoder chunkEncoder{ desc, [&](ByteSpan bytes) {
+                chunked.insert(chunked.end(), bytes.begin(), bytes.end());
+            } };
+
+            const auto pixels = ByteSpan{ rawImage };
+            for (usize pushed = 0; pushed < pixels.size();) {
+                const auto count = std::uniform_int_distribution<usize>{ 1, 3 * desc.m_width }(random);
+                const auto bytes = std::min(count * size, pixels.size() - pushed);
+                chunkEncoder.push(pixels.subspan(pushed, bytes));
+                pushed += bytes;
+            }
+            chunkEncoder.finish();
+
+            ut::expect(chunked == qoipp::encode(rawImage, desc)) << compare(qoiImage, chunked);
+        }
+
+        // a run left pending by a push followed by pixels that all need a full op
+        const auto tail = qoipp::ImageDesc{ 10, 1, desc.m_channels, desc.m_colorspace };
+        ByteVec    tailImage(qoipp::decodedSize(tail));
+        for (auto i : rv::iota(usize{ 0 }, tailImage.size())) {
+            tailImage[i] = i < 2 * size ? Byte{ 7 } : Byte(static_cast<u8>(i * 67 + 13));
+        }
+
+        ByteVec        tailEncoded;
+        qoipp::Encoder tailEncoder{ tail, [&](ByteSpan bytes) {
+            tailEncoded.insert(tailEncoded.end(), bytes.begin(), bytes.end());
+        } };
+        tailEncoder.push(ByteSpan{ tailImage }.first(2 * size));
+        tailEncoder.push(ByteSpan{ tailImage }.subspan(2 * size));
+        tailEncoder.finish();
+        ut::expect(tailEncoded == qoipp::encode(tailImage, tail));
+    };
+
+    "4-channel image incremental decode"_test = [&] {
+        ByteVec decoded;
+        usize   rows = 0;
+        auto    sink = [&](usize row, ByteSpan bytes) {
+            ut::expect(ut::that % row == rows++);
+            decoded.insert(decoded.end(), bytes.begin(), bytes.end());
+        };
+
+        qoipp::Decoder decoder{ sink };
+
+        // odd chunk size so that both the header and the ops are split across pushes
+        for (const auto& chunk : rv::chunk(qoiImage, 3)) {
+            ut::expect(!decoder.done());
+            ut::expect(ut::nothrow([&] { decoder.push(ByteVec{ chunk.begin(), chunk.end() }); }));
+        }
+
+        ut::expect(decoder.done());
+        ut::expect(decoder.desc() == desc);
+        ut::expect(ut::that % rows == desc.m_height);
+        ut::expect(ut::that % decoded.size() == rawImage.size());
+        ut::expect(std::memcmp(decoded.data(), rawImage.data(), rawImage.size()) == 0_i)
+            << compare(rawImage, decoded);
+
+        qoipp::Decoder invalid{ sink };
+        ut::expect(ut::throws([&] { invalid.push(rawImage); })) << "Invalid header should throw";
+    };
+
+    "4-channel image sequence encode and decode"_test = [&] {
+        const auto changed = changeRegion(rawImage, desc, { 5, 3, 7, 4 });
+        const auto toVec   = [](ByteSpan bytes) { return ByteVec{ bytes.begin(), bytes.end() }; };
+
+        auto encoder = qoipp::SequenceEncoder{};
+        auto decoder = qoipp::SequenceDecoder{};
+
+        const auto first  = toVec(encoder.encode(rawImage, desc));
+        const auto second = toVec(encoder.encode(changed, desc));
+        const auto third  = toVec(encoder.encode(changed, desc));
+
+        ut::expect(first == qoiImage) << "The first frame should be a plain QOI image";
+        ut::expect(!qoipp::SequenceDecoder::isDeltaFrame(first));
+        ut::expect(qoipp::SequenceDecoder::isDeltaFrame(second));
+        ut::expect(qoipp::SequenceDecoder::isDeltaFrame(third));
+        ut::expect(ut::that % second.size() < first.size());
+        ut::expect(ut::that % third.size() < second.size()) << "An unchanged frame should be all runs";
+
+        const auto* buffer = decoder.decode(first).m_data.data();
+        ut::expect(decoder.decode(first).m_data == rawImage);
+        ut::expect(decoder.decode(second).m_data == changed);
+
+        const auto& frame = decoder.decode(third);
+        ut::expect(frame.m_desc == desc);
+        ut::expect(frame.m_data == changed) << compare(changed, frame.m_data);
+        ut::expect(frame.m_data.data() == buffer) << "Frames should be decoded into the same buffer";
+
+        auto       rgb      = qoipp::SequenceDecoder{ true };
+        const auto rgbImage = qoipp::decode(qoipp::encode(changed, desc), true);
+        rgb.decode(first);
+        ut::expect(rgb.decode(second).m_data == rgbImage.m_data);
+
+        ut::expect(toVec(encoder.encode(rawImage, desc, true)) == qoiImage) << "Forced key frame";
+        encoder.reset();
+        ut::expect(!qoipp::SequenceDecoder::isDeltaFrame(encoder.encode(changed, desc)));
+
+        ut::expect(ut::throws([&] { encoder.encode(ByteSpan{ rawImage }.first(4), desc); }))
+            << "Data not matching the description should throw";
+
+        auto fresh = qoipp::SequenceDecoder{};
+        ut::expect(ut::throws([&] { fresh.decode(second); }))
+            << "Delta frame without a previous frame should throw";
+
+        const auto otherDesc = qoipp::ImageDesc{ desc.m_width, 3, desc.m_channels, desc.m_colorspace };
+        const auto otherSize = qoipp::decodedSize(otherDesc);
+        fresh.decode(qoipp::encode(ByteSpan{ rawImage }.first(otherSize), otherDesc));
+        ut::expect(ut::throws([&] { fresh.decode(second); }))
+            << "Delta frame after a frame of another size should throw";
+    };
+
     "4-channel image encode to and decode from file"_test = [&] {
         auto qoifile = mktemp();
 
         ut::expect(ut::nothrow([&] { qoipp::encodeToFile(qoifile, rawImage, desc, false); }));
         ut::expect(ut::throws([&] { qoipp::encodeToFile(qoifile, rawImage, desc, false); }));    // file exist
+        ut::expect(ut::nothrow([&] { qoipp::encodeToFile(qoifile, rawImage, desc, true); }));     // overwrite
+        ut::expect(ut::that % fs::file_size(qoifile) == qoiImage.size()) << "File should be shrunk to fit";
 
         qoipp::Image decoded;
         ut::expect(ut::nothrow([&] { decoded = qoipp::decodeFromFile(qoifile); }));
+        ut::expect(qoipp::tryDecodeFromFile(qoifile).m_value.m_data == decoded.m_data);
         ut::expect(decoded.m_desc == desc);
         ut::expect(ut::that % decoded.m_data.size() == rawImage.size());
         ut::expect(std::memcmp(decoded.m_data.data(), rawImage.data(), rawImage.size()) == 0_i)
@@ -355,9 +2408,27 @@ ut::suite fourChannelImage = [] {
         ut::expect(fs::is_empty(qoifile));
 
         ut::expect(ut::throws([&] { qoipp::decodeFromFile(qoifile); })) << "Empty file should throw";
+        ut::expect(qoipp::tryDecodeFromFile(qoifile).m_error == qoipp::Error::Truncated);
         fs::remove(qoifile);
         ut::expect(ut::throws([&] { qoipp::decodeFromFile(qoifile); })) << "Non-existent file should throw";
+        ut::expect(qoipp::tryDecodeFromFile(qoifile).m_error == qoipp::Error::File);
         ut::expect(!fs::exists(qoifile)) << "File should not be created if it previously not exist";
+        ut::expect(ut::throws([&] { qoipp::decodeFromFile(fs::temp_directory_path()); }))
+            << "Directory should throw";
+
+        // the image is written next to the path then renamed into place, nothing else is left behind
+        const auto dir = mktemp();
+        fs::create_directory(dir);
+        const auto placed = dir / "image.qoi";
+        qoipp::encodeToFile(placed, rawImage, desc);
+        qoipp::encodeToFile(placed, rawImage, desc, true);
+        const auto partial = ByteSpan{ rawImage }.first(3);
+        ut::expect(ut::throws([&] { qoipp::encodeToFile(placed, partial, desc, true); }));
+        ut::expect(ut::that % std::distance(fs::directory_iterator{ dir }, {}) == 1)
+            << "Temporary files should not be left behind";
+        ut::expect(qoipp::decodeFromFile(placed).m_data == qoipp::decode(qoiImage).m_data)
+            << "A failed overwrite should leave the file intact";
+        fs::remove_all(dir);
     };
 
     "4-channel image header read"_test = [&] {
@@ -388,6 +2459,189 @@ ut::suite fourChannelImage = [] {
 
         fs::remove(qoifile);
     };
+
+    "4-channel image header read from many files"_test = [&] {
+        const auto write = [](const fs::path& path, ByteSpan data) {
+            std::ofstream ofs{ path, std::ios::binary };
+            ofs.write(reinterpret_cast<const char*>(data.data()), std::ssize(data));
+        };
+
+        // enough files for the batch to be split between threads
+        std::vector<fs::path> paths;
+        for (usize i = 0; i < 200; ++i) {
+            write(paths.emplace_back(mktemp()), qoiImage);
+        }
+
+        const auto valid = paths.size();
+        write(paths.emplace_back(mktemp()), ByteSpan{ qoiImage }.first(10));    // truncated
+        write(paths.emplace_back(mktemp()), rawImage);                          // not a QOI image
+        paths.push_back(mktemp());                                              // missing
+        paths.push_back(fs::temp_directory_path());                             // a directory
+
+        std::vector<qoipp::FileHeader> headers;
+        ut::expect(ut::nothrow([&] { headers = qoipp::readHeaders(paths); }));
+        ut::expect(ut::that % headers.size() == paths.size());
+
+        for (auto i : rv::iota(0u, valid)) {
+            ut::expect(headers[i].m_error == qoipp::HeaderError::None);
+            ut::expect(headers[i].m_desc.has_value() and *headers[i].m_desc == desc);
+        }
+
+        ut::expect(headers[valid + 0].m_error == qoipp::HeaderError::Truncated);
+        ut::expect(headers[valid + 1].m_error == qoipp::HeaderError::Invalid);
+        ut::expect(headers[valid + 2].m_error == qoipp::HeaderError::Open);
+        ut::expect(headers[valid + 3].m_error == qoipp::HeaderError::Read);
+        for (auto i : rv::iota(valid, paths.size())) {
+            ut::expect(!headers[i].m_desc.has_value());
+        }
+
+        for (auto i : rv::iota(0u, paths.size() - 1)) {
+            fs::remove(paths[i]);
+        }
+    };
+
+    "4-channel image bulk file conversion"_test = [&] {
+        std::vector<qoipp::FileJob> jobs;
+        for (auto i : rv::iota(0, 8)) {
+            auto& job = jobs.emplace_back(mktemp(), mktemp());
+            if (i != 5) {
+                std::ofstream ofs{ job.m_input, std::ios::binary };
+                ofs.write(reinterpret_cast<const char*>(rawImage.data()), std::ssize(rawImage));
+            }
+        }
+        jobs[6].m_output = mktemp() / "missing" / "output.qoi";    // directory does not exist
+
+        const auto transform = [&](const qoipp::FileJob&, qoipp::ByteSpan input) {
+            return qoipp::encode(input, desc);
+        };
+
+        // small limits so that most of the jobs wait for the ones before them
+        const auto options = qoipp::FilePipelineOptions{
+            .m_threads     = 2,
+            .m_queueDepth  = 2,
+            .m_maxInFlight = 1,
+        };
+
+        std::vector<std::exception_ptr> errors;
+        ut::expect(ut::nothrow([&] { errors = qoipp::convertFiles(jobs, transform, options); }));
+        ut::expect(ut::that % errors.size() == jobs.size());
+
+        for (auto i : rv::iota(0u, jobs.size())) {
+            const auto& job = jobs[i];
+            if (i == 5 || i == 6) {
+                ut::expect(errors[i] != nullptr) << "Job" << i << "should fail";
+            } else {
+                ut::expect(errors[i] == nullptr) << "Job" << i << "should succeed";
+
+                const auto encoded = qoipp::decodeFromFile(job.m_output);
+                ut::expect(encoded.m_desc == desc);
+                ut::expect(std::memcmp(encoded.m_data.data(), rawImage.data(), rawImage.size()) == 0_i);
+                ut::expect(ut::that % fs::file_size(job.m_output) == qoiImage.size());
+            }
+            fs::remove(job.m_input);
+            fs::remove(job.m_output);
+        }
+
+        const auto invalid = qoipp::FilePipelineOptions{ .m_queueDepth = 0 };
+        ut::expect(ut::throws([&] { qoipp::convertFiles(jobs, transform, invalid); }));
+    };
+};
+
+ut::suite testingOnLongRuns = [] {
+    // runs of lengths around the run limit and the vector widths with different values for each channel
+    const auto makeImage = [](qoipp::Channels channels) {
+        const auto chan = static_cast<usize>(channels);
+
+        Image image{
+            .m_data = {},
+            .m_desc = {
+                .m_width      = 257,
+                .m_height     = 31,
+                .m_channels   = channels,
+                .m_colorspace = qoipp::Colorspace::sRGB,
+            },
+        };
+
+        const auto pixelCount = static_cast<usize>(image.m_desc.m_width * image.m_desc.m_height);
+
+        usize length = 1;
+        u8    value  = 0;
+        while (image.m_data.size() < pixelCount * chan) {
+            const auto count = std::min(length, pixelCount - image.m_data.size() / chan);
+            for (usize i = 0; i < count * chan; ++i) {
+                image.m_data.push_back(Byte(value + i % chan * 37));
+            }
+            length = length * 7 % 191 + 1;
+            value += 11;
+        }
+
+        return image;
+    };
+
+    for (auto channels : { qoipp::Channels::RGB, qoipp::Channels::RGBA }) {
+        "long runs encode compared to reference"_test = [&] {
+            const auto image      = makeImage(channels);
+            const auto qoiImage   = qoiEncode(image);
+            const auto qoippImage = qoipp::encode(image.m_data, image.m_desc);
+
+            ut::expect(ut::that % qoiImage.m_data.size() == qoippImage.size());
+            ut::expect(std::memcmp(qoiImage.m_data.data(), qoippImage.data(), qoippImage.size()) == 0_i)
+                << compare(qoiImage.m_data, qoippImage);
+
+            ByteVec encoded;
+            auto    sink = [&](ByteSpan bytes) { encoded.insert(encoded.end(), bytes.begin(), bytes.end()); };
+
+            // pushing in chunks that don't line up with the runs
+            qoipp::Encoder encoder{ image.m_desc, sink };
+            for (const auto& chunk : rv::chunk(image.m_data, static_cast<usize>(channels) * 45)) {
+                encoder.push(ByteVec{ chunk.begin(), chunk.end() });
+            }
+            encoder.finish();
+
+            ut::expect(ut::that % qoiImage.m_data.size() == encoded.size());
+            ut::expect(std::memcmp(qoiImage.m_data.data(), encoded.data(), encoded.size()) == 0_i)
+                << compare(qoiImage.m_data, encoded);
+        };
+
+        "long runs encode and decode with every kernel"_test = [&] {
+            const auto image    = makeImage(channels);
+            const auto qoiImage = qoiEncode(image);
+            const auto previous = qoipp::activeKernel();
+
+            // the conversion to the other number of channels is checked against the baseline kernel
+            const auto other = channels == qoipp::Channels::RGB ? qoipp::Channels::RGBA
+                                                                 : qoipp::Channels::RGB;
+            qoipp::setKernel(qoipp::Kernel::Baseline);
+            const auto converted = qoipp::decode(qoiImage.m_data, other);
+
+            for (auto kernel : { qoipp::Kernel::Baseline,
+                                 qoipp::Kernel::SSE42,
+                                 qoipp::Kernel::AVX2,
+                                 qoipp::Kernel::AVX512 }) {
+                if (!qoipp::isKernelSupported(kernel)) {
+                    ut::expect(ut::throws([&] { qoipp::setKernel(kernel); }))
+                        << "Unsupported kernel should throw";
+                    continue;
+                }
+
+                qoipp::setKernel(kernel);
+                ut::expect(qoipp::activeKernel() == kernel);
+
+                const auto encoded = qoipp::encode(image.m_data, image.m_desc);
+                ut::expect(encoded == qoiImage.m_data)
+                    << qoipp::kernelName(kernel) << ": " << compare(qoiImage.m_data, encoded);
+
+                const auto decoded = qoipp::decode(encoded);
+                ut::expect(decoded.m_data == image.m_data)
+                    << qoipp::kernelName(kernel) << ": " << compare(image.m_data, decoded.m_data);
+
+                ut::expect(qoipp::decode(encoded, other).m_data == converted.m_data)
+                    << qoipp::kernelName(kernel);
+            }
+
+            qoipp::setKernel(previous);
+        };
+    }
 };
 
 ut::suite testingOnRealImage = [] {